@@ -174,7 +174,8 @@ images at once."""
 Create a symmetric FloatImage containing all of the
 distances between the images in the list passed in. This is useful
 because it allows you to find the distance between any two pairs
-of images regardless of the order of the pairs.
+of images regardless of the order of the pairs. For large lists of
+images, unique_distances_ needs less than half of the memory.
 
 *normalize*
   When true, the features are normalized before performing the distance
@@ -187,20 +188,29 @@ of images regardless of the order of the pairs.
       progress.kill()
       return m
 
-   def unique_distances(self, images, normalize=True):
-      """**unique_distances** (ImageList *images*, Bool *normalize* = ``True``)
+   def unique_distances(self, images, normalize=True, single_precision=False):
+      """**unique_distances** (ImageList *images*, Bool *normalize* = ``True``, Bool *single_precision* = ``False``)
 
-Return a list of the unique pairs of images in the passed in list
-and the distances between them. The return list is a list of tuples
-of (distance, imagea, imageb) so that it easy to sort.
+Return the distances between all unique pairs of images in the passed in
+list. The distances are packed row by row in the order of the pairs
+(0, 1), (0, 2), ..., (0, n-1), (1, 2), ..., (n-2, n-1), so that the
+distance between the images *i* < *j* is at position
+*i* * (2 *n* - *i* - 1) / 2 + *j* - *i* - 1. Each pair is computed only
+once, in parallel when OpenMP is available.
 
 *normalize*
   When true, the features are normalized before performing the distance
-  calculations."""
+  calculations.
+
+*single_precision*
+  When false, the distances are returned as a FloatImage with a single
+  row. When true, they are returned as an ``array.array('f')``, which
+  needs half the memory."""
       self.generate_features_on_glyphs(images)
       l = len(images)
       progress = util.ProgressFactory("Generating unique distances...", l)
-      dists = self._unique_distances(images, progress.step, normalize)
+      dists = self._unique_distances(images, progress.step, normalize,
+                                     single_precision)
       #dists = self._unique_distances(images)
       progress.kill()
       return dists
@@ -345,6 +355,12 @@ Load the kNN settings from an XML file.  See save_settings_."""
 Saves the classifier-specific settings *and* data in an optimized and
 classifer-specific format.  
 
+The feature vectors are stored such that unserialize_ maps the file into
+memory and uses them in place. Loading is therefore fast independent of
+the size of the file, and several processes loading the same file share
+its memory. An existing file is replaced only after the new one has
+been written completely, so that classifiers using it are not affected.
+
 .. note:: 
    It is good practice to retain the XML
    file, since it is portable across platforms and to future versions of
@@ -678,6 +694,12 @@ Creates a new kNN classifier instance.
 *normalize*
     Normalize the feature vectors: x' = (x - mean_x)/stdev_x
 
+The attribute *feature_precision* selects the precision in which the
+classifier scans the feature vectors when it cannot use its search
+index: ``DOUBLE_FEATURES`` (the default), ``FLOAT_FEATURES``,
+``INT16_FEATURES`` or ``INT8_FEATURES`` (from ``gamera.knncore``). The
+reduced precisions need less memory bandwidth; the candidates they find
+are compared in double precision, so the results do not change.
       """
       self.features = features
       self.feature_functions = core.ImageBase.get_feature_functions(features)
@@ -689,6 +711,62 @@ Creates a new kNN classifier instance.
       _kNNBase.__del__(self)
       classify.NonInteractiveClassifier.__del__(self)
 
+   def merge_glyphs(self, glyphs):
+      """**merge_glyphs** (ImageList *glyphs*)
+
+Adds the given glyphs to the current set of training data.
+
+The glyphs are added to the classifier in place. When the feature
+vectors are normalized, the normalization is updated before the next
+classification."""
+      glyphs = list(glyphs)
+      self.generate_features_on_glyphs(glyphs)
+      # the database only grows once the glyphs have been accepted
+      self._append_images(glyphs)
+      self.database.extend(glyphs)
+
+   def add_to_database(self, glyphs):
+      """**add_to_database** (ImageList *glyphs*)
+
+Adds the given glyph (or list of glyphs) to the classifier training
+data in place, like merge_glyphs_.  Only manually classified glyphs
+are added, and no duplicates."""
+      glyphs = util.make_sequence(glyphs)
+      in_database = set([id(glyph) for glyph in self.database])
+      new_glyphs = []
+      for glyph in glyphs:
+         if (glyph.classification_state == core.MANUAL and
+             not id(glyph) in in_database):
+            in_database.add(id(glyph))
+            new_glyphs.append(glyph)
+      if len(new_glyphs):
+         self.merge_glyphs(new_glyphs)
+
+   def remove_from_database(self, glyphs):
+      """**remove_from_database** (ImageList *glyphs*)
+
+Removes the given glyphs from the classifier training data in place.
+Ignores silently if a given glyph is not in the training data.  At
+least one glyph must remain."""
+      glyphs = util.make_sequence(glyphs)
+      positions = {}
+      for i in range(len(self.database)):
+         positions[id(self.database[i])] = i
+      indexes = []
+      for glyph in glyphs:
+         if id(glyph) in positions:
+            indexes.append(positions.pop(id(glyph)))
+      if not len(indexes):
+         return
+      # the feature vectors of an unserialized classifier precede the
+      # glyphs of its database
+      offset = self.num_feature_vectors - len(self.database)
+      self._remove_images([offset + i for i in indexes])
+      indexes.sort()
+      indexes.reverse()
+      for i in indexes:
+         del self.database[i]
+
    def change_feature_set(self, f):
       """**change_feature_set** (*features*)
 
@@ -707,6 +785,35 @@ Changes the set of features used in the classifier to the given list of feature
          self.generate_features_on_glyphs(self.database)
          self.instantiate_from_images(self.database, self.normalize)
 
+   def classify_batch(self, glyphs, num_threads=0):
+      """**classify_batch** (ImageList *glyphs*, int *num_threads* = 0)
+
+Classifies a list of glyphs at once without setting their
+classification. This is much faster than classifying them one by
+one, because the glyphs are classified in parallel without holding
+the Python interpreter lock.
+
+The return value is a list with one tuple ``(id_name, confidencemap)``
+per glyph, as for classify_with_images_.
+
+*num_threads*
+  The number of threads to use. When 0, all available processors are
+  used. Without OpenMP support, the glyphs are classified sequentially.
+
+The classifier must not be changed by other Python threads while
+this method runs."""
+      self.generate_features_on_glyphs(glyphs)
+      return self._classify_batch(glyphs, num_threads)
+
+   def classify_features_batch(self, feature_vectors, num_threads=0):
+      """**classify_features_batch** (list *feature_vectors*, int *num_threads* = 0)
+
+Like classify_batch_, but classifies feature vectors instead of
+glyphs. Each feature vector must be an ``array.array('d')`` (or another
+object providing a buffer of doubles) with the features of the
+classifier in the order of its feature functions."""
+      return self._classify_batch(feature_vectors, num_threads)
+
    def set_normalization_state(self, flag):
       """**set_normalization_state** (bool *flag*)
 Set whether normalization is used or not for classification.
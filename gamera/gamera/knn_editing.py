@@ -16,21 +16,11 @@
 # along with this program; if not, write to the Free Software
 # Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 
-from random import randint
+from random import shuffle
 from gamera.args import Args, Int, Check
 from gamera.knn import kNNInteractive
 from gamera.util import ProgressFactory
 
-def _randomSetElement(set):
-    """Retrieve a random element from the given set
-
-    *set*
-      The set from which to select a random element"""
-    randPos = randint(0, len(set) - 1);
-    for pos, elem in enumerate(set):
-        if pos == randPos:
-            return elem
-
 def _copyClassifier(original, k = 0):
     """Copy a given kNNClassifer by constructing a new one with identical
 parameters.
@@ -48,15 +38,6 @@ parameters.
                 original._perform_splits,
                 k)
 
-def _getMainId(classificationResult):
-    """Classification results returned from a kNN Classifier are in a list
-containing '(confidence, className)' tuples. So to determine the 'main class',
-the classname with the highest confidence has to be returned.
-"""
-    # classificationResult is a tuple of the form
-    #   ([idname1, idname2, ...], confidences_for_idname1)
-    return classificationResult[0][0][1]
-
 class AlgoRegistry(object):
     """Registry containing a list of all available editing algorithms. Besides
 the callable itself, the registry also stores its docstring, a displayname and
@@ -159,24 +140,18 @@ Reference: D. Wilson: 'Asymptotic Properties of NN Rules Using Edited Data'.
                  rareThreshold = 3):
 
         editedClassifier = _copyClassifier(classifier, k)
-        toBeRemoved = set()
-        progress = ProgressFactory("Generating edited MNN classifier...",
-                                      len(classifier.get_glyphs()))
+        glyphs = list(classifier.get_glyphs())
+        progress = ProgressFactory("Generating edited MNN classifier...", 1)
 
         # classify each glyph with its leave-one-out classifier
-        for i, glyph in enumerate(classifier.get_glyphs()):
-            editedClassifier.get_glyphs().remove(glyph)
-            detectedClass = _getMainId(\
-                                editedClassifier.guess_glyph_automatic(glyph))
-            # check if recognized class complies with the true class
-            if glyph.get_main_id() != detectedClass:
-                toBeRemoved.add(glyph)
-            editedClassifier.get_glyphs().add(glyph)
-            progress.step()
-
-        rareClasses = self._getRareClasses(classifier.get_glyphs(),
-                                           protectRare, rareThreshold)
-        
+        toBeRemoved = set()
+        if len(glyphs) > 1:
+            for i in editedClassifier._edit_mnn(glyphs):
+                toBeRemoved.add(glyphs[i])
+        progress.step()
+
+        rareClasses = self._getRareClasses(glyphs, protectRare, rareThreshold)
+
         # remove 'bad' glyphs, if they are not in a rare class
         for glyph in toBeRemoved:
             if glyph.get_main_id() in rareClasses:
@@ -240,39 +215,23 @@ Reference: P.E. Hart: 'The Condensed Nearest Neighbor rule'. *IEEE Transactions
         if k == 0:
             k = classifier.num_k
         
-        progress = ProgressFactory("Generating edited CNN classifier...",
-                                      len(classifier.get_glyphs()))
+        progress = ProgressFactory("Generating edited CNN classifier...", 1)
 
-        # initialize Store (a) with a single element
+        # the Store (a) is initialized with the first glyph, the
+        # Grabbag (b) holds all others. Each glyph in b is classified with
+        # a as the classifier, and misclassified glyphs are moved to a,
+        # until no more elements are added to a
+        glyphs = list(classifier.get_glyphs())
         if randomize:
-            elem = _randomSetElement(classifier.get_glyphs())
-        else:
-            elem = classifier.get_glyphs().__iter__().next()
-        
-        aGlyphs = [elem]
-        a = kNNInteractive(aGlyphs, classifier.features, 
+            shuffle(glyphs)
+        a = kNNInteractive([], classifier.features,
                            classifier._perform_splits, k)
+        a.generate_features_on_glyphs(glyphs)
+        store = [0]
+        if len(glyphs) > 1:
+            store = a._edit_cnn(glyphs)
+        a.set_glyphs([glyphs[i] for i in store])
         progress.step()
-        
-        # initialize Grabbag (b) with all other
-        b = classifier.get_glyphs().copy()
-        b.remove(aGlyphs[0]);
-
-        # Classify each glyph in b with a as the classifier
-        # If glyph is misclassified, add it to a, repeat until no elements are 
-        # added to a
-        changed = True
-        while changed == True:
-            changed = False
-            # copy needed because iteration through dict is not possible while 
-            # deleting items from it
-            copyOfB = b.copy()
-            for glyph in copyOfB:
-                if glyph.get_main_id() != _getMainId(a.guess_glyph_automatic(glyph)):
-                    b.remove(glyph)
-                    a.get_glyphs().add(glyph)
-                    progress.step()
-                    changed = True
         progress.kill()
         a.num_k = 1
         return a
@@ -297,6 +256,6 @@ For documentation of the parameters see the independent algorithms"""
     def __call__(self, classifier, k = 0, protectRare = True,
                  rareThreshold = 3, randomize = True):
         return edit_cnn(edit_mnn(classifier, k, protectRare, rareThreshold),
-                   randomize)
+                        k, randomize)
 
 edit_mnn_cnn = EditMnnCnn()
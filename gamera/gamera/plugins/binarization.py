@@ -27,6 +27,7 @@
 from gamera.plugin import *
 from gamera.args import NoneDefault
 import _binarization
+from gamera.util import has_openmp
 
 class image_mean(PluginFunction):
     """
@@ -267,6 +268,68 @@ class gatos_threshold(PluginFunction):
     __call__ = staticmethod(__call__)
 
 
+class gatos_binarization(PluginFunction):
+    """
+    Binarizes an image with the complete method of Gatos et al.:
+    wiener_filter_, sauvola_threshold_ of the filtered image,
+    gatos_background_ and gatos_threshold_. See:
+
+    Gatos, Basilios, Ioannis Pratikakis, and Stavros
+    J. Perantonis. 2004. An adaptive binarization technique for low
+    quality historical documents. *Lecture Notes in Computer
+    Science* 3163: 102-113.
+
+    The result is the same as calling these functions one after the
+    other, but each step processes horizontal bands of the image in
+    parallel when Gamera has been compiled with OpenMP.
+
+    *wiener_region_size*, *noise_variance*
+      Parameters of wiener_filter_.
+
+    *region_size*
+      Region size of sauvola_threshold_ and gatos_background_.
+
+    *sensitivity*, *dynamic_range*, *lower_bound*, *upper_bound*
+      Parameters of sauvola_threshold_.
+
+    *q*, *p1*, *p2*
+      Parameters of gatos_threshold_.
+
+    *num_threads*
+      Number of threads; when zero, the OpenMP default is used.
+    """
+    return_type = ImageType([ONEBIT], "output")
+    self_type = ImageType([GREYSCALE])
+    args = Args([Int("wiener region size", default=5),
+                 Real("noise variance", default=-1.0),
+                 Int("region size", default=15),
+                 Real("sensitivity", default=0.5),
+                 Int("dynamic range", range=(1, 255), default=128),
+                 Int("lower bound", range=(0,255), default=20),
+                 Int("upper bound", range=(0,255), default=150),
+                 Real("q", default=0.6),
+                 Real("p1", default=0.5),
+                 Real("p2", default=0.8),
+                 Int("num_threads", default=0)])
+    def __call__(self, wiener_region_size=5, noise_variance=-1,
+                 region_size=15, sensitivity=0.5, dynamic_range=128,
+                 lower_bound=20, upper_bound=150,
+                 q=0.6, p1=0.5, p2=0.8, num_threads=0):
+        return _binarization.gatos_binarization(self,
+                                                wiener_region_size,
+                                                noise_variance,
+                                                region_size,
+                                                sensitivity,
+                                                dynamic_range,
+                                                lower_bound,
+                                                upper_bound,
+                                                q,
+                                                p1,
+                                                p2,
+                                                num_threads)
+    __call__ = staticmethod(__call__)
+
+
 class white_rohrer_threshold(PluginFunction):
     """
     Creates a binary image using White and Rohrer's dynamic thresholding
@@ -425,11 +488,15 @@ class BinarizationGenerator(PluginModule):
                  sauvola_threshold,
                  gatos_background,
                  gatos_threshold,
+                 gatos_binarization,
                  white_rohrer_threshold,
                  shading_subtraction,
                  brink_threshold]
     author = "John Ashley Burgoyne and Ichiro Fujinaga"
     url = "http://gamera.sourceforge.net/"
+    if has_openmp:
+        extra_compile_args = ["-fopenmp"]
+        extra_link_args = ["-fopenmp"]
 
 module = BinarizationGenerator()
 
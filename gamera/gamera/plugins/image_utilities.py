@@ -23,7 +23,7 @@ any other category, like image copying or computing histograms."""
 
 from gamera.plugin import *
 from gamera.gui import has_gui
-from gamera.util import warn_deprecated
+from gamera.util import warn_deprecated, has_openmp
 from gamera.args import NoneDefault
 import sys
 import _image_utilities
@@ -410,6 +410,9 @@ class UtilModule(PluginModule):
                  min_max_location, min_max_location_nomask]
     author = "Michael Droettboom and Karl MacMillan"
     url = "http://gamera.sourceforge.net/"
+    if has_openmp:
+        extra_compile_args = ["-fopenmp"]
+        extra_link_args = ["-fopenmp"]
 module = UtilModule()
 
 union_images = union_images()
@@ -56,9 +56,10 @@ class dilate(PluginFunction):
 class erode_dilate(PluginFunction):
   """
   Morphologically erodes or dilates the image with a rectangular or
-  ocagonal structuring element. For onebit images, this is simply a
-  wrapper for erode_with_structure_ or dilate_with_structure_ with
-  special cases for the structuring element.
+  ocagonal structuring element. For onebit images, the result is the
+  same as from erode_with_structure_ or dilate_with_structure_ with
+  the corresponding structuring element, but it is computed 64 pixels
+  at a time on a bit-packed copy of the image.
 
   The returned image is of the same size as the input image, which means
   that border pixels are not dilated beyond the image dimensions. If you
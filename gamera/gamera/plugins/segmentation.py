@@ -19,6 +19,7 @@
 from gamera.plugin import *
 from gamera import util
 import _segmentation
+from gamera.util import has_openmp
 
 
 class Segmenter(PluginFunction):
@@ -51,6 +52,71 @@ class cc_analysis(Segmenter):
     pass
 
 
+class cc_analysis_parallel(Segmenter):
+    """
+    Performs the same connected component analysis as cc_analysis_,
+    but labels horizontal strips of the image in several threads.
+
+    The labels of the strips are joined along the seams between the
+    strips, so that the result (including the labels) is identical to
+    that of cc_analysis_.
+
+    *num_threads*
+      The number of threads.  When 0, the number of processors is used.
+
+    Parallel labeling requires that Gamera was compiled with OpenMP
+    and that the image has DENSE storage; otherwise this is the same
+    as cc_analysis_.
+    """
+    args = Args([Int("num_threads", default=0)])
+    def __call__(self, num_threads=0):
+        return _segmentation.cc_analysis_parallel(self, num_threads)
+    __call__ = staticmethod(__call__)
+
+
+class cc_analysis_statistics(PluginFunction):
+    """
+    Performs the same connected component analysis as
+    cc_analysis_parallel_ and collects statistics of the components
+    while labeling them.
+
+    Returns the tuple (*ccs*, *statistics*), where *statistics[i]* is the
+    tuple (*black_area*, *center_x*, *center_y*, *mu20*, *mu11*, *mu02*)
+    of *ccs[i]*.  The center is the centroid of the black pixels in page
+    coordinates, and the *mu* values are the central second order moments
+    divided by the black area.
+
+    *num_threads*
+      The number of threads, as for cc_analysis_parallel_.
+    """
+    self_type = ImageType([ONEBIT])
+    args = Args([Int("num_threads", default=1)])
+    return_type = Class("ccs_and_statistics")
+    def __call__(self, num_threads=1):
+        return _segmentation.cc_analysis_statistics(self, num_threads)
+    __call__ = staticmethod(__call__)
+
+
+class cc_analysis_filter_black_area(Segmenter):
+    """
+    Performs the same connected component analysis as
+    cc_analysis_parallel_ and removes the components with a black area
+    smaller than *min_area* or larger than *max_area*, like
+    filter_black_area_small and filter_black_area_large.  The black
+    areas are counted while labeling, so the components are not scanned
+    again.
+
+    *num_threads*
+      The number of threads, as for cc_analysis_parallel_.
+    """
+    args = Args([Int("min_area", default=0), Int("max_area", default=2147483647),
+                 Int("num_threads", default=1)])
+    def __call__(self, min_area=0, max_area=2147483647, num_threads=1):
+        return _segmentation.cc_analysis_filter_black_area(
+            self, min_area, max_area, num_threads)
+    __call__ = staticmethod(__call__)
+
+
 class cc_and_cluster(Segmenter):
     """
     Performs connected component analysis using cc_analysis_ and then
@@ -258,11 +324,15 @@ def filter_black_area_large(ccs, max_size):
 class SegmentationModule(PluginModule):
     category = "Segmentation"
     cpp_headers=["segmentation.hpp"]
-    functions = [cc_analysis, cc_and_cluster, splitx, splity,
+    functions = [cc_analysis, cc_analysis_parallel, cc_analysis_statistics,
+                 cc_analysis_filter_black_area, cc_and_cluster, splitx, splity,
                  splitx_left, splitx_right, splity_top, splity_bottom,
                  splitx_max]
     author = "Michael Droettboom and Karl MacMillan"
     url = "http://gamera.sourceforge.net/"
+    if has_openmp:
+        extra_compile_args = ["-fopenmp"]
+        extra_link_args = ["-fopenmp"]
 
 module = SegmentationModule()
 
@@ -24,6 +24,7 @@
 from gamera.plugin import *
 from gamera.args import NoneDefault
 import _threshold
+from gamera.util import has_openmp
 
 class threshold(PluginFunction):
     """
@@ -310,5 +311,8 @@ class ThresholdModule(PluginModule):
                  soft_threshold, soft_threshold_find_sigma]
     author = "Michael Droettboom and Karl MacMillan"
     url = "http://gamera.sourceforge.net/"
+    if has_openmp:
+        extra_compile_args = ["-fopenmp"]
+        extra_link_args = ["-fopenmp"]
 
 module = ThresholdModule()
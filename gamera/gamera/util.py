@@ -29,6 +29,12 @@ from gamera.gui import has_gui
 from gamera.config import config
 from gamera.backport import sets, textwrap
 
+try:
+   from gamera.__compiletime_config__ import has_openmp
+except ImportError:
+   # setup.py has not written the build configuration yet
+   has_openmp = False
+
 config.add_option(
    "-p", "--progress-bar", action="store_true",
    help="[console] Display textual progress bars on stdout")
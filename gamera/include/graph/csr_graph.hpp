@@ -0,0 +1,142 @@
+/*
+ *
+ * Copyright (C) 2026 Gamera developers
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef _CSR_GRAPH_HPP_3F8B1D62C90A47
+#define _CSR_GRAPH_HPP_3F8B1D62C90A47
+
+#include "graph_common.hpp"
+#include <vector>
+#include <map>
+
+namespace Gamera { namespace GraphApi {
+
+
+
+// -----------------------------------------------------------------------------
+/// disjoint set forest with union by rank and path halving
+struct UnionFind {
+   std::vector<size_t> _parent;
+   std::vector<unsigned char> _rank;
+
+   UnionFind(size_t n) : _parent(n), _rank(n, 0) {
+      for(size_t i = 0; i < n; i++)
+         _parent[i] = i;
+   }
+
+   size_t find(size_t i) {
+      while(_parent[i] != i) {
+         _parent[i] = _parent[_parent[i]];
+         i = _parent[i];
+      }
+      return i;
+   }
+
+   /// merges the sets of a and b, returns false when they already were one
+   bool unite(size_t a, size_t b) {
+      a = find(a);
+      b = find(b);
+      if(a == b)
+         return false;
+      if(_rank[a] < _rank[b])
+         std::swap(a, b);
+      _parent[b] = a;
+      if(_rank[a] == _rank[b])
+         _rank[a]++;
+      return true;
+   }
+};
+
+
+
+// -----------------------------------------------------------------------------
+/** Immutable graph in compressed sparse row format.
+ *
+ * The nodes are numbered 0..n-1 and the edges leaving node i are the
+ * entries _offsets[i] to _offsets[i+1]-1 of _neighbors and _weights.
+ * Undirected edges are stored once for each direction. The node ids
+ * follow the node order of the Graph (or the sorted labels), and the
+ * neighbors of each node are in edge insertion order, so that BFS and
+ * DFS visit the nodes in the same order as BfsIterator and DfsIterator.
+ **/
+struct CsrGraph {
+   typedef unsigned int node_t;
+   static const node_t NO_NODE = (node_t)-1;
+
+   std::vector<size_t> _offsets;    ///< n+1 start positions in _neighbors
+   std::vector<node_t> _neighbors;  ///< target node of each edge entry
+   std::vector<cost_t> _weights;    ///< weight of each edge entry
+   std::vector<Node*> _nodes;       ///< Graph node of each id (if any)
+   std::vector<long> _labels;       ///< sorted label of each id (if any)
+   std::map<Node*, node_t> _ids;    ///< id of each Graph node (if any)
+   size_t _nedges;
+   bool _directed;
+
+   /// snapshot of the nodes and edges of g
+   CsrGraph(Graph* g);
+
+   /// graph of the given label adjacency pairs, e.g. from
+   /// labeled_region_neighbors; missing weights default to 1.0
+   CsrGraph(const std::vector<std::pair<long, long> >& labelpairs,
+         bool directed = false, const std::vector<cost_t>* weights = NULL);
+
+   size_t get_nnodes() const { return _offsets.size() - 1; }
+   size_t get_nedges() const { return _nedges; }
+   bool is_directed() const { return _directed; }
+   size_t degree(node_t n) const { return _offsets[n+1] - _offsets[n]; }
+
+   /// id of the node with the given label, NO_NODE if there is none
+   node_t get_node_id(long label) const;
+   /// id of the given Graph node, NO_NODE if it is not in the snapshot
+   node_t get_node_id(Node* node) const;
+
+   void BFS(node_t start, std::vector<node_t>& order) const;
+   void DFS(node_t start, std::vector<node_t>& order) const;
+
+   /// single source shortest paths; unreachable nodes get an infinite
+   /// distance and NO_NODE as predecessor
+   void dijkstra_shortest_path(node_t source, std::vector<cost_t>& distances,
+         std::vector<node_t>& predecessors) const;
+
+   /// Kruskal's algorithm on the edges taken as undirected; returns the
+   /// edges of a minimum spanning forest
+   void minimum_spanning_tree(std::vector<std::pair<node_t, node_t> >& edges,
+         std::vector<cost_t>* weights = NULL) const;
+
+   /// Prim's algorithm with a linear minimum search, O(n^2 + m), which
+   /// beats sorting the edges on dense graphs; only for undirected graphs
+   void minimum_spanning_tree_prim(
+         std::vector<std::pair<node_t, node_t> >& edges,
+         std::vector<cost_t>* weights = NULL) const;
+
+   /// same roots as the SubgraphRoots of a Graph, in id order
+   void subgraph_roots(std::vector<node_t>& roots) const;
+   size_t get_nsubgraphs() const;
+   size_t size_of_subgraph(node_t start) const;
+
+protected:
+   void build(std::vector<node_t>& from, std::vector<node_t>& to,
+         std::vector<cost_t>& weight, size_t nnodes);
+};
+
+
+
+}} // end Gamera::GraphApi
+#endif /* _CSR_GRAPH_HPP_3F8B1D62C90A47 */
+
@@ -180,6 +180,7 @@ struct Graph {
    Graph *create_spanning_tree(Node* node);
    Graph *create_spanning_tree(GraphData * value);
    Graph *create_minimum_spanning_tree(); //kruskal
+   Graph *create_minimum_spanning_tree_prim();
 
    //optimize_partitions only implemented in Python-wrapper
 
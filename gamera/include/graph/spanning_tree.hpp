@@ -21,6 +21,7 @@
 #ifndef _SPANNING_TREE_HPP_6AC2CA9C54D727
 #define _SPANNING_TREE_HPP_6AC2CA9C54D727
 #include "graph_common.hpp"
+#include "csr_graph.hpp"
 #include <map>
 
 namespace Gamera { namespace GraphApi {
@@ -38,9 +39,14 @@ class SpanningTree {
       }
    };
 
+   static Graph* create_tree_from_csr(const CsrGraph& csr, 
+         const std::vector<std::pair<CsrGraph::node_t, CsrGraph::node_t> >& edges,
+         const std::vector<cost_t>& weights);
+
 public:
    static Graph *create_minimum_spanning_tree(Graph* g);
    static Graph *create_minimum_spanning_tree_kruskal(Graph* g);
+   static Graph *create_minimum_spanning_tree_prim(Graph* g);
    static Graph* create_spanning_tree(Graph* g, Node* n);
 };
 
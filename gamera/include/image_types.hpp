@@ -25,6 +25,7 @@
 #include "image_data.hpp"
 #include "image_view.hpp"
 #include "rle_data.hpp"
+#include "packed_data.hpp"
 #include "connected_components.hpp"
 
 #include <list>
@@ -45,6 +46,7 @@ namespace Gamera {
   typedef ImageData<ComplexPixel> ComplexImageData;
   typedef ImageData<OneBitPixel> OneBitImageData;
   typedef RleImageData<OneBitPixel> OneBitRleImageData;
+  typedef PackedImageData<OneBitPixel> OneBitPackedImageData;
 
   /*
     ImageView
@@ -56,6 +58,7 @@ namespace Gamera {
   typedef ImageView<ComplexImageData> ComplexImageView;
   typedef ImageView<OneBitImageData> OneBitImageView;
   typedef ImageView<OneBitRleImageData> OneBitRleImageView;
+  typedef ImageView<OneBitPackedImageData> OneBitPackedImageView;
 
   /*
     Connected-components
@@ -80,9 +83,14 @@ namespace Gamera {
     COMPLEX
   };
   
+  /*
+    PACKED (one bit per pixel) is only available from C++ and is not
+    exposed as a storage format to Python.
+  */
   enum StorageTypes {
     DENSE,
-    RLE
+    RLE,
+    PACKED
   };
   
   /*
@@ -131,10 +139,12 @@ namespace Gamera {
     typedef typename T::data_type data_type;
     typedef ImageData<typename T::value_type> dense_data_type;
     typedef RleImageData<typename T::value_type> rle_data_type;
+    typedef PackedImageData<typename T::value_type> packed_data_type;
     // view types
     typedef ImageView<data_type> view_type;
     typedef ImageView<dense_data_type> dense_view_type;
     typedef ImageView<rle_data_type> rle_view_type;
+    typedef ImageView<packed_data_type> packed_view_type;
     // cc types
     typedef ConnectedComponent<data_type> cc_type;
     typedef ConnectedComponent<dense_data_type> dense_cc_type;
@@ -172,10 +182,12 @@ namespace Gamera {
     typedef RGBImageView::data_type data_type;
     typedef ImageData<RGBImageView::value_type> dense_data_type;
     typedef ImageData<RGBImageView::value_type> rle_data_type;
+    typedef ImageData<RGBImageView::value_type> packed_data_type;
     // view types
     typedef ImageView<data_type> view_type;
     typedef ImageView<dense_data_type> dense_view_type;
     typedef ImageView<rle_data_type> rle_view_type;
+    typedef ImageView<packed_data_type> packed_view_type;
     // cc types
     typedef ConnectedComponent<data_type> cc_type;
     typedef ConnectedComponent<dense_data_type> dense_cc_type;
@@ -208,10 +220,12 @@ namespace Gamera {
     typedef ComplexImageView::data_type data_type;
     typedef ImageData<ComplexImageView::value_type> dense_data_type;
     typedef ImageData<ComplexImageView::value_type> rle_data_type;
+    typedef ImageData<ComplexImageView::value_type> packed_data_type;
     // view types
     typedef ImageView<data_type> view_type;
     typedef ImageView<dense_data_type> dense_view_type;
     typedef ImageView<rle_data_type> rle_view_type;
+    typedef ImageView<packed_data_type> packed_view_type;
     // cc types
     typedef ConnectedComponent<data_type> cc_type;
     typedef ConnectedComponent<dense_data_type> dense_cc_type;
@@ -268,6 +282,16 @@ namespace Gamera {
     }
   };
 
+  template<>
+  struct TypeIdImageFactory<ONEBIT, PACKED> {
+    typedef OneBitPackedImageData data_type;
+    typedef OneBitPackedImageView image_type;
+    static image_type* create(const Point& origin, const Dim& dim) {
+      data_type* data = new data_type(dim, origin);
+      return new image_type(*data, origin, dim);
+    }
+  };
+
   template<>
   struct TypeIdImageFactory<GREYSCALE, DENSE> {
     typedef GreyScaleImageData data_type;
@@ -176,6 +176,157 @@ namespace Gamera {
       return distance;
     }
 
+    /*
+      FEATURE MATRIX
+
+      A set of feature vectors stored row by row in a single block of
+      memory.  Each row starts on a 32 byte boundary and is padded with
+      zeros to a multiple of four features, so that the distance kernels
+      below can always process four features at once.  (*m)[i] is the
+      i'th feature vector.
+    */
+    class FeatureMatrix {
+    public:
+      FeatureMatrix(size_t rows, size_t cols)
+        : m_rows(rows), m_capacity(rows), m_cols(cols), m_stride(stride_for(cols)) {
+        m_buffer = allocate(m_capacity, m_data);
+        std::fill(m_data, m_data + m_rows * m_stride, 0.0);
+      }
+      /*
+        A matrix on rows laid out as above in memory owned by someone else
+        (e.g. a mapped file), which must outlive the matrix.
+      */
+      FeatureMatrix(double* data, size_t rows, size_t cols)
+        : m_rows(rows), m_capacity(rows), m_cols(cols),
+          m_stride(stride_for(cols)), m_buffer(0), m_data(data) {
+        assert(((size_t)data & (ALIGNMENT - 1)) == 0);
+      }
+      ~FeatureMatrix() {
+        delete[] m_buffer;
+      }
+      // the number of feature vectors
+      size_t size() const { return m_rows; }
+      size_t num_features() const { return m_cols; }
+      // the distance between the starts of two rows
+      size_t stride() const { return m_stride; }
+      double* operator[](size_t i) { return m_data + i * m_stride; }
+      const double* operator[](size_t i) const { return m_data + i * m_stride; }
+      /*
+        Changes the number of rows, keeping the existing ones and filling
+        new ones with zeros. The memory grows geometrically, so that
+        appending rows one at a time takes amortized constant time. Only
+        for matrices that own their memory; the rows may move.
+      */
+      void resize(size_t rows) {
+        assert(m_buffer != 0);
+        if (rows > m_capacity) {
+          size_t capacity = std::max(rows, 2 * m_capacity);
+          double* data;
+          char* buffer = allocate(capacity, data);
+          std::copy(m_data, m_data + m_rows * m_stride, data);
+          delete[] m_buffer;
+          m_buffer = buffer;
+          m_data = data;
+          m_capacity = capacity;
+        }
+        if (rows > m_rows)
+          std::fill(m_data + m_rows * m_stride, m_data + rows * m_stride, 0.0);
+        m_rows = rows;
+      }
+      /*
+        Removes the rows with the given indexes (in ascending order),
+        keeping the order of the remaining rows.
+      */
+      void erase(const std::vector<size_t>& rows) {
+        assert(m_buffer != 0);
+        size_t kept = 0;
+        for (size_t i = 0, next = 0; i < m_rows; ++i) {
+          if (next < rows.size() && rows[next] == i) {
+            ++next;
+            continue;
+          }
+          if (kept != i)
+            std::copy((*this)[i], (*this)[i] + m_stride, (*this)[kept]);
+          ++kept;
+        }
+        m_rows = kept;
+      }
+      // the stride of the rows of a matrix with cols features
+      static size_t stride_for(size_t cols) { return (cols + 3) & ~size_t(3); }
+      enum { ALIGNMENT = 32 };
+    private:
+      // not copyable
+      FeatureMatrix(const FeatureMatrix&);
+      FeatureMatrix& operator=(const FeatureMatrix&);
+      char* allocate(size_t rows, double*& data) const {
+        char* buffer = new char[rows * m_stride * sizeof(double) + ALIGNMENT];
+        data = (double*)(((size_t)buffer + ALIGNMENT - 1)
+                         & ~size_t(ALIGNMENT - 1));
+        return buffer;
+      }
+      size_t m_rows, m_capacity, m_cols, m_stride;
+      char* m_buffer;
+      double* m_data;
+    };
+
+    /*
+      DISTANCE KERNELS for padded rows.
+
+      These compute the same distances as the functions above for rows of
+      a FeatureMatrix, where the selection has already been applied by
+      leaving out the deselected features and multiplying it into the
+      weights.  n must be a multiple of four (the stride of the rows).
+      Four independent partial sums avoid a dependency between
+      consecutive additions and allow the compiler to use SIMD
+      instructions.
+    */
+    inline double city_block_distance_padded(const double* known,
+                                             const double* unknown,
+                                             const double* weight, size_t n) {
+      double d0 = 0, d1 = 0, d2 = 0, d3 = 0;
+      for (size_t i = 0; i < n; i += 4) {
+        d0 += weight[i] * std::abs(unknown[i] - known[i]);
+        d1 += weight[i + 1] * std::abs(unknown[i + 1] - known[i + 1]);
+        d2 += weight[i + 2] * std::abs(unknown[i + 2] - known[i + 2]);
+        d3 += weight[i + 3] * std::abs(unknown[i + 3] - known[i + 3]);
+      }
+      return (d0 + d1) + (d2 + d3);
+    }
+
+    inline double euclidean_distance_padded(const double* known,
+                                            const double* unknown,
+                                            const double* weight, size_t n) {
+      double d0 = 0, d1 = 0, d2 = 0, d3 = 0;
+      for (size_t i = 0; i < n; i += 4) {
+        double e0 = unknown[i] - known[i];
+        double e1 = unknown[i + 1] - known[i + 1];
+        double e2 = unknown[i + 2] - known[i + 2];
+        double e3 = unknown[i + 3] - known[i + 3];
+        d0 += weight[i] * std::sqrt(e0 * e0);
+        d1 += weight[i + 1] * std::sqrt(e1 * e1);
+        d2 += weight[i + 2] * std::sqrt(e2 * e2);
+        d3 += weight[i + 3] * std::sqrt(e3 * e3);
+      }
+      return (d0 + d1) + (d2 + d3);
+    }
+
+    inline double fast_euclidean_distance_padded(const double* known,
+                                                 const double* unknown,
+                                                 const double* weight, size_t n) {
+      double d0 = 0, d1 = 0, d2 = 0, d3 = 0;
+      for (size_t i = 0; i < n; i += 4) {
+        double e0 = unknown[i] - known[i];
+        double e1 = unknown[i + 1] - known[i + 1];
+        double e2 = unknown[i + 2] - known[i + 2];
+        double e3 = unknown[i + 3] - known[i + 3];
+        d0 += weight[i] * (e0 * e0);
+        d1 += weight[i + 1] * (e1 * e1);
+        d2 += weight[i + 2] * (e2 * e2);
+        d3 += weight[i + 3] * (e3 * e3);
+      }
+      return (d0 + d1) + (d2 + d3);
+    }
+
     /*
       NORMALIZE
       
@@ -187,7 +338,9 @@ namespace Gamera {
       anything about the data structures used for storing the feature
       vectors. The add method is called for each feature vector,
       compute_normalization is called, and then feature vectors can
-      be normalized by calling apply.
+      be normalized by calling apply. The sums stay available, so that
+      feature vectors can be added and removed later and the
+      normalization be computed again.
     */
     class Normalize {
     public:
@@ -223,6 +376,30 @@ namespace Gamera {
         }
         ++m_num_feature_vectors;
       }
+      template<class T>
+      void remove(T begin, const T end) {
+        if (size_t(end - begin) != m_num_features)
+          throw std::range_error("Normalize: number features did not match.");
+        for (size_t i = 0; begin != end; ++begin, ++i) {
+          m_sum_vector[i] -= *begin;
+          m_sum2_vector[i] -= *begin * *begin;
+        }
+        --m_num_feature_vectors;
+      }
+      /*
+        Restores the sums of num_feature_vectors feature vectors from the
+        mean and stdev vectors, e.g. after these have been read from a
+        file.
+      */
+      void restore_sums(size_t num_feature_vectors) {
+        m_num_feature_vectors = num_feature_vectors;
+        double n = double(num_feature_vectors);
+        for (size_t i = 0; i < m_num_features; ++i) {
+          double var = m_stdev_vector[i] * m_stdev_vector[i];
+          m_sum_vector[i] = n * m_mean_vector[i];
+          m_sum2_vector[i] = (var * n * (n - 1) + m_sum_vector[i] * m_sum_vector[i]) / n;
+        }
+      }
       void compute_normalization() {
         assert(m_sum_vector != 0 && m_sum2_vector != 0);
         double mean, var, stdev, sum, sum2;
@@ -238,10 +415,6 @@ namespace Gamera {
           m_mean_vector[i] = mean;
           m_stdev_vector[i] = stdev;
         }
-        delete[] m_sum_vector;
-        m_sum_vector = 0;
-        delete[] m_sum2_vector;
-        m_sum2_vector = 0;
       }
       // in-place
       template<class T>
@@ -252,6 +425,15 @@ namespace Gamera {
         for (; begin != end; ++begin, ++mean, ++stdev)
           *begin = (*begin - *mean)/ *stdev;
       }
+      // the inverse of apply, in-place
+      template<class T>
+      void unapply(T begin, const T end) const {
+        assert(size_t(end - begin) == m_num_features);
+        double* mean = m_mean_vector;
+        double* stdev = m_stdev_vector;
+        for (; begin != end; ++begin, ++mean, ++stdev)
+          *begin = *begin * *stdev + *mean;
+      }
       // out-of-place
       template<class T, class U>
       void apply(T in_begin, const T end, U out_begin) const {
@@ -304,9 +486,14 @@ namespace Gamera {
       a database and majority the state of the class is undefined. If another
       search needs to be performed call reset (at which point add for each
       element will need to be called again).
+
+      kNearestNeighborsBase holds everything but the majority vote, which
+      is implemented by kNearestNeighbors: with a std::map for arbitrary
+      ids, and with arrays for int ids that are dense class numbers from
+      0 to num_classes - 1.
     */
-    template<class IdType, class CompLT, class CompEQ>
-    class kNearestNeighbors {
+    template<class IdType, class CompEQ>
+    class kNearestNeighborsBase {
     public:
       /*
         These nested classes are only used in kNearestNeighbors
@@ -334,33 +521,18 @@ namespace Gamera {
         double distance;
       };
 
-      class IdStat {
-      public:
-        IdStat() {
-          min_distance = std::numeric_limits<double>::max();
-          count = 0;
-        }
-        IdStat(double distance, size_t c) {
-          min_distance = distance;
-          count = c;
-        }
-        double min_distance;
-        double total_distance;
-        size_t count;
-      };
-
       // typedefs for convenience
       typedef IdType id_type;
       typedef Neighbor neighbor_type;
       typedef std::vector<neighbor_type> vec_type;
 
       // Constructor
-      kNearestNeighbors(size_t k = 1) : m_k(k) {
+      kNearestNeighborsBase(size_t k = 1) : m_k(k) {
         m_max_distance = 0;
         m_nun = NULL;
       }
       // Destructor
-      ~kNearestNeighbors() {
+      ~kNearestNeighborsBase() {
         if (m_nun) delete m_nun;
       }
       // Reset the class to its initial state
@@ -407,96 +579,13 @@ namespace Gamera {
           m_max_distance = distance;
       }
       /*
-        Find the id of the majority of the k nearest neighbors. This
-        includes tie-breaking if necessary.
+        Account for the distance of a neighbor that has not been added,
+        because a search index has excluded it from the k nearest neighbors.
+        It only takes part in the normalization of the default confidence.
       */
-      void majority() {
-        answer.clear();
-        
-        if (m_nn.size() == 0)
-          throw std::range_error("majority called without enough valid neighbors.");
-        // short circuit for k == 1
-        if (m_nn.size() == 1) {
-          answer.resize(1);
-          answer[0] = std::make_pair(m_nn[0].id, m_nn[0].distance);
-          return;
-        }
-        /*
-          Create a histogram of the ids in the nearest neighbors. A map
-          is used because the id_type could be anything. Additionally, even
-          if id_type was an integer there is no garuntee that they are small,
-          ordered numbers (making a vector impractical).
-        */
-        typedef std::map<id_type, IdStat, CompLT> map_type;
-        map_type id_map;
-        typename map_type::iterator current;
-        for (typename vec_type::iterator i = m_nn.begin();
-             i != m_nn.end(); ++i) {
-          current = id_map.find(i->id);
-          if (current == id_map.end()) {
-            id_map.insert(std::pair<id_type,
-                          IdStat>(i->id, IdStat(i->distance, 1)));
-          } else {
-            current->second.count++;
-            current->second.total_distance += i->distance;
-            if (current->second.min_distance > i->distance)
-              current->second.min_distance = i->distance;
-          }
-        }
-        /*
-          Now that we have the histogram we can take the majority if there
-          is a clear winner, but if not, we need do some sort of tie breaking.
-        */
-        if (id_map.size() == 1) {
-          answer.resize(1);
-          answer[0] = std::make_pair(id_map.begin()->first, id_map.begin()->second.min_distance);
-          return;
-        } else {
-          /*
-            Find the id(s) with the maximum
-          */
-          std::vector<typename map_type::iterator> max;
-          max.push_back(id_map.begin());
-          for (typename map_type::iterator i = id_map.begin();
-               i != id_map.end(); ++i) {
-            if (i->second.count > max[0]->second.count) {
-              max.clear();
-              max.push_back(i);
-            } else if (i->second.count == max[0]->second.count) {
-              max.push_back(i);
-            }
-          }
-          /*
-            If the vector only has 1 element there are no ties and
-            we are done.
-          */
-          if (max.size() == 1) {
-            // put the winner in the result vector
-            answer.push_back(std::make_pair(max[0]->first, max[0]->second.min_distance));
-            // remove the winner from the id_map
-            id_map.erase(max[0]);
-          } else {
-            /*
-              Tie-break by average distance
-            */
-            typename map_type::iterator min_dist = max[0];
-            for (size_t i = 1; i < max.size(); ++i) {
-              if (max[i]->second.total_distance
-                  < min_dist->second.total_distance)
-                min_dist = max[i];
-            }
-            answer.push_back(std::make_pair(min_dist->first, min_dist->second.min_distance));
-            id_map.erase(min_dist);
-          }
-          for (typename map_type::iterator i = id_map.begin();
-               i != id_map.end(); ++i) {
-            // Could not figure out why distance should be < 1 for additional
-            // classes => let us instead return all classes among kNN (CD)
-            //if (i->second.min_distance < 1)
-            answer.push_back(std::make_pair(i->first, i->second.min_distance));
-          }
-          return;
-        }
+      void add_distance(double distance) {
+        if (distance > m_max_distance)
+          m_max_distance = distance;
       }
       void calculate_confidences() {
         size_t i,j;
@@ -599,7 +688,7 @@ namespace Gamera {
           answer[i].second = get_default_confidence(answer[i].second);
         }
       }
-    private:
+    protected:
       CompEQ ceq; // test whether two class id's are equal
       // simple measure that is defined for all classes and k values
       double get_default_confidence(double dist) {
@@ -614,11 +703,210 @@ namespace Gamera {
       std::vector<double> confidence;
       std::vector<neighbor_type> m_nn;
       neighbor_type* m_nun;
-    private:
+    protected:
       size_t m_k;
       double m_max_distance;
     };
 
+    template<class IdType, class CompLT, class CompEQ>
+    class kNearestNeighbors : public kNearestNeighborsBase<IdType, CompEQ> {
+    public:
+      typedef kNearestNeighborsBase<IdType, CompEQ> base_type;
+      typedef IdType id_type;
+
+      class IdStat {
+      public:
+        IdStat() {
+          min_distance = std::numeric_limits<double>::max();
+          count = 0;
+        }
+        IdStat(double distance, size_t c) {
+          min_distance = distance;
+          total_distance = distance;
+          count = c;
+        }
+        double min_distance;
+        double total_distance;
+        size_t count;
+      };
+
+      kNearestNeighbors(size_t k = 1) : base_type(k) {}
+
+      /*
+        Find the id of the majority of the k nearest neighbors. This
+        includes tie-breaking if necessary.
+      */
+      void majority() {
+        this->answer.clear();
+        
+        if (this->m_nn.size() == 0)
+          throw std::range_error("majority called without enough valid neighbors.");
+        // short circuit for k == 1
+        if (this->m_nn.size() == 1) {
+          this->answer.resize(1);
+          this->answer[0] = std::make_pair(this->m_nn[0].id, this->m_nn[0].distance);
+          return;
+        }
+        /*
+          Create a histogram of the ids in the nearest neighbors. A map
+          is used because the id_type could be anything. Additionally, even
+          if id_type was an integer there is no garuntee that they are small,
+          ordered numbers (making a vector impractical).
+        */
+        typedef std::map<id_type, IdStat, CompLT> map_type;
+        map_type id_map;
+        typename map_type::iterator current;
+        for (typename base_type::vec_type::iterator i = this->m_nn.begin();
+             i != this->m_nn.end(); ++i) {
+          current = id_map.find(i->id);
+          if (current == id_map.end()) {
+            id_map.insert(std::pair<id_type,
+                          IdStat>(i->id, IdStat(i->distance, 1)));
+          } else {
+            current->second.count++;
+            current->second.total_distance += i->distance;
+            if (current->second.min_distance > i->distance)
+              current->second.min_distance = i->distance;
+          }
+        }
+        /*
+          Now that we have the histogram we can take the majority if there
+          is a clear winner, but if not, we need do some sort of tie breaking.
+        */
+        if (id_map.size() == 1) {
+          this->answer.resize(1);
+          this->answer[0] = std::make_pair(id_map.begin()->first, id_map.begin()->second.min_distance);
+          return;
+        } else {
+          /*
+            Find the id(s) with the maximum
+          */
+          std::vector<typename map_type::iterator> max;
+          max.push_back(id_map.begin());
+          for (typename map_type::iterator i = id_map.begin();
+               i != id_map.end(); ++i) {
+            if (i->second.count > max[0]->second.count) {
+              max.clear();
+              max.push_back(i);
+            } else if (i->second.count == max[0]->second.count) {
+              max.push_back(i);
+            }
+          }
+          /*
+            If the vector only has 1 element there are no ties and
+            we are done.
+          */
+          if (max.size() == 1) {
+            // put the winner in the result vector
+            this->answer.push_back(std::make_pair(max[0]->first, max[0]->second.min_distance));
+            // remove the winner from the id_map
+            id_map.erase(max[0]);
+          } else {
+            /*
+              Tie-break by average distance
+            */
+            typename map_type::iterator min_dist = max[0];
+            for (size_t i = 1; i < max.size(); ++i) {
+              if (max[i]->second.total_distance
+                  < min_dist->second.total_distance)
+                min_dist = max[i];
+            }
+            this->answer.push_back(std::make_pair(min_dist->first, min_dist->second.min_distance));
+            id_map.erase(min_dist);
+          }
+          for (typename map_type::iterator i = id_map.begin();
+               i != id_map.end(); ++i) {
+            // Could not figure out why distance should be < 1 for additional
+            // classes => let us instead return all classes among kNN (CD)
+            //if (i->second.min_distance < 1)
+            this->answer.push_back(std::make_pair(i->first, i->second.min_distance));
+          }
+          return;
+        }
+      }
+    };
+
+    /*
+      The majority vote for class numbers, counted in arrays indexed by
+      the class instead of a map. The result is the same as with the
+      generic implementation and std::less<int>: ties are resolved by the
+      total distance, and the other classes follow in ascending order.
+    */
+    template<class CompLT, class CompEQ>
+    class kNearestNeighbors<int, CompLT, CompEQ>
+      : public kNearestNeighborsBase<int, CompEQ> {
+    public:
+      typedef kNearestNeighborsBase<int, CompEQ> base_type;
+      typedef int id_type;
+
+      kNearestNeighbors(size_t k = 1, size_t num_classes = 0)
+        : base_type(k), m_count(num_classes, 0),
+          m_min_distance(num_classes), m_total_distance(num_classes) {
+        m_classes.reserve(k);
+      }
+      void majority() {
+        this->answer.clear();
+
+        if (this->m_nn.size() == 0)
+          throw std::range_error("majority called without enough valid neighbors.");
+        // short circuit for k == 1
+        if (this->m_nn.size() == 1) {
+          this->answer.resize(1);
+          this->answer[0] = std::make_pair(this->m_nn[0].id, this->m_nn[0].distance);
+          return;
+        }
+        // histogram of the classes among the nearest neighbors
+        m_classes.clear();
+        for (size_t i = 0; i < this->m_nn.size(); ++i) {
+          int id = this->m_nn[i].id;
+          double distance = this->m_nn[i].distance;
+          if (size_t(id) >= m_count.size()) {
+            m_count.resize(id + 1, 0);
+            m_min_distance.resize(id + 1);
+            m_total_distance.resize(id + 1);
+          }
+          if (m_count[id] == 0) {
+            m_classes.push_back(id);
+            m_count[id] = 1;
+            m_min_distance[id] = distance;
+            m_total_distance[id] = distance;
+          } else {
+            m_count[id]++;
+            m_total_distance[id] += distance;
+            if (m_min_distance[id] > distance)
+              m_min_distance[id] = distance;
+          }
+        }
+        std::sort(m_classes.begin(), m_classes.end());
+        /*
+          The winner has the largest count; among equal counts the smallest
+          total distance, and among equal total distances the smallest class.
+        */
+        size_t winner = 0;
+        for (size_t i = 1; i < m_classes.size(); ++i) {
+          int id = m_classes[i], best = m_classes[winner];
+          if (m_count[id] > m_count[best]
+              || (m_count[id] == m_count[best]
+                  && m_total_distance[id] < m_total_distance[best]))
+            winner = i;
+        }
+        this->answer.push_back(std::make_pair(m_classes[winner],
+                                              m_min_distance[m_classes[winner]]));
+        for (size_t i = 0; i < m_classes.size(); ++i) {
+          int id = m_classes[i];
+          if (i != winner)
+            this->answer.push_back(std::make_pair(id, m_min_distance[id]));
+          m_count[id] = 0;
+        }
+      }
+    private:
+      // the classes among the nearest neighbors
+      std::vector<int> m_classes;
+      std::vector<size_t> m_count;
+      std::vector<double> m_min_distance;
+      std::vector<double> m_total_distance;
+    };
+
   } // namespace kNN
 } //namespace Gamera
 
@@ -23,9 +23,24 @@
 
 #include <Python.h>
 #include <vector>
+#include <algorithm>
+#include <functional>
+#include <stdio.h>
+#ifndef _WIN32
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 #include "gameramodule.hpp"
 #include "knn.hpp"
 #include "knnmodule.hpp"
+#include "knnindex.hpp"
+#include "knnreduced.hpp"
 
 namespace Gamera { namespace kNN {
 #if 0
@@ -34,6 +49,148 @@ namespace Gamera { namespace kNN {
     0,
   };
 #endif
+  /*
+    CompactFeatures
+
+    The feature vectors reduced to the selected features with non-zero
+    weight, for the distance kernels on padded rows (see FeatureMatrix).
+    The selection is multiplied into the weights, so that the kernels
+    neither multiply by the selection nor visit deselected features.
+    It is built for one pair of selection and weight vectors and must be
+    rebuilt when these change.  With share_rows, the rows of features are
+    used in place when all features are active, instead of copying them;
+    features must then outlive the CompactFeatures.
+  */
+  class CompactFeatures {
+  public:
+    CompactFeatures(const FeatureMatrix& features, const int* selection_vector,
+                    const double* weight_vector, bool share_rows = false)
+      : m_selections(selection_vector,
+                     selection_vector + features.num_features()),
+        m_weights(weight_vector, weight_vector + features.num_features()),
+        m_indexes(active_features(features.num_features(), selection_vector,
+                                  weight_vector)),
+        m_vectors(share_rows && m_indexes.size() == features.num_features() ?
+                  0 : new FeatureMatrix(features.size(), m_indexes.size())),
+        vectors(m_vectors != 0 ? *m_vectors : features),
+        weights(1, m_indexes.size()),
+        unknown(1, m_indexes.size()) {
+      for (size_t j = 0; j < m_indexes.size(); ++j)
+        weights[0][j] = selection_vector[m_indexes[j]] * weight_vector[m_indexes[j]];
+      if (m_vectors != 0)
+        for (size_t i = 0; i < features.size(); ++i)
+          compact(features[i], (*m_vectors)[i]);
+    }
+    ~CompactFeatures() {
+      delete m_vectors;
+    }
+    // whether this was built for the given selections and weights
+    bool matches(const int* selection_vector, const double* weight_vector) const {
+      return std::equal(m_selections.begin(), m_selections.end(), selection_vector)
+        && std::equal(m_weights.begin(), m_weights.end(), weight_vector);
+    }
+    // copies the active features of a full feature vector to out
+    void compact(const double* full, double* out) const {
+      for (size_t j = 0; j < m_indexes.size(); ++j)
+        out[j] = full[m_indexes[j]];
+    }
+    // the length of the padded rows
+    size_t stride() const { return vectors.stride(); }
+  private:
+    // not copyable
+    CompactFeatures(const CompactFeatures&);
+    CompactFeatures& operator=(const CompactFeatures&);
+    static std::vector<size_t> active_features(size_t num_features,
+                                               const int* selections,
+                                               const double* weights) {
+      std::vector<size_t> indexes;
+      for (size_t i = 0; i < num_features; ++i)
+        if (selections[i] * weights[i] != 0.0)
+          indexes.push_back(i);
+      return indexes;
+    }
+    std::vector<int> m_selections;
+    std::vector<double> m_weights;
+    std::vector<size_t> m_indexes;
+    // the compacted rows, or 0 if the rows are shared
+    FeatureMatrix* m_vectors;
+  public:
+    const FeatureMatrix& vectors;
+    // the products of selections and weights of the active features
+    FeatureMatrix weights;
+    // temporary storage for a compacted unknown feature vector
+    FeatureMatrix unknown;
+  };
+
+  /*
+    MappedFile
+
+    A file mapped read-only into memory, so that the processes loading
+    the same file share its pages and only the pages that are used are
+    read.  Where mmap is not available, the file is read into memory
+    instead.  The data starts on a page boundary.
+  */
+  class MappedFile {
+  public:
+    MappedFile() : m_data(0), m_size(0), m_mapped(false), m_buffer(0) {}
+    ~MappedFile() {
+#ifndef _WIN32
+      if (m_mapped) {
+        munmap(m_data, m_size);
+        return;
+      }
+#endif
+      delete[] m_buffer;
+    }
+    // returns false if the file cannot be opened, read or mapped
+    bool open(const char* filename) {
+#ifndef _WIN32
+      int fd = ::open(filename, O_RDONLY);
+      if (fd < 0)
+        return false;
+      struct stat info;
+      if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        ::close(fd);
+        return false;
+      }
+      m_size = (size_t)info.st_size;
+      void* data = mmap(0, m_size, PROT_READ, MAP_SHARED, fd, 0);
+      ::close(fd);
+      if (data == MAP_FAILED)
+        return false;
+      m_data = (char*)data;
+      m_mapped = true;
+      return true;
+#else
+      FILE* file = fopen(filename, "rb");
+      if (file == 0)
+        return false;
+      if (fseek(file, 0, SEEK_END) != 0 || ftell(file) <= 0) {
+        fclose(file);
+        return false;
+      }
+      m_size = (size_t)ftell(file);
+      rewind(file);
+      m_buffer = new char[m_size + PAGE];
+      m_data = (char*)(((size_t)m_buffer + PAGE - 1) & ~size_t(PAGE - 1));
+      bool ok = fread(m_data, 1, m_size, file) == m_size;
+      fclose(file);
+      return ok;
+#endif
+    }
+    const char* data() const { return m_data; }
+    size_t size() const { return m_size; }
+  private:
+    enum { PAGE = 4096 };
+    // not copyable
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+    char* m_data;
+    size_t m_size;
+    bool m_mapped;
+    char* m_buffer;
+  };
+
   /*
     The KnnObject holds all of the information needed by knn. Unlike
     many of the parts of Gamera, there is a significant amount of
@@ -47,13 +204,44 @@ namespace Gamera { namespace kNN {
 
     /*
       The feature vectors.
-      A vector to double arrays of size num_features is used to store the
-      feature vectors. It is only used for non-interactive classification).
+      A FeatureMatrix with one row of num_features doubles per feature
+      vector. It is only used for non-interactive classification).
+    */
+    FeatureMatrix *feature_vectors;
+    /*
+      The file that unserialize mapped the feature vectors and class names
+      from, or 0 if they are allocated.  Mapped feature vectors must not
+      be modified.
+    */
+    MappedFile *mapped;
+    /*
+      The feature vectors compacted for the current selections and weights.
+      This is built on demand by get_compact_features.
     */
-    std::vector<double*> *feature_vectors;
+    CompactFeatures *compact_features;
+    /*
+      The search index over the compacted feature vectors, or 0 if there
+      are too few of them (see KnnIndex::applicable). It is rebuilt
+      together with compact_features.
+    */
+    KnnIndex *index;
+    /*
+      The compacted feature vectors in reduced precision, or 0 for double
+      precision. It is rebuilt together with compact_features.
+    */
+    ReducedFeatures *reduced;
+    FeaturePrecision feature_precision;
 
     // The id_names for the feature vectors
     char** id_names;
+    /*
+      The class of each feature vector: the id_names numbered in
+      alphabetical order (see knn_create_class_ids).
+    */
+    int* class_ids;
+    // The id_name of each class (pointing into id_names)
+    char** class_names;
+    size_t num_classes;
     // confidence types to be computed during classification
     std::vector<int> *confidence_types;
     // The current selected features
@@ -67,6 +255,13 @@ namespace Gamera { namespace kNN {
       calculation.
     */
     Normalize* normalize;
+    /*
+      Whether feature vectors have been added or removed since the
+      normalization was computed. The feature vectors are normalized
+      consistently with the old normalization until get_compact_features
+      computes the new one.
+    */
+    bool outdated_normalization;
     /*
       Temporary storage for the unknown feature vector. This is simply to avoid
       allocating memory for each call to classify (and could potentially
@@ -79,6 +274,11 @@ namespace Gamera { namespace kNN {
     DistanceType distance_type;
   };
 
+  /*
+    The kNearestNeighbors object for the classes of the feature vectors.
+  */
+  typedef kNearestNeighbors<int, std::less<int>, std::equal_to<int> > ClassNeighbors;
+
   /*
     String comparison functors used by the kNearestNeighbors object
   */
@@ -93,6 +293,314 @@ namespace Gamera { namespace kNN {
     }
   };
 
+  // deletes the compacted feature vectors and everything built on them
+  inline void delete_compact_features(KnnObject* o) {
+    delete o->index;
+    o->index = 0;
+    delete o->reduced;
+    o->reduced = 0;
+    delete o->compact_features;
+    o->compact_features = 0;
+  }
+
+  /*
+    Computes the normalization of the current feature vectors and changes
+    them from the old to the new normalization.
+  */
+  inline void update_normalization(KnnObject* o) {
+    size_t num_features = o->num_features;
+    std::vector<double> mean(o->normalize->get_mean_vector(),
+                             o->normalize->get_mean_vector() + num_features);
+    std::vector<double> stdev(o->normalize->get_stdev_vector(),
+                              o->normalize->get_stdev_vector() + num_features);
+    o->normalize->compute_normalization();
+    const double* new_mean = o->normalize->get_mean_vector();
+    const double* new_stdev = o->normalize->get_stdev_vector();
+    for (size_t i = 0; i < o->feature_vectors->size(); ++i) {
+      double* features = (*o->feature_vectors)[i];
+      for (size_t j = 0; j < num_features; ++j)
+        features[j] = (features[j] * stdev[j] + mean[j] - new_mean[j]) / new_stdev[j];
+    }
+    o->outdated_normalization = false;
+  }
+
+  /*
+    The compacted feature vectors for the current selections and weights,
+    rebuilt if they have changed since the last call.  As the selection and
+    weight vectors may also be modified directly (e.g. by the genetic
+    algorithms), they are compared on every call, which is cheap compared
+    to a classification. The search index is rebuilt along with them.
+    An outdated normalization is updated first.
+  */
+  inline CompactFeatures* get_compact_features(KnnObject* o) {
+    if (o->outdated_normalization) {
+      delete_compact_features(o);
+      update_normalization(o);
+    }
+    if (o->compact_features == 0
+        || !o->compact_features->matches(o->selection_vector, o->weight_vector)) {
+      delete_compact_features(o);
+      o->compact_features = new CompactFeatures(*o->feature_vectors,
+                                                o->selection_vector,
+                                                o->weight_vector, true);
+      const CompactFeatures& compact = *o->compact_features;
+      if (KnnIndex::applicable(compact.vectors.size(), compact.weights[0],
+                               compact.vectors.num_features()))
+        o->index = new KnnIndex(compact.vectors, compact.weights[0],
+                                compact.vectors.num_features());
+    }
+    if (o->reduced != 0 && o->reduced->precision() != o->feature_precision) {
+      delete o->reduced;
+      o->reduced = 0;
+    }
+    const CompactFeatures& compact = *o->compact_features;
+    if (o->reduced == 0
+        && ReducedFeatures::applicable(o->feature_precision, compact.weights[0],
+                                       compact.vectors.num_features()))
+      o->reduced = new ReducedFeatures(o->feature_precision, compact.vectors,
+                                       compact.weights[0]);
+    return o->compact_features;
+  }
+
+  /*
+    Admits the feature vectors whose class differs from the given one,
+    for the search of the nearest unlike neighbor.
+  */
+  class DifferentClass {
+  public:
+    DifferentClass(const int* class_ids, int class_id)
+      : m_class_ids(class_ids), m_class_id(class_id) {}
+    bool operator()(size_t i) const {
+      return m_class_ids[i] != m_class_id;
+    }
+  private:
+    const int* m_class_ids;
+    int m_class_id;
+  };
+
+  struct neighbor_index_less {
+    bool operator()(const KnnIndex::neighbor_type& a,
+                    const KnnIndex::neighbor_type& b) const {
+      return a.second < b.second;
+    }
+  };
+  struct neighbor_index_equal {
+    bool operator()(const KnnIndex::neighbor_type& a,
+                    const KnnIndex::neighbor_type& b) const {
+      return a.second == b.second;
+    }
+  };
+
+  /*
+    Adds the neighbors of the compacted unknown that determine the outcome
+    of a classification to knn: the k nearest neighbors, the nearest
+    unlike neighbor if its confidence is requested, and the largest
+    distance for the default confidence. They are added in the order of
+    the feature vectors, so that the result is the same as if all feature
+    vectors had been added. Returns the number of distance computations.
+  */
+  template<class KNN>
+  size_t add_indexed_neighbors(KnnObject* o, const KnnIndex& index,
+                               const double* unknown, KNN& knn) {
+    std::vector<KnnIndex::neighbor_type> neighbors, unlike;
+    size_t evaluations = index.nearest(o->distance_type, unknown, o->num_k,
+                                       neighbors);
+    if (std::find(o->confidence_types->begin(), o->confidence_types->end(),
+                  int(CONFIDENCE_NUN)) != o->confidence_types->end()) {
+      evaluations += index.nearest(o->distance_type, unknown, 1, unlike,
+                                   DifferentClass(o->class_ids,
+                                                  o->class_ids[neighbors[0].second]));
+      neighbors.insert(neighbors.end(), unlike.begin(), unlike.end());
+    }
+    double max_distance;
+    evaluations += index.farthest(o->distance_type, unknown, max_distance);
+    std::sort(neighbors.begin(), neighbors.end(), neighbor_index_less());
+    neighbors.erase(std::unique(neighbors.begin(), neighbors.end(),
+                                neighbor_index_equal()), neighbors.end());
+    for (size_t i = 0; i < neighbors.size(); ++i)
+      knn.add(o->class_ids[neighbors[i].second], neighbors[i].first);
+    knn.add_distance(max_distance);
+    return evaluations;
+  }
+
+  /*
+    Adds the same neighbors to knn as add_indexed_neighbors, scanning the
+    feature vectors in reduced precision. Only the feature vectors whose
+    approximate distance leaves them a chance to be one of the k nearest
+    neighbors, the nearest unlike neighbor or the farthest feature vector
+    are compared to the unknown in double precision.
+  */
+  template<class KNN>
+  void add_reduced_neighbors(KnnObject* o, const CompactFeatures& compact,
+                             const ReducedFeatures& reduced,
+                             const double* unknown, KNN& knn) {
+    DistanceType type = o->distance_type;
+    size_t n = reduced.size();
+    if (n == 0)
+      return;
+    std::vector<double> mapped(reduced.stride()), approximate(n);
+    reduced.map_unknown(unknown, &mapped[0]);
+    reduced.distances(type, &mapped[0], &approximate[0]);
+
+    std::vector<double> sorted(approximate);
+    size_t k = std::min(o->num_k, n);
+    std::nth_element(sorted.begin(), sorted.begin() + (k - 1), sorted.end());
+    double kth = reduced.upper_bound(type, sorted[k - 1]);
+    std::vector<KnnIndex::neighbor_type> neighbors;
+    for (size_t i = 0; i < n; ++i) {
+      if (reduced.lower_bound(type, approximate[i]) <= kth)
+        neighbors.push_back(std::make_pair(
+          compute_distance_padded(type, compact.vectors[i], unknown,
+                                  compact.weights[0], compact.stride()), i));
+    }
+    size_t nearest = std::min_element(neighbors.begin(), neighbors.end())->second;
+
+    if (std::find(o->confidence_types->begin(), o->confidence_types->end(),
+                  int(CONFIDENCE_NUN)) != o->confidence_types->end()) {
+      DifferentClass unlike(o->class_ids, o->class_ids[nearest]);
+      double closest = std::numeric_limits<double>::max();
+      for (size_t i = 0; i < n; ++i)
+        if (unlike(i))
+          closest = std::min(closest, approximate[i]);
+      closest = reduced.upper_bound(type, closest);
+      for (size_t i = 0; i < n; ++i) {
+        if (unlike(i) && reduced.lower_bound(type, approximate[i]) <= closest)
+          neighbors.push_back(std::make_pair(
+            compute_distance_padded(type, compact.vectors[i], unknown,
+                                    compact.weights[0], compact.stride()), i));
+      }
+    }
+
+    double farthest = reduced.lower_bound(
+      type, *std::max_element(approximate.begin(), approximate.end()));
+    double max_distance = 0.0;
+    for (size_t i = 0; i < n; ++i) {
+      if (reduced.upper_bound(type, approximate[i]) >= farthest)
+        max_distance = std::max(max_distance,
+          compute_distance_padded(type, compact.vectors[i], unknown,
+                                  compact.weights[0], compact.stride()));
+    }
+
+    std::sort(neighbors.begin(), neighbors.end(), neighbor_index_less());
+    neighbors.erase(std::unique(neighbors.begin(), neighbors.end(),
+                                neighbor_index_equal()), neighbors.end());
+    for (size_t i = 0; i < neighbors.size(); ++i)
+      knn.add(o->class_ids[neighbors[i].second], neighbors[i].first);
+    knn.add_distance(max_distance);
+  }
+
+  /*
+    Adds the feature vectors to knn for the classification of the compacted
+    unknown, searching index if it is not 0, scanning the reduced precision
+    feature vectors if there are any, and adding all feature vectors
+    otherwise. Returns the number of distance computations of the index.
+    This only reads from o, compact and index, so it may run concurrently.
+  */
+  template<class KNN>
+  size_t add_neighbors(KnnObject* o, const CompactFeatures& compact,
+                       const KnnIndex* index, const double* unknown, KNN& knn) {
+    if (index != 0)
+      return add_indexed_neighbors(o, *index, unknown, knn);
+    if (o->reduced != 0) {
+      add_reduced_neighbors(o, compact, *o->reduced, unknown, knn);
+      return 0;
+    }
+    for (size_t i = 0; i < compact.vectors.size(); ++i) {
+      double distance = compute_distance_padded(o->distance_type,
+                                                compact.vectors[i], unknown,
+                                                compact.weights[0],
+                                                compact.stride());
+      knn.add(o->class_ids[i], distance);
+    }
+    return 0;
+  }
+
+  /*
+    The number of threads for the loops over the feature vectors: none
+    when running inside a parallel region already (e.g. the fitness
+    evaluations of the genetic algorithms).
+  */
+  inline int knn_num_threads() {
+#ifdef _OPENMP
+    return omp_in_parallel() ? 1 : omp_get_max_threads();
+#else
+    return 1;
+#endif
+  }
+
+  /*
+    Whether feature vector i is classified correctly by the other feature
+    vectors, using the compacted feature vectors.
+  */
+  inline bool leave_one_out_query(DistanceType distance_type,
+                                  const CompactFeatures& compact,
+                                  const int* class_ids,
+                                  size_t i, ClassNeighbors& knn) {
+    const double* unknown = compact.vectors[i];
+    for (size_t j = 0; j < compact.vectors.size(); ++j) {
+      if (i == j)
+        continue;
+      double distance = compute_distance_padded(distance_type,
+                                                compact.vectors[j], unknown,
+                                                compact.weights[0],
+                                                compact.stride());
+      knn.add(class_ids[j], distance);
+    }
+    knn.majority();
+    bool correct = knn.answer[0].first == class_ids[i];
+    knn.reset();
+    return correct;
+  }
+
+  inline bool leave_one_out_query(KnnObject* o, const CompactFeatures& compact,
+                                  size_t i, ClassNeighbors& knn) {
+    return leave_one_out_query(o->distance_type, compact, o->class_ids, i, knn);
+  }
+
+  /*
+    Whether feature vector i is classified correctly by the other feature
+    vectors, using only the features in indexes.
+  */
+  inline bool leave_one_out_query(KnnObject* o, const int* selections,
+                                  const double* weights,
+                                  const std::vector<long>& indexes,
+                                  size_t i, ClassNeighbors& knn) {
+    const double* unknown = (*o->feature_vectors)[i];
+    for (size_t j = 0; j < o->feature_vectors->size(); ++j) {
+      if (i == j)
+        continue;
+      const double* current_known = (*o->feature_vectors)[j];
+      double distance;
+      if (o->distance_type == CITY_BLOCK) {
+        distance = city_block_distance_skip(current_known, unknown, selections, weights,
+                                            indexes.begin(), indexes.end());
+      } else if (o->distance_type == FAST_EUCLIDEAN) {
+        distance = fast_euclidean_distance_skip(current_known, unknown, selections, weights,
+                                                indexes.begin(), indexes.end());
+      } else {
+        distance = euclidean_distance_skip(current_known, unknown, selections, weights,
+                                           indexes.begin(), indexes.end());
+      }
+      knn.add(o->class_ids[j], distance);
+    }
+    knn.majority();
+    bool correct = knn.answer[0].first == o->class_ids[i];
+    knn.reset();
+    return correct;
+  }
+
+  /*
+    Leave-one-out cross validation: returns the number of correctly
+    classified feature vectors and the number of classified feature
+    vectors. Feature vectors whose class has too few examples for a
+    correct answer are skipped. The evaluation stops as soon as more
+    than stop_threshold feature vectors are misclassified.
+
+    The feature vectors are classified in parallel in blocks, and the
+    results of each block are counted in the order of the feature vectors,
+    so that the result (also when stopping early) does not depend on the
+    number of threads.
+  */
   static std::pair<int,int> leave_one_out(KnnObject* o, int stop_threshold,
                                           int* selection_vector = 0,
                                           double* weight_vector = 0,
@@ -108,73 +616,176 @@ namespace Gamera { namespace kNN {
     }
 
     assert(o->feature_vectors != 0);
-    kNearestNeighbors<char*, ltstr, eqstr> knn(o->num_k);
+
+    // We don't want to do the calculation if there is no
+    // hope that kNN will return the correct answer (because
+    // there aren't enough examples in the database).
+    std::vector<size_t> queries;
+    for (size_t i = 0; i < o->feature_vectors->size(); ++i)
+      if (o->id_name_histogram[i] >= int((o->num_k + 0.5) / 2))
+        queries.push_back(i);
+
+    // leave_one_out may run concurrently for different selections and
+    // weights, so it uses its own compacted feature vectors
+    CompactFeatures* compact = 0;
+    if (indexes == 0)
+      compact = new CompactFeatures(*o->feature_vectors, selections, weights,
+                                    true);
+
+    int num_threads = knn_num_threads();
+    size_t block_size = queries.size();
+    if (stop_threshold < std::numeric_limits<int>::max())
+      block_size = 16 * num_threads;
+    std::vector<char> correct(std::min(block_size, queries.size()));
 
     int total_correct = 0;
     int total_queries = 0;
-    if (indexes == 0) {
-      for (size_t i = 0; i < o->feature_vectors->size(); ++i/*, cur += o->num_features*/) {
-        // We don't want to do the calculation if there is no
-        // hope that kNN will return the correct answer (because
-        // there aren't enough examples in the database).
-        if (o->id_name_histogram[i] < int((o->num_k + 0.5) / 2)) {
-          continue;
-        }
-        double* current_known;
-        double* unknown = (*o->feature_vectors)[i];
-        for (size_t j = 0; j < o->feature_vectors->size(); ++j) {
-          current_known = (*o->feature_vectors)[j];
-          if (i == j)
-            continue;
-          double distance;
-          compute_distance(o->distance_type, current_known, o->num_features,
-                           unknown, &distance, selections, weights);
-          knn.add(o->id_names[j], distance);
+    for (size_t start = 0; start < queries.size(); start += block_size) {
+      long end = long(std::min(start + block_size, queries.size()));
+#ifdef _OPENMP
+#pragma omp parallel num_threads(num_threads) if(num_threads > 1)
+#endif
+      {
+        ClassNeighbors knn(o->num_k, o->num_classes);
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic, 4)
+#endif
+        for (long q = long(start); q < end; ++q) {
+          if (compact != 0)
+            correct[q - start] = leave_one_out_query(o, *compact, queries[q], knn);
+          else
+            correct[q - start] = leave_one_out_query(o, selections, weights,
+                                                     *indexes, queries[q], knn);
         }
-        knn.majority();
-        if (strcmp(knn.answer[0].first, o->id_names[i]) == 0) {
+      }
+      for (long q = long(start); q < end; ++q) {
+        if (correct[q - start])
           total_correct++;
-        }
-        knn.reset();
         total_queries++;
-        if (total_queries - total_correct > stop_threshold)
+        if (total_queries - total_correct > stop_threshold) {
+          delete compact;
           return std::make_pair(total_correct, total_queries);
+        }
+      }
+    }
+    delete compact;
+    return std::make_pair(total_correct, total_queries);
+  }
+
+  /*
+    Wilson's editing (MNN): marks the feature vectors that are
+    misclassified by the k nearest of the other feature vectors. The
+    feature vectors are classified in parallel.
+  */
+  inline void edit_mnn(DistanceType distance_type, const CompactFeatures& compact,
+                       const int* class_ids, size_t num_classes, size_t k,
+                       std::vector<char>& misclassified) {
+    long n = long(compact.vectors.size());
+    misclassified.assign(n, 0);
+    if (n < 2)
+      return;
+    int num_threads = knn_num_threads();
+#ifdef _OPENMP
+#pragma omp parallel num_threads(num_threads) if(num_threads > 1)
+#endif
+    {
+      ClassNeighbors knn(k, num_classes);
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic, 4)
+#endif
+      for (long i = 0; i < n; ++i)
+        misclassified[i] = !leave_one_out_query(distance_type, compact,
+                                                class_ids, i, knn);
+    }
+  }
+
+  /*
+    Adds feature vector s to the store of the CNN editing and updates the
+    k nearest stored neighbors (distance, class) of all feature vectors
+    not stored yet. Neighbors at equal distances are kept in the order
+    they were stored, as the kNearestNeighbors object does.
+  */
+  inline void edit_cnn_store(DistanceType distance_type,
+                             const CompactFeatures& compact,
+                             const int* class_ids, size_t k, size_t s,
+                             std::vector<std::pair<double, int> >& nearest,
+                             std::vector<size_t>& num_nearest,
+                             std::vector<char>& stored,
+                             std::vector<size_t>& store, int num_threads) {
+    stored[s] = 1;
+    store.push_back(s);
+    const double* added = compact.vectors[s];
+    long n = long(compact.vectors.size());
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(num_threads) if(num_threads > 1) schedule(static)
+#endif
+    for (long j = 0; j < n; ++j) {
+      if (stored[j])
+        continue;
+      double distance = compute_distance_padded(distance_type,
+                                                compact.vectors[j], added,
+                                                compact.weights[0],
+                                                compact.stride());
+      std::pair<double, int>* first = &nearest[j * k];
+      size_t pos;
+      if (num_nearest[j] < k) {
+        pos = num_nearest[j]++;
+      } else if (distance < first[k - 1].first) {
+        pos = k - 1;
+      } else {
+        continue;
       }
-    } else {
-      for (size_t i = 0; i < o->feature_vectors->size(); ++i) {
-        if (o->id_name_histogram[i] < int((o->num_k + 0.5) / 2))
+      for (; pos > 0 && distance < first[pos - 1].first; --pos)
+        first[pos] = first[pos - 1];
+      first[pos] = std::make_pair(distance, class_ids[s]);
+    }
+  }
+
+  /*
+    Hart's condensing (CNN): starting with feature vector 0, the feature
+    vectors are visited in order, and each one that is misclassified by
+    the k nearest feature vectors in the store is added to it, until a
+    pass over the feature vectors adds none. store receives the indexes
+    of the stored feature vectors in the order they were added.
+
+    Instead of scanning the store for every classification, the k nearest
+    stored neighbors of each feature vector are updated (in parallel)
+    whenever a feature vector is stored, so that every distance is only
+    computed once.
+  */
+  inline void edit_cnn(DistanceType distance_type, const CompactFeatures& compact,
+                       const int* class_ids, size_t num_classes, size_t k,
+                       std::vector<size_t>& store) {
+    size_t n = compact.vectors.size();
+    store.clear();
+    if (n == 0)
+      return;
+    std::vector<std::pair<double, int> > nearest(n * k);
+    std::vector<size_t> num_nearest(n, 0);
+    std::vector<char> stored(n, 0);
+    int num_threads = knn_num_threads();
+    edit_cnn_store(distance_type, compact, class_ids, k, 0, nearest,
+                   num_nearest, stored, store, num_threads);
+    ClassNeighbors knn(k, num_classes);
+    bool changed = true;
+    while (changed) {
+      changed = false;
+      for (size_t i = 1; i < n; ++i) {
+        if (stored[i])
           continue;
-        double* current_known;
-        double* unknown = (*o->feature_vectors)[i];
-        for (size_t j = 0; j < o->feature_vectors->size(); ++j) {
-          current_known = (*o->feature_vectors)[j];
-          if (i == j)
-            continue;
-          double distance;
-          if (o->distance_type == CITY_BLOCK) {
-            distance = city_block_distance_skip(current_known, unknown, selections, weights,
-                                                indexes->begin(), indexes->end());
-          } else if (o->distance_type == FAST_EUCLIDEAN) {
-            distance = fast_euclidean_distance_skip(current_known, unknown, selections, weights,
-                                                    indexes->begin(), indexes->end());
-          } else {
-            distance = euclidean_distance_skip(current_known, unknown, selections, weights,
-                                               indexes->begin(), indexes->end());
-          }
-
-          knn.add(o->id_names[j], distance);
-        }
+        const std::pair<double, int>* first = &nearest[i * k];
+        for (size_t j = 0; j < num_nearest[i]; ++j)
+          knn.add(first[j].second, first[j].first);
         knn.majority();
-        if (strcmp(knn.answer[0].first, o->id_names[i]) == 0) {
-          total_correct++;
-        }
+        bool correct = knn.answer[0].first == class_ids[i];
         knn.reset();
-        total_queries++;
-        if (total_queries - total_correct > stop_threshold)
-          return std::make_pair(total_correct, total_queries);
+        if (!correct) {
+          edit_cnn_store(distance_type, compact, class_ids, k, i, nearest,
+                         num_nearest, stored, store, num_threads);
+          changed = true;
+        }
       }
     }
-    return std::make_pair(total_correct, total_queries);
   }
 
 }} // end of namespaces
@@ -168,6 +168,8 @@ namespace Gamera { namespace GA {
                 typename EOT::const_iterator it;
 
                 std::ostringstream indiStream;
+                // enough digits to read the weights back exactly
+                indiStream.precision(std::numeric_limits<double>::digits10 + 2);
 
                 indiStream << "[";
                 for (it = bestIndi.begin(); it != bestIndi.end(); ++it) {
@@ -248,10 +250,60 @@ namespace Gamera { namespace GA {
         return true;
     }
 
+    // maximum number of cached fitness values
+    const size_t GA_FITNESS_CACHE_SIZE = 1 << 16;
+    // maximum number of pairwise distances kept for incremental evaluation
+    // (128 MB; see GAFitnessEval)
+    const size_t GA_PAIR_DISTANCES_SIZE = 1 << 24;
+
+    /**************************************************************************/
+    class GAPairDistances {
+    /**************************************************************************/
+    // The distances between all pairs (i, j), i < j, of feature vectors
+    // (packed row by row) for one feature weighting, where deselected
+    // features have the weight 0. It is shared read-only by the fitness
+    // evaluations and deleted with its last reference.
+        public:
+            std::vector<double> weights;
+            std::vector<double> distances;
+            int references;
+    };
+
+    /**************************************************************************/
+    struct GAEvalBuffers {
+    /**************************************************************************/
+    // the full length selection and weight vectors into which one thread
+    // converts the individuals it evaluates
+        std::vector<int> selections;
+        std::vector<double> weights;
+    };
+
+    // the contribution of a single feature to the distance
+    struct GACityBlockTerm {
+        double operator()(double a, double b) const { return std::abs(a - b); }
+    };
+    struct GAEuclideanTerm {
+        double operator()(double a, double b) const { return std::sqrt((a - b) * (a - b)); }
+    };
+    struct GAFastEuclideanTerm {
+        double operator()(double a, double b) const { return (a - b) * (a - b); }
+    };
+
     // *************************************************************************
     template <typename EOT>
     class GAFitnessEval : public eoEvalFunc<EOT> {
     // *************************************************************************
+    // Fitness: the leave-one-out recognition rate. The fitness of each
+    // evaluated individual is cached, because selection and replacement
+    // keep producing equal individuals. When the pairwise distances fit into
+    // GA_PAIR_DISTANCES_SIZE, the distances of the last fully evaluated
+    // individual are kept, and individuals differing from it in a few
+    // features only are evaluated by correcting these distances. The
+    // corrected distances differ from the ones of leave_one_out by rounding,
+    // so the neighbors that might be among the k nearest are computed again
+    // like in leave_one_out, and the fitness is always exactly the same.
+    // While a new reference replaces the old one, both are alive, which
+    // takes up to 2 * 8 * GA_PAIR_DISTANCES_SIZE bytes (256 MB).
         protected:
             KnnObject *knn;
             std::map<unsigned int, unsigned int> *indexRelation;
@@ -259,56 +311,403 @@ namespace Gamera { namespace GA {
             typedef typename EOT::ContainerType ContainerType;
             typedef typename EOT::AtomType AtomType;
 
+            std::map<std::vector<AtomType>, double> fitnessCache;
+
+            std::vector<size_t> queries;
+            std::vector<size_t> rowOffsets;
+            GAPairDistances *reference;
+            bool computingReference;
+
+            GAPairDistances *acquireReference() {
+                GAPairDistances *result;
+#ifdef _OPENMP
+#pragma omp critical(GAPairDistances)
+#endif
+                {
+                    result = this->reference;
+                    if (result != NULL) {
+                        result->references++;
+                    }
+                }
+                return result;
+            }
+
+            void releaseReference(GAPairDistances *distances) {
+                bool last;
+#ifdef _OPENMP
+#pragma omp critical(GAPairDistances)
+#endif
+                {
+                    last = --distances->references == 0;
+                }
+                if (last) {
+                    delete distances;
+                }
+            }
+
+            // the leave-one-out recognition rate, where the distance of each
+            // pair is taken from pairwise and corrected by delta[c] times
+            // the term of feature changed[c]. Corrected distances are only
+            // bounds: every pair whose distance may be among the k nearest
+            // is computed again from compact, the feature vectors compacted
+            // for the evaluated individual.
+            template <class Term>
+            double classifyPairs(const GAPairDistances &pairwise,
+                                 const CompactFeatures *compact,
+                                 const std::vector<size_t> &changed,
+                                 const std::vector<double> &delta, Term term) {
+                const FeatureMatrix &features = *this->knn->feature_vectors;
+                size_t n = features.size();
+                size_t k = std::min(this->knn->num_k, n - 1);
+                long numQueries = long(this->queries.size());
+                int numThreads = knn_num_threads();
+                int correct = 0;
+                // bound of the rounding errors of the corrected and of the
+                // recomputed distance, relative to the sum of the magnitudes
+                // of their terms
+                double tolerance = (2.0 * this->knn->num_features
+                                    + 4.0 * changed.size() + 32.0)
+                    * std::numeric_limits<double>::epsilon();
+#ifdef _OPENMP
+#pragma omp parallel num_threads(numThreads) if(numThreads > 1) reduction(+:correct)
+#endif
+                {
+                    ClassNeighbors nn(this->knn->num_k, this->knn->num_classes);
+                    std::vector<double> lower(n), upper(n);
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic, 4)
+#endif
+                    for (long q = 0; q < numQueries; ++q) {
+                        size_t i = this->queries[q];
+                        const double *unknown = features[i];
+                        for (size_t j = 0; j < n; ++j) {
+                            if (i == j) {
+                                continue;
+                            }
+                            size_t pos = (i < j) ? this->rowOffsets[i] + (j - i - 1)
+                                                 : this->rowOffsets[j] + (i - j - 1);
+                            double distance = pairwise.distances[pos];
+                            if (changed.empty()) {
+                                nn.add(this->knn->class_ids[j], distance);
+                                continue;
+                            }
+                            double magnitude = std::abs(distance);
+                            const double *known = features[j];
+                            for (size_t c = 0; c < changed.size(); ++c) {
+                                double correction = delta[c] * term(known[changed[c]],
+                                                                    unknown[changed[c]]);
+                                distance += correction;
+                                magnitude += std::abs(correction);
+                            }
+                            lower[j] = distance - tolerance * magnitude;
+                            upper[j] = distance + tolerance * magnitude;
+                        }
+                        if (!changed.empty()) {
+                            // no pair above the k-th smallest upper bound
+                            // can be among the k nearest
+                            upper[i] = std::numeric_limits<double>::max();
+                            lower[i] = upper[i];
+                            std::nth_element(upper.begin(), upper.begin() + (k - 1),
+                                             upper.end());
+                            double kth = upper[k - 1];
+                            for (size_t j = 0; j < n; ++j) {
+                                if (lower[j] <= kth) {
+                                    nn.add(this->knn->class_ids[j],
+                                           compute_distance_padded(this->knn->distance_type,
+                                                                   compact->vectors[j],
+                                                                   compact->vectors[i],
+                                                                   compact->weights[0],
+                                                                   compact->stride()));
+                                }
+                            }
+                        }
+                        nn.majority();
+                        if (nn.answer[0].first == this->knn->class_ids[i]) {
+                            correct++;
+                        }
+                        nn.reset();
+                    }
+                }
+                return correct / (double) numQueries;
+            }
+
+            double classifyPairs(const GAPairDistances &pairwise,
+                                 const CompactFeatures *compact,
+                                 const std::vector<size_t> &changed,
+                                 const std::vector<double> &delta) {
+                if (this->knn->distance_type == CITY_BLOCK) {
+                    return classifyPairs(pairwise, compact, changed, delta, GACityBlockTerm());
+                } else if (this->knn->distance_type == FAST_EUCLIDEAN) {
+                    return classifyPairs(pairwise, compact, changed, delta, GAFastEuclideanTerm());
+                } else {
+                    return classifyPairs(pairwise, compact, changed, delta, GAEuclideanTerm());
+                }
+            }
+
+            GAPairDistances *computePairs(int *selections, double *weights,
+                                          const std::vector<double> &effective) {
+                CompactFeatures compact(*this->knn->feature_vectors, selections,
+                                        weights, true);
+                GAPairDistances *result = new GAPairDistances();
+                result->weights = effective;
+                result->references = 1;
+                long n = long(compact.vectors.size());
+                result->distances.resize(n * (n - 1) / 2);
+                int numThreads = knn_num_threads();
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(numThreads) if(numThreads > 1) schedule(dynamic, 4)
+#endif
+                for (long i = 0; i < n; ++i) {
+                    double *row = &result->distances[0] + this->rowOffsets[i];
+                    for (long j = i + 1; j < n; ++j) {
+                        row[j - i - 1] = compute_distance_padded(this->knn->distance_type,
+                                                         compact.vectors[j],
+                                                         compact.vectors[i],
+                                                         compact.weights[0],
+                                                         compact.stride());
+                    }
+                }
+                return result;
+            }
+
+            double evaluatePairs(int *selections, double *weights) {
+                size_t numFeatures = this->knn->num_features;
+                std::vector<double> effective(numFeatures);
+                size_t active = 0;
+                for (size_t f = 0; f < numFeatures; ++f) {
+                    effective[f] = selections[f] ? weights[f] : 0.0;
+                    if (effective[f] != 0.0) {
+                        active++;
+                    }
+                }
+
+                std::vector<size_t> changed;
+                std::vector<double> delta;
+                GAPairDistances *pairwise = this->acquireReference();
+                if (pairwise != NULL) {
+                    for (size_t f = 0; f < numFeatures; ++f) {
+                        if (effective[f] != pairwise->weights[f]) {
+                            changed.push_back(f);
+                            delta.push_back(effective[f] - pairwise->weights[f]);
+                        }
+                    }
+                    if (4 * changed.size() <= active) {
+                        CompactFeatures compact(*this->knn->feature_vectors,
+                                                selections, weights, true);
+                        double fitness = this->classifyPairs(*pairwise, &compact,
+                                                             changed, delta);
+                        this->releaseReference(pairwise);
+                        return fitness;
+                    }
+                    this->releaseReference(pairwise);
+                }
+
+                // only one evaluation at a time computes new pairwise
+                // distances, the others use the plain leave-one-out
+                bool compute;
+#ifdef _OPENMP
+#pragma omp critical(GAPairDistances)
+#endif
+                {
+                    compute = !this->computingReference;
+                    this->computingReference = true;
+                }
+                if (!compute) {
+                    std::pair<int, int> looEvalRes =
+                        leave_one_out(this->knn, std::numeric_limits<int>::max(),
+                                      selections, weights, NULL);
+                    return looEvalRes.first / (double) looEvalRes.second;
+                }
+
+                pairwise = this->computePairs(selections, weights, effective);
+                double fitness = this->classifyPairs(*pairwise, NULL, std::vector<size_t>(),
+                                                     std::vector<double>());
+                GAPairDistances *previous;
+#ifdef _OPENMP
+#pragma omp critical(GAPairDistances)
+#endif
+                {
+                    previous = this->reference;
+                    this->reference = pairwise;
+                    this->computingReference = false;
+                }
+                if (previous != NULL) {
+                    this->releaseReference(previous);
+                }
+                return fitness;
+            }
+
+            double computeFitness(const EOT &individual, int *selections, double *weights) {
+                std::vector<AtomType> genes(individual.begin(), individual.end());
+                typename std::map<std::vector<AtomType>, double>::iterator it;
+                bool cached;
+                double fitness = 0.0;
+#ifdef _OPENMP
+#pragma omp critical(GAFitnessCache)
+#endif
+                {
+                    it = this->fitnessCache.find(genes);
+                    cached = it != this->fitnessCache.end();
+                    if (cached) {
+                        fitness = it->second;
+                    }
+                }
+                if (cached) {
+                    return fitness;
+                }
+
+                if (this->rowOffsets.empty()) {
+                    std::pair<int, int> looEvalRes =
+                        leave_one_out(this->knn, std::numeric_limits<int>::max(),
+                                      selections, weights, NULL);
+                    fitness = looEvalRes.first / (double) looEvalRes.second;
+                } else {
+                    fitness = this->evaluatePairs(selections != NULL ? selections : this->knn->selection_vector,
+                                                  weights != NULL ? weights : this->knn->weight_vector);
+                }
+
+#ifdef _OPENMP
+#pragma omp critical(GAFitnessCache)
+#endif
+                {
+                    if (this->fitnessCache.size() >= GA_FITNESS_CACHE_SIZE) {
+                        this->fitnessCache.clear();
+                    }
+                    this->fitnessCache[genes] = fitness;
+                }
+                return fitness;
+            }
+
         public:
             GAFitnessEval(KnnObject *knn, std::map<unsigned int, unsigned int> *indexRelation) {
                 this->knn = knn;
                 this->indexRelation = indexRelation;
+                this->reference = NULL;
+                this->computingReference = false;
+
+                // the same feature vectors as in leave_one_out are classified
+                size_t n = knn->feature_vectors->size();
+                for (size_t i = 0; i < n; ++i) {
+                    if (knn->id_name_histogram[i] >= int((knn->num_k + 0.5) / 2)) {
+                        this->queries.push_back(i);
+                    }
+                }
+                if (n > 1 && !this->queries.empty() &&
+                    n * (n - 1) / 2 <= GA_PAIR_DISTANCES_SIZE) {
+                    // the pairs of rows 0 to i - 1 come before row i
+                    this->rowOffsets.resize(n);
+                    for (size_t i = 0; i < n; ++i) {
+                        this->rowOffsets[i] = i * (2 * n - i - 1) / 2;
+                    }
+                }
+            }
+
+            ~GAFitnessEval() {
+                if (this->reference != NULL) {
+                    this->releaseReference(this->reference);
+                }
             }
 
             virtual std::string className(void) const { return "GAFitnessEval"; }
 
-            virtual void operator()( EOT &individual );
+            // evaluates the individual, converting it into the given buffers;
+            // evaluations with different buffers may run concurrently
+            void evaluate( EOT &individual, GAEvalBuffers &buffers );
+
+            virtual void operator()( EOT &individual ) {
+                GAEvalBuffers buffers;
+                this->evaluate(individual, buffers);
+            }
     };
 
     // specialization for weighting individual
     template <>
-    void GAFitnessEval<WeightingIndi>::operator()( WeightingIndi &individual ) {
-        AtomType* convertedVector = new AtomType[this->knn->num_features];
-        std::fill(convertedVector, convertedVector + this->knn->num_features, 0.0);
+    void GAFitnessEval<WeightingIndi>::evaluate( WeightingIndi &individual,
+                                                 GAEvalBuffers &buffers ) {
+        buffers.weights.assign(this->knn->num_features, 0.0);
 
         for (size_t i = 0; i < individual.size(); ++i) {
-            convertedVector[(*this->indexRelation)[i]] = individual[i];
+            buffers.weights[(*this->indexRelation)[i]] = individual[i];
         }
 
-        std::pair<int, int> looEvalRes;
-        looEvalRes = leave_one_out(this->knn, std::numeric_limits<int>::max(),
-                                   NULL, convertedVector, NULL);
-
-        individual.fitness( looEvalRes.first / (double) looEvalRes.second );
-        delete [] convertedVector;
+        individual.fitness( this->computeFitness(individual, NULL, &buffers.weights[0]) );
     }
 
     // specialization for selection individual
     template <>
-    void GAFitnessEval<SelectionIndi>::operator()( SelectionIndi &individual ) {
-        int* convertedVector = new int[this->knn->num_features];
-        std::fill(convertedVector, convertedVector + this->knn->num_features, 0);
+    void GAFitnessEval<SelectionIndi>::evaluate( SelectionIndi &individual,
+                                                 GAEvalBuffers &buffers ) {
+        buffers.selections.assign(this->knn->num_features, 0);
 
         for (size_t i = 0; i < individual.size(); ++i) {
             // §4.7/4 from the C++ Standard (Integral Conversion):
             // If the source type is bool, the value false is converted to zero
             // and the value true is converted to one.
-            convertedVector[(*this->indexRelation)[i]] = (int) individual[i];
+            buffers.selections[(*this->indexRelation)[i]] = (int) individual[i];
         }
 
-        std::pair<int, int> looEvalRes;
-        looEvalRes = leave_one_out(this->knn, std::numeric_limits<int>::max(),
-                                   convertedVector, NULL, NULL);
-
-        individual.fitness( looEvalRes.first / (double) looEvalRes.second );
-        delete [] convertedVector;
+        individual.fitness( this->computeFitness(individual, &buffers.selections[0], NULL) );
     }
 
+    // *************************************************************************
+    template <typename EOT>
+    class GAPopEval : public eoPopEvalFunc<EOT> {
+    // *************************************************************************
+    // Evaluates the invalid offspring on a team of threads, each converting
+    // the individuals into its own buffers, while the classifier is only
+    // read. When there are fewer individuals than threads, they are
+    // evaluated one after another, each by all threads.
+        protected:
+            GAFitnessEval<EOT> &eval;
+            eoEvalFuncCounter<EOT> &counter;
+            unsigned int threadNum;
+            std::vector<GAEvalBuffers> buffers;
+
+        public:
+            GAPopEval(GAFitnessEval<EOT> &eval, eoEvalFuncCounter<EOT> &counter,
+                      unsigned int threadNum)
+            : eval(eval), counter(counter), threadNum(std::max(threadNum, 1u)),
+              buffers(std::max(threadNum, 1u))
+            {}
+
+            virtual std::string className(void) const { return "GAPopEval"; }
+
+            void operator()(eoPop<EOT> &parents, eoPop<EOT> &offspring) {
+                std::vector<EOT*> invalid;
+                for (size_t i = 0; i < offspring.size(); ++i) {
+                    if (offspring[i].invalid()) {
+                        invalid.push_back(&offspring[i]);
+                    }
+                }
+                this->evaluate(invalid);
+            }
+
+            // evaluates the given (invalid) individuals
+            void evaluate(const std::vector<EOT*> &invalid) {
+                long numInvalid = long(invalid.size());
+
+#ifdef _OPENMP
+                int numThreads = int(this->threadNum);
+#pragma omp parallel num_threads(numThreads) if(numThreads > 1 && numInvalid >= numThreads)
+                {
+                    // when the region is not active, the evaluations use
+                    // numThreads threads instead; the setting only holds
+                    // inside the region
+                    omp_set_num_threads(numThreads);
+#pragma omp for schedule(dynamic, 1)
+                    for (long i = 0; i < numInvalid; ++i) {
+                        this->eval.evaluate(*invalid[i], this->buffers[omp_get_thread_num()]);
+                    }
+                }
+#else
+                for (long i = 0; i < numInvalid; ++i) {
+                    this->eval.evaluate(*invalid[i], this->buffers[0]);
+                }
+#endif
+                this->counter.value() += numInvalid;
+            }
+    };
+
     ////////////////////////////////////////////////////////////////////////////
     ////////////////////////////////////////////////////////////////////////////
     ////////////////////////////////////////////////////////////////////////////
@@ -349,6 +748,7 @@ namespace Gamera { namespace GA {
             unsigned int pSize;
             double cRate;
             double mRate;
+            unsigned int seed;
 
         public:
             GABaseSetting(int opMode = GA_SELECTION,
@@ -359,12 +759,14 @@ namespace Gamera { namespace GA {
             unsigned int getPopSize();
             double getCrossRate();
             double getMutRate();
+            unsigned int getSeed();
 
             // setter
             void setOpMode(int opMode);
             void setPopSize(unsigned int pSize);
             void setCrossRate(double cRate);
             void setMutRate(double mRate);
+            void setSeed(unsigned int seed);
     };
 
     /**************************************************************************/
@@ -454,6 +856,10 @@ namespace Gamera { namespace GA {
         protected:
             bool parallelMode;
             unsigned int threadNum;
+            unsigned int islands;
+            unsigned int migrationInterval;
+            unsigned int migrationSize;
+            bool asynchronous;
 
         public:
             GAParallelization(bool mode = true, unsigned int threads = 2);
@@ -463,6 +869,19 @@ namespace Gamera { namespace GA {
 
             unsigned int getThreadNum();
             void setThreadNum(unsigned int n = 2);
+
+            // island model: the number of sub-populations, and how many of
+            // the best individuals migrate to the next island how often
+            unsigned int getIslands();
+            void setIslands(unsigned int n = 1);
+            unsigned int getMigrationInterval();
+            void setMigrationInterval(unsigned int generations = 10);
+            unsigned int getMigrationSize();
+            void setMigrationSize(unsigned int n = 1);
+
+            // asynchronous steady-state mode
+            bool isAsynchronous();
+            void setAsynchronous(bool asynchronous = true);
     };
 
     /**************************************************************************/
@@ -495,6 +914,16 @@ namespace Gamera { namespace GA {
             std::ostringstream *monitorStream;
             std::ostringstream *bestIndiStream;
 
+            void runIslands(eoPop<EOT> &population, eoInit<EOT> &init,
+                            GAPopEval<EOT> &popEval, eoSelect<EOT> &select,
+                            eoTransform<EOT> &transform, eoReplacement<EOT> &replace,
+                            eoContinue<EOT> &checkpoint);
+            void runAsynchronous(eoPop<EOT> &population, GAFitnessEval<EOT> &eval,
+                                 eoEvalFuncCounter<EOT> &counter,
+                                 eoSelectOne<EOT> &select, eoQuadOp<EOT> &xover,
+                                 eoMonOp<EOT> &muta, eoContinue<EOT> &checkpoint,
+                                 unsigned int numThreads);
+
         public:
             GAOptimization<EOT>(KnnObject *knn,
                            GABaseSetting *baseSetting,
@@ -0,0 +1,417 @@
+/*
+ *
+ * Copyright (C) 2001-2009 Ichiro Fujinaga, Michael Droettboom,
+ *                         Karl MacMillan, and Christoph Dalitz
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef knnindex_HPP
+#define knnindex_HPP
+
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <utility>
+#include <cmath>
+#include "gameramodule.hpp"
+#include "knn.hpp"
+#include "knnmodule.hpp"
+
+namespace Gamera {
+  namespace kNN {
+
+    /*
+      KNN INDEX
+
+      A kd-tree over the rows of a FeatureMatrix for the exhaustive
+      searches of the non-interactive classifier. The distances are those
+      of compute_distance_padded with the weights the index was built for;
+      as all of them are sums of per-feature terms, the tree bounds hold
+      for every distance type and the same tree serves all of them.
+
+      The searches are exact: nearest returns the same neighbors as a scan
+      in the order of the feature vectors (ties are resolved towards the
+      smaller index), and farthest returns the largest distance to any
+      feature vector, which the kNN confidences are normalized with. The
+      latter uses a bounding ball (centroid and radius) per node.
+
+      In high dimensions a kd-tree may end up visiting most of the feature
+      vectors. The index therefore counts the distance computations of the
+      searches recorded with record, and reports itself as pointless when
+      they do not save at least half of a linear scan.
+    */
+    class KnnIndex {
+    public:
+      typedef std::pair<double, size_t> neighbor_type;
+
+      // searches admitting every feature vector
+      struct AdmitAll {
+        bool operator()(size_t) const { return true; }
+      };
+
+      /*
+        Whether an index pays off for the given number of feature vectors
+        and active features. Negative weights would break the bounds.
+      */
+      static bool applicable(size_t num_vectors, const double* weights,
+                             size_t num_features) {
+        if (num_vectors < min_vectors || num_features == 0)
+          return false;
+        for (size_t i = 0; i < num_features; ++i)
+          if (!(weights[i] > 0.0))
+            return false;
+        return true;
+      }
+
+      /*
+        Builds the index for the first num_features columns of vectors
+        (which must stay alive and unchanged) and the given weights.
+      */
+      KnnIndex(const FeatureMatrix& vectors, const double* weights,
+               size_t num_features)
+        : m_vectors(vectors), m_weights(weights),
+          m_num_features(num_features), m_order(vectors.size()),
+          m_centers(0), m_queries(0), m_evaluations(0), m_pointless(false) {
+        for (size_t i = 0; i < m_order.size(); ++i)
+          m_order[i] = i;
+        m_nodes.reserve(2 * (m_order.size() / (leaf_size / 2) + 1));
+        build(0, m_order.size());
+        compute_balls();
+      }
+      ~KnnIndex() {
+        delete m_centers;
+      }
+
+      /*
+        The k nearest feature vectors to unknown (with the padded length
+        of the rows) that are admitted by admit, sorted by distance and
+        index. Returns the number of distance computations.
+      */
+      template<class Admit>
+      size_t nearest(DistanceType distance_type, const double* unknown,
+                     size_t k, std::vector<neighbor_type>& result,
+                     const Admit& admit) const {
+        result.clear();
+        if (k == 0)
+          return 0;
+        NearestSearch<Admit> search(*this, distance_type, unknown, k,
+                                    result, admit);
+        search.run(0, 0.0);
+        return search.evaluations;
+      }
+      size_t nearest(DistanceType distance_type, const double* unknown,
+                     size_t k, std::vector<neighbor_type>& result) const {
+        return nearest(distance_type, unknown, k, result, AdmitAll());
+      }
+
+      /*
+        The largest distance of unknown to any of the feature vectors.
+        Returns the number of distance computations.
+      */
+      size_t farthest(DistanceType distance_type, const double* unknown,
+                      double& max_distance) const {
+        FarthestSearch search(*this, distance_type, unknown);
+        search.run(0);
+        max_distance = search.max_distance;
+        return search.evaluations;
+      }
+
+      /*
+        Adds the distance computations of a number of queries to the
+        statistics. This is not thread safe.
+      */
+      void record(size_t evaluations, size_t queries = 1) {
+        if (m_pointless)
+          return;
+        m_queries += queries;
+        m_evaluations += evaluations;
+        if (m_queries >= probe_queries) {
+          m_pointless = m_evaluations / m_queries > m_order.size() / 2;
+          m_queries = m_evaluations = 0;
+        }
+      }
+      // whether a linear scan is at least as fast as the index
+      bool pointless() const { return m_pointless; }
+
+      // indexes need at least this many feature vectors
+      static const size_t min_vectors = 256;
+
+    private:
+      static const size_t leaf_size = 16;
+      static const size_t probe_queries = 32;
+
+      struct Node {
+        // the range of the node in m_order
+        size_t begin, end;
+        // the child nodes, 0 for leaves
+        size_t left, right;
+        /*
+          The split feature and the largest and smallest value in that
+          feature of the left and the right child, respectively.
+        */
+        size_t feature;
+        double low, high;
+        // ball radius for the city block and the euclidean distances
+        double radius[2];
+      };
+
+      // index into Node::radius
+      static size_t metric(DistanceType distance_type) {
+        return distance_type == FAST_EUCLIDEAN ? 1 : 0;
+      }
+      /*
+        The distance converted to a metric (FAST_EUCLIDEAN is the square of
+        a metric, the other distances are metrics already).
+      */
+      static double to_metric(DistanceType distance_type, double distance) {
+        return distance_type == FAST_EUCLIDEAN ? std::sqrt(distance) : distance;
+      }
+      // the distance term of a single feature
+      static double term(DistanceType distance_type, double weight, double diff) {
+        return distance_type == FAST_EUCLIDEAN ?
+          weight * (diff * diff) : weight * std::abs(diff);
+      }
+      /*
+        Bounds are compared with a small tolerance, as they are summed in a
+        different order than the distances. Pruning a little less than
+        possible keeps the searches exact.
+      */
+      static double tolerance(double bound) {
+        return bound * 1e-9;
+      }
+
+      double distance(DistanceType distance_type, const double* a,
+                      const double* b) const {
+        return compute_distance_padded(distance_type, a, b, m_weights,
+                                       m_vectors.stride());
+      }
+
+      size_t build(size_t begin, size_t end) {
+        size_t n = m_nodes.size();
+        m_nodes.push_back(Node());
+        m_nodes[n].begin = begin;
+        m_nodes[n].end = end;
+        m_nodes[n].left = m_nodes[n].right = 0;
+        if (end - begin <= leaf_size)
+          return n;
+        // split at the median of the feature with the largest weighted spread
+        size_t feature = 0;
+        double spread = 0.0;
+        for (size_t j = 0; j < m_num_features; ++j) {
+          double lo = m_vectors[m_order[begin]][j], hi = lo;
+          for (size_t i = begin + 1; i < end; ++i) {
+            double v = m_vectors[m_order[i]][j];
+            if (v < lo) lo = v;
+            if (v > hi) hi = v;
+          }
+          if (m_weights[j] * (hi - lo) > spread) {
+            spread = m_weights[j] * (hi - lo);
+            feature = j;
+          }
+        }
+        if (!(spread > 0.0))
+          return n;
+        size_t middle = begin + (end - begin) / 2;
+        std::nth_element(m_order.begin() + begin, m_order.begin() + middle,
+                         m_order.begin() + end, FeatureLess(m_vectors, feature));
+        double low = m_vectors[m_order[begin]][feature];
+        for (size_t i = begin + 1; i < middle; ++i)
+          low = std::max(low, m_vectors[m_order[i]][feature]);
+        double high = m_vectors[m_order[middle]][feature];
+        size_t left = build(begin, middle);
+        size_t right = build(middle, end);
+        Node& node = m_nodes[n];
+        node.left = left;
+        node.right = right;
+        node.feature = feature;
+        node.low = low;
+        node.high = high;
+        return n;
+      }
+
+      void compute_balls() {
+        m_centers = new FeatureMatrix(m_nodes.size(), m_num_features);
+        for (size_t n = 0; n < m_nodes.size(); ++n) {
+          Node& node = m_nodes[n];
+          double* center = (*m_centers)[n];
+          for (size_t i = node.begin; i < node.end; ++i) {
+            const double* v = m_vectors[m_order[i]];
+            for (size_t j = 0; j < m_num_features; ++j)
+              center[j] += v[j];
+          }
+          for (size_t j = 0; j < m_num_features; ++j)
+            center[j] /= double(node.end - node.begin);
+          node.radius[0] = node.radius[1] = 0.0;
+          for (size_t i = node.begin; i < node.end; ++i) {
+            const double* v = m_vectors[m_order[i]];
+            node.radius[0] = std::max(node.radius[0],
+                                      distance(CITY_BLOCK, center, v));
+            node.radius[1] = std::max(node.radius[1],
+                                      std::sqrt(distance(FAST_EUCLIDEAN, center, v)));
+          }
+        }
+      }
+
+      class FeatureLess {
+      public:
+        FeatureLess(const FeatureMatrix& vectors, size_t feature)
+          : m_vectors(vectors), m_feature(feature) {}
+        bool operator()(size_t a, size_t b) const {
+          return m_vectors[a][m_feature] < m_vectors[b][m_feature];
+        }
+      private:
+        const FeatureMatrix& m_vectors;
+        size_t m_feature;
+      };
+
+      /*
+        Depth first search with incrementally updated lower bounds: for
+        each feature, offsets holds the distance term to the nearest cut
+        on the path to the current node.
+      */
+      template<class Admit>
+      struct NearestSearch {
+        NearestSearch(const KnnIndex& index_, DistanceType distance_type_,
+                      const double* unknown_, size_t k_,
+                      std::vector<neighbor_type>& result_, const Admit& admit_)
+          : index(index_), distance_type(distance_type_), unknown(unknown_),
+            k(k_), result(result_), admit(admit_),
+            offsets(index_.m_num_features, 0.0), evaluations(0) {}
+        bool pruned(double bound) const {
+          if (result.size() < k)
+            return false;
+          double worst = result.back().first;
+          return bound > worst + tolerance(worst);
+        }
+        void run(size_t n, double bound) {
+          const Node& node = index.m_nodes[n];
+          if (node.left == 0) {
+            for (size_t i = node.begin; i < node.end; ++i) {
+              size_t id = index.m_order[i];
+              if (!admit(id))
+                continue;
+              neighbor_type candidate(index.distance(distance_type,
+                                                     index.m_vectors[id], unknown),
+                                      id);
+              ++evaluations;
+              if (result.size() < k || candidate < result.back()) {
+                result.insert(std::upper_bound(result.begin(), result.end(),
+                                               candidate), candidate);
+                if (result.size() > k)
+                  result.pop_back();
+              }
+            }
+            return;
+          }
+          double value = unknown[node.feature];
+          double weight = index.m_weights[node.feature];
+          double diff_low = value - node.low, diff_high = value - node.high;
+          size_t near_child, far_child;
+          double cut;
+          if (diff_low + diff_high < 0) {
+            near_child = node.left;
+            far_child = node.right;
+            cut = term(distance_type, weight, diff_high);
+          } else {
+            near_child = node.right;
+            far_child = node.left;
+            cut = term(distance_type, weight, diff_low);
+          }
+          run(near_child, bound);
+          double offset = offsets[node.feature];
+          bound += cut - offset;
+          if (!pruned(bound)) {
+            offsets[node.feature] = cut;
+            run(far_child, bound);
+            offsets[node.feature] = offset;
+          }
+        }
+        const KnnIndex& index;
+        DistanceType distance_type;
+        const double* unknown;
+        size_t k;
+        std::vector<neighbor_type>& result;
+        const Admit& admit;
+        std::vector<double> offsets;
+        size_t evaluations;
+      };
+
+      // Branch and bound over the bounding balls of the nodes.
+      struct FarthestSearch {
+        FarthestSearch(const KnnIndex& index_, DistanceType distance_type_,
+                       const double* unknown_)
+          : index(index_), distance_type(distance_type_), unknown(unknown_),
+            max_distance(0.0), evaluations(0) {}
+        // the upper bound of the metric distance to the vectors in node n
+        double bound(size_t n) {
+          ++evaluations;
+          return to_metric(distance_type,
+                           index.distance(distance_type, (*index.m_centers)[n],
+                                          unknown))
+            + index.m_nodes[n].radius[metric(distance_type)];
+        }
+        bool pruned(double bound) const {
+          double current = to_metric(distance_type, max_distance);
+          return bound + tolerance(bound) < current;
+        }
+        void run(size_t n) {
+          const Node& node = index.m_nodes[n];
+          if (node.left == 0) {
+            for (size_t i = node.begin; i < node.end; ++i) {
+              double d = index.distance(distance_type,
+                                        index.m_vectors[index.m_order[i]], unknown);
+              if (d > max_distance)
+                max_distance = d;
+            }
+            evaluations += node.end - node.begin;
+            return;
+          }
+          double left = bound(node.left), right = bound(node.right);
+          if (left >= right) {
+            run(node.left);
+            if (!pruned(right))
+              run(node.right);
+          } else {
+            run(node.right);
+            if (!pruned(left))
+              run(node.left);
+          }
+        }
+        const KnnIndex& index;
+        DistanceType distance_type;
+        const double* unknown;
+        double max_distance;
+        size_t evaluations;
+      };
+
+      const FeatureMatrix& m_vectors;
+      const double* m_weights;
+      size_t m_num_features;
+      std::vector<size_t> m_order;
+      std::vector<Node> m_nodes;
+      FeatureMatrix* m_centers;
+      size_t m_queries, m_evaluations;
+      bool m_pointless;
+
+      // not copyable
+      KnnIndex(const KnnIndex&);
+      KnnIndex& operator=(const KnnIndex&);
+    };
+
+  } // namespace kNN
+} // namespace Gamera
+
+#endif
@@ -40,6 +40,17 @@ enum DistanceType {
   FAST_EUCLIDEAN
 };
 
+/*
+  The precision in which the non-interactive classifier scans the feature
+  vectors (see ReducedFeatures). The results are the same for all of them.
+*/
+enum FeaturePrecision {
+  DOUBLE_FEATURES,
+  FLOAT_FEATURES,
+  INT16_FEATURES,
+  INT8_FEATURES
+};
+
 
 /*
   get the feature vector from an image. image argument _must_ an image - no
@@ -110,6 +121,23 @@ inline void compute_distance(DistanceType distance_type, const double* known_buf
 }
 
 
+/*
+  Compute the distance between two padded rows of compacted feature
+  vectors (see FeatureMatrix), with the selections already multiplied
+  into the weights.
+*/
+inline double compute_distance_padded(DistanceType distance_type,
+                                      const double* known,
+                                      const double* unknown,
+                                      const double* weights, size_t stride) {
+  if (distance_type == CITY_BLOCK)
+    return city_block_distance_padded(known, unknown, weights, stride);
+  else if (distance_type == FAST_EUCLIDEAN)
+    return fast_euclidean_distance_padded(known, unknown, weights, stride);
+  else
+    return euclidean_distance_padded(known, unknown, weights, stride);
+}
+
 /*
   Compute the distance between a known and an unknown image
   with weights. This version takes an image and a buffer
@@ -0,0 +1,251 @@
+/*
+ *
+ * Copyright (C) 2001-2009 Ichiro Fujinaga, Michael Droettboom,
+ *                         Karl MacMillan, and Christoph Dalitz
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef knnreduced_HPP
+#define knnreduced_HPP
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include "gameramodule.hpp"
+#include "knn.hpp"
+#include "knnmodule.hpp"
+
+namespace Gamera {
+  namespace kNN {
+
+    /*
+      DISTANCE KERNELS for reduced precision rows.
+
+      Like the kernels for padded rows, but the known feature vector is
+      stored as floats or integers. The differences and sums are computed
+      in double precision, so only the storage of the rows is approximate.
+    */
+    template<class T>
+    inline double city_block_distance_reduced(const T* known,
+                                              const double* unknown,
+                                              const double* weight, size_t n) {
+      double d0 = 0, d1 = 0, d2 = 0, d3 = 0;
+      for (size_t i = 0; i < n; i += 4) {
+        d0 += weight[i] * std::abs(unknown[i] - double(known[i]));
+        d1 += weight[i + 1] * std::abs(unknown[i + 1] - double(known[i + 1]));
+        d2 += weight[i + 2] * std::abs(unknown[i + 2] - double(known[i + 2]));
+        d3 += weight[i + 3] * std::abs(unknown[i + 3] - double(known[i + 3]));
+      }
+      return (d0 + d1) + (d2 + d3);
+    }
+
+    template<class T>
+    inline double fast_euclidean_distance_reduced(const T* known,
+                                                  const double* unknown,
+                                                  const double* weight, size_t n) {
+      double d0 = 0, d1 = 0, d2 = 0, d3 = 0;
+      for (size_t i = 0; i < n; i += 4) {
+        double e0 = unknown[i] - double(known[i]);
+        double e1 = unknown[i + 1] - double(known[i + 1]);
+        double e2 = unknown[i + 2] - double(known[i + 2]);
+        double e3 = unknown[i + 3] - double(known[i + 3]);
+        d0 += weight[i] * (e0 * e0);
+        d1 += weight[i + 1] * (e1 * e1);
+        d2 += weight[i + 2] * (e2 * e2);
+        d3 += weight[i + 3] * (e3 * e3);
+      }
+      return (d0 + d1) + (d2 + d3);
+    }
+
+    /*
+      REDUCED FEATURES
+
+      The rows of a FeatureMatrix stored in single precision or quantized
+      to 16 or 8 bit integers, for scanning the feature vectors with a
+      half, a quarter or an eighth of the memory traffic. The integers are
+      scaled per feature, such that the range of the feature maps to the
+      range of the integer type.
+
+      The approximate distances differ from the exact ones by at most a
+      bound that follows from the rounding error of each feature, so the
+      exact distances can be bounded from the approximate ones (see
+      lower_bound and upper_bound). This lets the classifier compute the
+      exact distances only for the feature vectors that may matter, with
+      the same result as a scan in double precision. (EUCLIDEAN is a
+      weighted sum of absolute differences like CITY_BLOCK, and
+      FAST_EUCLIDEAN a weighted norm, for which the triangle inequality
+      bounds the error of its square root.)
+    */
+    class ReducedFeatures {
+    public:
+      /*
+        Whether the rows can be reduced for the given weights: the error
+        bounds require them to be non-negative.
+      */
+      static bool applicable(FeaturePrecision precision, const double* weights,
+                             size_t num_features) {
+        if (precision == DOUBLE_FEATURES)
+          return false;
+        for (size_t j = 0; j < num_features; ++j)
+          if (!(weights[j] >= 0.0))
+            return false;
+        return true;
+      }
+      // weights are those of the vectors, with the padded length of its rows
+      ReducedFeatures(FeaturePrecision precision, const FeatureMatrix& vectors,
+                      const double* weights)
+        : m_precision(precision), m_rows(vectors.size()),
+          m_stride(vectors.stride()),
+          m_scale(m_stride, 1.0), m_offset(m_stride, 0.0),
+          m_weights(m_stride, 0.0), m_square_weights(m_stride, 0.0),
+          m_error(0.0), m_square_error(0.0) {
+        size_t num_features = vectors.num_features();
+        size_t size;
+        if (precision == FLOAT_FEATURES)
+          size = sizeof(float);
+        else if (precision == INT16_FEATURES)
+          size = sizeof(short);
+        else
+          size = sizeof(signed char);
+        m_buffer = new char[m_rows * m_stride * size + ALIGNMENT];
+        m_data = (char*)(((size_t)m_buffer + ALIGNMENT - 1)
+                         & ~size_t(ALIGNMENT - 1));
+        std::fill(m_data, m_data + m_rows * m_stride * size, 0);
+        for (size_t j = 0; j < num_features; ++j) {
+          double low = 0.0, high = 0.0;
+          if (m_rows > 0)
+            low = high = vectors[0][j];
+          for (size_t i = 1; i < m_rows; ++i) {
+            low = std::min(low, vectors[i][j]);
+            high = std::max(high, vectors[i][j]);
+          }
+          // the largest rounding error of the feature
+          double error;
+          if (precision == FLOAT_FEATURES) {
+            error = std::max(std::abs(low), std::abs(high))
+              * std::numeric_limits<float>::epsilon() / 2;
+          } else {
+            double levels = precision == INT16_FEATURES ? 32767.0 : 127.0;
+            m_offset[j] = (low + high) / 2;
+            if (high > low)
+              m_scale[j] = levels / ((high - low) / 2);
+            error = 0.5 / m_scale[j];
+          }
+          m_weights[j] = weights[j] / m_scale[j];
+          m_square_weights[j] = weights[j] / (m_scale[j] * m_scale[j]);
+          m_error += weights[j] * error;
+          m_square_error += weights[j] * error * error;
+        }
+        m_square_error = std::sqrt(m_square_error);
+        if (precision == FLOAT_FEATURES)
+          fill((float*)m_data, vectors);
+        else if (precision == INT16_FEATURES)
+          fill((short*)m_data, vectors, 32767);
+        else
+          fill((signed char*)m_data, vectors, 127);
+      }
+      ~ReducedFeatures() {
+        delete[] m_buffer;
+      }
+      FeaturePrecision precision() const { return m_precision; }
+      size_t size() const { return m_rows; }
+      // the length of the padded rows, and of mapped unknowns
+      size_t stride() const { return m_stride; }
+      // maps a padded unknown feature vector to the scale of the rows
+      void map_unknown(const double* unknown, double* out) const {
+        for (size_t j = 0; j < m_stride; ++j)
+          out[j] = (unknown[j] - m_offset[j]) * m_scale[j];
+      }
+      // the approximate distances of all rows to a mapped unknown
+      void distances(DistanceType type, const double* mapped, double* out) const {
+        if (m_precision == FLOAT_FEATURES)
+          distances((const float*)m_data, type, mapped, out);
+        else if (m_precision == INT16_FEATURES)
+          distances((const short*)m_data, type, mapped, out);
+        else
+          distances((const signed char*)m_data, type, mapped, out);
+      }
+      /*
+        The smallest and largest exact distance of a row with the given
+        approximate distance. They are widened by a relative margin for
+        the rounding of the sums.
+      */
+      double lower_bound(DistanceType type, double approximate) const {
+        if (type == FAST_EUCLIDEAN) {
+          double root = std::sqrt(approximate) - m_square_error;
+          return root > 0.0 ? root * root * (1.0 - margin()) : 0.0;
+        }
+        return (approximate - m_error) * (1.0 - margin());
+      }
+      double upper_bound(DistanceType type, double approximate) const {
+        if (type == FAST_EUCLIDEAN) {
+          double root = std::sqrt(approximate) + m_square_error;
+          return root * root * (1.0 + margin());
+        }
+        return (approximate + m_error) * (1.0 + margin());
+      }
+    private:
+      static double margin() { return 1e-9; }
+      enum { ALIGNMENT = 32 };
+      // not copyable
+      ReducedFeatures(const ReducedFeatures&);
+      ReducedFeatures& operator=(const ReducedFeatures&);
+      void fill(float* data, const FeatureMatrix& vectors) {
+        for (size_t i = 0; i < m_rows; ++i)
+          for (size_t j = 0; j < vectors.num_features(); ++j)
+            data[i * m_stride + j] = float(vectors[i][j]);
+      }
+      template<class T>
+      void fill(T* data, const FeatureMatrix& vectors, int levels) {
+        for (size_t i = 0; i < m_rows; ++i) {
+          for (size_t j = 0; j < vectors.num_features(); ++j) {
+            double value = (vectors[i][j] - m_offset[j]) * m_scale[j];
+            value = std::floor(value + 0.5);
+            data[i * m_stride + j] =
+              T(std::max(-double(levels), std::min(double(levels), value)));
+          }
+        }
+      }
+      template<class T>
+      void distances(const T* data, DistanceType type, const double* mapped,
+                     double* out) const {
+        if (type == FAST_EUCLIDEAN) {
+          for (size_t i = 0; i < m_rows; ++i)
+            out[i] = fast_euclidean_distance_reduced(data + i * m_stride, mapped,
+                                                     &m_square_weights[0], m_stride);
+        } else {
+          for (size_t i = 0; i < m_rows; ++i)
+            out[i] = city_block_distance_reduced(data + i * m_stride, mapped,
+                                                 &m_weights[0], m_stride);
+        }
+      }
+      FeaturePrecision m_precision;
+      size_t m_rows, m_stride;
+      char* m_buffer;
+      char* m_data;
+      // the mapping of the features to the scale of the rows
+      std::vector<double> m_scale, m_offset;
+      // the weights for the scale of the rows
+      std::vector<double> m_weights, m_square_weights;
+      // the largest error of an approximate distance, or of its square root
+      double m_error, m_square_error;
+    };
+
+  }
+}
+
+#endif
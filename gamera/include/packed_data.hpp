@@ -0,0 +1,510 @@
+/*
+ *
+ * Copyright (C) 2001-2005 Ichiro Fujinaga, Michael Droettboom, and Karl MacMillan
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+  Bit-packed Image Data (one bit per pixel)
+
+  This is a third storage format for OneBit images, next to the dense
+  ImageData (one OneBitPixel per pixel) and the run-length compressed
+  RleImageData.  Every pixel occupies a single bit, and each row starts
+  on a fresh 64 bit word, so that algorithms can process whole rows
+  64 pixels at a time with shifts, boolean word operations and bit
+  counts.
+
+  Data Layout
+  -----------
+
+  Pixel (col, row) of the data is bit (col % 64) of word
+  (row * words_per_row + col / 64).  The least significant bit of a
+  word is the leftmost pixel.  Bits in the last word of a row beyond
+  ncols are always kept zero, so that word-wise bit counts need no
+  masking.
+
+  Limitations
+  -----------
+
+  Only the values 0 (white) and 1 (black) can be stored.  Labels
+  written by connected component analysis are therefore lost, and no
+  ConnectedComponent type is provided for this storage format.  Use
+  the dense format for labeling.
+
+  Random access through the iterators works like for the other
+  storage types, but requires a division per access to split the
+  linear position into row and column.  Algorithms that care for
+  speed should work on the rows returned by row_words().
+*/
+
+#ifndef cd17102026_packed_data
+#define cd17102026_packed_data
+
+#include "image_data.hpp"
+#include "dimensions.hpp"
+#include "accessor.hpp"
+#include "vigra/sized_int.hxx"
+
+#include <vector>
+#include <algorithm>
+#include <iterator>
+
+namespace Gamera {
+
+  namespace PackedDataDetail {
+
+    typedef vigra::UInt64 word_type;
+
+    static const size_t WORD_BITS = 64;
+    static const size_t WORD_SHIFT = 6;
+    static const size_t WORD_MASK = WORD_BITS - 1;
+
+    inline size_t words_for_bits(size_t nbits) {
+      return (nbits + WORD_BITS - 1) >> WORD_SHIFT;
+    }
+
+    /*
+      Mask with the lowest n bits set (0 <= n <= 64).
+    */
+    inline word_type low_mask(size_t n) {
+      if (n >= WORD_BITS)
+        return ~word_type(0);
+      return (word_type(1) << n) - 1;
+    }
+
+    /*
+      Number of set bits in a word.
+    */
+    inline size_t popcount(word_type w) {
+#if defined(__GNUC__)
+      return (size_t)__builtin_popcountll(w);
+#else
+      w = w - ((w >> 1) & 0x5555555555555555ULL);
+      w = (w & 0x3333333333333333ULL) + ((w >> 2) & 0x3333333333333333ULL);
+      w = (w + (w >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+      return (size_t)((w * 0x0101010101010101ULL) >> 56);
+#endif
+    }
+
+    /*
+      Index of the lowest set bit of a non-zero word.
+    */
+    inline size_t lowest_bit(word_type w) {
+#if defined(__GNUC__)
+      return (size_t)__builtin_ctzll(w);
+#else
+      size_t i = 0;
+      while (!(w & 1)) {
+        w >>= 1;
+        ++i;
+      }
+      return i;
+#endif
+    }
+
+    /*
+      Reads 64 bits of a packed row starting at bit position col.  Bits
+      beyond the end of the row are returned as zero.
+    */
+    inline word_type load_bits(const word_type* row, size_t nwords, size_t col) {
+      size_t w = col >> WORD_SHIFT;
+      size_t shift = col & WORD_MASK;
+      if (w >= nwords)
+        return 0;
+      word_type result = row[w] >> shift;
+      if (shift && w + 1 < nwords)
+        result |= row[w + 1] << (WORD_BITS - shift);
+      return result;
+    }
+
+    /*
+      Writes the lowest n bits (n <= 64) of bits into a packed row,
+      starting at bit position col.  Other bits of the row are left
+      untouched.
+    */
+    inline void store_bits(word_type* row, size_t col, word_type bits, size_t n) {
+      size_t w = col >> WORD_SHIFT;
+      size_t shift = col & WORD_MASK;
+      word_type mask = low_mask(n);
+      bits &= mask;
+      row[w] = (row[w] & ~(mask << shift)) | (bits << shift);
+      if (shift && shift + n > WORD_BITS) {
+        size_t rest = WORD_BITS - shift;
+        row[w + 1] = (row[w + 1] & ~(mask >> rest)) | (bits >> rest);
+      }
+    }
+
+    /*
+      PackedProxy
+
+      Like the RLEProxy, this is returned by the non-const iterators
+      instead of a reference, because single bits cannot be referenced.
+    */
+    template<class T>
+    // T is the PackedVector type
+    class PackedProxy {
+    public:
+      typedef typename T::value_type value_type;
+
+      PackedProxy(T* vec, size_t pos) : m_vec(vec), m_pos(pos) { }
+      void operator=(value_type v) {
+        m_vec->set(m_pos, v);
+      }
+      operator value_type() const {
+        return m_vec->get(m_pos);
+      }
+    private:
+      T* m_vec;
+      size_t m_pos;
+    };
+
+    /*
+      PackedVectorIterator and ConstPackedVectorIterator provide STL style
+      random access to the packed data.  They only store the linear
+      pixel position and split it into row and column on access.
+    */
+    template<class V, class Iterator>
+    class PackedVectorIteratorBase {
+    public:
+      typedef typename V::value_type value_type;
+      typedef int difference_type;
+      typedef std::random_access_iterator_tag iterator_category;
+
+      typedef Iterator self;
+
+      PackedVectorIteratorBase() : m_vec(0), m_pos(0) { }
+      PackedVectorIteratorBase(V* vec, size_t pos) : m_vec(vec), m_pos(pos) { }
+
+      self& operator++() {
+        ++m_pos;
+        return (self&)*this;
+      }
+      self operator++(int) {
+        self tmp = (self&)*this;
+        ++m_pos;
+        return tmp;
+      }
+      self& operator--() {
+        --m_pos;
+        return (self&)*this;
+      }
+      self operator--(int) {
+        self tmp = (self&)*this;
+        --m_pos;
+        return tmp;
+      }
+      self& operator+=(size_t n) {
+        m_pos += n;
+        return (self&)*this;
+      }
+      self operator+(size_t n) const {
+        self tmp = (const self&)*this;
+        tmp.m_pos += n;
+        return tmp;
+      }
+      self& operator-=(size_t n) {
+        m_pos -= n;
+        return (self&)*this;
+      }
+      self operator-(size_t n) const {
+        self tmp = (const self&)*this;
+        tmp.m_pos -= n;
+        return tmp;
+      }
+      bool operator==(const self& other) const {
+        return m_pos == other.m_pos;
+      }
+      bool operator!=(const self& other) const {
+        return m_pos != other.m_pos;
+      }
+      bool operator<(const self& other) const {
+        return m_pos < other.m_pos;
+      }
+      bool operator<=(const self& other) const {
+        return m_pos <= other.m_pos;
+      }
+      bool operator>(const self& other) const {
+        return m_pos > other.m_pos;
+      }
+      bool operator>=(const self& other) const {
+        return m_pos >= other.m_pos;
+      }
+      difference_type operator-(const self& other) const {
+        return m_pos - other.m_pos;
+      }
+      value_type get() const {
+        return m_vec->get(m_pos);
+      }
+    protected:
+      V* m_vec;
+      size_t m_pos;
+    };
+
+    template<class V>
+    class PackedVectorIterator
+      : public PackedVectorIteratorBase<V, PackedVectorIterator<V> > {
+    public:
+      typedef PackedVectorIterator self;
+      typedef PackedVectorIteratorBase<V, self> base;
+
+      using base::m_vec;
+      using base::m_pos;
+
+      typedef PackedProxy<V> proxy_type;
+      typedef proxy_type reference;
+      typedef proxy_type pointer;
+
+      PackedVectorIterator() : base() { }
+      PackedVectorIterator(V* vec, size_t pos) : base(vec, pos) { }
+
+      proxy_type operator*() const {
+        return proxy_type(m_vec, m_pos);
+      }
+      void set(const typename base::value_type& v) {
+        m_vec->set(m_pos, v);
+      }
+    };
+
+    template<class V>
+    class ConstPackedVectorIterator
+      : public PackedVectorIteratorBase<V, ConstPackedVectorIterator<V> > {
+    public:
+      typedef ConstPackedVectorIterator self;
+      typedef PackedVectorIteratorBase<V, self> base;
+
+      using base::m_vec;
+      using base::m_pos;
+
+      typedef void reference;
+      typedef typename V::value_type* pointer;
+
+      ConstPackedVectorIterator() : base() { }
+      ConstPackedVectorIterator(V* vec, size_t pos) : base(vec, pos) { }
+
+      typename V::value_type operator*() const {
+        return m_vec->get(m_pos);
+      }
+    };
+
+    /*
+      PackedVector is a bit vector that is organized in rows of ncols
+      bits, each padded to a whole number of words.
+    */
+    template<class Data>
+    class PackedVector {
+    public:
+      typedef PackedProxy<PackedVector> proxy_type;
+      typedef Data value_type;
+      typedef proxy_type reference;
+      typedef proxy_type pointer;
+      typedef int difference_type;
+      typedef PackedVector self;
+
+      // iterators
+      typedef PackedVectorIterator<self> iterator;
+      typedef ConstPackedVectorIterator<const self> const_iterator;
+
+      PackedVector(size_t size = 0, size_t ncols = 1)
+        : m_size(size), m_ncols(ncols ? ncols : 1) {
+        m_words_per_row = words_for_bits(m_ncols);
+        m_data.resize(rows_for(m_size) * m_words_per_row, 0);
+      }
+
+      size_t size() const { return m_size; }
+      size_t words_per_row() const { return m_words_per_row; }
+
+      /*
+        Changes the size and the row length.  The pixels are kept in
+        their linear order (like ImageData does), which means that
+        changing the row length shuffles them into new rows.
+      */
+      void resize(size_t size, size_t ncols) {
+        if (ncols == 0)
+          ncols = 1;
+        if (ncols == m_ncols) {
+          size_t old_size = m_size;
+          m_size = size;
+          m_data.resize(rows_for(m_size) * m_words_per_row, 0);
+          if (size < old_size)
+            clear_tail();
+          return;
+        }
+        self tmp(size, ncols);
+        size_t smallest = std::min(m_size, size);
+        for (size_t i = 0; i < smallest; ++i)
+          tmp.set(i, get(i));
+        swap(tmp);
+      }
+
+      void swap(self& other) {
+        std::swap(m_size, other.m_size);
+        std::swap(m_ncols, other.m_ncols);
+        std::swap(m_words_per_row, other.m_words_per_row);
+        m_data.swap(other.m_data);
+      }
+
+      /*
+        Pixel access by linear position.
+      */
+      value_type get(size_t pos) const {
+        size_t row = pos / m_ncols;
+        size_t col = pos - row * m_ncols;
+        return value_type((m_data[row * m_words_per_row + (col >> WORD_SHIFT)]
+                           >> (col & WORD_MASK)) & 1);
+      }
+
+      void set(size_t pos, value_type v) {
+        size_t row = pos / m_ncols;
+        size_t col = pos - row * m_ncols;
+        word_type bit = word_type(1) << (col & WORD_MASK);
+        word_type& w = m_data[row * m_words_per_row + (col >> WORD_SHIFT)];
+        if (v)
+          w |= bit;
+        else
+          w &= ~bit;
+      }
+
+      reference operator[](size_t pos) {
+        return proxy_type(this, pos);
+      }
+
+      /*
+        Word access for the row based algorithms.
+      */
+      word_type* row_words(size_t row) {
+        return &m_data[row * m_words_per_row];
+      }
+      const word_type* row_words(size_t row) const {
+        return &m_data[row * m_words_per_row];
+      }
+
+      /*
+        Iterator access
+      */
+      iterator begin() {
+        return iterator(this, 0);
+      }
+      iterator end() {
+        return iterator(this, m_size);
+      }
+      const_iterator begin() const {
+        return const_iterator(this, 0);
+      }
+      const_iterator end() const {
+        return const_iterator(this, m_size);
+      }
+
+    protected:
+      size_t rows_for(size_t size) const {
+        return (size + m_ncols - 1) / m_ncols;
+      }
+      // keeps the padding invariant when the last row was truncated
+      void clear_tail() {
+        if (m_size == 0)
+          return;
+        size_t last_row = (m_size - 1) / m_ncols;
+        size_t used = m_size - last_row * m_ncols;
+        word_type* row = row_words(last_row);
+        size_t w = used >> WORD_SHIFT;
+        if (w < m_words_per_row) {
+          row[w] &= low_mask(used & WORD_MASK);
+          for (++w; w < m_words_per_row; ++w)
+            row[w] = 0;
+        }
+      }
+
+      size_t m_size;
+      size_t m_ncols;
+      size_t m_words_per_row;
+      std::vector<word_type> m_data;
+    };
+  } // namespace PackedDataDetail
+
+  /*
+    This is a PackedVector with the additional interface necessary to
+    allow it to be used with an ImageView.
+  */
+  template<class T>
+  class PackedImageData : public PackedDataDetail::PackedVector<T>,
+                          public ImageDataBase {
+  public:
+    typedef PackedDataDetail::PackedVector<T> vector_type;
+    typedef PackedDataDetail::word_type word_type;
+    typedef T value_type;
+    typedef typename vector_type::reference reference;
+    typedef typename vector_type::pointer pointer;
+    typedef typename vector_type::iterator iterator;
+    typedef typename vector_type::const_iterator const_iterator;
+
+    using vector_type::size;
+
+    PackedImageData(const Size& size, const Point& offset)
+      : vector_type((size.height() + 1) * (size.width() + 1), size.width() + 1),
+        ImageDataBase(size, offset) {
+    }
+    PackedImageData(const Size& size)
+      : vector_type((size.height() + 1) * (size.width() + 1), size.width() + 1),
+        ImageDataBase(size) {
+    }
+    PackedImageData(const Dim& dim, const Point& offset)
+      : vector_type(dim.nrows() * dim.ncols(), dim.ncols()),
+        ImageDataBase(dim, offset) {
+    }
+    PackedImageData(const Dim& dim)
+      : vector_type(dim.nrows() * dim.ncols(), dim.ncols()),
+        ImageDataBase(dim) {
+    }
+
+    virtual size_t bytes() const {
+      return this->m_data.size() * sizeof(word_type);
+    }
+    virtual double mbytes() const { return bytes() / 1048576.0; }
+    virtual void dimensions(size_t rows, size_t cols) {
+      m_stride = cols;
+      do_resize(rows * cols);
+    }
+    virtual void dim(const Dim& dim) {
+      m_stride = dim.ncols();
+      do_resize(dim.nrows() * dim.ncols());
+    }
+    virtual Dim dim() const {
+      return Dim(m_stride, vector_type::m_size / m_stride);
+    }
+  protected:
+    virtual void do_resize(size_t size) {
+      vector_type::resize(size, m_stride);
+      ImageDataBase::m_size = size;
+    }
+  };
+
+  /*
+    Helpers for views on packed data.  packed_row returns the words of
+    row r of the view, and packed_col_offset the bit position of the
+    view's first column within these words.  Together with load_bits
+    and store_bits this allows word-wise processing of arbitrary views.
+  */
+  template<class View>
+  inline PackedDataDetail::word_type* packed_row(const View& view, size_t r) {
+    return view.data()->row_words(view.offset_y() + r - view.data()->page_offset_y());
+  }
+
+  template<class View>
+  inline size_t packed_col_offset(const View& view) {
+    return view.offset_x() - view.data()->page_offset_x();
+  }
+}
+
+#endif
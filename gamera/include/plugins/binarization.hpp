@@ -30,6 +30,10 @@
 
 #include <iostream>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 using namespace Gamera;
 
 /* Adaptive function for summing to double. */
@@ -144,6 +148,119 @@ FloatPixel image_variance(const T &src)
     return sum / area - mean * mean;
 }
 
+/* size_t row_band_count(size_t nrows, size_t min_rows, int num_threads)
+ *
+ * Number of horizontal bands in which the rows of an image are processed
+ * in parallel: one per thread (all OpenMP threads if num_threads <= 0),
+ * but no band shorter than min_rows.  Always 1 without OpenMP.
+ */
+inline size_t row_band_count(size_t nrows, size_t min_rows, int num_threads)
+{
+#ifdef _OPENMP
+    if (num_threads <= 0)
+        num_threads = omp_get_max_threads();
+    return std::max((size_t)1,
+                    std::min((size_t)num_threads, nrows / std::max(min_rows, (size_t)1)));
+#else
+    return 1;
+#endif
+}
+
+/* void for_each_row_band(size_t nrows, size_t nbands, const Band& band)
+ *
+ * Calls band(first_row, end_row) for nbands consecutive bands of rows,
+ * in parallel with OpenMP.  The bands of the regional algorithms below
+ * read half a region of rows above and below themselves (their halo),
+ * so the bands are made large compared to the region size.
+ */
+template<class Band>
+void for_each_row_band(size_t nrows, size_t nbands, const Band& band)
+{
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static, 1) num_threads((int)nbands)
+#endif
+    for (long i = 0; i < (long)nbands; ++i)
+        band(nrows * i / nbands, nrows * (i + 1) / nbands);
+}
+
+/* summed_area_tables
+ *
+ * Summed-area tables (integral images) of the pixel values and of their
+ * squares.  Entry (x, y) holds the sum over all pixels above and to the
+ * left of (x, y), so the sum over any rectangle is obtained from four
+ * entries and the regional statistics below cost O(1) per pixel,
+ * regardless of the region size.
+ *
+ * The regions are clipped at the image borders in the same way as in
+ * the original implementation of the thresholding algorithms.
+ */
+class summed_area_tables
+{
+public:
+    template<class T>
+    summed_area_tables(const T &src, size_t region_size)
+        : m_ncols(src.ncols()), m_nrows(src.nrows()),
+          m_half_region_size(region_size / 2),
+          m_sums((src.ncols() + 1) * (src.nrows() + 1), 0.0),
+          m_squares((src.ncols() + 1) * (src.nrows() + 1), 0.0)
+    {
+        const size_t stride = m_ncols + 1;
+        typename T::const_row_iterator row = src.row_begin();
+        typename T::const_col_iterator col;
+        ImageAccessor<typename T::value_type> acc;
+        for (size_t y = 1; row != src.row_end(); ++row, ++y) {
+            double row_sum = 0.0, row_squares = 0.0;
+            size_t x = 1;
+            for (col = row.begin(); col != row.end(); ++col, ++x) {
+                double value = (double)acc.get(col);
+                row_sum += value;
+                row_squares += value * value;
+                m_sums[y * stride + x] = m_sums[(y - 1) * stride + x] + row_sum;
+                m_squares[y * stride + x]
+                    = m_squares[(y - 1) * stride + x] + row_squares;
+            }
+        }
+    }
+
+    /* Region around (x, y) as the table positions of its upper left and
+     * (exclusive) lower right corner. */
+    void region(coord_t x, coord_t y, size_t& x0, size_t& y0,
+                size_t& x1, size_t& y1) const
+    {
+        x0 = (x > m_half_region_size) ? x - m_half_region_size : 0;
+        y0 = (y > m_half_region_size) ? y - m_half_region_size : 0;
+        x1 = std::min(x + m_half_region_size, m_ncols - 1) + 1;
+        y1 = std::min(y + m_half_region_size, m_nrows - 1) + 1;
+    }
+
+    FloatPixel mean(coord_t x, coord_t y) const
+    {
+        size_t x0, y0, x1, y1;
+        region(x, y, x0, y0, x1, y1);
+        return region_sum(m_sums, x0, y0, x1, y1) / ((x1 - x0) * (y1 - y0));
+    }
+
+    /* Mean of the squares in the region around (x, y). */
+    FloatPixel mean_square(coord_t x, coord_t y) const
+    {
+        size_t x0, y0, x1, y1;
+        region(x, y, x0, y0, x1, y1);
+        return region_sum(m_squares, x0, y0, x1, y1) / ((x1 - x0) * (y1 - y0));
+    }
+
+private:
+    double region_sum(const std::vector<double>& table, size_t x0, size_t y0,
+                      size_t x1, size_t y1) const
+    {
+        const size_t stride = m_ncols + 1;
+        return table[y1 * stride + x1] - table[y0 * stride + x1]
+            - table[y1 * stride + x0] + table[y0 * stride + x0];
+    }
+
+    size_t m_ncols, m_nrows, m_half_region_size;
+    std::vector<double> m_sums, m_squares;
+};
+
 /* Float mean_filter(Image src, size_t region_size);
  *
  * The implementation of region size is not entirely correct because of
@@ -156,25 +273,19 @@ FloatImageView* mean_filter(const T &src, size_t region_size)
     if ((region_size < 1) || (region_size > std::min(src.nrows(), src.ncols())))
         throw std::out_of_range("mean_filter: region_size out of range");
 
-    size_t half_region_size = region_size / 2;
+    summed_area_tables tables(src, region_size);
 
-    typename ImageFactory<T>::view_type* copy = ImageFactory<T>::new_view(src);
     FloatImageData* data = new FloatImageData(src.size(), src.origin());
     FloatImageView* view = new FloatImageView(*data);
-  
-    for (coord_t y = 0; y < src.nrows(); ++y) {
-        for (coord_t x = 0; x < src.ncols(); ++x) {
-            // Define the region.
-            Point ul((coord_t)std::max(0, (int)x - (int)half_region_size),
-                     (coord_t)std::max(0, (int)y - (int)half_region_size));
-            Point lr((coord_t)std::min(x + half_region_size, src.ncols() - 1),
-                     (coord_t)std::min(y + half_region_size, src.nrows() - 1));
-            copy->rect_set(ul, lr);
-            view->set(Point(x, y), image_mean(*copy));
-        }
-    }
 
-    delete copy;
+    const long nrows = (long)src.nrows();
+#ifdef _OPENMP
+#pragma omp parallel for num_threads((int)row_band_count(src.nrows(), 64, 0))
+#endif
+    for (long y = 0; y < nrows; ++y)
+        for (coord_t x = 0; x < src.ncols(); ++x)
+            view->set(Point(x, y), tables.mean(x, y));
+
     return view;
 }
 
@@ -194,76 +305,61 @@ FloatImageView* variance_filter(const T &src,
      if (src.size() != means.size())
         throw std::invalid_argument("variance_filter: sizes must match");
  
-    size_t half_region_size = region_size / 2;
+    summed_area_tables tables(src, region_size);
 
-    // Compute squares of each element. This step avoid repeating the squaring
-    // operation for overlapping regions.
-    FloatImageData* squaredData = new FloatImageData(src.size(), src.origin());
-    FloatImageView* squares = new FloatImageView(*squaredData);
-
-    transform(src.vec_begin(), 
-              src.vec_end(), 
-              squares->vec_begin(), 
-              double_squared<typename T::value_type>());
-  
     FloatImageData* data = new FloatImageData(src.size(), src.origin());
     FloatImageView* view = new FloatImageView(*data);  
 
-    for (coord_t y = 0; y < src.nrows(); ++y) {
+    const long nrows = (long)src.nrows();
+#ifdef _OPENMP
+#pragma omp parallel for num_threads((int)row_band_count(src.nrows(), 64, 0))
+#endif
+    for (long y = 0; y < nrows; ++y) {
         for (coord_t x = 0; x < src.ncols(); ++x) {
-            // Define the region.
-            Point ul((coord_t)std::max(0, (int)x - (int)half_region_size),
-                     (coord_t)std::max(0, (int)y - (int)half_region_size));
-            Point lr((coord_t)std::min(x + half_region_size, src.ncols() - 1),
-                     (coord_t)std::min(y + half_region_size, src.nrows() - 1));
-            squares->rect_set(ul, lr);
-            // Compute the variance.
-            FloatPixel sum
-                = std::accumulate(squares->vec_begin(), 
-                                  squares->vec_end(), 
-                                  (FloatPixel)0);
-            size_t area = squares->nrows() * squares->ncols();
             FloatPixel mean = means.get(Point(x,y));
-            view->set(Point(x, y), sum / area - mean * mean);
+            view->set(Point(x, y), tables.mean_square(x, y) - mean * mean);
         }
     }
     
-    delete squaredData;
-    delete squares;
     return view;
 }
 
 /*
  * Image wiener_filter(Image src, size_t region_size, double noise_variance);
  * 
+ * The rows are filtered in parallel by num_threads threads (all OpenMP
+ * threads if num_threads <= 0).
  */
 template<class T>
-T* wiener_filter(const T &src, size_t region_size, double noise_variance)
+T* wiener_filter(const T &src, size_t region_size, double noise_variance,
+                 int num_threads = 0)
 {
     if ((region_size < 1) || (region_size > std::min(src.nrows(), src.ncols())))
         throw std::out_of_range("niblack_threshold: region_size out of range");
     
     // Compute regional statistics.
-    const FloatImageView* means = mean_filter(src, region_size);
-    const FloatImageView* variances = variance_filter(src, *means, region_size);
+    summed_area_tables tables(src, region_size);
+    const size_t ncols = src.ncols();
+    const long nrows = (long)src.nrows();
+    const int nthreads = (int)row_band_count(src.nrows(), 64, num_threads);
 
     // Compute noise variance if needed.
     if (noise_variance < 0) {
-        FloatImageData* orderedVariancesData 
-            = new FloatImageData(variances->size(), variances->origin());
-        FloatImageView* orderedVariances 
-            = new FloatImageView(*orderedVariancesData);        
-        std::copy(variances->vec_begin(),
-                  variances->vec_end(),
-                  orderedVariances->vec_begin());
-        size_t area = orderedVariances->nrows() * orderedVariances->ncols();
-        std::nth_element(orderedVariances->vec_begin(),
-                         orderedVariances->vec_begin() + (area - 1) / 2,
-                         orderedVariances->vec_end());
-        noise_variance 
-            = (double)*(orderedVariances->vec_begin() + (area - 1) / 2);
-        delete orderedVariancesData;
-        delete orderedVariances;
+        std::vector<FloatPixel> variances(src.nrows() * ncols);
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(nthreads)
+#endif
+        for (long y = 0; y < nrows; ++y) {
+            for (coord_t x = 0; x < ncols; ++x) {
+                FloatPixel mean = tables.mean(x, y);
+                variances[y * ncols + x] = tables.mean_square(x, y) - mean * mean;
+            }
+        }
+        size_t area = variances.size();
+        std::nth_element(variances.begin(),
+                         variances.begin() + (area - 1) / 2,
+                         variances.end());
+        noise_variance = (double)variances[(area - 1) / 2];
     }
 
     typedef typename T::value_type value_type;
@@ -272,10 +368,13 @@ T* wiener_filter(const T &src, size_t region_size, double noise_variance)
     data_type* data = new data_type(src.size(), src.origin());
     view_type* view = new view_type(*data);
 
-    for (coord_t y = 0; y < src.nrows(); ++y) {
-        for (coord_t x = 0; x < src.ncols(); ++x) {
-            double mean = (double)means->get(Point(x, y));
-            double variance = (double)variances->get(Point(x, y));
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(nthreads)
+#endif
+    for (long y = 0; y < nrows; ++y) {
+        for (coord_t x = 0; x < ncols; ++x) {
+            double mean = (double)tables.mean(x, y);
+            double variance = (double)tables.mean_square(x, y) - mean * mean;
             // The estimate of noise variance will never be perfect, but in
             // theory, it would be impossible for any region to have a local
             // variance less than it. The following check eliminates that
@@ -292,11 +391,233 @@ T* wiener_filter(const T &src, size_t region_size, double noise_variance)
         }
     }
 
-    delete means->data(); delete means;
-    delete variances->data(); delete variances;
     return view;
 }
 
+/* sliding_region_sums
+ *
+ * Two sums over the region around each pixel of one row at a time, for
+ * algorithms that consume regional statistics in raster order.  The
+ * sums of each column over the rows of the current region are updated
+ * by adding the row entering the region and subtracting the row leaving
+ * it, so only a few rows of sums are kept instead of whole tables or
+ * float images.  The regions are the same as for summed_area_tables.
+ *
+ * Rows provides
+ *
+ *   void add_row(size_t y, double sign, double* first, double* second) const
+ *
+ * which adds sign times the contributions of row y to the column sums.
+ */
+template<class Rows>
+class sliding_region_sums
+{
+public:
+    sliding_region_sums(const Rows& rows, size_t ncols, size_t nrows,
+                        size_t region_size)
+        : m_rows(rows), m_ncols(ncols), m_nrows(nrows),
+          m_half_region_size(region_size / 2),
+          m_next_row((size_t)-1), m_rows_in_region(0),
+          m_column_firsts(ncols, 0.0), m_column_seconds(ncols, 0.0),
+          m_firsts(ncols + 1, 0.0), m_seconds(ncols + 1, 0.0) {}
+
+    /* Moves the region to row y.  Consecutive rows are updated
+     * incrementally, any other row starts the region afresh. */
+    void next_row(coord_t y)
+    {
+        if (y != m_next_row) {
+            std::fill(m_column_firsts.begin(), m_column_firsts.end(), 0.0);
+            std::fill(m_column_seconds.begin(), m_column_seconds.end(), 0.0);
+            size_t first = (y > m_half_region_size) ? y - m_half_region_size : 0;
+            size_t last = std::min(y + m_half_region_size, m_nrows - 1);
+            for (size_t r = first; r <= last; ++r)
+                m_rows.add_row(r, 1.0, &m_column_firsts[0], &m_column_seconds[0]);
+            m_rows_in_region = last - first + 1;
+        } else {
+            if (y > m_half_region_size) {
+                m_rows.add_row(y - m_half_region_size - 1, -1.0,
+                               &m_column_firsts[0], &m_column_seconds[0]);
+                --m_rows_in_region;
+            }
+            if (y + m_half_region_size < m_nrows) {
+                m_rows.add_row(y + m_half_region_size, 1.0,
+                               &m_column_firsts[0], &m_column_seconds[0]);
+                ++m_rows_in_region;
+            }
+        }
+        m_next_row = y + 1;
+        // prefix sums along the row
+        for (size_t x = 0; x < m_ncols; ++x) {
+            m_firsts[x + 1] = m_firsts[x] + m_column_firsts[x];
+            m_seconds[x + 1] = m_seconds[x] + m_column_seconds[x];
+        }
+    }
+
+    double first(coord_t x) const
+    {
+        size_t x0, x1;
+        region(x, x0, x1);
+        return m_firsts[x1] - m_firsts[x0];
+    }
+
+    double second(coord_t x) const
+    {
+        size_t x0, x1;
+        region(x, x0, x1);
+        return m_seconds[x1] - m_seconds[x0];
+    }
+
+    /* Number of pixels in the region around x. */
+    size_t area(coord_t x) const
+    {
+        size_t x0, x1;
+        region(x, x0, x1);
+        return (x1 - x0) * m_rows_in_region;
+    }
+
+private:
+    void region(coord_t x, size_t& x0, size_t& x1) const
+    {
+        x0 = (x > m_half_region_size) ? x - m_half_region_size : 0;
+        x1 = std::min(x + m_half_region_size, m_ncols - 1) + 1;
+    }
+
+    const Rows& m_rows;
+    size_t m_ncols, m_nrows, m_half_region_size, m_next_row, m_rows_in_region;
+    std::vector<double> m_column_firsts, m_column_seconds;
+    std::vector<double> m_firsts, m_seconds;
+};
+
+/* Rows of pixel values and their squares, for the regional mean and
+ * mean square.  For integer pixel types the results are identical to
+ * summed_area_tables. */
+template<class T>
+struct region_value_rows
+{
+    const T& src;
+    region_value_rows(const T& src) : src(src) {}
+
+    void add_row(size_t y, double sign, double* sums, double* squares) const
+    {
+        typename T::const_row_iterator row = src.row_begin() + y;
+        typename T::const_col_iterator col = row.begin();
+        ImageAccessor<typename T::value_type> acc;
+        for (size_t x = 0; col != row.end(); ++col, ++x) {
+            double value = (double)acc.get(col);
+            sums[x] += sign * value;
+            squares[x] += sign * value * value;
+        }
+    }
+};
+
+/* Band of regional_threshold; see below. */
+template<class T, class Thresholder>
+struct regional_threshold_band
+{
+    const T& src;
+    OneBitImageView& dest;
+    size_t region_size;
+    int lower_bound, upper_bound;
+    const Thresholder& thresholder;
+
+    regional_threshold_band(const T& src, OneBitImageView& dest,
+                            size_t region_size, int lower_bound,
+                            int upper_bound, const Thresholder& thresholder)
+        : src(src), dest(dest), region_size(region_size),
+          lower_bound(lower_bound), upper_bound(upper_bound),
+          thresholder(thresholder) {}
+
+    void operator()(size_t first_row, size_t end_row) const
+    {
+        region_value_rows<T> rows(src);
+        sliding_region_sums<region_value_rows<T> >
+            statistics(rows, src.ncols(), src.nrows(), region_size);
+
+        typename T::const_row_iterator src_row = src.row_begin() + first_row;
+        typename T::const_col_iterator src_col;
+        OneBitImageView::row_iterator dest_row = dest.row_begin() + first_row;
+        OneBitImageView::col_iterator dest_col;
+        ImageAccessor<typename T::value_type> src_acc;
+        ImageAccessor<OneBitPixel> dest_acc;
+        for (coord_t y = first_row; y < end_row; ++src_row, ++dest_row, ++y) {
+            statistics.next_row(y);
+            coord_t x = 0;
+            for (src_col = src_row.begin(), dest_col = dest_row.begin();
+                 src_col != src_row.end(); ++src_col, ++dest_col, ++x) {
+                // Check global thresholds and then threshold adaptively.
+                FloatPixel pixel_value = (FloatPixel)src_acc.get(src_col);
+                if (pixel_value < (FloatPixel)lower_bound) {
+                    dest_acc.set(black(dest), dest_col);
+                } else if (pixel_value >= (FloatPixel)upper_bound) {
+                    dest_acc.set(white(dest), dest_col);
+                } else {
+                    FloatPixel area = (FloatPixel)statistics.area(x);
+                    FloatPixel mean = statistics.first(x) / area;
+                    FloatPixel deviation
+                        = std::sqrt(statistics.second(x) / area - mean * mean);
+                    dest_acc.set(pixel_value > thresholder(mean, deviation)
+                                 ? white(dest) : black(dest), dest_col);
+                }
+            }
+        }
+    }
+};
+
+/* OneBit regional_threshold(GreyScale src, size_t region_size,
+ *                           int lower_bound, int upper_bound,
+ *                           Thresholder thresholder, int num_threads)
+ *
+ * Single pass over src for the adaptive thresholding algorithms based
+ * on the regional mean and standard deviation.  thresholder(mean,
+ * deviation) returns the threshold of a pixel; pixels below
+ * lower_bound are always black and pixels at or above upper_bound are
+ * always white.  Bands of rows are thresholded in parallel by
+ * num_threads threads (all OpenMP threads if num_threads <= 0).
+ */
+template<class T, class Thresholder>
+OneBitImageView* regional_threshold(const T &src,
+                                    size_t region_size,
+                                    int lower_bound,
+                                    int upper_bound,
+                                    const Thresholder& thresholder,
+                                    int num_threads = 0)
+{
+    typedef ImageFactory<OneBitImageView>::data_type data_type;
+    typedef ImageFactory<OneBitImageView>::view_type view_type;
+    data_type* data = new data_type(src.size(), src.origin());
+    view_type* view = new view_type(*data);
+
+    for_each_row_band(src.nrows(),
+                      row_band_count(src.nrows(), 4 * region_size, num_threads),
+                      regional_threshold_band<T, Thresholder>
+                      (src, *view, region_size, lower_bound, upper_bound,
+                       thresholder));
+    return view;
+}
+
+struct niblack_thresholder
+{
+    const double sensitivity;
+    niblack_thresholder(double sensitivity) : sensitivity(sensitivity) {}
+    FloatPixel operator()(FloatPixel mean, FloatPixel deviation) const
+        {
+            return mean + sensitivity * deviation;
+        }
+};
+
+struct sauvola_thresholder
+{
+    const double sensitivity;
+    const double dynamic_range;
+    sauvola_thresholder(double sensitivity, int dynamic_range)
+        : sensitivity(sensitivity), dynamic_range(dynamic_range) {}
+    FloatPixel operator()(FloatPixel mean, FloatPixel deviation) const
+        {
+            FloatPixel adjusted_deviation = 1.0 - deviation / dynamic_range;
+            return mean + (1.0 - sensitivity * adjusted_deviation);
+        }
+};
+
 /*
  * OneBit niblack_threshold(GreyScale src, 
  *                          size_t region_size, 
@@ -309,41 +630,14 @@ OneBitImageView* niblack_threshold(const T &src,
                                    size_t region_size, 
                                    double sensitivity,
                                    int lower_bound,
-                                   int upper_bound)
+                                   int upper_bound,
+                                   int num_threads = 0)
 {
     if ((region_size < 1) || (region_size > std::min(src.nrows(), src.ncols())))
         throw std::out_of_range("niblack_threshold: region_size out of range");
 
-    // Compute regional statistics.
-    const FloatImageView* means = mean_filter(src, region_size);
-    const FloatImageView* variances = variance_filter(src, *means, region_size);
-
-    typedef ImageFactory<OneBitImageView>::data_type data_type;
-    typedef ImageFactory<OneBitImageView>::view_type view_type;
-    data_type* data = new data_type(src.size(), src.origin());
-    view_type* view = new view_type(*data);
-
-    for (coord_t y = 0; y < src.nrows(); ++y) {
-        for (coord_t x = 0; x < src.ncols(); ++x) {
-            // Check global thresholds and then threshold adaptively.
-            FloatPixel pixel_value = (FloatPixel)src.get(Point(x, y));
-            if (pixel_value < (FloatPixel)lower_bound) {
-                view->set(Point(x, y), black(*view));
-            } else if (pixel_value >= (FloatPixel)upper_bound) {
-                view->set(Point(x, y), white(*view));
-            } else {
-                FloatPixel mean = means->get(Point(x, y));
-                FloatPixel deviation = std::sqrt(variances->get(Point(x, y)));
-                FloatPixel threshold = mean + sensitivity * deviation;
-                view->set(Point(x, y), 
-                          pixel_value > threshold ? white(*view) : black(*view));
-            }
-        }
-    }
-
-    delete means->data(); delete means;
-    delete variances->data(); delete variances;
-    return view;
+    return regional_threshold(src, region_size, lower_bound, upper_bound,
+                              niblack_thresholder(sensitivity), num_threads);
 }
 
 /*
@@ -360,110 +654,112 @@ OneBitImageView* sauvola_threshold(const T &src,
                                    double sensitivity,
                                    int dynamic_range,
                                    int lower_bound,
-                                   int upper_bound)
+                                   int upper_bound,
+                                   int num_threads = 0)
 {
     if ((region_size < 1) || (region_size > std::min(src.nrows(), src.ncols())))
         throw std::out_of_range("niblack_threshold: region_size out of range");
 
-    // Compute regional statistics.
-    const FloatImageView* means = mean_filter(src, region_size);
-    const FloatImageView* variances = variance_filter(src, *means, region_size);
+    return regional_threshold(src, region_size, lower_bound, upper_bound,
+                              sauvola_thresholder(sensitivity, dynamic_range),
+                              num_threads);
+}
 
-    typedef ImageFactory<OneBitImageView>::data_type data_type;
-    typedef ImageFactory<OneBitImageView>::view_type view_type;
-    data_type* data = new data_type(src.size(), src.origin());
-    view_type* view = new view_type(*data);
+/* Rows of the background pixels for gatos_background: the number of
+ * pixels that are white in the binarization and the sum of their values
+ * in src. */
+template<class T, class U>
+struct gatos_background_rows
+{
+    const T& src;
+    const U& binarization;
+    gatos_background_rows(const T& src, const U& binarization)
+        : src(src), binarization(binarization) {}
 
-    for (coord_t y = 0; y < src.nrows(); ++y) {
-        for (coord_t x = 0; x < src.ncols(); ++x) {
-            // Check global thresholds and then threshold adaptively.
-            FloatPixel pixel_value = (FloatPixel)src.get(Point(x, y));
-            if (pixel_value < (FloatPixel)lower_bound) {
-                view->set(Point(x, y), black(*view));
-            } else if (pixel_value >= (FloatPixel)upper_bound) {
-                view->set(Point(x, y), white(*view));
-            } else {
-                FloatPixel mean = means->get(Point(x, y));
-                FloatPixel deviation = std::sqrt(variances->get(Point(x, y)));
-                FloatPixel adjusted_deviation 
-                    = 1.0 - deviation / (FloatPixel)dynamic_range;
-                FloatPixel threshold 
-                    = mean + (1.0 - sensitivity * adjusted_deviation);
-                view->set(Point(x, y), 
-                          pixel_value > threshold ? white(*view) : black(*view));
+    void add_row(size_t y, double sign, double* counts, double* sums) const
+    {
+        typename T::const_row_iterator src_row = src.row_begin() + y;
+        typename T::const_col_iterator src_col = src_row.begin();
+        typename U::const_row_iterator bin_row = binarization.row_begin() + y;
+        typename U::const_col_iterator bin_col = bin_row.begin();
+        ImageAccessor<typename T::value_type> src_acc;
+        ImageAccessor<typename U::value_type> bin_acc;
+        for (size_t x = 0; src_col != src_row.end(); ++src_col, ++bin_col, ++x) {
+            if (!is_black(bin_acc.get(bin_col))) {
+                counts[x] += sign;
+                sums[x] += sign * (double)src_acc.get(src_col);
             }
         }
     }
+};
 
-    delete means->data(); delete means;
-    delete variances->data(); delete variances;
-    return view;
-}
+/* Band of gatos_background; see below. */
+template<class T, class U>
+struct gatos_background_band
+{
+    const T& src;
+    const U& binarization;
+    T& dest;
+    size_t region_size;
+
+    gatos_background_band(const T& src, const U& binarization, T& dest,
+                          size_t region_size)
+        : src(src), binarization(binarization), dest(dest),
+          region_size(region_size) {}
+
+    void operator()(size_t first_row, size_t end_row) const
+    {
+        typedef typename T::value_type value_type;
+        gatos_background_rows<T, U> rows(src, binarization);
+        sliding_region_sums<gatos_background_rows<T, U> >
+            background(rows, src.ncols(), src.nrows(), region_size);
+
+        for (coord_t y = first_row; y < end_row; ++y) {
+            background.next_row(y);
+            for (coord_t x = 0; x < src.ncols(); ++x) {
+                if (is_white(binarization.get(Point(x, y)))) {
+                    dest.set(Point(x, y), src.get(Point(x, y)));
+                } else {
+                    // Average of the background pixels in the region.
+                    double count = background.first(x);
+                    dest.set(Point(x, y),
+                             count > 0
+                             ? (value_type)(background.second(x) / count)
+                             : white(src));
+                }
+            }
+        }
+    }
+};
 
 /* 
  * Image* gatos_background(Image src, size_t region_size);
+ *
+ * The background pixels in the region around each pixel are counted
+ * and summed with sliding_region_sums, and bands of rows are processed
+ * in parallel by num_threads threads (all OpenMP threads if
+ * num_threads <= 0).
  */
 template<class T, class U>
 T* gatos_background(const T &src, 
                     const U &binarization, 
-                    size_t region_size)
+                    size_t region_size,
+                    int num_threads = 0)
 {
     if ((region_size < 1) || (region_size > std::min(src.nrows(), src.ncols())))
         throw std::out_of_range("gatos_background: region_size out of range");
     if (src.size() != binarization.size())
         throw std::invalid_argument("gatos_background: sizes must match");
  
-    size_t half_region_size = region_size / 2;
-
-    typename ImageFactory<T>::view_type* scopy 
-        = ImageFactory<T>::new_view(src);
-    typename ImageFactory<U>::view_type* bcopy
-        = ImageFactory<U>::new_view(binarization);
-
-    typedef std::pair<unsigned int, FloatPixel> gatos_pair;
-    typedef typename T::value_type src_value_type;
-    typedef typename U::value_type binarization_value_type;
-
     typedef typename ImageFactory<T>::data_type data_type;
     typedef typename ImageFactory<T>::view_type view_type;
     data_type* data = new data_type(src.size(), src.origin());
     view_type* view = new view_type(*data);
 
-    for (coord_t y = 0; y < src.nrows(); ++y) {
-        for (coord_t x = 0; x < src.ncols(); ++x) {
-            if (is_white(binarization.get(Point(x, y)))) {
-                view->set(Point(x, y), src.get(Point(x, y)));
-            } else {
-                // Define the region.
-                Point ul((coord_t)std::max(0, (int)x - (int)half_region_size),
-                         (coord_t)std::max(0, (int)y - (int)half_region_size));
-                Point lr((coord_t)std::min(x + half_region_size, src.ncols() - 1),
-                         (coord_t)std::min(y + half_region_size, src.nrows() - 1));
-                scopy->rect_set(ul, lr);
-                bcopy->rect_set(ul, lr);
-                // Count and accumulate background pixels.
-                gatos_pair sums =
-                    std::inner_product(bcopy->vec_begin(),
-                                       bcopy->vec_end(),
-                                       scopy->vec_begin(),
-                                       gatos_pair(0, 0.0),
-                                       pair_plus<gatos_pair>(),
-                                       gatos_accumulate
-                                       <
-                                       gatos_pair,
-                                       binarization_value_type,
-                                       src_value_type
-                                       >());
-                view->set(Point(x, y), 
-                          sums.first > 0
-                          ? (src_value_type)(sums.second / sums.first)
-                          : white(src));
-            }
-        }
-    }
-
-    delete scopy;
-    delete bcopy;
+    for_each_row_band(src.nrows(),
+                      row_band_count(src.nrows(), 4 * region_size, num_threads),
+                      gatos_background_band<T, U>
+                      (src, binarization, *view, region_size));
     return view;
 }
 
@@ -475,6 +771,10 @@ T* gatos_background(const T &src,
  *                       double q,
  *                       double p1,
  *                       double p2);
+ *
+ * The global statistics and the thresholding are computed row by row,
+ * in parallel by num_threads threads (all OpenMP threads if
+ * num_threads <= 0).
  */
 template<class T, class U>
 OneBitImageView* gatos_threshold(const T &src, 
@@ -482,7 +782,8 @@ OneBitImageView* gatos_threshold(const T &src,
                                  const U &binarization,
                                  double q,
                                  double p1,
-                                 double p2)
+                                 double p2,
+                                 int num_threads = 0)
 {
     if (src.size() != background.size())
         throw std::invalid_argument("gatos_threshold: sizes must match");
@@ -493,51 +794,133 @@ OneBitImageView* gatos_threshold(const T &src,
     typedef typename T::value_type base_value_type;
     typedef typename U::value_type binarization_value_type;
 
-    double delta_numerator 
-        = std::inner_product(src.vec_begin(),
-                             src.vec_end(),
-                             background.vec_begin(),
-                             (double)0,
-                             double_plus<base_value_type>(),
-                             std::minus<base_value_type>());
-    unsigned int delta_denominator
-        = std::count_if(binarization.vec_begin(),
-                        binarization.vec_end(),
-                        is_black<binarization_value_type>);
+    const long nrows = (long)src.nrows();
+    const int nthreads = (int)row_band_count(src.nrows(), 64, num_threads);
+
+    // The sums are sums of integers and thus do not depend on the order
+    // in which the rows are added up.
+    double delta_numerator = 0.0;
+    unsigned int delta_denominator = 0;
+    unsigned int b_count = 0;
+    double b_sum = 0.0;
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(nthreads) \
+    reduction(+:delta_numerator,delta_denominator,b_count,b_sum)
+#endif
+    for (long y = 0; y < nrows; ++y) {
+        typename T::const_row_iterator src_row = src.row_begin() + y;
+        typename T::const_row_iterator background_row = background.row_begin() + y;
+        typename U::const_row_iterator bin_row = binarization.row_begin() + y;
+        delta_numerator
+            += std::inner_product(src_row.begin(),
+                                  src_row.end(),
+                                  background_row.begin(),
+                                  (double)0,
+                                  double_plus<base_value_type>(),
+                                  std::minus<base_value_type>());
+        delta_denominator
+            += std::count_if(bin_row.begin(),
+                             bin_row.end(),
+                             is_black<binarization_value_type>);
+        gatos_pair b_sums
+            = std::inner_product(bin_row.begin(),
+                                 bin_row.end(),
+                                 background_row.begin(),
+                                 gatos_pair(0, 0.0),
+                                 pair_plus<gatos_pair>(),
+                                 gatos_accumulate
+                                 <
+                                 gatos_pair,
+                                 binarization_value_type,
+                                 base_value_type
+                                 >());
+        b_count += b_sums.first;
+        b_sum += b_sums.second;
+    }
     double delta = delta_numerator / (double)delta_denominator;
-                             
-    gatos_pair b_sums
-        = std::inner_product(binarization.vec_begin(),
-                             binarization.vec_end(),
-                             background.vec_begin(),
-                             gatos_pair(0, 0.0),
-                             pair_plus<gatos_pair>(),
-                             gatos_accumulate
-                             <
-                             gatos_pair,
-                             binarization_value_type,
-                             base_value_type
-                             >());
-    double b = (double)b_sums.second / (double)b_sums.first;
+    double b = b_sum / (double)b_count;
 
     typedef ImageFactory<OneBitImageView>::data_type data_type;
     typedef ImageFactory<OneBitImageView>::view_type view_type;
     data_type* data = new data_type(src.size(), src.origin());
     view_type* view = new view_type(*data);
 
-    std::transform(src.vec_begin(), 
-                   src.vec_end(),
-                   background.vec_begin(),
-                   view->vec_begin(),
-                   gatos_thresholder
-                   <
-                   typename T::value_type, 
-                   typename U::value_type
-                   >(q, delta, b, p1, p2));
+    gatos_thresholder<base_value_type, OneBitPixel>
+        thresholder(q, delta, b, p1, p2);
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(nthreads)
+#endif
+    for (long y = 0; y < nrows; ++y) {
+        typename T::const_row_iterator src_row = src.row_begin() + y;
+        typename T::const_row_iterator background_row = background.row_begin() + y;
+        view_type::row_iterator dest_row = view->row_begin() + y;
+        std::transform(src_row.begin(), 
+                       src_row.end(),
+                       background_row.begin(),
+                       dest_row.begin(),
+                       thresholder);
+    }
 
     return view;
 }
 
+/*
+ * OneBit gatos_binarization(GreyScale src,
+ *                           size_t wiener_region_size,
+ *                           double noise_variance,
+ *                           size_t region_size,
+ *                           double sensitivity,
+ *                           int dynamic_range,
+ *                           int lower_bound,
+ *                           int upper_bound,
+ *                           double q,
+ *                           double p1,
+ *                           double p2,
+ *                           int num_threads);
+ *
+ * The complete method of Gatos et al.: wiener_filter, sauvola_threshold
+ * of the filtered image, gatos_background and gatos_threshold.  Each
+ * step processes bands of rows in parallel; the steps themselves run one
+ * after the other, because the noise variance and the parameters of
+ * gatos_threshold are statistics over the whole image.
+ */
+template<class T>
+OneBitImageView* gatos_binarization(const T &src,
+                                    size_t wiener_region_size,
+                                    double noise_variance,
+                                    size_t region_size,
+                                    double sensitivity,
+                                    int dynamic_range,
+                                    int lower_bound,
+                                    int upper_bound,
+                                    double q,
+                                    double p1,
+                                    double p2,
+                                    int num_threads)
+{
+    size_t max_region_size = std::min(src.nrows(), src.ncols());
+    if ((wiener_region_size < 1) || (wiener_region_size > max_region_size))
+        throw std::out_of_range("gatos_binarization: wiener_region_size out of range");
+    if ((region_size < 1) || (region_size > max_region_size))
+        throw std::out_of_range("gatos_binarization: region_size out of range");
+
+    T* filtered = wiener_filter(src, wiener_region_size, noise_variance,
+                                num_threads);
+    OneBitImageView* binarization
+        = sauvola_threshold(*filtered, region_size, sensitivity, dynamic_range,
+                            lower_bound, upper_bound, num_threads);
+    T* background = gatos_background(*filtered, *binarization, region_size,
+                                     num_threads);
+    OneBitImageView* result
+        = gatos_threshold(*filtered, *background, *binarization, q, p1, p2,
+                          num_threads);
+
+    delete background->data(); delete background;
+    delete binarization->data(); delete binarization;
+    delete filtered->data(); delete filtered;
+    return result;
+}
+
 
 /*
  White Rohrer thresholding. This implementation uses code from
@@ -911,23 +1294,13 @@ OneBitImageView* white_rohrer_threshold (const T& in, int x_lookahead, int y_loo
  */
 template<class T>
 FloatVector* histogram_real_values(const T& image) {
+    std::vector<size_t> counts;
+    histogram_counts(image, counts);
+
     // The histogram is the size of all of the possible values of
     // the pixel type.
-    size_t l = std::numeric_limits<typename T::value_type>::max() + 1;
-    FloatVector* values = new FloatVector(l);
-
-    // set the list to 0
-    std::fill(values->begin(), values->end(), 0);
-
-    typename T::const_row_iterator row = image.row_begin();
-    typename T::const_col_iterator col;
-    ImageAccessor<typename T::value_type> acc;
-
-    // create the histogram
-    for (; row != image.row_end(); ++row)
-      for (col = row.begin(); col != row.end(); ++col)
-    (*values)[acc.get(col)]++;
-
+    FloatVector* values = new FloatVector(counts.size());
+    std::copy(counts.begin(), counts.end(), values->begin());
     return values;
 }
 
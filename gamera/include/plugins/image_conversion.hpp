@@ -826,5 +826,83 @@ namespace Gamera {
     return view;	
   }
 
+
+  /*
+    OneBitPackedImageView* to_packed(OneBit image);
+    OneBitImageView* packed_to_dense(OneBitPackedImageView image);
+
+    Conversion between the dense or run-length OneBit formats and the
+    bit-packed storage format (see packed_data.hpp).  As the packed
+    format only stores black and white, pixel labels are lost.
+  */
+  template<class T>
+  OneBitPackedImageView* to_packed(const T& image) {
+    using namespace PackedDataDetail;
+    typedef TypeIdImageFactory<ONEBIT, PACKED> fact_type;
+    OneBitPackedImageView* view = fact_type::create(image.origin(), image.dim());
+    view->resolution(image.resolution());
+    typename T::const_row_iterator in_row = image.row_begin();
+    typename T::const_col_iterator in_col;
+    for (size_t r = 0; in_row != image.row_end(); ++in_row, ++r) {
+      word_type* out = packed_row(*view, r);
+      size_t c = 0;
+      for (in_col = in_row.begin(); in_col != in_row.end(); ++in_col, ++c) {
+        if (is_black(*in_col))
+          out[c >> WORD_SHIFT] |= word_type(1) << (c & WORD_MASK);
+      }
+    }
+    return view;
+  }
+
+  /*
+    Dense OneBit views are packed straight from the rows of their data,
+    64 pixels to a word.
+  */
+  inline OneBitPackedImageView* to_packed(const OneBitImageView& image) {
+    using namespace PackedDataDetail;
+    typedef TypeIdImageFactory<ONEBIT, PACKED> fact_type;
+    OneBitPackedImageView* view = fact_type::create(image.origin(), image.dim());
+    view->resolution(image.resolution());
+    const OneBitImageData& data = *image.data();
+    const size_t stride = data.stride();
+    const OneBitPixel* first = data.begin()
+      + stride * (image.offset_y() - data.page_offset_y())
+      + (image.offset_x() - data.page_offset_x());
+    for (size_t r = 0; r < image.nrows(); ++r) {
+      const OneBitPixel* in = first + r * stride;
+      word_type* out = packed_row(*view, r);
+      for (size_t c = 0; c < image.ncols(); c += WORD_BITS) {
+        size_t n = std::min(WORD_BITS, image.ncols() - c);
+        word_type bits = 0;
+        for (size_t i = 0; i < n; ++i)
+          bits |= word_type(in[c + i] != 0) << i;
+        out[c >> WORD_SHIFT] = bits;
+      }
+    }
+    return view;
+  }
+
+  inline OneBitImageView* packed_to_dense(const OneBitPackedImageView& image) {
+    using namespace PackedDataDetail;
+    typedef TypeIdImageFactory<ONEBIT, DENSE> fact_type;
+    OneBitImageView* view = fact_type::create(image.origin(), image.dim());
+    view->resolution(image.resolution());
+    size_t nwords = image.data()->words_per_row();
+    size_t in_off = packed_col_offset(image);
+    // the new view covers all of its data
+    OneBitImageData& data = *view->data();
+    for (size_t r = 0; r < image.nrows(); ++r) {
+      const word_type* in = packed_row(image, r);
+      OneBitPixel* out = data.begin() + r * data.stride();
+      for (size_t c = 0; c < image.ncols(); c += WORD_BITS) {
+        word_type bits = load_bits(in, nwords, in_off + c);
+        size_t n = std::min(WORD_BITS, image.ncols() - c);
+        for (size_t i = 0; i < n; ++i)
+          out[c + i] = OneBitPixel((bits >> i) & 1);
+      }
+    }
+    return view;
+  }
+
   }
 #endif
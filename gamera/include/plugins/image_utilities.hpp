@@ -33,6 +33,7 @@
 #include <math.h>
 #include <algorithm>
 #include <map>
+#include <vector>
 
 // for compatibility: resize, scale, mirror, and shear
 //  were formerly implemented in image_utilitis instead of transformation
@@ -254,6 +255,91 @@ namespace Gamera {
   }
 
 
+  /*
+    void histogram_counts(GreyScale|Grey16 image, std::vector<size_t>& counts);
+
+    Counts how often each pixel value occurs in an image.  counts is
+    resized to the number of possible values of the pixel type.
+  */
+  template<class T>
+  void histogram_counts(const T& image, std::vector<size_t>& counts) {
+    counts.assign(std::numeric_limits<typename T::value_type>::max() + 1, 0);
+
+    typename T::const_row_iterator row = image.row_begin();
+    typename T::const_col_iterator col;
+    ImageAccessor<typename T::value_type> acc;
+    for (; row != image.row_end(); ++row)
+      for (col = row.begin(); col != row.end(); ++col)
+        counts[acc.get(col)]++;
+  }
+
+  /*
+    Dense GreyScale and Grey16 images are counted row by row straight
+    from the image data.  NSUB interleaved sub-histograms keep the
+    increments of neighboring pixels independent of each other, which
+    matters for the long runs of equal values typical of scanned pages.
+    With OpenMP, the rows of large images are split among threads and
+    the sub-histograms are added up at the end.
+  */
+  inline size_t histogram_bin(GreyScalePixel v) {
+    return v;
+  }
+
+  // Grey16 pixels are stored in an unsigned int; larger values than
+  // white are counted as white
+  inline size_t histogram_bin(Grey16Pixel v) {
+    return std::min(size_t(v), size_t(pixel_traits<Grey16Pixel>::white()));
+  }
+
+  template<class Pixel, size_t NSUB>
+  void histogram_counts_dense(const ImageView<ImageData<Pixel> >& image,
+                              std::vector<size_t>& counts) {
+    const size_t nbins = size_t(pixel_traits<Pixel>::white()) + 1;
+    const size_t nrows = image.nrows(), ncols = image.ncols();
+    const ImageData<Pixel>& data = *image.data();
+    const size_t stride = data.stride();
+    const Pixel* first = data.begin()
+      + stride * (image.offset_y() - data.page_offset_y())
+      + (image.offset_x() - data.page_offset_x());
+    counts.assign(nbins, 0);
+
+#ifdef _OPENMP
+#pragma omp parallel if (nrows * ncols >= (1 << 20))
+#endif
+    {
+      std::vector<size_t> sub(NSUB * nbins, 0);
+      size_t* h = &sub[0];
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+      for (long y = 0; y < long(nrows); ++y) {
+        const Pixel* p = first + y * stride;
+        size_t x = 0;
+        for (; x + NSUB <= ncols; x += NSUB)
+          for (size_t j = 0; j < NSUB; ++j)
+            h[j * nbins + histogram_bin(p[x + j])]++;
+        for (; x < ncols; ++x)
+          h[histogram_bin(p[x])]++;
+      }
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+      for (size_t i = 0; i < nbins; ++i)
+        for (size_t j = 0; j < NSUB; ++j)
+          counts[i] += h[j * nbins + i];
+    }
+  }
+
+  inline void histogram_counts(const GreyScaleImageView& image, std::vector<size_t>& counts) {
+    histogram_counts_dense<GreyScalePixel, 4>(image, counts);
+  }
+
+  // With 65536 bins, sub-histograms would cost more to clear and add up
+  // than they save on the usual image sizes.
+  inline void histogram_counts(const Grey16ImageView& image, std::vector<size_t>& counts) {
+    histogram_counts_dense<Grey16Pixel, 1>(image, counts);
+  }
+
   /*
     FloatVector histogram(GreyScale|Grey16 image);
 
@@ -262,32 +348,18 @@ namespace Gamera {
   */
   template<class T>
   FloatVector* histogram(const T& image) {
+    std::vector<size_t> counts;
+    histogram_counts(image, counts);
+
     // The histogram is the size of all of the possible values of
     // the pixel type.
-    size_t l = std::numeric_limits<typename T::value_type>::max() + 1;
+    size_t l = counts.size();
     FloatVector* values = new FloatVector(l);
 
-    try {
-      // set the list to 0
-      std::fill(values->begin(), values->end(), 0);
-      
-      typename T::const_row_iterator row = image.row_begin();
-      typename T::const_col_iterator col;
-      ImageAccessor<typename T::value_type> acc;
-
-      // create the histogram
-      for (; row != image.row_end(); ++row)
-        for (col = row.begin(); col != row.end(); ++col)
-          (*values)[acc.get(col)]++;
-
-      // convert from absolute values to percentages
-      double size = image.nrows() * image.ncols();
-      for (size_t i = 0; i < l; i++) {
-        (*values)[i] = (*values)[i] / size;
-      }
-    } catch (std::exception e) {
-      delete values;
-      throw;
+    // convert from absolute values to percentages
+    double size = image.nrows() * image.ncols();
+    for (size_t i = 0; i < l; i++) {
+      (*values)[i] = counts[i] / size;
     }
     return values;
   }
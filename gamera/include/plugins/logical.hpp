@@ -79,6 +79,69 @@ logical_combine(T& a, const U& b, const FUNCTOR& functor, bool in_place) {
   }
 }
 
+/*
+  Word-wise version of logical_combine for bit-packed images.  The
+  functor is applied to 64 pixels at a time and returns the black
+  pixels of the result.
+*/
+template<class FUNCTOR>
+inline OneBitPackedImageView*
+packed_logical_combine(OneBitPackedImageView& a, const OneBitPackedImageView& b,
+                       const FUNCTOR& functor, bool in_place) {
+  using namespace PackedDataDetail;
+  if (a.nrows() != b.nrows() || a.ncols() != b.ncols())
+    throw std::runtime_error("Images must be the same size.");
+
+  OneBitPackedImageView* dest = NULL;
+  OneBitPackedImageView* out = &a;
+  if (!in_place) {
+    typedef TypeIdImageFactory<ONEBIT, PACKED> fact_type;
+    dest = fact_type::create(a.origin(), a.dim());
+    out = dest;
+  }
+
+  size_t a_words = a.data()->words_per_row();
+  size_t b_words = b.data()->words_per_row();
+  size_t a_off = packed_col_offset(a);
+  size_t b_off = packed_col_offset(b);
+  size_t out_off = packed_col_offset(*out);
+  for (size_t r = 0; r < a.nrows(); ++r) {
+    const word_type* ra = packed_row(a, r);
+    const word_type* rb = packed_row(b, r);
+    word_type* rout = packed_row(*out, r);
+    for (size_t c = 0; c < a.ncols(); c += WORD_BITS) {
+      size_t n = std::min(WORD_BITS, a.ncols() - c);
+      word_type x = load_bits(ra, a_words, a_off + c);
+      word_type y = load_bits(rb, b_words, b_off + c);
+      store_bits(rout, out_off + c, functor(x, y), n);
+    }
+  }
+
+  // Returning NULL is converted to None by the wrapper mechanism
+  return dest;
+}
+
+struct packed_and {
+  PackedDataDetail::word_type operator()(PackedDataDetail::word_type x,
+                                         PackedDataDetail::word_type y) const {
+    return x & y;
+  }
+};
+
+struct packed_or {
+  PackedDataDetail::word_type operator()(PackedDataDetail::word_type x,
+                                         PackedDataDetail::word_type y) const {
+    return x | y;
+  }
+};
+
+struct packed_xor {
+  PackedDataDetail::word_type operator()(PackedDataDetail::word_type x,
+                                         PackedDataDetail::word_type y) const {
+    return x ^ y;
+  }
+};
+
 template<class T, class U>
 typename ImageFactory<T>::view_type* 
 and_image(T& a, const U& b, bool in_place=true) {
@@ -107,5 +170,23 @@ xor_image(T& a, const U& b, bool in_place=true) {
   return logical_combine(a, b, logical_xor<bool>(), in_place);
 }
 
+/*
+  The bit-packed images are combined a word at a time.
+*/
+inline OneBitPackedImageView*
+and_image(OneBitPackedImageView& a, const OneBitPackedImageView& b, bool in_place=true) {
+  return packed_logical_combine(a, b, packed_and(), in_place);
+}
+
+inline OneBitPackedImageView*
+or_image(OneBitPackedImageView& a, const OneBitPackedImageView& b, bool in_place=true) {
+  return packed_logical_combine(a, b, packed_or(), in_place);
+}
+
+inline OneBitPackedImageView*
+xor_image(OneBitPackedImageView& a, const OneBitPackedImageView& b, bool in_place=true) {
+  return packed_logical_combine(a, b, packed_xor(), in_place);
+}
+
 }
 #endif
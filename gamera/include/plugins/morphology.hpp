@@ -29,6 +29,7 @@
 #include "gamera.hpp"
 #include "neighbor.hpp"
 #include "image_utilities.hpp"
+#include "image_conversion.hpp"
 #include "vigra/distancetransform.hxx"
 
 // for backward compatibility:
@@ -230,18 +231,15 @@ namespace Gamera {
 
     try {
       if (times > 1) {
+	// flip_view and new_view take turns as source and destination
 	view_type* flip_view = simple_image_copy(m);
 	try {
 	  unsigned int r, ngeo = 0;
 	  bool n8;
 	  ngeo = 1;
 	  for (r = 1; r <= times; r++) {
-	    if (r > 1) {
-	      typename view_type::vec_iterator g = flip_view->vec_begin();
-	      typename view_type::vec_iterator h = new_view->vec_begin();
-	      for (; g != flip_view->vec_end(); g++, h++)
-		*g = *h;
-	    }
+	    if (r > 1)
+	      std::swap(flip_view, new_view);
 	    if (geo && (ngeo % 2 == 0))
 	      n8 = true;
 	    else
@@ -284,8 +282,8 @@ namespace Gamera {
 	return new_view;
       }
     } catch (std::exception e) {
+      delete new_view->data();
       delete new_view;
-      delete new_data;
       throw;
     }
   }
@@ -300,7 +298,100 @@ namespace Gamera {
 	return new_view;
   }
   
-  /* for onebit images the use of erode/dilate_with_structure is much faster
+  /*
+    The rows above, at and below a word of packed OneBit data combined
+    vertically (AND for erosion, OR for dilation).  Rows beyond the
+    image border are passed as null pointers and count as white.
+  */
+  inline PackedDataDetail::word_type
+  packed_vertical(const PackedDataDetail::word_type* up,
+                  const PackedDataDetail::word_type* mid,
+                  const PackedDataDetail::word_type* down,
+                  size_t i, bool erode) {
+    if (erode)
+      return (up ? up[i] : 0) & mid[i] & (down ? down[i] : 0);
+    return (up ? up[i] : 0) | mid[i] | (down ? down[i] : 0);
+  }
+
+  /*
+    One 3x3 erosion or dilation of packed OneBit data, with the square
+    or (cross == true) the cross shaped structuring element.  Each
+    output row is computed 64 pixels at a time from the three input
+    rows around it, with shifts for the horizontal neighbors and
+    word-wise ANDs (erosion) or ORs (dilation).  Pixels outside the
+    image count as white, like in erode_with_structure and
+    dilate_with_structure.
+  */
+  inline void packed_erode_dilate_step(const OneBitPackedImageData& in,
+                                       OneBitPackedImageData& out,
+                                       size_t nrows, size_t ncols,
+                                       bool erode, bool cross) {
+    using namespace PackedDataDetail;
+    const size_t nwords = in.words_per_row();
+    const word_type last_mask = low_mask(ncols - (nwords - 1) * WORD_BITS);
+    for (size_t r = 0; r < nrows; ++r) {
+      const word_type* up = (r > 0) ? in.row_words(r - 1) : 0;
+      const word_type* mid = in.row_words(r);
+      const word_type* down = (r + 1 < nrows) ? in.row_words(r + 1) : 0;
+      word_type* dest = out.row_words(r);
+      // The square combines the three rows vertically before shifting,
+      // the cross only shifts the middle row.
+      word_type prev = 0;
+      word_type cur = cross ? mid[0] : packed_vertical(up, mid, down, 0, erode);
+      for (size_t i = 0; i < nwords; ++i) {
+        word_type next = 0;
+        if (i + 1 < nwords)
+          next = cross ? mid[i + 1]
+            : packed_vertical(up, mid, down, i + 1, erode);
+        word_type left = (cur << 1) | (prev >> (WORD_BITS - 1));
+        word_type right = (cur >> 1) | (next << (WORD_BITS - 1));
+        word_type result;
+        if (erode) {
+          result = cur & left & right;
+          if (cross)
+            result &= (up ? up[i] : 0) & (down ? down[i] : 0);
+        } else {
+          result = cur | left | right;
+          if (cross)
+            result |= (up ? up[i] : 0) | (down ? down[i] : 0);
+        }
+        dest[i] = result;
+        prev = cur;
+        cur = next;
+      }
+      dest[nwords - 1] &= last_mask;
+    }
+  }
+
+  /*
+    erode_dilate for OneBit images on bit-packed copies of the image.
+    The square of size 2*times+1 is applied as times 3x3 squares, the
+    octagon as alternating crosses and squares ((times+1)/2 crosses,
+    which is the number of pixels cut off the corners of the octagon
+    in erode_dilate).  The two packed buffers take turns as input and
+    output, so nothing is copied between the steps.
+  */
+  template<class T>
+  OneBitImageView* packed_erode_dilate(const T& src, size_t times,
+                                       int direction, int geo) {
+    OneBitPackedImageView* packed = to_packed(src);
+    OneBitPackedImageData other(src.dim(), src.origin());
+    OneBitPackedImageData* in = packed->data();
+    OneBitPackedImageData* out = &other;
+    for (size_t i = 0; i < times; ++i) {
+      bool cross = geo && (i % 2 == 0);
+      packed_erode_dilate_step(*in, *out, src.nrows(), src.ncols(),
+                               direction != 0, cross);
+      std::swap(in, out);
+    }
+    OneBitPackedImageView result(*in);
+    OneBitImageView* dest = packed_to_dense(result);
+    delete packed->data();
+    delete packed;
+    return dest;
+  }
+
+  /* for onebit images the bit-parallel packed_erode_dilate is much faster
      than the general implementation erode_dilate_original */
   template<>
   ImageFactory<OneBitImageView>::view_type* erode_dilate<OneBitImageView>(OneBitImageView &src, const size_t times, int direction, int geo){
@@ -308,38 +399,7 @@ namespace Gamera {
     if (src.nrows() < 3 || src.ncols() < 3 || times < 1)
       return simple_image_copy(src);
 
-    OneBitImageData* se_data = new OneBitImageData(Dim(1+2*times,1+2*times));
-	OneBitImageView* se = new OneBitImageView(*se_data);
-	OneBitImageView* result;
-
-    // structuring element se depends on the geometry
-	if (geo) {
-      // create octagonal kernel
-      //result = erode_dilate_original(src,times,direction,geo);
-      //return result;
-      int n_corner = (1+(int)times) / 2;
-      int n = (int)se->ncols()-1;
-      for(int y = 0; y < (int)se->nrows(); y++)
-        for(int x = 0; x < (int)se->ncols(); x++)
-          if (!(x+y < n_corner || n-x+y < n_corner ||
-                x+n-y < n_corner || n-x+n-y < n_corner))
-          se->set(Point(x,y),OneBitPixel(1));
-    }
-    else {
-      // create square kernel
-      for(int y = 0; y < (int)se->nrows(); y++)
-        for(int x = 0; x < (int)se->ncols(); x++)
-          se->set(Point(x,y),OneBitPixel(1));
-    }
-
-	if (direction)
-      result = erode_with_structure(src,*se, Point(times,times));
-	else
-      result = dilate_with_structure(src,*se,Point(times,times),false);
-    delete se->data();
-    delete se;
-
-	return result;
+    return packed_erode_dilate(src, times, direction, geo);
   }
   
   template<class T>
@@ -110,6 +110,45 @@ namespace Gamera {
     return projection_cols(proj_image);
   }
 
+  /*
+    Projections of bit-packed images count the black pixels
+    of 64 pixels at a time.
+  */
+  inline IntVector* projection_rows(const OneBitPackedImageView& image) {
+    using namespace PackedDataDetail;
+    IntVector* proj = new IntVector(image.nrows(), 0);
+    size_t nwords = image.data()->words_per_row();
+    size_t off = packed_col_offset(image);
+    for (size_t r = 0; r != image.nrows(); ++r) {
+      const word_type* row = packed_row(image, r);
+      size_t count = 0;
+      for (size_t c = 0; c < image.ncols(); c += WORD_BITS) {
+        size_t n = std::min(WORD_BITS, image.ncols() - c);
+        count += popcount(load_bits(row, nwords, off + c) & low_mask(n));
+      }
+      (*proj)[r] = (int)count;
+    }
+    return proj;
+  }
+
+  inline IntVector* projection_cols(const OneBitPackedImageView& image) {
+    using namespace PackedDataDetail;
+    IntVector* proj = new IntVector(image.ncols(), 0);
+    size_t nwords = image.data()->words_per_row();
+    size_t off = packed_col_offset(image);
+    for (size_t r = 0; r != image.nrows(); ++r) {
+      const word_type* row = packed_row(image, r);
+      for (size_t c = 0; c < image.ncols(); c += WORD_BITS) {
+        size_t n = std::min(WORD_BITS, image.ncols() - c);
+        word_type bits = load_bits(row, nwords, off + c) & low_mask(n);
+        // visit only the black pixels
+        for (; bits; bits &= bits - 1)
+          (*proj)[c + lowest_bit(bits)] += 1;
+      }
+    }
+    return proj;
+  }
+
   /*
     Projections of strips of a image -
     the coordinates are relative to the view.
@@ -27,22 +27,32 @@
 #include <functional>
 #include <map>
 #include <stdexcept>
+#include <string>
 #include "gamera.hpp"
 #include "gamera_limits.hpp"
 #include "features.hpp"
 #include "image_utilities.hpp"
 #include "projections.hpp"
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 /*
   Connected-component analysis (8-connected)
 
-  This is the standard two-pass connected-component analysis algorithm that
-  will work on any matrix regardless of the storage format but only for
-  OneBit or floating-point pixels.  The labeling works by setting the value
-  in the matrix to the correct label (that is why OneBit matrices use
-  unsigned shorts instead of some bit-packed format).  This means that the
-  number of components is limited by the size of the pixel type (65536 for
-  unsigned shorts).
+  This is a two-pass connected-component analysis algorithm that will
+  work on any matrix regardless of the storage format but only for
+  OneBit or floating-point pixels.  The labeling works by setting the
+  value in the matrix to the correct label (that is why OneBit matrices
+  use unsigned shorts instead of some bit-packed format).  This means
+  that the number of components is limited by the size of the pixel
+  type (65536 for unsigned shorts).
+
+  The provisional labels of the first pass are 32 bit values kept
+  outside the image, and their equivalences are resolved with a
+  union-find structure, so that only the number of final components
+  is limited by the pixel type.
 
   Authors
   -------
@@ -52,243 +62,644 @@
   History
   -------
   Started 6/8/01 KWM
-
-  TODO
-  ----
-  - This algorithm can be significantly faster when working on run-length data
-  so an appropriate specialization should be made when run-length matrices
-  are completed.
+  Union-find labeling with 32 bit provisional labels 10/17/26
+  Parallel labeling of horizontal strips 10/17/26
+  Run based labeling of RLE images 10/17/26
+  Optional component statistics while labeling 10/17/26
 */
 
-namespace {
+namespace Gamera {
+
   /*
-    This is a two-step connected-component labeling algorithm - the first step
-    labels the pixel and the second pass reduces the number of labels to one
-    per connected-component. The data necessary to form this second pass is
-    stored in the equivalence and equiv_table objects.
+    Statistics of a connected component that can be collected by
+    cc_analysis while labeling, so that they need not be computed by
+    scanning the components afterwards.  The moments are the raw
+    moments of the black pixels in page coordinates.
   */
-  struct equivalence {
-    equivalence(size_t l = 0, size_t e = 0) { label = l; equiv = e; }
-    size_t label;
-    size_t equiv;
-    // for sorting by label
-    bool operator<(const equivalence& other) const {
-      return label < other.label; }
-    bool operator==(const equivalence& other) const {
-      return label == other.label &&  equiv == other.equiv; }
+  struct CcStatistics {
+    CcStatistics()
+      : black_area(0), m10(0.0), m01(0.0), m20(0.0), m11(0.0), m02(0.0) { }
+
+    void add(size_t x, size_t y) {
+      double dx = double(x), dy = double(y);
+      black_area++;
+      m10 += dx;
+      m01 += dy;
+      m20 += dx * dx;
+      m11 += dx * dy;
+      m02 += dy * dy;
+    }
+
+    // adds the horizontal run of pixels (begin..end, y)
+    void add_run(size_t begin, size_t end, size_t y) {
+      double n = double(end - begin + 1), dy = double(y);
+      double b = double(begin), e = double(end);
+      double sum_x = (b + e) * n / 2.0;
+      // sum of the squares from begin to end
+      double sum_xx = (e * (e + 1.0) * (2.0 * e + 1.0)
+                       - (b - 1.0) * b * (2.0 * b - 1.0)) / 6.0;
+      black_area += end - begin + 1;
+      m10 += sum_x;
+      m01 += dy * n;
+      m20 += sum_xx;
+      m11 += dy * sum_x;
+      m02 += dy * dy * n;
+    }
+
+    void add(const CcStatistics& other) {
+      black_area += other.black_area;
+      m10 += other.m10;
+      m01 += other.m01;
+      m20 += other.m20;
+      m11 += other.m11;
+      m02 += other.m02;
+    }
+
+    // moves the origin of the coordinate system to (-x, -y)
+    void translate(double x, double y) {
+      double n = double(black_area);
+      m20 += 2.0 * x * m10 + x * x * n;
+      m02 += 2.0 * y * m01 + y * y * n;
+      m11 += x * m01 + y * m10 + x * y * n;
+      m10 += x * n;
+      m01 += y * n;
+    }
+
+    double centroid_x() const { return m10 / black_area; }
+    double centroid_y() const { return m01 / black_area; }
+
+    // central second order moments, normalized by the area
+    double mu20() const { return m20 / black_area - centroid_x() * centroid_x(); }
+    double mu11() const { return m11 / black_area - centroid_x() * centroid_y(); }
+    double mu02() const { return m02 / black_area - centroid_y() * centroid_y(); }
+
+    size_t black_area;
+    double m10, m01, m20, m11, m02;
   };
-  
-  struct equiv_table : public std::vector<equivalence> {
-    equiv_table() : std::vector<equivalence>() { }
-    // add an equivalence
-    void add(size_t a, size_t b) {
-      if (size() == 0 || (back().label != a || back().equiv != b)) {
-        if (a < b)
-          push_back(equivalence(a, b));
+
+  /*
+    The statistics of all components returned by cc_analysis.  Entry i
+    belongs to the i-th component of the returned list, which has the
+    label i + 2, so the entries remain valid when components are
+    removed from the list (see ccs::statistics).
+  */
+  typedef std::vector<CcStatistics> CcStatisticsTable;
+}
+
+namespace {
+  typedef unsigned int cc_label_type;
+
+  /*
+    Union-find structure over the provisional labels.  Label 0 is the
+    background.  The root of a set is always its smallest label, which
+    is the label that was first encountered in raster order.
+  */
+  class label_union_find {
+  public:
+    label_union_find() : m_parent(1, 0) { }
+
+    cc_label_type new_label() {
+      if (m_parent.size() >= size_t(std::numeric_limits<cc_label_type>::max()))
+        throw std::range_error("Max provisional label exceeded.");
+      cc_label_type l = cc_label_type(m_parent.size());
+      m_parent.push_back(l);
+      return l;
+    }
+
+    cc_label_type find(cc_label_type x) {
+      // path halving
+      while (m_parent[x] != x) {
+        m_parent[x] = m_parent[m_parent[x]];
+        x = m_parent[x];
+      }
+      return x;
+    }
+
+    void merge(cc_label_type a, cc_label_type b) {
+      a = find(a);
+      b = find(b);
+      if (a < b)
+        m_parent[b] = a;
+      else if (b < a)
+        m_parent[a] = b;
+    }
+
+    size_t size() const { return m_parent.size(); }
+
+    /*
+      Replaces every provisional label by a final label.  The sets are
+      numbered consecutively starting with first, in the order of their
+      roots.  Returns the number of sets.  After this, only
+      final_label() may be used.
+    */
+    size_t flatten(cc_label_type first) {
+      cc_label_type next = first;
+      for (size_t i = 1; i < m_parent.size(); ++i) {
+        // parents are always smaller, so they are already final
+        if (m_parent[i] == i)
+          m_parent[i] = next++;
         else
-          push_back(equivalence(b, a));
+          m_parent[i] = m_parent[m_parent[i]];
       }
+      return next - first;
     }
+
+    cc_label_type final_label(cc_label_type l) const {
+      return m_parent[l];
+    }
+
+  private:
+    std::vector<cc_label_type> m_parent;
   };
-}
 
-namespace Gamera {
+  /*
+    Chooses the provisional label of a black pixel from its already
+    visited neighbors.  above points to the label of the N neighbor,
+    so above[-1] is NW and above[1] is NE; west is the W label.  When
+    two labels of different sets meet, the second one is returned in
+    join.  A result of 0 means that a new label is needed.
+
+    The choice does not depend on the state of the union-find
+    structure, so the second pass can reproduce the provisional labels
+    from a single row of history instead of storing them for the
+    whole image.
+  */
+  inline cc_label_type choose_label(const cc_label_type* above, cc_label_type west,
+                                    cc_label_type& join) {
+    join = 0;
+    // W, NW and NE are all adjacent to N and thus already merged with it
+    if (above[0])
+      return above[0];
+    // W and NW are adjacent to each other, but not to NE
+    cc_label_type label = west ? west : above[-1];
+    if (above[1]) {
+      if (label)
+        join = above[1];
+      else
+        label = above[1];
+    }
+    return label;
+  }
+
+  /*
+    Bounding boxes and, when with_statistics is set, the statistics of
+    the components, indexed by label.  Coordinates are relative to the
+    labeled view.
+  */
+  struct cc_component_table {
+    cc_component_table(bool statistics = false) : with_statistics(statistics) { }
+    void resize(size_t n) {
+      min_x.assign(n, std::numeric_limits<size_t>::max());
+      min_y.assign(n, std::numeric_limits<size_t>::max());
+      max_x.assign(n, 0);
+      max_y.assign(n, 0);
+      if (with_statistics)
+        statistics.assign(n, Gamera::CcStatistics());
+    }
+    void add_box(size_t label, size_t x, size_t y) {
+      if (x < min_x[label])
+        min_x[label] = x;
+      if (x > max_x[label])
+        max_x[label] = x;
+      if (y < min_y[label])
+        min_y[label] = y;
+      if (y > max_y[label])
+        max_y[label] = y;
+    }
+    void add(size_t label, size_t x, size_t y) {
+      add_box(label, x, y);
+      if (with_statistics)
+        statistics[label].add(x, y);
+    }
+    void add_run(size_t label, size_t begin, size_t end, size_t y) {
+      add_box(label, begin, y);
+      add_box(label, end, y);
+      if (with_statistics)
+        statistics[label].add_run(begin, end, y);
+    }
+    // merges entry other_label of other into entry label
+    void add(size_t label, const cc_component_table& other, size_t other_label) {
+      add_box(label, other.min_x[other_label], other.min_y[other_label]);
+      add_box(label, other.max_x[other_label], other.max_y[other_label]);
+      if (with_statistics)
+        statistics[label].add(other.statistics[other_label]);
+    }
+    bool with_statistics;
+    std::vector<size_t> min_x, min_y, max_x, max_y;
+    std::vector<Gamera::CcStatistics> statistics;
+  };
 
+  /*
+    First pass over the rows [begin, end) of image.  The strip is
+    labeled as if it were an image on its own.  The provisional labels
+    of its first and last row are returned in first_row and last_row
+    (padded like the row buffers below), so that strips labeled
+    independently can be joined along their seams.
+  */
   template<class T>
-  ImageList* cc_analysis(T& image) {
-    equiv_table eq;
-    // get the max value that can be held in the matrix
-    typename T::value_type max_value = 
-      std::numeric_limits<typename T::value_type>::max();
-    // The first label we use is 2 to distinguish it from an unlabled black pixel
-    typename T::value_type curr_label = 2;
-
-    typename T::value_type W, NW, N, NE;
-    ImageAccessor<typename T::value_type> acc;
-    typename T::Iterator row, col, lr, ul, above;
-    lr = image.lowerRight();
-    ul = image.upperLeft();
-    // progress_bar.set_length(image.nrows() / 40);
-    size_t i0 = 0;
-    for (row = image.upperLeft(); row.y != lr.y; ++row.y, ++i0) {
-      for (col = row; col.x != lr.x; ++col.x) {
-        /*
-          If this image has been labeled once already, it is necessary to start
-          with all the pixels labeled with 1.
-        */
-        if (acc(col) > 0)
-          acc.set(1, col);
-        if (acc(col) > 0) {
-          W = NW = N = NE = 0;
-          if (col.y != ul.y) {
-            above = col;
-            --above.y;
-            N = acc(above);
-            if (col.x != ul.x) {
-              --above.x;
-              NW = acc(above);
-              ++above.x;
-            }
-            ++above.x;
-            if (above.x != lr.x)
-              NE = acc(above);
-          }
-          if (col.x != ul.x)
-            W = acc(col - Diff2D(1, 0));
-        
-          if (W  == 0) W  = max_value;
-          if (NW == 0) NW = max_value;
-          if (N  == 0) N  = max_value;
-          if (NE == 0) NE = max_value;
-          typename T::value_type smallest_label = max_value;
-        
-          if (smallest_label > W ) smallest_label = W;
-          if (smallest_label > NW) smallest_label = NW;
-          if (smallest_label > N ) smallest_label = N;
-          if (smallest_label > NE) smallest_label = NE;
-        
-          if (smallest_label == max_value) { // new object found!
-            acc.set(curr_label, col);
-            if (curr_label == max_value) {
-              throw std::range_error("Max label exceeded - change OneBitPixel type in pixel.hpp");
-            }
-            curr_label++;
-          } else {
-            acc.set(smallest_label, col);
-          
-            // adjust equiv_table if necessary
-            if (W  == max_value) W  = 0;
-            if (NW == max_value) NW = 0;
-            if (N  == max_value) N  = 0;
-            if (NE == max_value) NE = 0;
-          
-            if (W && W != smallest_label)
-              eq.add(smallest_label, W);
-            if (NW && NW != smallest_label)
-              eq.add(smallest_label, NW);
-            if (N && N != smallest_label)
-              eq.add(smallest_label, N);
-            if (NE && NE != smallest_label)
-              eq.add(smallest_label, NE);
-          }
+  void cc_label_strip(T& image, size_t begin, size_t end, label_union_find& uf,
+                      std::vector<cc_label_type>& first_row,
+                      std::vector<cc_label_type>& last_row) {
+    const size_t ncols = image.ncols();
+    Gamera::ImageAccessor<typename T::value_type> acc;
+    typename T::col_iterator col;
+
+    /*
+      Two rows of provisional labels, padded by one pixel on either
+      side: the label of column c is stored at index c + 1.
+    */
+    std::vector<cc_label_type> prev(ncols + 2, 0), curr(ncols + 2, 0);
+    cc_label_type join;
+    typename T::row_iterator row = image.row_begin() + begin;
+    for (size_t r = begin; r != end; ++r, ++row) {
+      size_t c = 0;
+      for (col = row.begin(); col != row.end(); ++col, ++c) {
+        if (acc.get(col) == 0) {
+          curr[c + 1] = 0;
+          continue;
         }
+        cc_label_type label = choose_label(&prev[c + 1], curr[c], join);
+        if (label == 0)
+          label = uf.new_label();
+        else if (join)
+          uf.merge(label, join);
+        curr[c + 1] = label;
       }
-      // if ((i0 % 20) == 0)
-      // progress_bar.step();
+      if (r == begin)
+        first_row = curr;
+      prev.swap(curr);
     }
-  
-    /*
-      labels size can be curr_label because curr_label is always the next
-      label - i.e. it is currently unused
-    */
+    last_row = prev;
+  }
 
-    std::vector<size_t> labels(curr_label);
-    for (size_t i = 0; i < labels.size(); i++)
-      labels[i] = i;
-  
-    // sort by label
-    std::sort(eq.begin(), eq.end());
-  
-    // resolve the equivalences
-
-    for (size_t i = 1; i < eq.size(); i++) {
-      size_t x = eq[i].label;
-      size_t y = eq[i].equiv;
-    
-      if (labels[y] > labels[x]) {
-        if (labels[y] != y)
-          labels[labels[y]] = labels[x];
-        labels[y] = labels[x];
-      } else if (labels[y] < labels[x]) {
-        if (labels[labels[y]] < labels[x])
-          labels[x] = labels[labels[y]];
+  /*
+    Second pass over the rows [begin, end) of image after
+    cc_label_strip() and uf.flatten().  The provisional labels are
+    reproduced and each pixel is set to its final label, mapped
+    through to_global when it is given.  The bounding boxes and
+    statistics are collected by the (unmapped) final label of the
+    strip.
+  */
+  template<class T>
+  void cc_relabel_strip(T& image, size_t begin, size_t end, const label_union_find& uf,
+                        const std::vector<cc_label_type>* to_global,
+                        cc_component_table& components) {
+    typedef typename T::value_type value_type;
+    const size_t ncols = image.ncols();
+    Gamera::ImageAccessor<value_type> acc;
+    typename T::col_iterator col;
+
+    std::vector<cc_label_type> prev(ncols + 2, 0), curr(ncols + 2, 0);
+    cc_label_type join;
+    cc_label_type next_label = 1;
+    typename T::row_iterator row = image.row_begin() + begin;
+    for (size_t r = begin; r != end; ++r, ++row) {
+      size_t c = 0;
+      for (col = row.begin(); col != row.end(); ++col, ++c) {
+        if (acc.get(col) == 0) {
+          curr[c + 1] = 0;
+          continue;
+        }
+        cc_label_type label = choose_label(&prev[c + 1], curr[c], join);
+        if (label == 0)
+          label = next_label++;
+        curr[c + 1] = label;
+        cc_label_type final_label = uf.final_label(label);
+        if (to_global)
+          acc.set(value_type((*to_global)[final_label]), col);
         else
-          labels[x] = labels[y];
+          acc.set(value_type(final_label), col);
+        components.add(final_label, c, r);
       }
+      prev.swap(curr);
+    }
+  }
+
+  template<class T>
+  void cc_check_label_limit(size_t ncomponents) {
+    // the first final label is 2
+    if (ncomponents + 1 > size_t(std::numeric_limits<typename T::value_type>::max()))
+      throw std::range_error("Max label exceeded - change OneBitPixel type in pixel.hpp");
+  }
+
+  template<class T>
+  Gamera::ImageList* cc_make_components(T& image, const cc_component_table& components,
+                                        size_t ncomponents,
+                                        Gamera::CcStatisticsTable* statistics) {
+    using namespace Gamera;
+    if (statistics) {
+      statistics->assign(components.statistics.begin() + 2, components.statistics.end());
+      for (size_t i = 0; i < ncomponents; ++i)
+        (*statistics)[i].translate(double(image.offset_x()), double(image.offset_y()));
     }
-    bool swapped = true;
-    while (swapped) {
-      swapped = false;
-      for (size_t i = 0; i < eq.size(); i++) {
-        size_t x = eq[i].label;
-        size_t y = eq[i].equiv;
-      
-        if (labels[x] != labels[y]) {
-          swapped = true;
-          if (labels[x] < labels[y])
-            labels[y] = labels[x];
+    ImageList* ccs = new ImageList();
+    try {
+      for (size_t i = 2; i < ncomponents + 2; ++i) {
+        ccs->push_back(new ConnectedComponent<typename T::data_type>(*((typename T::data_type*)image.data()),
+                                                                     OneBitPixel(i),
+                                                                     Point(components.min_x[i] + image.offset_x(),
+                                                                           components.min_y[i] + image.offset_y()),
+                                                                     Dim(components.max_x[i] - components.min_x[i] + 1,
+                                                                         components.max_y[i] - components.min_y[i] + 1)));
+      }
+    } catch (std::exception e) {
+      for (ImageList::iterator i = ccs->begin(); i != ccs->end(); ++i)
+        delete *i;
+      delete ccs;
+      throw;
+    }
+    return ccs;
+  }
+
+  /*
+    Only images with dense storage may be labeled by several threads,
+    since setting a pixel in the other formats may touch data shared
+    with neighboring rows.
+  */
+  template<class Data>
+  struct cc_parallel_storage {
+    enum { value = false };
+  };
+
+  template<class V>
+  struct cc_parallel_storage<Gamera::ImageData<V> > {
+    enum { value = true };
+  };
+
+  /*
+    A horizontal run of black pixels of an RLE image with its
+    provisional label.  begin and end are the first and last column
+    of the run in the view.
+  */
+  struct cc_run {
+    cc_run(size_t r, size_t b, size_t e)
+      : row(r), begin(b), end(e), label(0) { }
+    size_t row, begin, end;
+    cc_label_type label;
+  };
+
+  /*
+    Appends the black runs of the data positions [begin, begin + ncols)
+    as row row to runs.  The run lists are walked directly, and touching
+    runs of different non-zero values are joined.
+  */
+  template<class Data>
+  void cc_rle_row_runs(const Data& data, size_t begin, size_t ncols, size_t row,
+                       std::vector<cc_run>& runs) {
+    using namespace Gamera::RleDataDetail;
+    const size_t end = begin + ncols;
+    const size_t first = runs.size();
+    for (size_t chunk = get_chunk(begin); chunk <= get_chunk(end - 1); ++chunk) {
+      size_t run_begin = chunk << RLE_CHUNK_BITS;
+      typename Data::list_type::const_iterator i = data.m_data[chunk].begin();
+      for (; i != data.m_data[chunk].end() && run_begin < end; ++i) {
+        // runs are [run_begin, run_end) in global positions
+        size_t run_end = get_global_pos(i->end, chunk) + 1;
+        if (i->value != 0 && run_end > begin) {
+          size_t b = std::max(run_begin, begin) - begin;
+          size_t e = std::min(run_end, end) - begin - 1;
+          if (runs.size() > first && runs.back().end + 1 == b)
+            runs.back().end = e;
           else
-            labels[x] = labels[y];
+            runs.push_back(cc_run(row, b, e));
         }
+        run_begin = run_end;
       }
     }
-  
-    for (size_t i = 0; i < labels.size(); i++)
-      if(labels[labels[i]] < labels[i])
-        labels[i] = labels[labels[i]];
-  
+  }
+}
+
+namespace Gamera {
+
+  /*
+    When statistics is given, it is filled with the CcStatistics of the
+    returned components.
+  */
+  template<class T>
+  ImageList* cc_analysis(T& image, CcStatisticsTable* statistics) {
     /*
-      Second Pass - relabel with equivalences and get bounding boxes
-      This used to use a map, but I think that it is worth the memory
-      use to use a vector for mapping the labels to the rects. The 
-      vector is a lot faster.
+      First pass - provisional labels and their equivalences
     */
-    ImageList* ccs = NULL;
+    label_union_find uf;
+    std::vector<cc_label_type> first_row, last_row;
+    cc_label_strip(image, 0, image.nrows(), uf, first_row, last_row);
 
-    typedef std::vector<Rect*> map_type;
-    map_type rects(labels.size(), 0);
-    try {
-      row = image.upperLeft();
-      for (size_t i = 0; i < image.nrows(); i++, ++row.y) {
-        size_t j;
-        for (j = 0, col = row; j < image.ncols(); j++, ++col.x) {
-          // relabel
-          acc.set(labels[acc(col)], col); 
-          // put bounding box in map
-          typename T::value_type label = acc(col);
-          if (label) {
-            if (rects[label] == 0) {
-              rects[label] = new Rect(Point(j, i), Dim(1, 1));
-            } else {
-              if (j < rects[label]->ul_x())
-                rects[label]->ul_x(j);
-              if (j > rects[label]->lr_x())
-                rects[label]->lr_x(j);
-              if (i < rects[label]->ul_y())
-                rects[label]->ul_y(i);
-              if (i > rects[label]->lr_y())
-                rects[label]->lr_y(i);
-            }
-          }
+    /*
+      The first label we use is 2 to distinguish it from an unlabeled
+      black pixel.  Check the number of components before touching the
+      image, so that the image is left untouched on failure.
+    */
+    size_t ncomponents = uf.flatten(2);
+    cc_check_label_limit<T>(ncomponents);
+
+    /*
+      Second Pass - reproduce the provisional labels, relabel with the
+      final labels and get bounding boxes
+    */
+    cc_component_table components(statistics != 0);
+    components.resize(ncomponents + 2);
+    cc_relabel_strip(image, 0, image.nrows(), uf, 0, components);
+
+    return cc_make_components(image, components, ncomponents, statistics);
+  }
+
+  template<class T>
+  ImageList* cc_analysis(T& image) {
+    return cc_analysis(image, (CcStatisticsTable*)0);
+  }
+
+  /*
+    Connected-component analysis for run-length encoded images
+
+    The labeling works on the runs of the RleImageData instead of
+    single pixels: each run in a row is joined with all runs in the
+    previous row that overlap it or touch it diagonally.  Runs get
+    their provisional labels in raster order, so the labels are the
+    same as for the same image with DENSE storage.  The final labels
+    are written back run by run with RleVector::fill.
+  */
+  inline ImageList* cc_analysis(OneBitRleImageView& image, CcStatisticsTable* statistics) {
+    OneBitRleImageData& data = *((OneBitRleImageData*)image.data());
+    const size_t nrows = image.nrows();
+    const size_t stride = data.stride();
+    const size_t start = stride * (image.offset_y() - data.page_offset_y())
+      + (image.offset_x() - data.page_offset_x());
+
+    /*
+      First pass - provisional labels of the runs and their
+      equivalences.  The runs of the previous row are [prev_begin,
+      prev_end) in runs.
+    */
+    std::vector<cc_run> runs;
+    label_union_find uf;
+    size_t prev_begin = 0, prev_end = 0;
+    for (size_t r = 0; r < nrows; ++r) {
+      size_t curr_begin = runs.size();
+      cc_rle_row_runs(data, start + r * stride, image.ncols(), r, runs);
+      size_t p = prev_begin;
+      for (size_t i = curr_begin; i < runs.size(); ++i) {
+        cc_run& run = runs[i];
+        while (p < prev_end && runs[p].end + 1 < run.begin)
+          ++p;
+        cc_label_type label = 0;
+        for (size_t q = p; q < prev_end && runs[q].begin <= run.end + 1; ++q) {
+          if (label == 0)
+            label = runs[q].label;
+          else
+            uf.merge(label, runs[q].label);
         }
-        // if ((i % 20) == 0)
-        // progress_bar.step();
+        run.label = label ? label : uf.new_label();
       }
+      prev_begin = curr_begin;
+      prev_end = runs.size();
+    }
+
+    size_t ncomponents = uf.flatten(2);
+    cc_check_label_limit<OneBitRleImageView>(ncomponents);
+
+    /*
+      Second pass - write the final labels and get bounding boxes
+    */
+    cc_component_table components(statistics != 0);
+    components.resize(ncomponents + 2);
+    for (std::vector<cc_run>::const_iterator i = runs.begin(); i != runs.end(); ++i) {
+      cc_label_type label = uf.final_label(i->label);
+      size_t pos = start + i->row * stride;
+      data.fill(pos + i->begin, pos + i->end + 1, OneBitPixel(label));
+      components.add_run(label, i->begin, i->end, i->row);
+    }
+
+    return cc_make_components(image, components, ncomponents, statistics);
+  }
+
+  inline ImageList* cc_analysis(OneBitRleImageView& image) {
+    return cc_analysis(image, (CcStatisticsTable*)0);
+  }
 
-      // create ConnectedComponents
-      ccs = new ImageList();
+  /*
+    Connected-component analysis on horizontal strips in parallel
+
+    Each strip is labeled with its own union-find structure.  The
+    strip labels are then numbered globally in strip order and joined
+    across the seams between the last row of a strip and the first
+    row of the next one.  As the smallest global label of a component
+    belongs to the strip part that comes first in raster order, the
+    result is identical to that of cc_analysis.
+
+    When compiled without OpenMP, or for storage formats other than
+    DENSE, this is the same as cc_analysis.
+  */
+  template<class T>
+  ImageList* cc_analysis_parallel(T& image, int num_threads, CcStatisticsTable* statistics) {
+    // strips lower than this are not worth the seam merging
+    const size_t min_strip_height = 32;
+    size_t nstrips = 1;
+#ifdef _OPENMP
+    if (cc_parallel_storage<typename T::data_type>::value) {
+      if (num_threads <= 0)
+        num_threads = omp_get_max_threads();
+      nstrips = std::min(size_t(num_threads), image.nrows() / min_strip_height);
+    }
+#endif
+    if (nstrips <= 1)
+      return cc_analysis(image, statistics);
+
+    std::vector<size_t> strip_begin(nstrips + 1);
+    for (size_t s = 0; s <= nstrips; ++s)
+      strip_begin[s] = s * image.nrows() / nstrips;
+    std::vector<label_union_find> strip_uf(nstrips);
+    std::vector<std::vector<cc_label_type> > first_row(nstrips), last_row(nstrips);
+    std::vector<cc_component_table> strip_components(nstrips, cc_component_table(statistics != 0));
+    std::vector<size_t> strip_ncomponents(nstrips);
+    std::string error;
+
+    /*
+      First pass on each strip
+    */
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(num_threads) schedule(static, 1)
+#endif
+    for (int s = 0; s < int(nstrips); ++s) {
       try {
-        for (size_t i = 0; i < rects.size(); ++i) {
-          if (rects[i] != 0) {
-            ccs->push_back(new ConnectedComponent<typename T::data_type>(*((typename T::data_type*)image.data()),
-                                                                         OneBitPixel(i),
-                                                                         Point(rects[i]->offset_x() + image.offset_x(),
-                                                                               rects[i]->offset_y() + image.offset_y()),
-                                                                         rects[i]->dim()));
-            delete rects[i];
-          }
-        }
-      } catch (std::exception e) {
-        for (ImageList::iterator i = ccs->begin(); i != ccs->end(); ++i)
-          delete *i;
-        delete ccs;
-        throw;
+        cc_label_strip(image, strip_begin[s], strip_begin[s + 1], strip_uf[s],
+                       first_row[s], last_row[s]);
+        strip_ncomponents[s] = strip_uf[s].flatten(1);
+      } catch (std::exception& e) {
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+        error = e.what();
       }
-    } catch (std::exception e) {
-      for (size_t i = 0; i != rects.size(); ++i)
-        delete rects[i];
     }
-    return ccs;
+    if (!error.empty())
+      throw std::runtime_error(error);
+
+    /*
+      Global labels of the strip components and seam merging.  The
+      strip labels are final_label() 1..n, so strip s starts at
+      offset[s] + 1.
+    */
+    std::vector<size_t> offset(nstrips + 1, 0);
+    for (size_t s = 0; s < nstrips; ++s)
+      offset[s + 1] = offset[s] + strip_ncomponents[s];
+    label_union_find global_uf;
+    for (size_t i = 0; i < offset[nstrips]; ++i)
+      global_uf.new_label();
+    const size_t ncols = image.ncols();
+    for (size_t s = 1; s < nstrips; ++s) {
+      const std::vector<cc_label_type>& above = last_row[s - 1];
+      const std::vector<cc_label_type>& below = first_row[s];
+      for (size_t c = 1; c <= ncols; ++c) {
+        if (below[c] == 0)
+          continue;
+        cc_label_type b = cc_label_type(offset[s] + strip_uf[s].final_label(below[c]));
+        for (size_t n = c - 1; n <= c + 1; ++n)
+          if (above[n])
+            global_uf.merge(b, cc_label_type(offset[s - 1] + strip_uf[s - 1].final_label(above[n])));
+      }
+    }
+    size_t ncomponents = global_uf.flatten(2);
+    cc_check_label_limit<T>(ncomponents);
+
+    std::vector<std::vector<cc_label_type> > to_global(nstrips);
+    for (size_t s = 0; s < nstrips; ++s) {
+      to_global[s].resize(strip_ncomponents[s] + 1, 0);
+      for (size_t i = 1; i <= strip_ncomponents[s]; ++i)
+        to_global[s][i] = global_uf.final_label(cc_label_type(offset[s] + i));
+    }
+
+    /*
+      Second pass on each strip
+    */
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(num_threads) schedule(static, 1)
+#endif
+    for (int s = 0; s < int(nstrips); ++s) {
+      try {
+        strip_components[s].resize(strip_ncomponents[s] + 1);
+        cc_relabel_strip(image, strip_begin[s], strip_begin[s + 1], strip_uf[s],
+                         &to_global[s], strip_components[s]);
+      } catch (std::exception& e) {
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+        error = e.what();
+      }
+    }
+    if (!error.empty())
+      throw std::runtime_error(error);
+
+    cc_component_table components(statistics != 0);
+    components.resize(ncomponents + 2);
+    for (size_t s = 0; s < nstrips; ++s)
+      for (size_t i = 1; i <= strip_ncomponents[s]; ++i)
+        components.add(to_global[s][i], strip_components[s], i);
+    return cc_make_components(image, components, ncomponents, statistics);
+  }
+
+  template<class T>
+  ImageList* cc_analysis_parallel(T& image, int num_threads) {
+    return cc_analysis_parallel(image, num_threads, (CcStatisticsTable*)0);
   }
 
   template<class T>
@@ -418,6 +829,97 @@ namespace Gamera {
         }
       } 
     }
+
+    /*
+      The statistics of the component cc in a table filled by
+      cc_analysis.
+    */
+    template<class T>
+    inline const CcStatistics& statistics(const CcStatisticsTable& table, const T& cc) {
+      return table[cc.label() - 2];
+    }
+
+    /*
+      The same as above, but the black area is taken from the statistics
+      collected by cc_analysis instead of counting the pixels again.
+    */
+    template<class T>
+    void filter_black_area_large(T& ccs, int max_area, const CcStatisticsTable& table) {
+      typename T::iterator i;
+      for (i = ccs.begin(); i != ccs.end();) {
+        int bai = (int)statistics(table, **i).black_area;
+        if (bai > max_area) {
+          std::fill((*i)->vec_begin(), (*i)->vec_end(), 0);
+          delete *i;
+          ccs.erase(i++);
+        } else {
+          ++i;
+        }
+      }
+    }
+
+    template<class T>
+    void filter_black_area_small(T& ccs, int min_area, const CcStatisticsTable& table) {
+      typename T::iterator i;
+      for (i = ccs.begin(); i != ccs.end();) {
+        int bai = (int)statistics(table, **i).black_area;
+        if (bai < min_area) {
+          std::fill((*i)->vec_begin(), (*i)->vec_end(), 0);
+          delete *i;
+          ccs.erase(i++);
+        } else {
+          ++i;
+        }
+      }
+    }
+  }
+
+  /*
+    PyObject* cc_analysis_statistics(OneBit image, int num_threads);
+
+    Labels the image with cc_analysis_parallel and returns the tuple
+    (ccs, statistics), where statistics[i] is the tuple
+    (black_area, center_x, center_y, mu20, mu11, mu02) of ccs[i] as
+    collected while labeling.
+  */
+  template<class T>
+  PyObject* cc_analysis_statistics(T& image, int num_threads) {
+    CcStatisticsTable table;
+    ImageList* ccs = cc_analysis_parallel(image, num_threads, &table);
+    PyObject* stats = PyList_New(table.size());
+    for (size_t i = 0; i < table.size(); ++i) {
+      const CcStatistics& s = table[i];
+      PyList_SET_ITEM(stats, i, Py_BuildValue(CHAR_PTR_CAST "(lddddd)",
+                                              long(s.black_area),
+                                              s.centroid_x(), s.centroid_y(),
+                                              s.mu20(), s.mu11(), s.mu02()));
+    }
+    PyObject* pyccs = ImageList_to_python(ccs);
+    delete ccs;
+    return Py_BuildValue(CHAR_PTR_CAST "(NN)", pyccs, stats);
+  }
+
+  /*
+    ImageList* cc_analysis_filter_black_area(OneBit image, int min_area,
+                                             int max_area, int num_threads);
+
+    cc_analysis_parallel followed by the table based
+    ccs::filter_black_area_small and ccs::filter_black_area_large.
+  */
+  template<class T>
+  ImageList* cc_analysis_filter_black_area(T& image, int min_area, int max_area,
+                                           int num_threads) {
+    typedef ConnectedComponent<typename T::data_type> cc_type;
+    CcStatisticsTable table;
+    ImageList* ccs = cc_analysis_parallel(image, num_threads, &table);
+    // the filters need the labels of the components
+    std::list<cc_type*> typed;
+    for (ImageList::iterator i = ccs->begin(); i != ccs->end(); ++i)
+      typed.push_back(static_cast<cc_type*>(*i));
+    ccs::filter_black_area_small(typed, min_area, table);
+    ccs::filter_black_area_large(typed, max_area, table);
+    ccs->assign(typed.begin(), typed.end());
+    return ccs;
   }
 
   size_t find_split_point(IntVector *projections, double& center) {
@@ -65,6 +65,36 @@ void threshold_fill(const T& in, U& out, typename T::value_type threshold) {
   }
 }
 
+/*
+  For bit-packed output, the result is assembled 64 pixels at a time
+  and written with a single word store.
+*/
+template<class T>
+void threshold_fill(const T& in, OneBitPackedImageView& out, typename T::value_type threshold) {
+  using namespace PackedDataDetail;
+  if (in.nrows() != out.nrows() || in.ncols() != out.ncols())
+    throw std::range_error("Dimensions must match!");
+
+  typename T::const_row_iterator in_row = in.row_begin();
+  typename T::const_col_iterator in_col;
+  ImageAccessor<typename T::value_type> in_acc;
+  size_t off = packed_col_offset(out);
+
+  for (size_t r = 0; in_row != in.row_end(); ++in_row, ++r) {
+    word_type* row = packed_row(out, r);
+    in_col = in_row.begin();
+    for (size_t c = 0; c < in.ncols(); c += WORD_BITS) {
+      size_t n = std::min(WORD_BITS, in.ncols() - c);
+      word_type bits = 0;
+      for (size_t i = 0; i < n; ++i, ++in_col) {
+        if (!(in_acc.get(in_col) > threshold))
+          bits |= word_type(1) << i;
+      }
+      store_bits(row, off + c, bits, n);
+    }
+  }
+}
+
 /*
   Image* threshold(GreyScale|Grey16|Float image, threshold, storage_format);
 
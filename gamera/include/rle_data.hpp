@@ -40,6 +40,7 @@
 #include <utility>
 #include <cassert>
 #include <iterator>
+#include <algorithm>
 
 #ifndef kwm05072002_rle_data
 #define kwm05072002_rle_data
@@ -635,6 +636,25 @@ namespace Gamera {
 	}
       }
 
+      /*
+	Set all positions in [begin, end) to v. This works on whole
+	runs instead of single positions, so the cost depends on the
+	number of runs in the affected chunks, not on end - begin.
+      */
+      void fill(size_t begin, size_t end, value_type v) {
+	assert(begin <= end && end <= m_size);
+	if (begin == end)
+	  return;
+	size_t first_chunk = get_chunk(begin);
+	size_t last_chunk = get_chunk(end - 1);
+	for (size_t chunk = first_chunk; chunk <= last_chunk; ++chunk) {
+	  size_t lo = (chunk == first_chunk) ? get_rel_pos(begin) : 0;
+	  size_t hi = (chunk == last_chunk) ? get_rel_pos(end - 1) : RLE_CHUNK_1;
+	  fill_in_chunk(chunk, lo, hi, v);
+	}
+	m_dirty++;
+      }
+
       /*
 	Iterator access
       */
@@ -785,6 +805,39 @@ namespace Gamera {
 	  }
 	}
       }
+      /*
+	Replaces the relative positions [lo, hi] of a chunk by a
+	single run of value v (see fill).
+      */
+      void fill_in_chunk(size_t chunk, size_t lo, size_t hi, value_type v) {
+	list_type& runs = m_data[chunk];
+	list_type result;
+	size_t start = 0;
+	typename list_type::iterator i = runs.begin();
+	// runs (or their parts) before lo
+	for (; i != runs.end() && start < lo; ++i) {
+	  size_t run_end = std::min(size_t(i->end), lo - 1);
+	  append_run(result, run_end, i->value);
+	  start = size_t(i->end) + 1;
+	}
+	if (lo > 0 && v != 0 && (result.empty() || size_t(result.back().end) < lo - 1))
+	  append_run(result, lo - 1, 0);
+	append_run(result, hi, v);
+	// runs (or their parts) after hi
+	for (i = runs.begin(); i != runs.end(); ++i)
+	  if (size_t(i->end) > hi)
+	    append_run(result, i->end, i->value);
+	// pixels off the end of the list are white anyway
+	while (!result.empty() && result.back().value == 0)
+	  result.pop_back();
+	runs.swap(result);
+      }
+      void append_run(list_type& runs, size_t end, value_type v) {
+	if (!runs.empty() && runs.back().value == v)
+	  runs.back().end = runsize_t(end);
+	else
+	  runs.push_back(run_type(runsize_t(end), v));
+      }
     public:
       size_t m_size;
       std::vector<list_type> m_data;
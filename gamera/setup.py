@@ -193,6 +193,13 @@ else:
                       extra_compile_args=["-Wall"]
                       )
 
+# classify_batch of the kNN classifier runs in parallel with OpenMP
+knncore_extras = dict(gamera_setup.extras)
+if has_openmp:
+    knncore_extras['extra_compile_args'] = \
+        knncore_extras.get('extra_compile_args', []) + ["-fopenmp"]
+    knncore_extras['extra_link_args'] = \
+        knncore_extras.get('extra_link_args', []) + ["-fopenmp"]
 
 extensions = [Extension("gamera.gameracore",
                         ["src/gameramodule.cpp",
@@ -215,7 +222,7 @@ extensions = [Extension("gamera.gameracore",
               Extension("gamera.knncore", 
                         ["src/knncoremodule.cpp"],
                         include_dirs=["include", "src"],
-                        **gamera_setup.extras
+                        **knncore_extras
                         ),
               ExtGA,
               Extension("gamera.graph", graph_files,
@@ -223,6 +230,10 @@ extensions = [Extension("gamera.gameracore",
                         **gamera_setup.extras),
               Extension("gamera.kdtree", kdtree_files,
                         include_dirs=["include", "src", "include/geostructs"],
+                        **gamera_setup.extras),
+              # only used by tests/test_packed.py
+              Extension("gamera._packedtest", ["src/packedtestmodule.cpp"],
+                        include_dirs=["include", "include/plugins"],
                         **gamera_setup.extras)]
 extensions.extend(plugin_extensions)
 
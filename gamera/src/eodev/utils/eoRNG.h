@@ -148,6 +148,8 @@ public :
     void reseed(uint32_t s)
         {
             initialize(2*s);
+            // the same seed has to give the same normal deviates
+            cached = false;
         }
 
     /* FIXME remove in next release
@@ -0,0 +1,368 @@
+/*
+ *
+ * Copyright (C) 2026 Gamera developers
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "graph/graph.hpp"
+#include "graph/node.hpp"
+#include "graph/edge.hpp"
+#include "graph/csr_graph.hpp"
+#include <algorithm>
+#include <functional>
+#include <queue>
+#include <stdexcept>
+#include <limits>
+
+namespace Gamera { namespace GraphApi {
+
+
+
+const CsrGraph::node_t CsrGraph::NO_NODE;
+
+
+
+// -----------------------------------------------------------------------------
+CsrGraph::CsrGraph(Graph* g) {
+   _directed = g->is_directed();
+   _nedges = g->get_nedges();
+
+   _nodes.reserve(g->get_nnodes());
+   for(NodeIterator it = g->_nodes.begin(); it != g->_nodes.end(); it++) {
+      _ids[*it] = (node_t)_nodes.size();
+      _nodes.push_back(*it);
+   }
+
+   // the Node edge lists already are adjacency lists in insertion order
+   _offsets.resize(_nodes.size() + 1);
+   _offsets[0] = 0;
+   for(size_t i = 0; i < _nodes.size(); i++) {
+      Node* n = _nodes[i];
+      for(EdgeIterator eit = n->_edges.begin(); eit != n->_edges.end(); eit++) {
+         Node* m = (*eit)->traverse(n);
+         if(m != NULL) {
+            _neighbors.push_back(_ids[m]);
+            _weights.push_back((*eit)->weight);
+         }
+      }
+      _offsets[i+1] = _neighbors.size();
+   }
+}
+
+
+
+// -----------------------------------------------------------------------------
+CsrGraph::CsrGraph(const std::vector<std::pair<long, long> >& labelpairs,
+      bool directed, const std::vector<cost_t>* weights) {
+   _directed = directed;
+   _nedges = labelpairs.size();
+   if(weights != NULL && weights->size() != labelpairs.size())
+      throw std::invalid_argument("CsrGraph: number of weights does not "
+            "match the number of label pairs");
+
+   _labels.reserve(2 * labelpairs.size());
+   for(size_t i = 0; i < labelpairs.size(); i++) {
+      _labels.push_back(labelpairs[i].first);
+      _labels.push_back(labelpairs[i].second);
+   }
+   std::sort(_labels.begin(), _labels.end());
+   _labels.erase(std::unique(_labels.begin(), _labels.end()), _labels.end());
+
+   std::vector<node_t> from, to;
+   std::vector<cost_t> weight;
+   size_t nentries = directed ? labelpairs.size() : 2 * labelpairs.size();
+   from.reserve(nentries);
+   to.reserve(nentries);
+   weight.reserve(nentries);
+   for(size_t i = 0; i < labelpairs.size(); i++) {
+      node_t a = get_node_id(labelpairs[i].first);
+      node_t b = get_node_id(labelpairs[i].second);
+      cost_t w = (weights == NULL) ? 1.0 : (*weights)[i];
+      from.push_back(a); to.push_back(b); weight.push_back(w);
+      if(!directed) {
+         from.push_back(b); to.push_back(a); weight.push_back(w);
+      }
+   }
+   build(from, to, weight, _labels.size());
+}
+
+
+
+// -----------------------------------------------------------------------------
+// counting sort of the edge entries by their source node; stable, so that
+// the neighbors keep the order of the input
+void CsrGraph::build(std::vector<node_t>& from, std::vector<node_t>& to,
+      std::vector<cost_t>& weight, size_t nnodes) {
+   _offsets.assign(nnodes + 1, 0);
+   for(size_t i = 0; i < from.size(); i++)
+      _offsets[from[i] + 1]++;
+   for(size_t i = 0; i < nnodes; i++)
+      _offsets[i+1] += _offsets[i];
+
+   std::vector<size_t> pos(_offsets.begin(), _offsets.end() - 1);
+   _neighbors.resize(from.size());
+   _weights.resize(from.size());
+   for(size_t i = 0; i < from.size(); i++) {
+      size_t p = pos[from[i]]++;
+      _neighbors[p] = to[i];
+      _weights[p] = weight[i];
+   }
+}
+
+
+
+// -----------------------------------------------------------------------------
+CsrGraph::node_t CsrGraph::get_node_id(long label) const {
+   std::vector<long>::const_iterator it =
+      std::lower_bound(_labels.begin(), _labels.end(), label);
+   if(it == _labels.end() || *it != label)
+      return NO_NODE;
+   return (node_t)(it - _labels.begin());
+}
+
+
+
+// -----------------------------------------------------------------------------
+CsrGraph::node_t CsrGraph::get_node_id(Node* node) const {
+   std::map<Node*, node_t>::const_iterator it = _ids.find(node);
+   if(it == _ids.end())
+      return NO_NODE;
+   return it->second;
+}
+
+
+
+// -----------------------------------------------------------------------------
+void CsrGraph::BFS(node_t start, std::vector<node_t>& order) const {
+   std::vector<bool> visited(get_nnodes(), false);
+   order.clear();
+   order.push_back(start);
+   visited[start] = true;
+   // order doubles as the queue
+   for(size_t head = 0; head < order.size(); head++) {
+      node_t n = order[head];
+      for(size_t p = _offsets[n]; p < _offsets[n+1]; p++) {
+         node_t m = _neighbors[p];
+         if(!visited[m]) {
+            visited[m] = true;
+            order.push_back(m);
+         }
+      }
+   }
+}
+
+
+
+// -----------------------------------------------------------------------------
+void CsrGraph::DFS(node_t start, std::vector<node_t>& order) const {
+   std::vector<bool> visited(get_nnodes(), false);
+   std::vector<node_t> stack;
+   order.clear();
+   stack.push_back(start);
+   visited[start] = true;
+   while(!stack.empty()) {
+      node_t n = stack.back();
+      stack.pop_back();
+      order.push_back(n);
+      for(size_t p = _offsets[n]; p < _offsets[n+1]; p++) {
+         node_t m = _neighbors[p];
+         if(!visited[m]) {
+            visited[m] = true;
+            stack.push_back(m);
+         }
+      }
+   }
+}
+
+
+
+// -----------------------------------------------------------------------------
+void CsrGraph::dijkstra_shortest_path(node_t source,
+      std::vector<cost_t>& distances, std::vector<node_t>& predecessors) const {
+   typedef std::pair<cost_t, node_t> HeapEntry;
+   std::priority_queue<HeapEntry, std::vector<HeapEntry>,
+      std::greater<HeapEntry> > heap;
+
+   distances.assign(get_nnodes(), std::numeric_limits<cost_t>::infinity());
+   predecessors.assign(get_nnodes(), NO_NODE);
+   distances[source] = 0;
+   heap.push(HeapEntry(0, source));
+
+   // outdated heap entries are skipped instead of decreasing keys
+   while(!heap.empty()) {
+      HeapEntry top = heap.top();
+      heap.pop();
+      node_t n = top.second;
+      if(top.first > distances[n])
+         continue;
+      for(size_t p = _offsets[n]; p < _offsets[n+1]; p++) {
+         node_t m = _neighbors[p];
+         cost_t d = top.first + _weights[p];
+         if(d < distances[m]) {
+            distances[m] = d;
+            predecessors[m] = n;
+            heap.push(HeapEntry(d, m));
+         }
+      }
+   }
+}
+
+
+
+// -----------------------------------------------------------------------------
+struct CsrEdgeWeightLess {
+   const std::vector<cost_t>& _weights;
+   CsrEdgeWeightLess(const std::vector<cost_t>& weights) : _weights(weights) {}
+   bool operator() (size_t a, size_t b) const {
+      return _weights[a] < _weights[b];
+   }
+};
+
+void CsrGraph::minimum_spanning_tree(
+      std::vector<std::pair<node_t, node_t> >& edges,
+      std::vector<cost_t>* weights) const {
+   // each undirected edge is stored twice, only use the entry with from < to
+   std::vector<size_t> entries;
+   std::vector<node_t> from;
+   from.reserve(_neighbors.size());
+   entries.reserve(_directed ? _neighbors.size() : _neighbors.size() / 2);
+   for(node_t n = 0; n < get_nnodes(); n++) {
+      for(size_t p = _offsets[n]; p < _offsets[n+1]; p++) {
+         from.push_back(n);
+         if(_neighbors[p] != n && (_directed || n < _neighbors[p]))
+            entries.push_back(p);
+      }
+   }
+   std::stable_sort(entries.begin(), entries.end(), CsrEdgeWeightLess(_weights));
+
+   UnionFind sets(get_nnodes());
+   edges.clear();
+   if(weights != NULL)
+      weights->clear();
+   for(size_t i = 0; i < entries.size() && edges.size() + 1 < get_nnodes(); i++) {
+      size_t p = entries[i];
+      if(sets.unite(from[p], _neighbors[p])) {
+         edges.push_back(std::make_pair(from[p], _neighbors[p]));
+         if(weights != NULL)
+            weights->push_back(_weights[p]);
+      }
+   }
+}
+
+
+
+// -----------------------------------------------------------------------------
+void CsrGraph::minimum_spanning_tree_prim(
+      std::vector<std::pair<node_t, node_t> >& edges,
+      std::vector<cost_t>* weights) const {
+   if(_directed)
+      throw std::invalid_argument("Prim's algorithm is only for undirected "
+            "graphs");
+
+   size_t n = get_nnodes();
+   std::vector<cost_t> key(n, std::numeric_limits<cost_t>::infinity());
+   std::vector<node_t> parent(n, NO_NODE);
+   std::vector<char> in_tree(n, 0);
+   edges.clear();
+   if(weights != NULL)
+      weights->clear();
+
+   for(size_t step = 0; step < n; step++) {
+      // a node with infinite key starts the tree of the next component
+      node_t u = NO_NODE;
+      for(node_t v = 0; v < n; v++)
+         if(!in_tree[v] && (u == NO_NODE || key[v] < key[u]))
+            u = v;
+      in_tree[u] = 1;
+      if(parent[u] != NO_NODE) {
+         edges.push_back(std::make_pair(parent[u], u));
+         if(weights != NULL)
+            weights->push_back(key[u]);
+      }
+      for(size_t p = _offsets[u]; p < _offsets[u+1]; p++) {
+         node_t v = _neighbors[p];
+         if(!in_tree[v] && _weights[p] < key[v]) {
+            key[v] = _weights[p];
+            parent[v] = u;
+         }
+      }
+   }
+}
+
+
+
+// -----------------------------------------------------------------------------
+void CsrGraph::subgraph_roots(std::vector<node_t>& roots) const {
+   // Like SubgraphRoots, every node not reached yet becomes a root, and all
+   // nodes reached from it are no roots. Each search has its own visited
+   // stamp, so that a directed search also walks through nodes reached
+   // before. In an undirected graph this never happens.
+   size_t n = get_nnodes();
+   std::vector<char> reached(n, 0);
+   std::vector<char> is_root(n, 0);
+   std::vector<node_t> stamp(n, NO_NODE);
+   std::vector<node_t> stack;
+
+   for(node_t root = 0; root < n; root++) {
+      if(reached[root])
+         continue;
+      reached[root] = 1;
+      is_root[root] = 1;
+      stamp[root] = root;
+      stack.push_back(root);
+      while(!stack.empty()) {
+         node_t v = stack.back();
+         stack.pop_back();
+         for(size_t p = _offsets[v]; p < _offsets[v+1]; p++) {
+            node_t m = _neighbors[p];
+            if(stamp[m] != root) {
+               stamp[m] = root;
+               reached[m] = 1;
+               is_root[m] = 0;
+               stack.push_back(m);
+            }
+         }
+      }
+   }
+
+   roots.clear();
+   for(node_t i = 0; i < n; i++)
+      if(is_root[i])
+         roots.push_back(i);
+}
+
+
+
+// -----------------------------------------------------------------------------
+size_t CsrGraph::get_nsubgraphs() const {
+   std::vector<node_t> roots;
+   subgraph_roots(roots);
+   return roots.size();
+}
+
+
+
+// -----------------------------------------------------------------------------
+size_t CsrGraph::size_of_subgraph(node_t start) const {
+   std::vector<node_t> order;
+   DFS(start, order);
+   return order.size();
+}
+
+
+
+}} // end Gamera::GraphApi
+
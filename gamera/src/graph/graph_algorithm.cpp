@@ -24,6 +24,7 @@
 #include "graph/spanning_tree.hpp"
 #include "graph/shortest_path.hpp"
 #include "graph/subgraph_root.hpp"
+#include "graph/csr_graph.hpp"
 
 namespace Gamera { namespace GraphApi {
 
@@ -42,6 +43,12 @@ NodeVector *Graph::get_subgraph_roots() {
 
 // -----------------------------------------------------------------------------
 size_t Graph::get_nsubgraphs() {
+   // in undirected graphs, the subgraphs are the connected components,
+   // which are much cheaper to count on the CSR arrays
+   if(!is_directed()) {
+      CsrGraph csr(this);
+      return csr.get_nsubgraphs();
+   }
    NodeVector *roots = get_subgraph_roots();
    size_t count = roots->size();
    delete roots;
@@ -106,13 +113,11 @@ bool Graph::has_path(Node* from_node, Node* to_node) {
 /// returns size of subgraph with root *node*. please remind that starting node
 /// is not counted;
 size_t Graph::size_of_subgraph(Node* node) {
-   DfsIterator it(this, node);
-   size_t count = 0;
-
-   while(it.next() != NULL)
-      count++;
-
-   return count;
+   CsrGraph csr(this);
+   CsrGraph::node_t id = csr.get_node_id(node);
+   if(id == CsrGraph::NO_NODE)
+      return 0;
+   return csr.size_of_subgraph(id);
 }
 
 
@@ -155,14 +160,45 @@ DfsIterator* Graph::DFS(GraphData * value) {
 
 
 
+// -----------------------------------------------------------------------------
+/// Runs Dijkstra's algorithm on the CSR snapshot and returns the paths in
+/// the form of ShortestPath: every node of the graph is a key, a path
+/// lists the nodes from the destination back to the source, and a node
+/// that is not reachable gets cost 0 and a path of only itself.
+static ShortestPathMap* csr_shortest_path_map(const CsrGraph& csr,
+      CsrGraph::node_t source) {
+   std::vector<cost_t> distances;
+   std::vector<CsrGraph::node_t> predecessors;
+   csr.dijkstra_shortest_path(source, distances, predecessors);
+
+   ShortestPathMap* result = new ShortestPathMap();
+   for(CsrGraph::node_t i = 0; i < csr.get_nnodes(); i++) {
+      DijkstraPath& path = (*result)[csr._nodes[i]];
+      if(i != source && predecessors[i] == CsrGraph::NO_NODE) {
+         path.cost = 0;
+         path.path.push_back(csr._nodes[i]);
+         continue;
+      }
+      path.cost = distances[i];
+      for(CsrGraph::node_t n = i; n != CsrGraph::NO_NODE; n = predecessors[n])
+         path.path.push_back(csr._nodes[n]);
+   }
+   return result;
+}
+
+
+
 // -----------------------------------------------------------------------------
 ShortestPathMap* Graph::dijkstra_shortest_path(Node* node) {
    if(node == NULL) {
       return NULL;
    }
    else {
-      ShortestPath s;
-      return s.dijkstra_shortest_path(this, node);
+      CsrGraph csr(this);
+      CsrGraph::node_t id = csr.get_node_id(node);
+      if(id == CsrGraph::NO_NODE)
+         return NULL;
+      return csr_shortest_path_map(csr, id);
    }
 }
 
@@ -178,14 +214,11 @@ ShortestPathMap* Graph::dijkstra_shortest_path(GraphData * value) {
 
 // -----------------------------------------------------------------------------
 std::map<Node*, ShortestPathMap*> Graph::dijkstra_all_pairs_shortest_path() {
+   // one snapshot for all sources
    std::map<Node*, ShortestPathMap*> res;
-   NodePtrIterator *it = get_nodes();
-   Node* n;
-   
-   while((n=it->next()) != NULL) {
-      res[n] = dijkstra_shortest_path(n);
-   }   
-   delete it;
+   CsrGraph csr(this);
+   for(CsrGraph::node_t i = 0; i < csr.get_nnodes(); i++)
+      res[csr._nodes[i]] = csr_shortest_path_map(csr, i);
    return res;
 }
 
@@ -226,5 +259,12 @@ Graph *Graph::create_minimum_spanning_tree() { //Kruskal
 
 
 
+// -----------------------------------------------------------------------------
+Graph *Graph::create_minimum_spanning_tree_prim() {
+   return SpanningTree::create_minimum_spanning_tree_prim(this);
+}
+
+
+
 }} // end Gamera::GraphApi
 
@@ -21,6 +21,8 @@
 #include "nodeobject.hpp"
 #include "graphobject.hpp"
 #include "edgeobject.hpp"
+#include "csr_graph.hpp"
+#include <stdexcept>
 
 
 
@@ -46,6 +48,83 @@ static PyObject* Factory(PyObject* self, PyObject* args) {
 
 
 
+// Creates a graph from label adjacency pairs (e.g. from
+// labeled_region_neighbors). The CSR label constructor numbers the labels,
+// so that every pair is added by node pointers without value lookups.
+static PyObject* from_label_pairs(PyObject* self, PyObject* args) {
+  PyObject *pairs = NULL, *weights = Py_None;
+  long flags = FLAG_UNDIRECTED;
+  if (PyArg_ParseTuple(args, CHAR_PTR_CAST "O|Ol:from_label_pairs", &pairs,
+                       &weights, &flags) <= 0)
+    return 0;
+
+  PyObject* seq = PySequence_Fast(pairs, "labelpairs must be iterable");
+  if (seq == NULL)
+    return 0;
+  std::vector<std::pair<long, long> > labelpairs;
+  size_t npairs = PySequence_Fast_GET_SIZE(seq);
+  labelpairs.reserve(npairs);
+  for (size_t i = 0; i < npairs; i++) {
+    PyObject* pair = PySequence_Fast(PySequence_Fast_GET_ITEM(seq, i), "");
+    long a = -1, b = -1;
+    if (pair != NULL && PySequence_Fast_GET_SIZE(pair) == 2) {
+      a = PyInt_AsLong(PySequence_Fast_GET_ITEM(pair, 0));
+      b = PyInt_AsLong(PySequence_Fast_GET_ITEM(pair, 1));
+    }
+    if (pair == NULL || PySequence_Fast_GET_SIZE(pair) != 2 || PyErr_Occurred()) {
+      Py_XDECREF(pair);
+      Py_DECREF(seq);
+      PyErr_SetString(PyExc_TypeError,
+                      "labelpairs must be pairs of integer labels");
+      return 0;
+    }
+    Py_DECREF(pair);
+    labelpairs.push_back(std::make_pair(a, b));
+  }
+  Py_DECREF(seq);
+
+  std::vector<cost_t> costs;
+  if (weights != Py_None) {
+    PyObject* wseq = PySequence_Fast(weights, "weights must be iterable");
+    if (wseq == NULL)
+      return 0;
+    size_t nweights = PySequence_Fast_GET_SIZE(wseq);
+    costs.reserve(nweights);
+    for (size_t i = 0; i < nweights; i++)
+      costs.push_back(PyFloat_AsDouble(PySequence_Fast_GET_ITEM(wseq, i)));
+    Py_DECREF(wseq);
+    if (PyErr_Occurred())
+      return 0;
+  }
+
+  CsrGraph* csr;
+  try {
+    csr = new CsrGraph(labelpairs, (flags & FLAG_DIRECTED) != 0,
+                       weights == Py_None ? NULL : &costs);
+  }
+  catch (std::invalid_argument e) {
+    PyErr_SetString(PyExc_ValueError, e.what());
+    return 0;
+  }
+
+  GraphObject* so = graph_new((flag_t)flags);
+  std::vector<Node*> nodes(csr->get_nnodes());
+  for (size_t i = 0; i < nodes.size(); i++) {
+    PyObject* label = PyInt_FromLong(csr->_labels[i]);
+    nodes[i] = so->_graph->add_node_ptr(new GraphDataPyObject(label));
+    Py_DECREF(label);
+  }
+  for (size_t i = 0; i < npairs; i++)
+    so->_graph->add_edge(nodes[csr->get_node_id(labelpairs[i].first)],
+                         nodes[csr->get_node_id(labelpairs[i].second)],
+                         costs.empty() ? 1.0 : costs[i],
+                         so->_graph->is_directed());
+  delete csr;
+  return (PyObject*)so;
+}
+
+
+
 // defines some convenience wrappers for creating graphs easier.
 PyMethodDef graph_module_methods[] = {
   { CHAR_PTR_CAST "Tree", Factory<FLAG_TREE>, METH_VARARGS,
@@ -58,6 +137,12 @@ PyMethodDef graph_module_methods[] = {
     CHAR_PTR_CAST "Create a new directed acyclic graph" },
   { CHAR_PTR_CAST "Undirected", Factory<FLAG_UNDIRECTED>, METH_VARARGS,
     CHAR_PTR_CAST "Create a new undirected (cyclic) graph" },
+  { CHAR_PTR_CAST "from_label_pairs", from_label_pairs, METH_VARARGS,
+    CHAR_PTR_CAST "**from_label_pairs** (*labelpairs*, *weights* = None, *flags* = ``UNDIRECTED``)\n\n"
+    "Create a new graph from a list of label pairs, as returned by "
+    "labeled_region_neighbors. The nodes are the labels in ascending order, "
+    "and each pair becomes an edge with the cost given in *weights* (1.0 by "
+    "default). Pairs that violate the restrictions of *flags* are skipped." },
   {NULL}
 };
 
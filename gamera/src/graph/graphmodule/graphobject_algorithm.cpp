@@ -24,6 +24,8 @@
 #include "iteratorobject.hpp"
 #include "bfsdfsiterator.hpp"
 #include "nodeobject.hpp"
+#include "csr_graph.hpp"
+#include <limits>
 
 
 
@@ -69,6 +71,10 @@ PyObject* graph_dijkstra_shortest_path(PyObject* self, PyObject* root) {
       GraphDataPyObject a(root);
       pathmap = so->_graph->dijkstra_shortest_path(&a);
    }
+   if(pathmap == NULL) {
+      PyErr_SetString(PyExc_KeyError, "starting-node not found");
+      return NULL;
+   }
    PyObject* pathdict = pathmap_to_dict(pathmap);
    delete pathmap;
    return pathdict;
@@ -149,6 +155,8 @@ PyObject* graph_create_spanning_tree(PyObject* self, PyObject* pyobject) {
 // graph_create_minimum_spanning_tree_unique_distances
 // -----------------------------------------------------------------------------
 
+enum MstAlgorithm { MST_KRUSKAL, MST_PRIM };
+
 /// Sorting class for graph_create_minimum_spanning_tree_unique_distances
 struct DistsSorter {
    DistsSorter(FloatImageView* image) { m_image = image; }
@@ -166,7 +174,7 @@ struct DistsSorter {
 
 // -----------------------------------------------------------------------------
 PyObject* graph_create_minimum_spanning_tree_unique_distances(GraphObject* so, 
-      PyObject* images, PyObject* uniq_dists) {
+      PyObject* images, PyObject* uniq_dists, MstAlgorithm algorithm) {
 
    PyObject* images_seq = PySequence_Fast(images, "images must be iteratable");
    if (images_seq == NULL)
@@ -202,25 +210,19 @@ PyObject* graph_create_minimum_spanning_tree_unique_distances(GraphObject* so,
       Py_DECREF(images_seq);
       return 0;
    }
+   int images_len = PySequence_Fast_GET_SIZE(images_seq);
+   if (size_t(images_len) != dists->nrows()) {
+      PyErr_SetString(PyExc_ValueError, 
+            "the number of images does not match the distance matrix.");
+      Py_DECREF(images_seq);
+      return 0;
+   }
 
    // get the graph ready
    so->_graph->remove_all_edges();
    GRAPH_UNSET_FLAG(so->_graph, FLAG_CYCLIC);
 
-   // make the list for sorting
-   typedef std::vector<std::pair<size_t, size_t> > index_vec_type;
-   index_vec_type indexes(((dists->nrows() * dists->nrows()) - dists->nrows()) / 2);
-   size_t row, col, index = 0;
-   for (row = 0; row < dists->nrows(); ++row) {
-      for (col = row + 1; col < dists->nrows(); ++col) {
-         indexes[index].first = row;
-         indexes[index++].second = col;
-      }
-   }
-   std::sort(indexes.begin(), indexes.end(), DistsSorter(dists));
-
    // Add the nodes to the graph and build our map for later
-   int images_len = PySequence_Fast_GET_SIZE(images_seq);
    std::vector<Node*> nodes(images_len);
    int i;
    for (i = 0; i < images_len; ++i) {
@@ -230,16 +232,54 @@ PyObject* graph_create_minimum_spanning_tree_unique_distances(GraphObject* so,
    }
    Py_DECREF(images_seq);
 
-   // create the mst using kruskal
-   i = 0;
-   while (i < int(indexes.size()) && (int(so->_graph->get_nedges()) 
-            < (images_len - 1))) {
-
-      size_t row = indexes[i].first;
-      size_t col = indexes[i].second;
-      cost_t weight = dists->get(Point(col, row));
-      so->_graph->add_edge(nodes[row], nodes[col], weight);
-      ++i;
+   if (algorithm == MST_PRIM) {
+      // the complete graph is dense, so Prim's algorithm with a linear
+      // minimum search needs neither an edge list nor sorting
+      std::vector<cost_t> key(images_len, std::numeric_limits<cost_t>::infinity());
+      std::vector<int> parent(images_len, -1);
+      std::vector<char> in_tree(images_len, 0);
+      for (int step = 0; step < images_len; ++step) {
+         int u = -1;
+         for (int v = 0; v < images_len; ++v)
+            if (!in_tree[v] && (u < 0 || key[v] < key[u]))
+               u = v;
+         in_tree[u] = 1;
+         if (parent[u] >= 0)
+            so->_graph->add_edge(nodes[parent[u]], nodes[u], key[u]);
+         for (int v = 0; v < images_len; ++v) {
+            if (!in_tree[v]) {
+               cost_t weight = dists->get(Point(v, u));
+               if (weight < key[v]) {
+                  key[v] = weight;
+                  parent[v] = u;
+               }
+            }
+         }
+      }
+   }
+   else {
+      // make the list for sorting
+      typedef std::vector<std::pair<size_t, size_t> > index_vec_type;
+      index_vec_type indexes(((dists->nrows() * dists->nrows()) - dists->nrows()) / 2);
+      size_t row, col, index = 0;
+      for (row = 0; row < dists->nrows(); ++row) {
+         for (col = row + 1; col < dists->nrows(); ++col) {
+            indexes[index].first = row;
+            indexes[index++].second = col;
+         }
+      }
+      std::sort(indexes.begin(), indexes.end(), DistsSorter(dists));
+
+      // create the mst using kruskal
+      UnionFind sets(images_len);
+      for (index = 0; index < indexes.size() && 
+            (int(so->_graph->get_nedges()) < (images_len - 1)); ++index) {
+         row = indexes[index].first;
+         col = indexes[index].second;
+         if (sets.unite(row, col))
+            so->_graph->add_edge(nodes[row], nodes[col], 
+                  dists->get(Point(col, row)));
+      }
    }
 
    RETURN_VOID();
@@ -248,17 +288,25 @@ PyObject* graph_create_minimum_spanning_tree_unique_distances(GraphObject* so,
 
 
 // -----------------------------------------------------------------------------
-PyObject* graph_create_minimum_spanning_tree(PyObject* self, PyObject* args) {
+/// Without arguments, a new minimum spanning tree of the graph is returned.
+/// Otherwise the graph is replaced by the minimum spanning tree of the given
+/// images with the distances from the given matrix.
+static PyObject* graph_create_minimum_spanning_tree_with(PyObject* self, 
+      PyObject* args, const char* format, MstAlgorithm graph_algorithm,
+      MstAlgorithm matrix_algorithm) {
    INIT_SELF_GRAPH();
 
    PyObject* images = NULL;
    PyObject* uniq_dists = NULL;
-   if(PyArg_ParseTuple(args, CHAR_PTR_CAST "|OO:create_minimum_spanning_tree", 
-            &images, &uniq_dists) <= 0)
+   if(PyArg_ParseTuple(args, CHAR_PTR_CAST format, &images, &uniq_dists) <= 0)
       return NULL;
    
    if (images == NULL || uniq_dists == NULL) {
-      Graph* g = so->_graph->create_minimum_spanning_tree(); 
+      Graph* g;
+      if (graph_algorithm == MST_PRIM)
+         g = so->_graph->create_minimum_spanning_tree_prim();
+      else
+         g = so->_graph->create_minimum_spanning_tree(); 
       if(g == NULL) {
          PyErr_SetString(PyExc_TypeError, "Graph Type does not match");
          return NULL;
@@ -269,30 +317,69 @@ PyObject* graph_create_minimum_spanning_tree(PyObject* self, PyObject* args) {
    }
    else
       return graph_create_minimum_spanning_tree_unique_distances(so, images, 
-            uniq_dists);
+            uniq_dists, matrix_algorithm);
 
 }
 
 
 
 // -----------------------------------------------------------------------------
-PyObject* graph_BFS(PyObject* self, PyObject* root) {
-   INIT_SELF_GRAPH();
-   BfsIterator* it = NULL;
+PyObject* graph_create_minimum_spanning_tree(PyObject* self, PyObject* args) {
+   return graph_create_minimum_spanning_tree_with(self, args,
+         "|OO:create_minimum_spanning_tree", MST_KRUSKAL, MST_PRIM);
+}
+
+
+
+// -----------------------------------------------------------------------------
+PyObject* graph_create_minimum_spanning_tree_kruskal(PyObject* self, 
+      PyObject* args) {
+   return graph_create_minimum_spanning_tree_with(self, args,
+         "|OO:create_minimum_spanning_tree_kruskal", MST_KRUSKAL, MST_KRUSKAL);
+}
+
+
+
+// -----------------------------------------------------------------------------
+PyObject* graph_create_minimum_spanning_tree_prim(PyObject* self, 
+      PyObject* args) {
+   return graph_create_minimum_spanning_tree_with(self, args,
+         "|OO:create_minimum_spanning_tree_prim", MST_PRIM, MST_PRIM);
+}
+
+
+
+// -----------------------------------------------------------------------------
+/// Helper for graph_BFS and graph_DFS: the traversal runs on a CSR snapshot
+/// of the graph and the returned iterator walks through the visited nodes
+static PyObject* graph_csr_traversal(GraphObject* so, PyObject* root,
+      bool depth_first) {
+   Node* start;
    if(is_NodeObject(root))
-      it = so->_graph->BFS(((NodeObject*)root)->_node);
+      start = ((NodeObject*)root)->_node;
    else {
       GraphDataPyObject a(root);
-      it = so->_graph->BFS(&a);
+      start = so->_graph->get_node(&a);
    }
-   if(it == NULL) {
+   CsrGraph csr(so->_graph);
+   CsrGraph::node_t id = csr.get_node_id(start);
+   if(id == CsrGraph::NO_NODE) {
       PyErr_SetString(PyExc_KeyError, "starting-node not found");
       return NULL;
-
    }
 
-   NTIteratorObject<BfsIterator>* nti = 
-      iterator_new<NTIteratorObject<BfsIterator> >();
+   std::vector<CsrGraph::node_t> order;
+   if(depth_first)
+      csr.DFS(id, order);
+   else
+      csr.BFS(id, order);
+   NodeVector* nodes = new NodeVector();
+   for(size_t i = 0; i < order.size(); i++)
+      nodes->push_back(csr._nodes[order[i]]);
+
+   NodeVectorPtrIterator* it = new NodeVectorPtrIterator(so->_graph, nodes);
+   NTIteratorObject<NodeVectorPtrIterator>* nti =
+      iterator_new<NTIteratorObject<NodeVectorPtrIterator> >();
    nti->init(it, so);
 
    return (PyObject*)nti;
@@ -301,26 +388,17 @@ PyObject* graph_BFS(PyObject* self, PyObject* root) {
 
 
 // -----------------------------------------------------------------------------
-PyObject* graph_DFS(PyObject* self, PyObject* root) {
+PyObject* graph_BFS(PyObject* self, PyObject* root) {
    INIT_SELF_GRAPH();
-   DfsIterator* it = NULL;
-   if(is_NodeObject(root))
-      it = so->_graph->DFS(((NodeObject*)root)->_node);
-   else {
-      GraphDataPyObject a(root);
-      it = so->_graph->DFS(&a);
-   }
-   if(it == NULL) {
-      PyErr_SetString(PyExc_KeyError, "starting-node not found");
-      return NULL;
+   return graph_csr_traversal(so, root, false);
+}
 
-   }
 
-   NTIteratorObject<DfsIterator>* nti = 
-      iterator_new<NTIteratorObject<DfsIterator> >();
-   nti->init(it, so);
 
-   return (PyObject*)nti;
+// -----------------------------------------------------------------------------
+PyObject* graph_DFS(PyObject* self, PyObject* root) {
+   INIT_SELF_GRAPH();
+   return graph_csr_traversal(so, root, true);
 }
 
 
@@ -31,6 +31,8 @@ extern "C" {
   PyObject* graph_all_pairs_shortest_path(PyObject* self, PyObject* _);
   PyObject* graph_create_spanning_tree(PyObject* self, PyObject* pyobject);
   PyObject* graph_create_minimum_spanning_tree(PyObject* so, PyObject* args);
+  PyObject* graph_create_minimum_spanning_tree_kruskal(PyObject* so, PyObject* args);
+  PyObject* graph_create_minimum_spanning_tree_prim(PyObject* so, PyObject* args);
   PyObject* graph_BFS(PyObject* self, PyObject* args);
   PyObject* graph_DFS(PyObject* self, PyObject* args);
   PyObject* graph_get_color(PyObject* self, PyObject* pyobject);
@@ -81,19 +83,34 @@ extern "C" {
     CHAR_PTR_CAST "**create_spanning_tree** (*value* or *node*)\n\n" \
     "Returns a new graph which is a (probably non-optimal) spanning tree of all nodes reachable from the given node. This tree is created using DFS." }, \
   { CHAR_PTR_CAST "create_minimum_spanning_tree", graph_create_minimum_spanning_tree, METH_VARARGS, \
-    CHAR_PTR_CAST "**create_minimum_spanning_tree** ()\n\n" \
-    "Creates a minimum spanning tree of the entire graph in place using Kruskal's algorithm.\n" \
-    "A minimum spanning tree connects all nodes using the minimum total edge cost.\n" \
+    CHAR_PTR_CAST "**create_minimum_spanning_tree** (*images* = None, *uniq_dists* = None)\n\n" \
+    "Returns a new graph which is a minimum spanning tree of the entire graph, using Kruskal's algorithm.\n" \
+    "A minimum spanning tree connects all nodes using the minimum total edge cost.\n\n" \
+    "When a list of *images* and their distance matrix *uniq_dists* (a FLOAT image, e.g. from " \
+    "kNNInteractive.distance_matrix) are given, the graph is instead replaced in place by the minimum spanning " \
+    "tree of the complete graph on the images. For this dense graph Prim's algorithm is used.\n" \
+  }, \
+  { CHAR_PTR_CAST "create_minimum_spanning_tree_kruskal", graph_create_minimum_spanning_tree_kruskal, METH_VARARGS, \
+    CHAR_PTR_CAST "**create_minimum_spanning_tree_kruskal** (*images* = None, *uniq_dists* = None)\n\n" \
+    "Like create_minimum_spanning_tree_, but always uses Kruskal's algorithm, which sorts the edges " \
+    "by their cost and adds them unless a union-find forest shows that they would close a cycle. " \
+    "This is the faster choice for sparse graphs.\n" \
+  }, \
+  { CHAR_PTR_CAST "create_minimum_spanning_tree_prim", graph_create_minimum_spanning_tree_prim, METH_VARARGS, \
+    CHAR_PTR_CAST "**create_minimum_spanning_tree_prim** (*images* = None, *uniq_dists* = None)\n\n" \
+    "Like create_minimum_spanning_tree_, but always uses Prim's algorithm, which grows the tree from one " \
+    "node and needs O(n^2) time independent of the number of edges. This is the faster choice for dense graphs. " \
+    "For graphs with several subgraphs, a minimum spanning forest is returned by both algorithms.\n" \
   }, \
 
 
 #define SEARCH_METHODS \
   { CHAR_PTR_CAST "BFS", graph_BFS, METH_O, \
     CHAR_PTR_CAST "**BFS** (*value* or *node*)\n\n" \
-    "A lazy iterator that returns the nodes in breadth-first order starting from the given *value* or *node*. Note that the starting node is included in the returned nodes." }, \
+    "An iterator that returns the nodes in breadth-first order starting from the given *value* or *node*. The order is computed on a compressed snapshot of the graph when the method is called. Note that the starting node is included in the returned nodes." }, \
   { CHAR_PTR_CAST "DFS", graph_DFS, METH_O, \
     CHAR_PTR_CAST "**DFS** (*value* or *node*)\n\n" \
-    "A lazy iterator that returns the nodes in depth-first order starting from the given *value* or *node*.  Note that the starting node is included in the returned nodes." }, \
+    "An iterator that returns the nodes in depth-first order starting from the given *value* or *node*. The order is computed on a compressed snapshot of the graph when the method is called.  Note that the starting node is included in the returned nodes." }, \
 
 
 #define COLOR_METHODS \
@@ -27,38 +27,60 @@ namespace Gamera { namespace GraphApi {
 
 
 // -----------------------------------------------------------------------------
+/// copies all nodes of the CSR snapshot and the given edges into a new tree
+Graph* SpanningTree::create_tree_from_csr(const CsrGraph& csr, 
+      const std::vector<std::pair<CsrGraph::node_t, CsrGraph::node_t> >& edges,
+      const std::vector<cost_t>& weights) {
+   Graph* tree = new Graph(FLAG_TREE);
+   std::vector<Node*> nodes(csr.get_nnodes());
+   for(size_t i = 0; i < nodes.size(); i++)
+      nodes[i] = tree->add_node_ptr(csr._nodes[i]->_value->copy());
+
+   for(size_t i = 0; i < edges.size(); i++)
+      tree->add_edge(nodes[edges[i].first], nodes[edges[i].second], 
+            weights[i], false);
+
+   return tree;
+}
+
+
+
+// -----------------------------------------------------------------------------
+/// Kruskal's algorithm: the edges are taken in the order of their weight and
+/// added unless a union-find forest tells that they would close a cycle
 Graph *SpanningTree::create_minimum_spanning_tree_kruskal(Graph* g) {
    if(g->is_directed()) //Kruskal-algorithm is only for undirected graphs
       return NULL;
 
    Graph* tree = new Graph(FLAG_TREE);
+   std::map<Node*, size_t> ids;
+   std::vector<Node*> tree_nodes;
+   tree_nodes.reserve(g->get_nnodes());
+   NodePtrIterator *nit = g->get_nodes();
+   Node* n;
+   while((n=nit->next()) != NULL) {
+      ids[n] = tree_nodes.size();
+      tree_nodes.push_back(tree->add_node_ptr(n->_value->copy()));
+   }
+   delete nit;
+
+   // the queue only determines the order of equally weighted edges
    std::priority_queue<Edge*, std::vector<Edge*>, mst_compare_func> edgeQueue;
    EdgePtrIterator *eit = g->get_edges();
    Edge* e;
    while((e = eit->next()) != NULL) {
       edgeQueue.push(e);
    }
-   
    delete eit;
-   NodePtrIterator *nit = g->get_nodes();
-   Node* n;
-   while((n=nit->next()) != NULL) {
-      tree->add_node((n)->_value->copy());
-   }
 
-   delete nit;
-   while(!edgeQueue.empty() && (tree->get_nnodes()-1) > tree->get_nedges()) {
+   UnionFind sets(tree_nodes.size());
+   while(!edgeQueue.empty() && tree->get_nedges() + 1 < tree_nodes.size()) {
       Edge* edge = edgeQueue.top();
       edgeQueue.pop();
-      bool path_fromto = tree->has_path(edge->from_node->_value, 
-            edge->to_node->_value);
-
-      bool path_tofrom = tree->has_path(edge->to_node->_value, 
-            edge->from_node->_value);
-
-      if (!path_fromto && !path_tofrom) {
-         tree->add_edge(edge->from_node->_value, edge->to_node->_value, 
-               edge->weight, false);
+      size_t from = ids[edge->from_node];
+      size_t to = ids[edge->to_node];
+      if(sets.unite(from, to)) {
+         tree->add_edge(tree_nodes[from], tree_nodes[to], edge->weight, false);
       }
    }
  
@@ -67,6 +89,21 @@ Graph *SpanningTree::create_minimum_spanning_tree_kruskal(Graph* g) {
 
 
 
+// -----------------------------------------------------------------------------
+/// Prim's algorithm without a heap, for dense graphs
+Graph *SpanningTree::create_minimum_spanning_tree_prim(Graph* g) {
+   if(g->is_directed())
+      return NULL;
+
+   CsrGraph csr(g);
+   std::vector<std::pair<CsrGraph::node_t, CsrGraph::node_t> > edges;
+   std::vector<cost_t> weights;
+   csr.minimum_spanning_tree_prim(edges, &weights);
+   return create_tree_from_csr(csr, edges, weights);
+}
+
+
+
 // -----------------------------------------------------------------------------
 Graph *SpanningTree::create_minimum_spanning_tree(Graph *g) {
    return create_minimum_spanning_tree_kruskal(g);
@@ -34,6 +34,8 @@
 #include <vector>
 #include <map>
 #include <string.h>
+#include <stdint.h>
+#include <string>
 #include <assert.h>
 #include <stdio.h>
 // for rand
@@ -41,6 +43,9 @@
 #include <time.h>
 // exception handling
 #include <stdexcept>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 using namespace Gamera;
 using namespace Gamera::kNN;
@@ -61,10 +66,16 @@ extern "C" {
                            PyObject* kwds);
   static void knn_dealloc(PyObject* self);
   static PyObject* knn_instantiate_from_images(PyObject* self, PyObject* args);
+  static PyObject* knn_append_images(PyObject* self, PyObject* args);
+  static PyObject* knn_remove_images(PyObject* self, PyObject* args);
   // classification
   static PyObject* knn_classify(PyObject* self, PyObject* args);
   static PyObject* knn_classify_with_images(PyObject* self, PyObject* args);
+  static PyObject* knn_classify_batch(PyObject* self, PyObject* args);
   static PyObject* knn_leave_one_out(PyObject* self, PyObject* args);
+  // editing
+  static PyObject* knn_edit_mnn(PyObject* self, PyObject* args);
+  static PyObject* knn_edit_cnn(PyObject* self, PyObject* args);
   // distance
   static PyObject* knn_knndistance_statistics(PyObject* self, PyObject* args);
   static PyObject* knn_distance_from_images(PyObject* self, PyObject* args);
@@ -76,6 +87,8 @@ extern "C" {
   static int knn_set_num_k(PyObject* self, PyObject* v);
   static PyObject* knn_get_distance_type(PyObject* self);
   static int knn_set_distance_type(PyObject* self, PyObject* v);
+  static PyObject* knn_get_feature_precision(PyObject* self);
+  static int knn_set_feature_precision(PyObject* self, PyObject* v);
   static PyObject* knn_get_confidence_types(PyObject* self);
   static int knn_set_confidence_types(PyObject* self, PyObject* v);
   static PyObject* knn_get_selections(PyObject* self, PyObject* args);
@@ -83,6 +96,7 @@ extern "C" {
   static PyObject* knn_get_weights(PyObject* self, PyObject* args);
   static PyObject* knn_set_weights(PyObject* self, PyObject* args);
   static PyObject* knn_get_num_features(PyObject* self);
+  static PyObject* knn_get_num_feature_vectors(PyObject* self);
   static int knn_set_num_features(PyObject* self, PyObject* v);
   // saving/loading
   static PyObject* knn_serialize(PyObject* self, PyObject* args);
@@ -103,6 +117,8 @@ PyMethodDef knn_methods[] = {
   },
   { (char *)"instantiate_from_images", knn_instantiate_from_images, METH_VARARGS,
     (char *)"Use the list of images for non-interactive classification." },
+  { (char *)"_append_images", knn_append_images, METH_VARARGS, (char *)"" },
+  { (char *)"_remove_images", knn_remove_images, METH_VARARGS, (char *)"" },
   { (char *)"_distance_from_images", knn_distance_from_images, METH_VARARGS, (char *)"" },
   { (char *)"_distance_between_images", knn_distance_between_images, METH_VARARGS, (char *)"" },
   { (char *)"_distance_matrix", knn_distance_matrix, METH_VARARGS, (char *)"" },
@@ -117,7 +133,11 @@ PyMethodDef knn_methods[] = {
     (char *)"Get the weights used for classification." },
   { (char *)"classify", knn_classify, METH_VARARGS,
     (char *)"" },
+  { (char *)"_classify_batch", knn_classify_batch, METH_VARARGS,
+    (char *)"" },
   { (char *)"leave_one_out", knn_leave_one_out, METH_VARARGS, (char *)"" },
+  { (char *)"_edit_mnn", knn_edit_mnn, METH_VARARGS, (char *)"" },
+  { (char *)"_edit_cnn", knn_edit_cnn, METH_VARARGS, (char *)"" },
   { (char *)"_knndistance_statistics", knn_knndistance_statistics, METH_VARARGS,
     (char *)"" },
   { (char *)"serialize", knn_serialize, METH_VARARGS, (char *)"" },
@@ -130,10 +150,15 @@ PyGetSetDef knn_getset[] = {
     (char *)"The value of k used for classification.", 0 },
   { (char *)"distance_type", (getter)knn_get_distance_type, (setter)knn_set_distance_type,
     (char *)"The type of distance calculation used.", 0 },
+  { (char *)"feature_precision", (getter)knn_get_feature_precision,
+    (setter)knn_set_feature_precision,
+    (char *)"The precision in which the feature vectors are scanned.", 0 },
   { (char *)"confidence_types", (getter)knn_get_confidence_types, (setter)knn_set_confidence_types,
     (char *)"The types of confidences computed during classification.", 0 },
   { (char *)"num_features", (getter)knn_get_num_features, (setter)knn_set_num_features,
     (char *)"The current number of features.", 0 },
+  { (char *)"num_feature_vectors", (getter)knn_get_num_feature_vectors, 0,
+    (char *)"The number of feature vectors for non-interactive classification.", 0 },
   { NULL }
 };
 
@@ -150,17 +175,15 @@ static void knn_delete_feature_data(KnnObject* o) {
     num_feature_vectors = 0;
   } else {
     num_feature_vectors = o->feature_vectors->size();
-
-    std::vector<double*>::iterator fv_it;
-    for (fv_it = o->feature_vectors->begin(); fv_it != o->feature_vectors->end(); ++fv_it ) {
-      delete[] *fv_it;
-    }
     delete o->feature_vectors;
     o->feature_vectors = 0;
   }
+  delete_compact_features(o);
+  o->outdated_normalization = false;
 
   if (o->id_names != 0) {
-    for (size_t i = 0; i < num_feature_vectors; ++i) {
+    // mapped id_names point into the file
+    for (size_t i = 0; o->mapped == 0 && i < num_feature_vectors; ++i) {
       if (o->id_names[i] != 0)
         delete[] o->id_names[i];
     }
@@ -171,6 +194,19 @@ static void knn_delete_feature_data(KnnObject* o) {
     delete[] o->id_name_histogram;
     o->id_name_histogram = 0;
   }
+  if (o->class_ids != 0) {
+    delete[] o->class_ids;
+    o->class_ids = 0;
+  }
+  if (o->class_names != 0) {
+    delete[] o->class_names;
+    o->class_names = 0;
+  }
+  o->num_classes = 0;
+  if (o->mapped != 0) {
+    delete o->mapped;
+    o->mapped = 0;
+  }
 }
 
 static void set_num_features(KnnObject* o, size_t num_features) {
@@ -210,11 +246,20 @@ static PyObject* knn_new(PyTypeObject* pytype, PyObject* args,
   */
   o->num_features = 0;
   o->feature_vectors = 0;
+  o->mapped = 0;
+  o->compact_features = 0;
+  o->index = 0;
+  o->reduced = 0;
+  o->feature_precision = DOUBLE_FEATURES;
   o->id_names = 0;
+  o->class_ids = 0;
+  o->class_names = 0;
+  o->num_classes = 0;
   o->id_name_histogram = 0;
   o->selection_vector = 0;
   o->weight_vector = 0;
   o->normalize = 0;
+  o->outdated_normalization = false;
   o->unknown = 0;
   o->num_k = 1;
   o->distance_type = CITY_BLOCK;
@@ -239,9 +284,7 @@ static int knn_create_feature_data(KnnObject* o, size_t num_feature_vectors) {
   try {
     assert(num_feature_vectors > 0);
 
-    o->feature_vectors = new std::vector<double*>(num_feature_vectors);
-    for (size_t i = 0; i < num_feature_vectors; ++i)
-      (*o->feature_vectors)[i] = new double[o->num_features];
+    o->feature_vectors = new FeatureMatrix(num_feature_vectors, o->num_features);
 
     o->id_names = new char*[num_feature_vectors];
     for (size_t i = 0; i < num_feature_vectors; ++i)
@@ -254,6 +297,38 @@ static int knn_create_feature_data(KnnObject* o, size_t num_feature_vectors) {
   return 1;
 }
 
+/*
+  Number the classes of the feature vectors in alphabetical order of their
+  id_names, so that the class numbers compare like the id_names, and store
+  the number of feature vectors per class for fast access in leave-one-out.
+*/
+static void knn_create_class_ids(KnnObject* o) {
+  size_t num_feature_vectors = o->feature_vectors->size();
+  std::map<char*, int, ltstr> classes;
+  for (size_t i = 0; i < num_feature_vectors; ++i)
+    classes.insert(std::make_pair(o->id_names[i], 0));
+  if (o->class_names != 0)
+    delete[] o->class_names;
+  if (o->class_ids != 0)
+    delete[] o->class_ids;
+  o->num_classes = classes.size();
+  o->class_names = new char*[o->num_classes];
+  int class_id = 0;
+  for (std::map<char*, int, ltstr>::iterator i = classes.begin();
+       i != classes.end(); ++i, ++class_id) {
+    i->second = class_id;
+    o->class_names[class_id] = i->first;
+  }
+  std::vector<int> histogram(o->num_classes, 0);
+  o->class_ids = new int[num_feature_vectors];
+  for (size_t i = 0; i < num_feature_vectors; ++i) {
+    o->class_ids[i] = classes[o->id_names[i]];
+    histogram[o->class_ids[i]]++;
+  }
+  for (size_t i = 0; i < num_feature_vectors; ++i)
+    o->id_name_histogram[i] = histogram[o->class_ids[i]];
+}
+
 // destructor for Python
 static void knn_dealloc(PyObject* self) {
   KnnObject* o = (KnnObject*)self;
@@ -333,7 +408,6 @@ static PyObject* knn_instantiate_from_images(PyObject* self, PyObject* args) {
   double* tmp_fv;
   Py_ssize_t tmp_fv_len;
 
-  std::map<char*, int, ltstr> id_name_histogram;
   double *current_features;
   for (size_t i = 0; i < o->feature_vectors->size(); ++i) {
     current_features = (*o->feature_vectors)[i];
@@ -363,27 +437,20 @@ static PyObject* knn_instantiate_from_images(PyObject* self, PyObject* args) {
     }
     o->id_names[i] = new char[len + 1];
     strncpy(o->id_names[i], tmp_id_name, len + 1);
-    id_name_histogram[o->id_names[i]]++;
   }
 
-  /*
-    Apply the normalization and store the histogram data for fast access in
-    leave-one-out.
-  */
+  // Apply the normalization
   if (o->normalize != 0) {
     o->normalize->compute_normalization();
 
     for (size_t i = 0; i < o->feature_vectors->size(); ++i) {
       current_features = (*o->feature_vectors)[i];
       o->normalize->apply(current_features, current_features + o->num_features);
-      o->id_name_histogram[i] = id_name_histogram[o->id_names[i]];
-    }
-  } else {
-    for (size_t i = 0; i < o->feature_vectors->size(); ++i) {
-      current_features = (*o->feature_vectors)[i];
-      o->id_name_histogram[i] = id_name_histogram[o->id_names[i]];
     }
   }
+  knn_create_class_ids(o);
+  // build the compacted feature vectors and the search index
+  get_compact_features(o);
 
   Py_DECREF(images_seq);
   Py_INCREF(Py_None);
@@ -393,6 +460,216 @@ static PyObject* knn_instantiate_from_images(PyObject* self, PyObject* args) {
   return 0;
 }
 
+/*
+  Copies the feature vectors and id_names that unserialize has mapped from
+  a file, so that they can be modified.
+*/
+static void knn_unmap_feature_data(KnnObject* o) {
+  if (o->mapped == 0)
+    return;
+  delete_compact_features(o);
+  size_t num_feature_vectors = o->feature_vectors->size();
+  FeatureMatrix* features = new FeatureMatrix(num_feature_vectors, o->num_features);
+  std::copy((*o->feature_vectors)[0],
+            (*o->feature_vectors)[0] + num_feature_vectors * features->stride(),
+            (*features)[0]);
+  delete o->feature_vectors;
+  o->feature_vectors = features;
+  for (size_t i = 0; i < num_feature_vectors; ++i) {
+    char* id_name = new char[strlen(o->id_names[i]) + 1];
+    strcpy(id_name, o->id_names[i]);
+    o->id_names[i] = id_name;
+  }
+  delete o->mapped;
+  o->mapped = 0;
+  // the class names pointed into the file
+  knn_create_class_ids(o);
+}
+
+/*
+  Resizes the arrays with an entry per feature vector to the current
+  number of feature vectors, keeping the id_names of the first num_kept.
+*/
+static void knn_resize_id_names(KnnObject* o, size_t num_kept) {
+  size_t num_feature_vectors = o->feature_vectors->size();
+  char** id_names = new char*[num_feature_vectors];
+  std::copy(o->id_names, o->id_names + num_kept, id_names);
+  std::fill(id_names + num_kept, id_names + num_feature_vectors, (char*)0);
+  delete[] o->id_names;
+  o->id_names = id_names;
+  delete[] o->id_name_histogram;
+  o->id_name_histogram = new int[num_feature_vectors];
+}
+
+/*
+  Append and remove change the feature vectors of a non-interactive
+  classifier in place. The new feature vectors are normalized with the
+  current normalization, which is only updated before the next
+  classification (see get_compact_features), so that several changes in
+  a row do not each normalize all feature vectors again.
+*/
+static PyObject* knn_append_images(PyObject* self, PyObject* args) {
+  KnnObject* o = (KnnObject*)self;
+  PyObject* images;
+  if (PyArg_ParseTuple(args, CHAR_PTR_CAST "O", &images) <= 0)
+    return 0;
+  if (o->feature_vectors == 0) {
+    PyErr_SetString(PyExc_RuntimeError,
+                    "knn: append_images called before instantiate_from_images.");
+    return 0;
+  }
+  PyObject* images_seq = PySequence_Fast(images, "First argument must be iterable");
+  if (images_seq == NULL)
+    return 0;
+
+  // check all images before changing anything
+  size_t num_images = PySequence_Fast_GET_SIZE(images_seq);
+  std::vector<double*> features(num_images);
+  std::vector<char*> id_names(num_images);
+  for (size_t i = 0; i < num_images; ++i) {
+    PyObject* cur_image = PySequence_Fast_GET_ITEM(images_seq, i);
+    if (!is_ImageObject(cur_image)) {
+      PyErr_SetString(PyExc_TypeError, "knn: expected an image");
+      Py_DECREF(images_seq);
+      return 0;
+    }
+    Py_ssize_t len;
+    if (image_get_fv(cur_image, &features[i], &len) < 0) {
+      PyErr_SetString(PyExc_ValueError, "knn: could not get features from image");
+      Py_DECREF(images_seq);
+      return 0;
+    }
+    if (size_t(len) != o->num_features) {
+      PyErr_SetString(PyExc_ValueError, "knn: feature vector lengths don't match");
+      Py_DECREF(images_seq);
+      return 0;
+    }
+    int id_len;
+    if (image_get_id_name(cur_image, &id_names[i], &id_len) < 0) {
+      PyErr_SetString(PyExc_ValueError, "knn: could not get id name");
+      Py_DECREF(images_seq);
+      return 0;
+    }
+  }
+
+  knn_unmap_feature_data(o);
+  delete_compact_features(o);
+  size_t num_kept = o->feature_vectors->size();
+  o->feature_vectors->resize(num_kept + num_images);
+  knn_resize_id_names(o, num_kept);
+  for (size_t i = 0; i < num_images; ++i) {
+    double* current_features = (*o->feature_vectors)[num_kept + i];
+    std::copy(features[i], features[i] + o->num_features, current_features);
+    if (o->normalize != 0) {
+      o->normalize->add(current_features, current_features + o->num_features);
+      o->normalize->apply(current_features, current_features + o->num_features);
+      o->outdated_normalization = true;
+    }
+    o->id_names[num_kept + i] = new char[strlen(id_names[i]) + 1];
+    strcpy(o->id_names[num_kept + i], id_names[i]);
+  }
+  knn_create_class_ids(o);
+  Py_DECREF(images_seq);
+  Py_INCREF(Py_None);
+  return Py_None;
+}
+
+static PyObject* knn_remove_images(PyObject* self, PyObject* args) {
+  KnnObject* o = (KnnObject*)self;
+  PyObject* indexes;
+  if (PyArg_ParseTuple(args, CHAR_PTR_CAST "O", &indexes) <= 0)
+    return 0;
+  if (o->feature_vectors == 0) {
+    PyErr_SetString(PyExc_RuntimeError,
+                    "knn: remove_images called before instantiate_from_images.");
+    return 0;
+  }
+  PyObject* indexes_seq = PySequence_Fast(indexes, "Indexes must be an iterable list of indexes.");
+  if (indexes_seq == NULL)
+    return 0;
+  size_t num_feature_vectors = o->feature_vectors->size();
+  std::vector<size_t> rows;
+  for (Py_ssize_t i = 0; i < PySequence_Fast_GET_SIZE(indexes_seq); ++i) {
+    PyObject* tmp = PySequence_Fast_GET_ITEM(indexes_seq, i);
+    if (!PyInt_Check(tmp)) {
+      PyErr_SetString(PyExc_TypeError, "knn: expected indexes to be ints");
+      Py_DECREF(indexes_seq);
+      return 0;
+    }
+    long index = PyInt_AS_LONG(tmp);
+    if (index < 0 || size_t(index) >= num_feature_vectors) {
+      PyErr_SetString(PyExc_IndexError, "knn: index out of range in index list");
+      Py_DECREF(indexes_seq);
+      return 0;
+    }
+    rows.push_back(size_t(index));
+  }
+  Py_DECREF(indexes_seq);
+  std::sort(rows.begin(), rows.end());
+  rows.erase(std::unique(rows.begin(), rows.end()), rows.end());
+  if (rows.size() == num_feature_vectors) {
+    PyErr_SetString(PyExc_ValueError,
+                    "knn: a non-interactive classifier needs at least one feature vector.");
+    return 0;
+  }
+
+  knn_unmap_feature_data(o);
+  delete_compact_features(o);
+  std::vector<double> removed(o->num_features);
+  for (size_t i = 0, next = 0; i < num_feature_vectors; ++i) {
+    if (next < rows.size() && rows[next] == i) {
+      ++next;
+      if (o->normalize != 0) {
+        const double* current_features = (*o->feature_vectors)[i];
+        std::copy(current_features, current_features + o->num_features,
+                  removed.begin());
+        o->normalize->unapply(removed.begin(), removed.end());
+        o->normalize->remove(removed.begin(), removed.end());
+        o->outdated_normalization = true;
+      }
+      delete[] o->id_names[i];
+    } else {
+      o->id_names[i - next] = o->id_names[i];
+    }
+  }
+  o->feature_vectors->erase(rows);
+  knn_resize_id_names(o, o->feature_vectors->size());
+  knn_create_class_ids(o);
+  Py_INCREF(Py_None);
+  return Py_None;
+}
+
+/*
+  The Python result of a classification: a tuple of the id_name list of
+  (confidence, id_name) pairs and the dictionary of confidences.
+*/
+static PyObject* classify_result(KnnObject* o,
+                                 const std::vector<std::pair<int, double> >& answer,
+                                 const std::vector<int>& confidence_types,
+                                 const std::vector<double>& confidence) {
+  PyObject* ans_list = PyList_New(answer.size());
+  for (size_t i = 0; i < answer.size(); ++i) {
+    // PyList_SET_ITEM steals references so this code only looks
+    // like it leaks. KWM
+    PyObject* ans = PyTuple_New(2);
+    PyTuple_SET_ITEM(ans, 0, PyFloat_FromDouble(answer[i].second));
+    PyTuple_SET_ITEM(ans, 1, PyString_FromString(o->class_names[answer[i].first]));
+    PyList_SET_ITEM(ans_list, i, ans);
+  }
+  PyObject* conf_dict = PyDict_New();
+  for (size_t i = 0; i < confidence_types.size(); ++i) {
+    PyObject* o1 = PyInt_FromLong(confidence_types[i]);
+    PyObject* o2 = PyFloat_FromDouble(confidence[i]);
+    PyDict_SetItem(conf_dict, o1, o2);
+    Py_DECREF(o1);
+    Py_DECREF(o2);
+  }
+  PyObject* result = PyTuple_New(2);
+  PyTuple_SET_ITEM(result, 0, ans_list);
+  PyTuple_SET_ITEM(result, 1, conf_dict);
+  return result;
+}
+
 /*
   non-interactive classification using the data created by
   instantiate from images.
@@ -425,6 +702,9 @@ static PyObject* knn_classify(PyObject* self, PyObject* args) {
     return 0;
   }
 
+  // this also brings the normalization up to date
+  CompactFeatures* compact = get_compact_features(o);
+
   // normalize the unknown
   if (o->normalize != 0) {
     o->normalize->apply(fv, fv + o->num_features, o->unknown);
@@ -433,45 +713,155 @@ static PyObject* knn_classify(PyObject* self, PyObject* args) {
   }
 
   // create the kNN object
-  kNearestNeighbors<char*, ltstr, eqstr> knn(o->num_k);
+  ClassNeighbors knn(o->num_k, o->num_classes);
   knn.confidence_types = *(o->confidence_types);
 
-  double *current_known;
+  double* compact_unknown = compact->unknown[0];
+  compact->compact(o->unknown, compact_unknown);
 
-  for (size_t i = 0; i < o->feature_vectors->size(); ++i) {
-    double distance;
-
-    current_known = (*o->feature_vectors)[i];
+  KnnIndex* index = o->index;
+  if (index != 0 && index->pointless())
+    index = 0;
+  size_t evaluations = add_neighbors(o, *compact, index, compact_unknown, knn);
+  if (index != 0)
+    index->record(evaluations);
+  knn.majority();
+  knn.calculate_confidences();
+  return classify_result(o, knn.answer, knn.confidence_types, knn.confidence);
+}
 
-    compute_distance(o->distance_type, current_known, o->num_features,
-                     o->unknown, &distance,
-                     o->selection_vector, o->weight_vector);
+/*
+  non-interactive classification of a list of unknowns, which are either
+  images or buffers of doubles (e.g. array.array('d')) holding the feature
+  vectors. All feature vectors are normalized and compacted first, then the
+  classifications run on num_threads OpenMP threads (all available if 0)
+  without the interpreter lock.
+*/
+static PyObject* knn_classify_batch(PyObject* self, PyObject* args) {
+  KnnObject* o = (KnnObject*)self;
 
-    knn.add(o->id_names[i], distance);
+  if (o->feature_vectors == 0) {
+      PyErr_SetString(PyExc_RuntimeError,
+                      "knn: classify_batch called before instantiate from images");
+      return 0;
   }
-  knn.majority();
-  knn.calculate_confidences();
-  PyObject* ans_list = PyList_New(knn.answer.size());
-  for (size_t i = 0; i < knn.answer.size(); ++i) {
-    // PyList_SET_ITEM steals references so this code only looks
-    // like it leaks. KWM
-    PyObject* ans = PyTuple_New(2);
-    PyTuple_SET_ITEM(ans, 0, PyFloat_FromDouble(knn.answer[i].second));
-    PyTuple_SET_ITEM(ans, 1, PyString_FromString(knn.answer[i].first));
-    PyList_SET_ITEM(ans_list, i, ans);
+  PyObject* unknowns;
+  int num_threads = 0;
+  if (PyArg_ParseTuple(args, CHAR_PTR_CAST "O|i", &unknowns, &num_threads) <= 0) {
+    return 0;
   }
-  PyObject* conf_dict = PyDict_New();
-  for (size_t i = 0; i < knn.confidence_types.size(); ++i) {
-    PyObject* o1 = PyInt_FromLong(knn.confidence_types[i]);
-    PyObject* o2 = PyFloat_FromDouble(knn.confidence[i]);
-    PyDict_SetItem(conf_dict, o1, o2);
-    Py_DECREF(o1);
-    Py_DECREF(o2);
+  PyObject* unknowns_seq = PySequence_Fast(unknowns, "knn: unknowns must be iterable");
+  if (unknowns_seq == NULL)
+    return 0;
+  size_t num_unknowns = PySequence_Fast_GET_SIZE(unknowns_seq);
+  PyObject* results = PyList_New(num_unknowns);
+  if (num_unknowns == 0) {
+    Py_DECREF(unknowns_seq);
+    return results;
   }
-  PyObject* result = PyTuple_New(2);
-  PyTuple_SET_ITEM(result, 0, ans_list);
-  PyTuple_SET_ITEM(result, 1, conf_dict);
-  return result;
+
+  CompactFeatures* compact = get_compact_features(o);
+  FeatureMatrix compact_unknowns(num_unknowns, compact->vectors.num_features());
+  for (size_t i = 0; i < num_unknowns; ++i) {
+    PyObject* unknown = PySequence_Fast_GET_ITEM(unknowns_seq, i);
+    double* fv;
+    Py_ssize_t fv_len;
+    if (is_ImageObject(unknown)) {
+      if (image_get_fv(unknown, &fv, &fv_len) < 0) {
+        PyErr_SetString(PyExc_ValueError, "knn: could not get features");
+        goto error;
+      }
+    } else {
+      if (PyObject_AsReadBuffer(unknown, (const void**)&fv, &fv_len) < 0) {
+        PyErr_SetString(PyExc_TypeError,
+                        "knn: unknowns must be images or arrays of doubles");
+        goto error;
+      }
+      fv_len /= sizeof(double);
+    }
+    if (size_t(fv_len) != o->num_features) {
+      PyErr_SetString(PyExc_ValueError, "knn: features not the correct size");
+      goto error;
+    }
+    if (o->normalize != 0) {
+      o->normalize->apply(fv, fv + o->num_features, o->unknown);
+      compact->compact(o->unknown, compact_unknowns[i]);
+    } else {
+      compact->compact(fv, compact_unknowns[i]);
+    }
+  }
+
+  {
+    KnnIndex* index = o->index;
+    if (index != 0 && index->pointless())
+      index = 0;
+    std::vector<std::vector<std::pair<int, double> > > answers(num_unknowns);
+    std::vector<std::vector<double> > confidences(num_unknowns);
+    size_t evaluations = 0;
+    bool failed = false;
+
+    Py_BEGIN_ALLOW_THREADS
+#ifdef _OPENMP
+    if (num_threads <= 0)
+      num_threads = omp_get_max_threads();
+#pragma omp parallel num_threads(num_threads) reduction(+:evaluations)
+#endif
+    {
+      // No exception may leave the parallel region, and every thread has
+      // to reach the loop, so a thread whose neighbor list cannot be
+      // allocated just skips its share of the unknowns.
+      ClassNeighbors* knn = 0;
+      try {
+        knn = new ClassNeighbors(o->num_k, o->num_classes);
+        knn->confidence_types = *(o->confidence_types);
+      } catch (std::exception&) {
+        delete knn;
+        knn = 0;
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+        failed = true;
+      }
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic, 16)
+#endif
+      for (long i = 0; i < long(num_unknowns); ++i) {
+        if (knn == 0)
+          continue;
+        try {
+          evaluations += add_neighbors(o, *compact, index, compact_unknowns[i], *knn);
+          knn->majority();
+          knn->calculate_confidences();
+          answers[i].swap(knn->answer);
+          confidences[i].swap(knn->confidence);
+        } catch (std::exception&) {
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+          failed = true;
+        }
+        knn->reset();
+      }
+      delete knn;
+    }
+    Py_END_ALLOW_THREADS
+
+    if (failed) {
+      PyErr_SetString(PyExc_RuntimeError, "knn: classification failed");
+      goto error;
+    }
+    if (index != 0)
+      index->record(evaluations, num_unknowns);
+    for (size_t i = 0; i < num_unknowns; ++i)
+      PyList_SET_ITEM(results, i, classify_result(o, answers[i], *(o->confidence_types),
+                                                  confidences[i]));
+  }
+  Py_DECREF(unknowns_seq);
+  return results;
+ error:
+  Py_DECREF(unknowns_seq);
+  Py_DECREF(results);
+  return 0;
 }
 
 static PyObject* knn_classify_with_images(PyObject* self, PyObject* args) {
@@ -651,234 +1041,190 @@ static PyObject* knn_distance_between_images(PyObject* self, PyObject* args) {
   of images regardless of the order of the pairs. NOTE: the features
   are normalized before performing the distance calculations.
 */
-PyObject* knn_distance_matrix(PyObject* self, PyObject* args) {
-  KnnObject* o = (KnnObject*)self;
-  PyObject* images;
-  PyObject* progress = 0;
-  long normalize = 1;
-  if (PyArg_ParseTuple(args, CHAR_PTR_CAST "O|Oi", &images, &progress, &normalize) <= 0)
-    return 0;
-  // images is a list of Gamera/Python ImageObjects
-  PyObject* images_seq = PySequence_Fast(images, "First argument must be iterable.");
-  if (images_seq == NULL)
-    return 0;
-
+/*
+  Collect the feature vectors of a list of images for the pairwise
+  distances, normalized with the statistics of these images if normalize
+  is true, and compacted for the current selections and weights. Returns
+  0 with a Python exception set on failure.
+*/
+static CompactFeatures* knn_pairwise_features(KnnObject* o, PyObject* images_seq,
+                                              long normalize) {
   int images_len = PySequence_Fast_GET_SIZE(images_seq);
   if (!(images_len > 1)) {
     PyErr_SetString(PyExc_ValueError, "List must have at least two images.");
-    Py_DECREF(images_seq);
-    return 0;
-  }
-
-  // Check the number of features
-  double* buf_a, *buf_b;
-  Py_ssize_t len_a, len_b;
-  PyObject* cur_a, *cur_b;
-  cur_a = PySequence_Fast_GET_ITEM(images_seq, 0);
-  if (!is_ImageObject(cur_a)) {
-    PyErr_SetString(PyExc_TypeError, "knn: expected an image");
-    Py_DECREF(images_seq);
-    return 0;
-  }
-  if (image_get_fv(cur_a, &buf_a, &len_a) < 0) {
-    Py_DECREF(images_seq);
     return 0;
   }
-
-  if (len_a != (int)o->num_features) {
-    PyErr_SetString(PyExc_ValueError, "knn: feature vector lengths don't match.");
-    Py_DECREF(images_seq);
-    return 0;
-  }
-
-  // create the normalization object
-  double* tmp_a = new double[len_a];
-  double* tmp_b = new double[len_a];
-  FloatImageData* data = new FloatImageData(Dim(images_len, images_len));
-  FloatImageView* mat = new FloatImageView(*data);
-
-  kNN::Normalize norm(len_a);
+  FeatureMatrix features(images_len, o->num_features);
+  kNN::Normalize norm(o->num_features);
   for (int i = 0; i < images_len; ++i) {
-    cur_a = PySequence_Fast_GET_ITEM(images_seq, i);
-    if (cur_a == NULL)
-      goto mat_error;
-    if (!is_ImageObject(cur_a)) {
+    PyObject* cur = PySequence_Fast_GET_ITEM(images_seq, i);
+    if (!is_ImageObject(cur)) {
       PyErr_SetString(PyExc_TypeError, "knn: expected an image");
-      goto mat_error;
+      return 0;
     }
-    if (image_get_fv(cur_a, &buf_a, &len_a) < 0)
-      goto mat_error;
-    if (len_a != (int)o->num_features) {
+    double* buf;
+    Py_ssize_t len;
+    if (image_get_fv(cur, &buf, &len) < 0)
+      return 0;
+    if (len != (int)o->num_features) {
       PyErr_SetString(PyExc_ValueError, "knn: feature vector lengths don't match.");
-      goto mat_error;
+      return 0;
     }
+    std::copy(buf, buf + len, features[i]);
     if (normalize)
-      norm.add(buf_a, buf_a + len_a);
+      norm.add(buf, buf + len);
   }
-  if (normalize)
+  if (normalize) {
     norm.compute_normalization();
-
-  std::fill(mat->vec_begin(), mat->vec_end(), 0.0);
-  // do the distance calculations
-  for (int i = 0; i < images_len; ++i) {
-    cur_a = PySequence_Fast_GET_ITEM(images_seq, i);
-    if (cur_a == NULL)
-      goto mat_error;
-    if (image_get_fv(cur_a, &buf_a, &len_a) < 0)
-      goto mat_error;
-    if (normalize)
-      norm.apply(buf_a, buf_a + len_a, tmp_a);
-    for (int j = i + 1; j < images_len; ++j) {
-      cur_b = PySequence_Fast_GET_ITEM(images_seq, j);
-      if (cur_b == NULL)
-        goto mat_error;
-      if (image_get_fv(cur_b, &buf_b, &len_b) < 0)
-        goto mat_error;
-      if (normalize)
-        norm.apply(buf_b, buf_b + len_b, tmp_b);
-      double distance;
-      if (normalize)
-        compute_distance(o->distance_type, tmp_a, len_a, tmp_b, &distance,
-                         o->selection_vector, o->weight_vector);
-      else
-        compute_distance(o->distance_type, buf_a, len_a, buf_b, &distance,
-                         o->selection_vector, o->weight_vector);
-      mat->set(Point(j, i), distance);
-      mat->set(Point(i, j), distance);
-    }
-    if (progress)
-      PyObject_CallObject(progress, NULL);
+    for (int i = 0; i < images_len; ++i)
+      norm.apply(features[i], features[i] + o->num_features);
   }
-  delete[] tmp_a;
-  delete[] tmp_b;
-  Py_DECREF(images_seq);
-  return create_ImageObject(mat);
- mat_error:
-  Py_DECREF(images_seq);
-  // delete the image
-  delete mat; delete data;
-  // delete the tmp buffers
-  delete[] tmp_a; delete[] tmp_b;
-  return 0;
+  return new CompactFeatures(features, o->selection_vector, o->weight_vector);
 }
 
 /*
-  unique_distances takes a list of images and returns all of the unique
-  pairs of distances between the images.
+  Storage for the pairwise distances: the full symmetric matrix, and the
+  upper triangle packed row by row, i.e. the pairs (0, 1), (0, 2), ...,
+  (0, n - 1), (1, 2), ... in double or single precision.
 */
-PyObject* knn_unique_distances(PyObject* self, PyObject* args) {
+struct SymmetricDistances {
+  SymmetricDistances(double* data, size_t n) : m_data(data), m_n(n) {}
+  void operator()(size_t i, size_t j, double distance) {
+    m_data[i * m_n + j] = distance;
+    m_data[j * m_n + i] = distance;
+  }
+  double* m_data;
+  size_t m_n;
+};
+
+template<class T>
+struct PackedDistances {
+  PackedDistances(T* data, size_t n) : m_data(data), m_n(n) {}
+  void operator()(size_t i, size_t j, double distance) {
+    // the pairs of rows 0 to i - 1 come first
+    m_data[i * (2 * m_n - i - 1) / 2 + (j - i - 1)] = T(distance);
+  }
+  T* m_data;
+  size_t m_n;
+};
+
+/*
+  Compute the distances of all pairs (i, j), i < j, of the compacted
+  feature vectors and pass them to store. The upper triangle is divided
+  into square tiles, so that the feature vectors of a tile stay in the
+  cache; the tiles of a band of rows are computed in parallel without the
+  interpreter lock, and progress is called once per row after each band.
+*/
+template<class Store>
+static void knn_pairwise_distances(KnnObject* o, const CompactFeatures& compact,
+                                   PyObject* progress, Store& store) {
+  const size_t tile = 64;
+  size_t n = compact.vectors.size();
+  int num_threads = knn_num_threads();
+  for (size_t band = 0; band < n; band += tile) {
+    size_t band_end = std::min(band + tile, n);
+    long num_tiles = long((n - band + tile - 1) / tile);
+    Py_BEGIN_ALLOW_THREADS
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(num_threads) schedule(dynamic) if(num_threads > 1)
+#endif
+    for (long t = 0; t < num_tiles; ++t) {
+      size_t columns = band + t * tile;
+      size_t columns_end = std::min(columns + tile, n);
+      for (size_t i = band; i < band_end; ++i) {
+        const double* a = compact.vectors[i];
+        for (size_t j = std::max(columns, i + 1); j < columns_end; ++j) {
+          store(i, j, compute_distance_padded(o->distance_type, a,
+                                              compact.vectors[j],
+                                              compact.weights[0],
+                                              compact.stride()));
+        }
+      }
+    }
+    Py_END_ALLOW_THREADS
+    if (progress) {
+      for (size_t i = band; i < band_end; ++i)
+        PyObject_CallObject(progress, NULL);
+    }
+  }
+}
+
+PyObject* knn_distance_matrix(PyObject* self, PyObject* args) {
   KnnObject* o = (KnnObject*)self;
   PyObject* images;
-  PyObject* progress;
+  PyObject* progress = 0;
   long normalize = 1;
-  if (PyArg_ParseTuple(args, CHAR_PTR_CAST "OO|i", &images, &progress, &normalize) <= 0)
+  if (PyArg_ParseTuple(args, CHAR_PTR_CAST "O|Oi", &images, &progress, &normalize) <= 0)
     return 0;
   // images is a list of Gamera/Python ImageObjects
   PyObject* images_seq = PySequence_Fast(images, "First argument must be iterable.");
   if (images_seq == NULL)
     return 0;
-
-  int images_len = PySequence_Fast_GET_SIZE(images_seq);
-  if (!(images_len > 1)) {
-    PyErr_SetString(PyExc_ValueError, "List must have at least two images.");
-    Py_DECREF(images_seq);
+  CompactFeatures* compact = knn_pairwise_features(o, images_seq, normalize);
+  Py_DECREF(images_seq);
+  if (compact == 0)
     return 0;
-  }
-  // create the 'vector' for the output
-  int list_len = ((images_len * images_len) - images_len) / 2;
-  FloatImageData* data = new FloatImageData(Dim(list_len, 1));
-  FloatImageView* list = new FloatImageView(*data);
 
-  // create a default set of weights for the distance calculation.
-  double* buf_a, *buf_b;
-  Py_ssize_t len_a, len_b;
-  PyObject* cur_a, *cur_b;
-  cur_a = PySequence_Fast_GET_ITEM(images_seq, 0);
-  if (!is_ImageObject(cur_a)) {
-    PyErr_SetString(PyExc_TypeError, "knn: expected an image");
-    Py_DECREF(images_seq);
+  size_t n = compact->vectors.size();
+  FloatImageData* data = new FloatImageData(Dim(n, n));
+  FloatImageView* mat = new FloatImageView(*data);
+  std::fill(mat->vec_begin(), mat->vec_end(), 0.0);
+  SymmetricDistances store(data->begin(), n);
+  knn_pairwise_distances(o, *compact, progress, store);
+  delete compact;
+  return create_ImageObject(mat);
+}
+
+PyObject* knn_unique_distances(PyObject* self, PyObject* args) {
+  KnnObject* o = (KnnObject*)self;
+  PyObject* images;
+  PyObject* progress;
+  long normalize = 1;
+  int single_precision = 0;
+  if (PyArg_ParseTuple(args, CHAR_PTR_CAST "OO|ii", &images, &progress, &normalize,
+                       &single_precision) <= 0)
     return 0;
-  }
-  if (image_get_fv(cur_a, &buf_a, &len_a) < 0) {
-    Py_DECREF(images_seq);
+  // images is a list of Gamera/Python ImageObjects
+  PyObject* images_seq = PySequence_Fast(images, "First argument must be iterable.");
+  if (images_seq == NULL)
     return 0;
-  }
-
-  if (len_a != (int)o->num_features) {
-    PyErr_SetString(PyExc_ValueError, "knn: feature vector lengths don't match.");
-    Py_DECREF(images_seq);
+  CompactFeatures* compact = knn_pairwise_features(o, images_seq, normalize);
+  Py_DECREF(images_seq);
+  if (compact == 0)
     return 0;
-  }
 
-  // create the normalization object
-  kNN::Normalize norm(len_a);
-  for (int i = 0; i < images_len; ++i) {
-    cur_a = PySequence_Fast_GET_ITEM(images_seq, i);
-    if (!is_ImageObject(cur_a)) {
-      PyErr_SetString(PyExc_TypeError, "knn: expected an image");
-      Py_DECREF(images_seq);
-      return 0;
-    }
-    if (cur_a == NULL) {
-      Py_DECREF(images_seq);
+  size_t n = compact->vectors.size();
+  size_t list_len = n * (n - 1) / 2;
+  PyObject* result;
+  if (single_precision) {
+    // an array.array('f') of list_len zeros
+    PyObject* arglist = Py_BuildValue(CHAR_PTR_CAST "(s[f])", "f", 0.0);
+    PyObject* zero = PyEval_CallObject(array_init, arglist);
+    Py_DECREF(arglist);
+    if (zero == 0) {
+      delete compact;
       return 0;
     }
-    if (image_get_fv(cur_a, &buf_a, &len_a) < 0) {
-      Py_DECREF(images_seq);
+    result = PySequence_Repeat(zero, Py_ssize_t(list_len));
+    Py_DECREF(zero);
+    float* buf;
+    Py_ssize_t buf_len;
+    if (result == 0 || PyObject_AsWriteBuffer(result, (void**)&buf, &buf_len) < 0) {
+      Py_XDECREF(result);
+      delete compact;
       return 0;
     }
-    if (normalize)
-      norm.add(buf_a, buf_a + len_a);
-  }
-  if (normalize)
-    norm.compute_normalization();
-  double* tmp_a = new double[len_a];
-  double* tmp_b = new double[len_a];
-  // do the distance calculations
-  size_t index = 0;
-  for (int i = 0; i < images_len; ++i) {
-    cur_a = PySequence_Fast_GET_ITEM(images_seq, i);
-    if (cur_a == NULL)
-      goto uniq_error;
-    if (image_get_fv(cur_a, &buf_a, &len_a) < 0)
-      goto uniq_error;
-    if (normalize)
-      norm.apply(buf_a, buf_a + len_a, tmp_a);
-    for (int j = i + 1; j < images_len; ++j) {
-      cur_b = PySequence_Fast_GET_ITEM(images_seq, j);
-      if (cur_b == NULL)
-        goto uniq_error;
-      if (image_get_fv(cur_b, &buf_b, &len_b) < 0)
-        goto uniq_error;
-
-      if (len_a != len_b) {
-        PyErr_SetString(PyExc_ValueError, "Feature vector lengths do not match!");
-        goto uniq_error;
-      }
-      if (normalize)
-        norm.apply(buf_b, buf_b + len_b, tmp_b);
-      double distance;
-      if (normalize)
-        compute_distance(o->distance_type, tmp_a, len_a, tmp_b, &distance,
-                         o->selection_vector, o->weight_vector);
-      else
-        compute_distance(o->distance_type, buf_a, len_a, buf_b, &distance,
-                         o->selection_vector, o->weight_vector);
-      list->set(Point(index, 0), distance);
-      index++;
-    }
-    // call the progress object
-    PyObject_CallObject(progress, NULL);
+    PackedDistances<float> store(buf, n);
+    knn_pairwise_distances(o, *compact, progress, store);
+  } else {
+    FloatImageData* data = new FloatImageData(Dim(list_len, 1));
+    FloatImageView* list = new FloatImageView(*data);
+    PackedDistances<double> store(data->begin(), n);
+    knn_pairwise_distances(o, *compact, progress, store);
+    result = create_ImageObject(list);
   }
-
-  delete[] tmp_a; delete[] tmp_b;
-  return create_ImageObject(list);
-  // in case of error
- uniq_error:
-  delete[] tmp_a; delete[] tmp_b;
-  delete list;
-  delete data;
-  return 0;
+  delete compact;
+  return result;
 }
 
 static PyObject* knn_get_num_k(PyObject* self) {
@@ -907,6 +1253,25 @@ static int knn_set_distance_type(PyObject* self, PyObject* v) {
   return 0;
 }
 
+static PyObject* knn_get_feature_precision(PyObject* self) {
+  return Py_BuildValue(CHAR_PTR_CAST "i", ((KnnObject*)self)->feature_precision);
+}
+
+static int knn_set_feature_precision(PyObject* self, PyObject* v) {
+  if (!PyInt_Check(v)) {
+    PyErr_SetString(PyExc_TypeError, "knn: expected an int.");
+    return -1;
+  }
+  long precision = PyInt_AS_LONG(v);
+  if (precision < DOUBLE_FEATURES || precision > INT8_FEATURES) {
+    PyErr_SetString(PyExc_ValueError, "knn: unknown feature precision.");
+    return -1;
+  }
+  // the reduced feature vectors are rebuilt on the next classification
+  ((KnnObject*)self)->feature_precision = (FeaturePrecision)precision;
+  return 0;
+}
+
 static PyObject* knn_get_confidence_types(PyObject* self) {
   size_t n,i;
   PyObject* entry;
@@ -959,6 +1324,9 @@ static PyObject* knn_leave_one_out(PyObject* self, PyObject* args) {
                     "knn: leave_one_out called before instantiate_from_images.");
     return 0;
   }
+  // prototypes added or removed since the last classification leave the
+  // normalization outdated; update it before using the feature vectors
+  get_compact_features(o);
   if (indexes == 0) {
     // If we don't have a list of indexes, just do the leave_one_out
     Py_BEGIN_ALLOW_THREADS
@@ -1007,14 +1375,116 @@ static PyObject* knn_leave_one_out(PyObject* self, PyObject* args) {
   }
 }
 
+/*
+  The compacted feature vectors and the class ids of the main id names of
+  a list of images, for the editing algorithms. The class ids are numbered
+  in alphabetical order of the id names, like in knn_create_class_ids, so
+  that ties are resolved as by the classifier. Returns 0 with an exception
+  set on errors.
+*/
+static CompactFeatures* knn_editing_features(KnnObject* o, PyObject* images,
+                                             std::vector<int>& class_ids,
+                                             size_t& num_classes) {
+  PyObject* images_seq = PySequence_Fast(images, "First argument must be iterable.");
+  if (images_seq == NULL)
+    return 0;
+  int images_len = PySequence_Fast_GET_SIZE(images_seq);
+  std::map<std::string, int> ids;
+  class_ids.resize(images_len);
+  for (int i = 0; i < images_len; ++i) {
+    PyObject* cur = PySequence_Fast_GET_ITEM(images_seq, i);
+    char* id_name;
+    int len;
+    if (!is_ImageObject(cur)) {
+      PyErr_SetString(PyExc_TypeError, "knn: expected an image");
+      Py_DECREF(images_seq);
+      return 0;
+    }
+    if (image_get_id_name(cur, &id_name, &len) < 0) {
+      Py_DECREF(images_seq);
+      return 0;
+    }
+    std::map<std::string, int>::iterator it =
+      ids.insert(std::make_pair(std::string(id_name), int(ids.size()))).first;
+    class_ids[i] = it->second;
+  }
+  num_classes = ids.size();
+  std::vector<int> sorted_ids(num_classes);
+  int class_id = 0;
+  for (std::map<std::string, int>::iterator it = ids.begin();
+       it != ids.end(); ++it, ++class_id)
+    sorted_ids[it->second] = class_id;
+  for (int i = 0; i < images_len; ++i)
+    class_ids[i] = sorted_ids[class_ids[i]];
+  CompactFeatures* compact = knn_pairwise_features(o, images_seq, 0);
+  Py_DECREF(images_seq);
+  return compact;
+}
+
+/*
+  Wilson's editing: the indexes of the images that are misclassified by
+  the other images
+*/
+static PyObject* knn_edit_mnn(PyObject* self, PyObject* args) {
+  KnnObject* o = (KnnObject*)self;
+  PyObject* images;
+  if (PyArg_ParseTuple(args, CHAR_PTR_CAST "O", &images) <= 0)
+    return 0;
+  std::vector<int> class_ids;
+  size_t num_classes;
+  CompactFeatures* compact = knn_editing_features(o, images, class_ids, num_classes);
+  if (compact == 0)
+    return 0;
+  std::vector<char> misclassified;
+  Py_BEGIN_ALLOW_THREADS
+  edit_mnn(o->distance_type, *compact, &class_ids[0], num_classes, o->num_k,
+           misclassified);
+  Py_END_ALLOW_THREADS
+  delete compact;
+  PyObject* result = PyList_New(0);
+  for (size_t i = 0; i < misclassified.size(); ++i) {
+    if (misclassified[i]) {
+      PyObject* index = PyInt_FromLong(long(i));
+      PyList_Append(result, index);
+      Py_DECREF(index);
+    }
+  }
+  return result;
+}
+
+/*
+  Hart's condensing: the indexes of the images in the condensed store, in
+  the order they were added
+*/
+static PyObject* knn_edit_cnn(PyObject* self, PyObject* args) {
+  KnnObject* o = (KnnObject*)self;
+  PyObject* images;
+  if (PyArg_ParseTuple(args, CHAR_PTR_CAST "O", &images) <= 0)
+    return 0;
+  std::vector<int> class_ids;
+  size_t num_classes;
+  CompactFeatures* compact = knn_editing_features(o, images, class_ids, num_classes);
+  if (compact == 0)
+    return 0;
+  std::vector<size_t> store;
+  Py_BEGIN_ALLOW_THREADS
+  edit_cnn(o->distance_type, *compact, &class_ids[0], num_classes, o->num_k,
+           store);
+  Py_END_ALLOW_THREADS
+  delete compact;
+  PyObject* result = PyList_New(store.size());
+  for (size_t i = 0; i < store.size(); ++i)
+    PyList_SET_ITEM(result, i, PyInt_FromLong(long(store[i])));
+  return result;
+}
+
 /*
   statistics of average distance to k nearest neighbors
 */
 static PyObject* knn_knndistance_statistics(PyObject* self, PyObject* args) {
   KnnObject* o = (KnnObject*)self;
   PyObject* progress = 0;
-  int k;
-  size_t i,j;
+  int k = 0;
   if (PyArg_ParseTuple(args, CHAR_PTR_CAST "|iO", &k, &progress) <= 0)
     return 0;
   if (o->feature_vectors == 0) {
@@ -1030,36 +1500,58 @@ static PyObject* knn_knndistance_statistics(PyObject* self, PyObject* args) {
                     "knn: knndistance_statistics requires more than k training samples.");
     return 0;
   }
-  PyObject* entry;
-  PyObject* result = PyList_New(o->feature_vectors->size());
-  double *feature_i, *feature_j;
-  double distance;
-  kNearestNeighbors<char*, ltstr, eqstr> knn((size_t)k);
-  for (i=0; i<o->feature_vectors->size(); i++) {
-    knn.reset();
-    // find k nearest neighbors of i-th prototype
-    feature_i = (*o->feature_vectors)[i];
-    for (j=0; j<o->feature_vectors->size(); j++) {
-      if (j==i) continue;
-      feature_j = (*o->feature_vectors)[j];
-      // compute distance
-      compute_distance(o->distance_type, feature_i, o->num_features,
-                       feature_j, &distance, o->selection_vector, o->weight_vector);
-      // store distance in kNearestNeighbors
-      knn.add(o->id_names[j], distance);
+  size_t num_feature_vectors = o->feature_vectors->size();
+  PyObject* result = PyList_New(num_feature_vectors);
+  CompactFeatures* compact = get_compact_features(o);
+  int num_threads = knn_num_threads();
+  /*
+    The rows are processed in parallel without the interpreter lock, in
+    blocks so that the progress can be reported in between.
+  */
+  size_t block_size = 64 * num_threads;
+  std::vector<double> averages(block_size);
+  for (size_t start = 0; start < num_feature_vectors; start += block_size) {
+    long end = long(std::min(start + block_size, num_feature_vectors));
+    Py_BEGIN_ALLOW_THREADS
+#ifdef _OPENMP
+#pragma omp parallel num_threads(num_threads) if(num_threads > 1)
+#endif
+    {
+      ClassNeighbors knn((size_t)k, o->num_classes);
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic, 4)
+#endif
+      for (long i = long(start); i < end; ++i) {
+        // find k nearest neighbors of i-th prototype
+        const double* feature_i = compact->vectors[i];
+        for (size_t j = 0; j < num_feature_vectors; ++j) {
+          if (j == size_t(i)) continue;
+          double distance = compute_distance_padded(o->distance_type,
+                                                    feature_i,
+                                                    compact->vectors[j],
+                                                    compact->weights[0],
+                                                    compact->stride());
+          // store distance in kNearestNeighbors
+          knn.add(o->class_ids[j], distance);
+        }
+        // compute average distance
+        double distance = 0.0;
+        for (size_t j = 0; j < knn.m_nn.size(); ++j) {
+          distance += knn.m_nn[j].distance;
+        }
+        averages[i - start] = distance / k;
+        knn.reset();
+      }
     }
-    // compute average distance
-    distance = 0.0;
-    for (j=0; j < knn.m_nn.size(); ++j) {
-      distance += knn.m_nn[j].distance;
+    Py_END_ALLOW_THREADS
+    for (long i = long(start); i < end; ++i) {
+      PyObject* entry = PyTuple_New(2);
+      PyTuple_SET_ITEM(entry, 0, PyFloat_FromDouble(averages[i - start]));
+      PyTuple_SET_ITEM(entry, 1, PyString_FromString(o->id_names[i]));
+      PyList_SET_ITEM(result, i, entry);
+      if (progress)
+        PyObject_CallObject(progress, NULL);
     }
-    distance = distance / k;
-    entry = PyTuple_New(2);
-    PyTuple_SET_ITEM(entry, 0, PyFloat_FromDouble(distance));
-    PyTuple_SET_ITEM(entry, 1, PyString_FromString(o->id_names[i]));
-    PyList_SetItem(result, i, entry);
-    if (progress)
-      PyObject_CallObject(progress, NULL);
   }
   return result;
 }
@@ -1076,45 +1568,102 @@ static PyObject* knn_knndistance_statistics(PyObject* self, PyObject* args) {
 
   FORMAT
 
-  The format is designed to be as simple as possible. First is a header consisting
-  of the file format version (currently 2), then the size and settings of the data,
-  and finally the data.
+  The file (version 3) consists of a header followed by sections at the offsets
+  given in the header. The sections are laid out exactly like the data of the kNN
+  object, so that unserialize maps the file into memory and uses the feature
+  vectors and class names in place: loading does not depend on the size of the
+  file, and processes loading the same file share its pages. All numbers are
+  stored in the native byte order, so the files are not portable between
+  platforms.
 
   HEADER
 
   size             what
   ------------------------------------------
-  unsigned long    version
-  unsigned long    number of k
-  unsigned long    number of feaures
-  unsigned long    number of feature vectors
-  unsigned long    number of feature names
-  na               list of feature names in the format
-                   of unsigned long (length - including null)
-                   and char[]
-  bool             flag which indicated wheter normalization is used or not
-    double[]       normalization mean_vector (sizeof(double) * #feature vectors)
-                   NOTE: only if normalization is used
-    double[]       normalization stdev_vector (sizeof(double) * #feature vectors)
+  char[8]          "GAMERAKN"
+  uint64           version (3)
+  uint64           number of k
+  uint64           number of features
+  uint64           number of feature vectors
+  uint64           number of classes
+  uint64           flag which indicates whether normalization is used or not
+  uint64           number of feature names
+  uint64           offset and size (in bytes) of the feature names
+  uint64           offset and size (in bytes) of the class names
+  uint64           offset of the class ids
+  uint64           offset of the normalization
+  uint64           offset of the selection vector
+  uint64           offset of the weighting vector
+  uint64           offset of the feature vectors
+  uint64           size of the file
+
+  SECTIONS
+
+  size             what
+  ------------------------------------------
+  char[]           feature names, each terminated by \0
+  char[]           class names in alphabetical order, each terminated by \0
+  int32[]          the class of each feature vector, numbered like the class
+                   names (see knn_create_class_ids)
+  double[]         normalization mean_vector and stdev_vector (num_features each)
                    NOTE: only if normalization is used
-  int[]            selection vector (sizeof(int) * #features)
-  double[]         weighting vector (sizeof(double) * #features)
+  int32[]          selection vector (num_features)
+  double[]         weighting vector (num_features)
+  double[]         the (normalized) feature vectors as a FeatureMatrix, i.e.
+                   rows padded with zeros to a multiple of four features
 
-  DATA
+  Each section starts at a multiple of 8 bytes, the feature vectors at a
+  multiple of 4096 bytes (a page).
 
-  The data as stored a list of id_names followed by the feature vectors.
-  The id_names are stored as:
+  Files of version 2, in which the id_names and feature vectors were stored
+  one by one, can still be read.
+*/
+struct KnnFileHeader {
+  char magic[8];
+  uint64_t version;
+  uint64_t num_k;
+  uint64_t num_features;
+  uint64_t num_feature_vectors;
+  uint64_t num_classes;
+  uint64_t normalize;
+  uint64_t num_feature_names;
+  uint64_t feature_names_offset;
+  uint64_t feature_names_size;
+  uint64_t class_names_offset;
+  uint64_t class_names_size;
+  uint64_t class_ids_offset;
+  uint64_t normalization_offset;
+  uint64_t selections_offset;
+  uint64_t weights_offset;
+  uint64_t features_offset;
+  uint64_t file_size;
+};
 
-  size             what
-  ------------------------------------------
-  unsigned long    length of string
-  char[]           id_name
+static const char knn_file_magic[8] = { 'G', 'A', 'M', 'E', 'R', 'A', 'K', 'N' };
 
-  There are, of course, feature_vectors->size() id_names. Next is the data which is
-  simply written directly - i.e. feature_vectors->size() arrays of doubles of length
-  num_features.
+static uint64_t knn_file_align(uint64_t offset, uint64_t alignment) {
+  return (offset + alignment - 1) / alignment * alignment;
+}
 
+/*
+  Pads the file with zeros from pos to offset, writes size bytes of data
+  and advances pos.
 */
+static bool knn_file_write(FILE* file, uint64_t& pos, uint64_t offset,
+                           const void* data, size_t size) {
+  static const char zeros[256] = { 0 };
+  while (pos < offset) {
+    size_t n = (size_t)std::min(offset - pos, (uint64_t)sizeof(zeros));
+    if (fwrite(zeros, 1, n, file) != n)
+      return false;
+    pos += n;
+  }
+  if (size != 0 && fwrite(data, 1, size, file) != size)
+    return false;
+  pos += size;
+  return true;
+}
+
 static PyObject* knn_serialize(PyObject* self, PyObject* args) {
   KnnObject* o = (KnnObject*)self;
   char* filename;
@@ -1128,143 +1677,267 @@ static PyObject* knn_serialize(PyObject* self, PyObject* args) {
     PyErr_SetString(PyExc_TypeError, "knn: list of features must be a list.");
     return 0;
   }
-
-  unsigned long feature_size = PyList_GET_SIZE(features);
-
-  FILE* file = fopen(filename, "w+b");
-  if (file == 0) {
-    PyErr_SetString(PyExc_IOError, "knn: error opening file.");
-    return 0;
-  }
-
   if (o->feature_vectors == 0) {
     PyErr_SetString(PyExc_RuntimeError, "knn: serialize called before instatiate from images.");
-    fclose(file);
     return 0;
   }
+  // save the current normalization
+  get_compact_features(o);
 
-  // write the header info
-  unsigned long version = 2;
-  if (fwrite((const void*)&version, sizeof(unsigned long), 1, file) != 1) {
-    PyErr_SetString(PyExc_IOError, "knn: problem writing to a file.");
-    fclose(file);
-    return 0;
-  }
-  unsigned long num_k = (unsigned long)o->num_k;
-  if (fwrite((const void*)&num_k, sizeof(unsigned long), 1, file) != 1) {
-    PyErr_SetString(PyExc_IOError, "knn: problem writing to a file.");
-    fclose(file);
-    return 0;
-  }
-  unsigned long num_features = (unsigned long)o->num_features;
-  if (fwrite((const void*)&num_features, sizeof(unsigned long), 1, file) != 1) {
-    PyErr_SetString(PyExc_IOError, "knn: problem writing to a file.");
-    fclose(file);
+  std::string feature_names;
+  for (Py_ssize_t i = 0; i < PyList_GET_SIZE(features); ++i) {
+    PyObject* cur_string = PyList_GET_ITEM(features, i);
+    if (!PyString_Check(cur_string)) {
+      PyErr_SetString(PyExc_TypeError, "knn: feature names must be strings.");
+      return 0;
+    }
+    feature_names.append(PyString_AS_STRING(cur_string),
+                         PyString_GET_SIZE(cur_string) + 1);
+  }
+  std::string class_names;
+  for (size_t i = 0; i < o->num_classes; ++i)
+    class_names.append(o->class_names[i], strlen(o->class_names[i]) + 1);
+
+  size_t num_feature_vectors = o->feature_vectors->size();
+  std::vector<int32_t> class_ids(o->class_ids, o->class_ids + num_feature_vectors);
+  std::vector<int32_t> selections(o->selection_vector,
+                                  o->selection_vector + o->num_features);
+
+  KnnFileHeader header;
+  memcpy(header.magic, knn_file_magic, sizeof(header.magic));
+  header.version = 3;
+  header.num_k = o->num_k;
+  header.num_features = o->num_features;
+  header.num_feature_vectors = num_feature_vectors;
+  header.num_classes = o->num_classes;
+  header.normalize = o->normalize != 0;
+  header.num_feature_names = PyList_GET_SIZE(features);
+  header.feature_names_offset = knn_file_align(sizeof(header), 8);
+  header.feature_names_size = feature_names.size();
+  header.class_names_offset =
+    knn_file_align(header.feature_names_offset + header.feature_names_size, 8);
+  header.class_names_size = class_names.size();
+  header.class_ids_offset =
+    knn_file_align(header.class_names_offset + header.class_names_size, 8);
+  header.normalization_offset =
+    knn_file_align(header.class_ids_offset + num_feature_vectors * sizeof(int32_t), 8);
+  header.selections_offset = header.normalization_offset
+    + (header.normalize ? 2 * o->num_features * sizeof(double) : 0);
+  header.weights_offset =
+    knn_file_align(header.selections_offset + o->num_features * sizeof(int32_t), 8);
+  header.features_offset =
+    knn_file_align(header.weights_offset + o->num_features * sizeof(double), 4096);
+  size_t features_size =
+    num_feature_vectors * o->feature_vectors->stride() * sizeof(double);
+  header.file_size = header.features_offset + features_size;
+
+  /*
+    The file is written under a temporary name and then renamed, so that
+    processes which have mapped an older version of the file keep using a
+    consistent copy of it.
+  */
+  std::string tmp_filename = std::string(filename) + ".tmp";
+  FILE* file = fopen(tmp_filename.c_str(), "wb");
+  if (file == 0) {
+    PyErr_SetString(PyExc_IOError, "knn: error opening file.");
     return 0;
   }
-  unsigned long num_feature_vectors = (unsigned long)o->feature_vectors->size();
-  if (fwrite((const void*)&num_feature_vectors, sizeof(unsigned long), 1, file) != 1) {
+  uint64_t pos = 0;
+  bool ok = knn_file_write(file, pos, 0, &header, sizeof(header))
+    && knn_file_write(file, pos, header.feature_names_offset,
+                      feature_names.data(), feature_names.size())
+    && knn_file_write(file, pos, header.class_names_offset,
+                      class_names.data(), class_names.size())
+    && knn_file_write(file, pos, header.class_ids_offset,
+                      &class_ids[0], class_ids.size() * sizeof(int32_t));
+  if (ok && header.normalize) {
+    ok = knn_file_write(file, pos, header.normalization_offset,
+                        o->normalize->get_mean_vector(),
+                        o->num_features * sizeof(double))
+      && knn_file_write(file, pos, pos, o->normalize->get_stdev_vector(),
+                        o->num_features * sizeof(double));
+  }
+  ok = ok
+    && knn_file_write(file, pos, header.selections_offset,
+                      &selections[0], selections.size() * sizeof(int32_t))
+    && knn_file_write(file, pos, header.weights_offset,
+                      o->weight_vector, o->num_features * sizeof(double))
+    && knn_file_write(file, pos, header.features_offset,
+                      (*o->feature_vectors)[0], features_size);
+  if (fclose(file) != 0)
+    ok = false;
+#ifdef _WIN32
+  if (ok)
+    remove(filename);
+#endif
+  if (!ok || rename(tmp_filename.c_str(), filename) != 0) {
+    remove(tmp_filename.c_str());
     PyErr_SetString(PyExc_IOError, "knn: problem writing to a file.");
-    fclose(file);
     return 0;
   }
+  Py_INCREF(Py_None);
+  return Py_None;
+}
 
-  // write the feature names
-  if (fwrite((const void*)&feature_size, sizeof(unsigned long), 1, file) != 1) {
-    PyErr_SetString(PyExc_IOError, "knn: problem writing to a file.");
-    fclose(file);
-    return 0;
-  }
+/*
+  Checks that the sections given in the header of a version 3 file lie
+  within the file and fit the sizes of the data. Returns an error message,
+  or 0 if the header is valid.
+*/
+static const char* knn_check_file_header(const KnnFileHeader& header,
+                                         size_t file_size) {
+  if (header.version != 3)
+    return "knn: unknown version of knn file.";
+  if (header.file_size != file_size)
+    return "knn: knn file has the wrong size.";
+  if (header.num_features == 0 || header.num_feature_vectors == 0
+      || header.num_classes == 0 || header.num_classes > header.num_feature_vectors)
+    return "knn: knn file is corrupt.";
+  uint64_t stride = FeatureMatrix::stride_for((size_t)header.num_features);
+  // the sizes of the sections, computed such that they cannot overflow
+  uint64_t max_count = file_size / sizeof(double);
+  if (header.num_features > max_count || header.num_feature_vectors > max_count
+      || header.num_feature_vectors > max_count / stride)
+    return "knn: knn file is corrupt.";
+  struct { uint64_t offset, size; } sections[] = {
+    { header.feature_names_offset, header.feature_names_size },
+    { header.class_names_offset, header.class_names_size },
+    { header.class_ids_offset, header.num_feature_vectors * sizeof(int32_t) },
+    { header.normalization_offset,
+      header.normalize ? 2 * header.num_features * sizeof(double) : 0 },
+    { header.selections_offset, header.num_features * sizeof(int32_t) },
+    { header.weights_offset, header.num_features * sizeof(double) },
+    { header.features_offset,
+      header.num_feature_vectors * stride * sizeof(double) }
+  };
+  for (size_t i = 0; i < sizeof(sections) / sizeof(sections[0]); ++i) {
+    if (sections[i].offset % 8 != 0 || sections[i].offset > file_size
+        || sections[i].size > file_size - sections[i].offset)
+      return "knn: knn file is corrupt.";
+  }
+  if (header.features_offset % FeatureMatrix::ALIGNMENT != 0)
+    return "knn: knn file is corrupt.";
+  return 0;
+}
 
-  for (size_t i = 0; i < feature_size; ++i) {
-    PyObject* cur_string = PyList_GET_ITEM(features, i);
-    unsigned long string_size = PyString_GET_SIZE(cur_string) + 1;
-    if (fwrite((const void*)&string_size, sizeof(unsigned long), 1, file) != 1) {
-      PyErr_SetString(PyExc_IOError, "knn: problem writing to a file.");
-      fclose(file);
-      return 0;
-    }
-    if (fwrite((const void*)PyString_AS_STRING(cur_string),
-               sizeof(char), string_size, file) != string_size) {
-      PyErr_SetString(PyExc_IOError, "knn: problem writing to a file.");
-      fclose(file);
-      return 0;
-    }
-  }
+/*
+  Splits a section of \0 terminated strings. Returns false unless it
+  consists of exactly count strings.
+*/
+static bool knn_split_names(const char* data, uint64_t size, uint64_t count,
+                            std::vector<const char*>& names) {
+  const char* end = data + size;
+  while (data != end && names.size() < count) {
+    names.push_back(data);
+    data = (const char*)memchr(data, '\0', end - data);
+    if (data == 0)
+      return false;
+    ++data;
+  }
+  return data == end && names.size() == count;
+}
 
-  for (size_t i = 0; i < o->feature_vectors->size(); ++i) {
-    unsigned long len = strlen(o->id_names[i]) + 1; // include \0
-    if (fwrite((const void*)&len, sizeof(unsigned long), 1, file) != 1) {
-      PyErr_SetString(PyExc_IOError, "knn: problem writing to a file.");
-      fclose(file);
-      return 0;
-    }
-    if (fwrite((const void*)o->id_names[i], sizeof(char), len, file) != len) {
-      PyErr_SetString(PyExc_IOError, "knn: problem writing to a file.");
-      fclose(file);
-      return 0;
-    }
-  }
+static PyObject* knn_unserialize_version_2(KnnObject* o, const char* filename);
 
-  bool normalize = (bool) o->normalize;
-  if (fwrite((const void*) &normalize, sizeof(bool), 1, file) != 1) {
-    PyErr_SetString(PyExc_IOError, "knn: problem writing to a file.");
-    fclose(file);
+static PyObject* knn_unserialize(PyObject* self, PyObject* args) {
+  KnnObject* o = (KnnObject*)self;
+  char* filename;
+  if (PyArg_ParseTuple(args, CHAR_PTR_CAST "s", &filename) <= 0)
     return 0;
-  }
-
-  if (normalize) {
-    if (fwrite((const void*)o->normalize->get_mean_vector(),
-               sizeof(double), o->num_features, file) != o->num_features) {
-      PyErr_SetString(PyExc_IOError, "knn: problem writing to a file.");
-      fclose(file);
-      return 0;
-    }
-    if (fwrite((const void*)o->normalize->get_stdev_vector(),
-               sizeof(double), o->num_features, file) != o->num_features) {
-      PyErr_SetString(PyExc_IOError, "knn: problem writing to a file.");
-      fclose(file);
-      return 0;
-    }
-  }
 
-  if (fwrite((const void*)o->selection_vector, sizeof(int), o->num_features, file)
-      != o->num_features) {
-    PyErr_SetString(PyExc_IOError, "knn: problem writing to a file.");
-    fclose(file);
+  MappedFile* file = new MappedFile();
+  if (!file->open(filename)) {
+    delete file;
+    PyErr_SetString(PyExc_IOError, "knn: error opening file.");
     return 0;
   }
+  if (file->size() < sizeof(KnnFileHeader)
+      || memcmp(file->data(), knn_file_magic, sizeof(knn_file_magic)) != 0) {
+    delete file;
+    return knn_unserialize_version_2(o, filename);
+  }
 
-  if (fwrite((const void*)o->weight_vector, sizeof(double), o->num_features, file)
-      != o->num_features) {
-    PyErr_SetString(PyExc_IOError, "knn: problem writing to a file.");
-    fclose(file);
+  KnnFileHeader header;
+  memcpy(&header, file->data(), sizeof(header));
+  const char* error = knn_check_file_header(header, file->size());
+  std::vector<const char*> feature_names, class_names;
+  if (error == 0
+      && !(knn_split_names(file->data() + header.feature_names_offset,
+                           header.feature_names_size, header.num_feature_names,
+                           feature_names)
+           && knn_split_names(file->data() + header.class_names_offset,
+                              header.class_names_size, header.num_classes,
+                              class_names)))
+    error = "knn: knn file is corrupt.";
+  size_t num_feature_vectors = (size_t)header.num_feature_vectors;
+  const int32_t* class_ids =
+    (const int32_t*)(file->data() + header.class_ids_offset);
+  for (size_t i = 0; error == 0 && i < num_feature_vectors; ++i) {
+    if (class_ids[i] < 0 || uint64_t(class_ids[i]) >= header.num_classes)
+      error = "knn: knn file is corrupt.";
+  }
+  if (error != 0) {
+    delete file;
+    PyErr_SetString(PyExc_IOError, error);
     return 0;
   }
 
-  // write the data
-  double* cur;
-  for (size_t i = 0; i < o->feature_vectors->size(); ++i) {
-    cur = (*o->feature_vectors)[i];
-    if (fwrite((const void*)cur, sizeof(double), o->num_features, file)
-        != o->num_features) {
-      PyErr_SetString(PyExc_IOError, "knn: problem writing to a file.");
-      fclose(file);
-      return 0;
-    }
+  PyObject* result = PyList_New(feature_names.size());
+  for (size_t i = 0; i < feature_names.size(); ++i)
+    PyList_SET_ITEM(result, i, PyString_FromString(feature_names[i]));
+
+  knn_delete_feature_data(o);
+  set_num_features(o, (size_t)header.num_features);
+  o->num_k = (size_t)header.num_k;
+  o->mapped = file;
+  o->feature_vectors =
+    new FeatureMatrix((double*)(file->data() + header.features_offset),
+                      num_feature_vectors, o->num_features);
+
+  // the class names are used in place as the id_names
+  o->num_classes = class_names.size();
+  o->class_names = new char*[o->num_classes];
+  for (size_t i = 0; i < o->num_classes; ++i)
+    o->class_names[i] = (char*)class_names[i];
+  std::vector<int> histogram(o->num_classes, 0);
+  o->class_ids = new int[num_feature_vectors];
+  o->id_names = new char*[num_feature_vectors];
+  o->id_name_histogram = new int[num_feature_vectors];
+  for (size_t i = 0; i < num_feature_vectors; ++i) {
+    o->class_ids[i] = class_ids[i];
+    o->id_names[i] = o->class_names[class_ids[i]];
+    histogram[class_ids[i]]++;
+  }
+  for (size_t i = 0; i < num_feature_vectors; ++i)
+    o->id_name_histogram[i] = histogram[o->class_ids[i]];
+
+  if (o->normalize != 0)
+    delete o->normalize;
+  o->normalize = 0;
+  if (header.normalize) {
+    const double* mean = (const double*)(file->data() + header.normalization_offset);
+    const double* stdev = mean + o->num_features;
+    o->normalize = new Normalize(o->num_features);
+    o->normalize->set_mean_vector(mean, mean + o->num_features);
+    o->normalize->set_stdev_vector(stdev, stdev + o->num_features);
+    o->normalize->restore_sums(num_feature_vectors);
   }
+  const int32_t* selections =
+    (const int32_t*)(file->data() + header.selections_offset);
+  std::copy(selections, selections + o->num_features, o->selection_vector);
+  const double* weights = (const double*)(file->data() + header.weights_offset);
+  std::copy(weights, weights + o->num_features, o->weight_vector);
 
-  fclose(file);
-  Py_INCREF(Py_None);
-  return Py_None;
+  get_compact_features(o);
+  return result;
 }
 
-static PyObject* knn_unserialize(PyObject* self, PyObject* args) {
-  KnnObject* o = (KnnObject*)self;
-  char* filename;
-  if (PyArg_ParseTuple(args, CHAR_PTR_CAST "s", &filename) <= 0)
-    return 0;
-
+/*
+  Reads a file of version 2 of the format, in which the header is followed by
+  the id_names as unsigned long length (including \0) and char[], and the
+  feature vectors as num_features doubles each.
+*/
+static PyObject* knn_unserialize_version_2(KnnObject* o, const char* filename) {
   FILE* file = fopen(filename, "rb");
   if (file == 0) {
     PyErr_SetString(PyExc_IOError, "knn: error opening file.");
@@ -1328,7 +2001,6 @@ static PyObject* knn_unserialize(PyObject* self, PyObject* args) {
   }
   o->num_k = num_k;
 
-  std::map<char*, int, ltstr> id_name_histogram;
   for (size_t i = 0; i < o->feature_vectors->size(); ++i) {
     unsigned long len;
     if (fread((void*)&len, sizeof(unsigned long), 1, file) != 1) {
@@ -1342,7 +2014,6 @@ static PyObject* knn_unserialize(PyObject* self, PyObject* args) {
       fclose(file);
       return 0;
     }
-    id_name_histogram[o->id_names[i]]++;
   }
 
   bool normalize = false;
@@ -1352,7 +2023,11 @@ static PyObject* knn_unserialize(PyObject* self, PyObject* args) {
     return 0;
   }
 
+  if (o->normalize != 0)
+    delete o->normalize;
+  o->normalize = 0;
   if (normalize) {
+    o->normalize = new Normalize(o->num_features);
     double* tmp_mean_norm = new double[o->num_features];
     if (fread((void*)tmp_mean_norm, sizeof(double), o->num_features, file) != o->num_features) {
       PyErr_SetString(PyExc_IOError, "knn: problem reading file.");
@@ -1372,6 +2047,7 @@ static PyObject* knn_unserialize(PyObject* self, PyObject* args) {
     }
     o->normalize->set_stdev_vector(tmp_stdev_norm, tmp_stdev_norm + o->num_features);
     delete[] tmp_stdev_norm;
+    o->normalize->restore_sums(num_feature_vectors);
   }
 
   if (fread((void*)o->selection_vector, sizeof(int), o->num_features, file) != o->num_features) {
@@ -1394,10 +2070,11 @@ static PyObject* knn_unserialize(PyObject* self, PyObject* args) {
       fclose(file);
       return 0;
     }
-    o->id_name_histogram[i] = id_name_histogram[o->id_names[i]];
   }
 
   fclose(file);
+  knn_create_class_ids(o);
+  get_compact_features(o);
   return feature_names;
 }
 
@@ -1516,6 +2193,13 @@ static PyObject* knn_get_num_features(PyObject* self) {
   return Py_BuildValue(CHAR_PTR_CAST "i", o->num_features);
 }
 
+static PyObject* knn_get_num_feature_vectors(PyObject* self) {
+  KnnObject* o = (KnnObject*)self;
+  if (o->feature_vectors == 0)
+    return PyInt_FromLong(0);
+  return PyInt_FromLong(o->feature_vectors->size());
+}
+
 static int knn_set_num_features(PyObject* self, PyObject* v) {
   KnnObject* o = (KnnObject*)self;
   if (!PyInt_Check(v)) {
@@ -1553,6 +2237,14 @@ DL_EXPORT(void) initknncore(void) {
                        Py_BuildValue(CHAR_PTR_CAST "i", EUCLIDEAN));
   PyDict_SetItemString(d, "FAST_EUCLIDEAN",
                        Py_BuildValue(CHAR_PTR_CAST "i", FAST_EUCLIDEAN));
+  PyDict_SetItemString(d, "DOUBLE_FEATURES",
+                       Py_BuildValue(CHAR_PTR_CAST "i", DOUBLE_FEATURES));
+  PyDict_SetItemString(d, "FLOAT_FEATURES",
+                       Py_BuildValue(CHAR_PTR_CAST "i", FLOAT_FEATURES));
+  PyDict_SetItemString(d, "INT16_FEATURES",
+                       Py_BuildValue(CHAR_PTR_CAST "i", INT16_FEATURES));
+  PyDict_SetItemString(d, "INT8_FEATURES",
+                       Py_BuildValue(CHAR_PTR_CAST "i", INT8_FEATURES));
 
   PyObject* array_dict = get_module_dict("array");
   if (array_dict == 0) {
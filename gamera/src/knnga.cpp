@@ -84,6 +84,7 @@ GABaseSetting::GABaseSetting(int opMode /*= GA_SELECTION*/,
     this->pSize = pSize;
     this->cRate = cRate;
     this->mRate = mRate;
+    this->seed = 0;
 }
 
 int GABaseSetting::getOpMode() {
@@ -102,6 +103,10 @@ double GABaseSetting::getMutRate() {
     return this->mRate;
 }
 
+unsigned int GABaseSetting::getSeed() {
+    return this->seed;
+}
+
 void GABaseSetting::setOpMode(int opMode) {
     if ( opMode != GA_SELECTION && opMode != GA_WEIGHTING ) {
         throw std::invalid_argument("GABaseSetting: setOpMode: unknown mode of opertation");
@@ -122,6 +127,10 @@ void GABaseSetting::setMutRate(double mRate) {
     this->mRate = mRate;
 }
 
+void GABaseSetting::setSeed(unsigned int seed) {
+    this->seed = seed;
+}
+
 /******************************************************************************/
 /******************************************************************************/
 /******************************************************************************/
@@ -444,6 +453,10 @@ GAParallelization::GAParallelization(bool mode /*= true*/,
                                      unsigned int threads /*= 2*/) {
     this->parallelMode = mode;
     this->threadNum = threads;
+    this->islands = 1;
+    this->migrationInterval = 10;
+    this->migrationSize = 1;
+    this->asynchronous = false;
 }
 
 bool GAParallelization::isParallel() {
@@ -462,6 +475,44 @@ void GAParallelization::setThreadNum(unsigned int n /*= 2*/) {
     this->threadNum = n;
 }
 
+unsigned int GAParallelization::getIslands() {
+    return this->islands;
+}
+
+void GAParallelization::setIslands(unsigned int n /*= 1*/) {
+    if (n < 1) {
+        throw std::runtime_error("GAParallelization: at least one island is needed");
+    }
+    this->islands = n;
+}
+
+unsigned int GAParallelization::getMigrationInterval() {
+    return this->migrationInterval;
+}
+
+void GAParallelization::setMigrationInterval(unsigned int generations /*= 10*/) {
+    if (generations < 1) {
+        throw std::runtime_error("GAParallelization: invalid migration interval");
+    }
+    this->migrationInterval = generations;
+}
+
+unsigned int GAParallelization::getMigrationSize() {
+    return this->migrationSize;
+}
+
+void GAParallelization::setMigrationSize(unsigned int n /*= 1*/) {
+    this->migrationSize = n;
+}
+
+bool GAParallelization::isAsynchronous() {
+    return this->asynchronous;
+}
+
+void GAParallelization::setAsynchronous(bool asynchronous /*= true*/) {
+    this->asynchronous = asynchronous;
+}
+
 /******************************************************************************/
 /******************************************************************************/
 /******************************************************************************/
@@ -529,32 +580,10 @@ void GAOptimization<EOT>::StartCalculation() {
     this->manualStop.setFlag(true);
     this->running = true;
 
-    // seed the random number generator from EO
-    rng.reseed(time(NULL));
-
-#ifdef _OPENMP
-    // *************** PARALLELIZATION ***************
-    // Set parallel environment settings
-    // 'make_parallel' from eoParallel works only with an eoParser object
-    // so we have to simulate an argc and argv here :(
-    int argc = 1;
-    char *argv[] = { (char*)"dummy-argv" };
-    eoParser parser(argc, argv);
-
-    std::string section("Parallelization");
-    parser.setORcreateParam(this->parallelization->isParallel(),
-        "parallelize-loop",
-        "Enable memory shared parallelization into evaluation's loops",
-        '\0', section);
-    parser.setORcreateParam(this->parallelization->isParallel(),
-        "parallelize-dynamic",
-        "Enable dynamic memory shared parallelization",
-        '\0', section);
-
-    omp_set_num_threads(this->parallelization->getThreadNum());
-
-    make_parallel(parser);
-#endif
+    // seed the random number generator from EO, from the time unless a
+    // seed is given
+    unsigned int seed = this->baseSetting->getSeed();
+    rng.reseed(seed != 0 ? seed : time(NULL));
 
     // adjust the individual size for the case of weighting with
     // prior deselected features and build an index relation map
@@ -572,8 +601,15 @@ void GAOptimization<EOT>::StartCalculation() {
     }
 
     // *************** FITNESS SETTINGS ***************
+    // The individuals are evaluated in parallel by GAPopEval, or one after
+    // another, each with parallel leave-one-out loops
     GAFitnessEval<EOT> fitnessEvalFunctor(this->getKnnObject(), &indexRelation);
     eoEvalFuncCounter<EOT> eval(fitnessEvalFunctor);
+    unsigned int numThreads = 1;
+    if (this->parallelization->isParallel()) {
+        numThreads = this->parallelization->getThreadNum();
+    }
+    GAPopEval<EOT> popEval(fitnessEvalFunctor, eval, numThreads);
 
     // *************** POPULATIONS SETTINGS ***************
     // Create a population and fill it with random values for the start
@@ -584,7 +620,8 @@ void GAOptimization<EOT>::StartCalculation() {
     population.append(this->baseSetting->getPopSize(), random);
 
     // calculate the fitness for the individuals in the first generation
-    apply<EOT>(eval, population);
+    eoPop<EOT> noParents;
+    popEval(noParents, population);
 
     // *************** SELECTION SETTINGS ***************
     SelectOneDefaultWorth<EOT> *selectionMethod = this->selection->getSetting();
@@ -690,15 +727,174 @@ void GAOptimization<EOT>::StartCalculation() {
     eoSGATransform<EOT> transform(xover, this->baseSetting->getCrossRate(),
                                   muta, this->baseSetting->getMutRate());
 
-    eoEasyEA<EOT> realGA( checkpoint, eval, selection, transform, *replacement );
-
     // run the main GA algorithm
     if (this->manualStop.getFlag()) {
-        realGA(population);
+        if (this->parallelization->getIslands() > 1) {
+            this->runIslands(population, random, popEval, selection, transform,
+                             *replacement, checkpoint);
+        } else if (this->parallelization->isAsynchronous()) {
+            this->runAsynchronous(population, fitnessEvalFunctor, eval,
+                                  *selectionMethod, xover, muta, checkpoint,
+                                  numThreads);
+        } else {
+            eoEasyEA<EOT> realGA( checkpoint, popEval, selection, transform, *replacement );
+            realGA(population);
+        }
     }
     this->running = false;
 }
 
+/*
+  Island model: each island evolves its own population with the configured
+  operators. The offspring of all islands are evaluated together, so that
+  the threads stay busy, and every migrationInterval generations the best
+  migrationSize individuals of each island replace the worst ones of the
+  next island (ring topology). The checkpoint sees all islands as one
+  population, and the best popSize individuals of all islands are left in
+  population at the end.
+*/
+template <typename EOT>
+void GAOptimization<EOT>::runIslands(eoPop<EOT> &population, eoInit<EOT> &init,
+                                     GAPopEval<EOT> &popEval, eoSelect<EOT> &select,
+                                     eoTransform<EOT> &transform,
+                                     eoReplacement<EOT> &replace,
+                                     eoContinue<EOT> &checkpoint) {
+    unsigned int numIslands = this->parallelization->getIslands();
+    unsigned int popSize = population.size();
+    unsigned int migrationSize = std::min(this->parallelization->getMigrationSize(),
+                                          popSize);
+
+    std::vector<eoPop<EOT> > islands(numIslands);
+    std::vector<EOT*> invalid;
+    islands[0] = population;
+    for (unsigned int i = 1; i < numIslands; ++i) {
+        islands[i].append(popSize, init);
+        for (unsigned int j = 0; j < popSize; ++j) {
+            invalid.push_back(&islands[i][j]);
+        }
+    }
+    popEval.evaluate(invalid);
+
+    std::vector<eoPop<EOT> > offspring(numIslands);
+    eoPop<EOT> all;
+    unsigned int generation = 0;
+    do {
+        invalid.clear();
+        for (unsigned int i = 0; i < numIslands; ++i) {
+            offspring[i].clear();
+            select(islands[i], offspring[i]);
+            transform(offspring[i]);
+            for (size_t j = 0; j < offspring[i].size(); ++j) {
+                if (offspring[i][j].invalid()) {
+                    invalid.push_back(&offspring[i][j]);
+                }
+            }
+        }
+        popEval.evaluate(invalid);
+        for (unsigned int i = 0; i < numIslands; ++i) {
+            replace(islands[i], offspring[i]);
+        }
+
+        generation++;
+        if (generation % this->parallelization->getMigrationInterval() == 0 &&
+            migrationSize > 0) {
+            std::vector<std::vector<EOT> > emigrants(numIslands);
+            for (unsigned int i = 0; i < numIslands; ++i) {
+                islands[i].sort();
+                emigrants[i].assign(islands[i].begin(),
+                                    islands[i].begin() + migrationSize);
+            }
+            for (unsigned int i = 0; i < numIslands; ++i) {
+                eoPop<EOT> &target = islands[(i + 1) % numIslands];
+                std::copy(emigrants[i].begin(), emigrants[i].end(),
+                          target.end() - migrationSize);
+            }
+        }
+
+        all.clear();
+        for (unsigned int i = 0; i < numIslands; ++i) {
+            all.insert(all.end(), islands[i].begin(), islands[i].end());
+        }
+    } while (checkpoint(all));
+
+    // the best individuals of all islands form the final population
+    all.sort();
+    population.assign(all.begin(), all.begin() + popSize);
+}
+
+/*
+  Asynchronous steady-state mode: each thread breeds a single offspring,
+  evaluates it, and inserts it right away in place of the worst individual
+  when it is better, without waiting for the other threads. Breeding and
+  insertion are serialized, the evaluations run concurrently. Every
+  popSize offspring count as a generation for the checkpoint.
+*/
+template <typename EOT>
+void GAOptimization<EOT>::runAsynchronous(eoPop<EOT> &population,
+                                          GAFitnessEval<EOT> &eval,
+                                          eoEvalFuncCounter<EOT> &counter,
+                                          eoSelectOne<EOT> &select,
+                                          eoQuadOp<EOT> &xover, eoMonOp<EOT> &muta,
+                                          eoContinue<EOT> &checkpoint,
+                                          unsigned int numThreads) {
+    unsigned int popSize = population.size();
+    unsigned int numOffspring = 0;
+    bool proceed = true;
+
+#ifdef _OPENMP
+#pragma omp parallel num_threads(numThreads)
+#endif
+    {
+        GAEvalBuffers buffers;
+        EOT child;
+        bool breeding = true;
+        while (breeding) {
+#ifdef _OPENMP
+#pragma omp critical(GASteadyState)
+#endif
+            {
+                breeding = proceed;
+                if (breeding) {
+                    select.setup(population);
+                    child = select(population);
+                    EOT mate = select(population);
+                    if (rng.flip(this->baseSetting->getCrossRate()) && xover(child, mate)) {
+                        child.invalidate();
+                    }
+                    if (rng.flip(this->baseSetting->getMutRate()) && muta(child)) {
+                        child.invalidate();
+                    }
+                }
+            }
+            if (!breeding) {
+                break;
+            }
+
+            bool evaluated = child.invalid();
+            if (evaluated) {
+                eval.evaluate(child, buffers);
+            }
+
+#ifdef _OPENMP
+#pragma omp critical(GASteadyState)
+#endif
+            {
+                if (evaluated) {
+                    counter.value()++;
+                }
+                typename eoPop<EOT>::iterator worst = population.it_worse_element();
+                if (child.fitness() > worst->fitness()) {
+                    *worst = child;
+                }
+                numOffspring++;
+                if (proceed && numOffspring % popSize == 0) {
+                    proceed = checkpoint(population);
+                }
+            }
+        }
+    }
+}
+
 template <typename EOT>
 void GAOptimization<EOT>::StopCalculation() {
     this->manualStop.setFlag(false);
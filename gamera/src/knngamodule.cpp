@@ -35,11 +35,13 @@ extern "C" {
     static PyObject* getPopSize(PyObject* object);
     static PyObject* getCrossRate(PyObject* object);
     static PyObject* getMutRate(PyObject* object);
+    static PyObject* getSeed(PyObject* object);
     // Setter
     static int setOpMode(PyObject* object, PyObject* arg);
     static int setPopSize(PyObject* object, PyObject* arg);
     static int setCrossRate(PyObject* object, PyObject* arg);
     static int setMutRate(PyObject* object, PyObject* arg);
+    static int setSeed(PyObject* object, PyObject* arg);
 }
 
 struct GABaseSettingObject {
@@ -68,6 +70,10 @@ PyGetSetDef GABaseSetting_getset[] = {
     { (char *) "mutRate", (getter)getMutRate, (setter)setMutRate,
       (char *) "the mutation probability "
                "(should be between 0.0 and 1.0)", NULL },
+    { (char *) "seed", (getter)getSeed, (setter)setSeed,
+      (char *) "the seed of the random number generator; when 0 (the "
+               "default), it is seeded from the time, so that each "
+               "optimization differs", NULL },
     { NULL }
 };
 
@@ -158,6 +164,17 @@ static PyObject* getMutRate(PyObject* object) {
     }
 }
 
+static PyObject* getSeed(PyObject* object) {
+    GABaseSettingObject *self = (GABaseSettingObject*) object;
+
+    try {
+        return Py_BuildValue(CHAR_PTR_CAST "I", self->baseSetting->getSeed());
+    } catch (std::exception &e) {
+        PyErr_SetString(PyExc_RuntimeError, e.what());
+        Py_RETURN_NONE;
+    }
+}
+
 static int setOpMode(PyObject* object, PyObject* arg) {
     GABaseSettingObject *self = (GABaseSettingObject*) object;
 
@@ -237,6 +254,29 @@ static int setMutRate(PyObject* object, PyObject* arg) {
     return 0;
 }
 
+static int setSeed(PyObject* object, PyObject* arg) {
+    GABaseSettingObject *self = (GABaseSettingObject*) object;
+
+    if(!PyInt_Check(arg)) {
+        PyErr_SetString(PyExc_TypeError, "GABaseSetting.setSeed: seed have to be an int");
+        return -1;
+    }
+    long seed = PyInt_AsLong(arg);
+    if (seed < 0) {
+        PyErr_SetString(PyExc_ValueError, "GABaseSetting.setSeed: seed must not be negative");
+        return -1;
+    }
+
+    try {
+        self->baseSetting->setSeed((unsigned int) seed);
+    } catch (std::exception &e) {
+        PyErr_SetString(PyExc_RuntimeError, e.what());
+        return -1;
+    }
+
+    return 0;
+}
+
 void init_GABaseSettingType(PyObject *d) {
     GABaseSettingType.ob_type = &PyType_Type;
     GABaseSettingType.tp_name = CHAR_PTR_CAST "gamera.knnga.GABaseSetting";
@@ -1352,9 +1392,17 @@ extern "C" {
     // Getter
     static PyObject* getMode(PyObject* object);
     static PyObject* getThreadNum(PyObject* object);
+    static PyObject* getIslands(PyObject* object);
+    static PyObject* getMigrationInterval(PyObject* object);
+    static PyObject* getMigrationSize(PyObject* object);
+    static PyObject* getAsynchronous(PyObject* object);
     // Setter
     static int setMode(PyObject* object, PyObject* arg);
     static int setThreadNum(PyObject* object, PyObject* arg);
+    static int setIslands(PyObject* object, PyObject* arg);
+    static int setMigrationInterval(PyObject* object, PyObject* arg);
+    static int setMigrationSize(PyObject* object, PyObject* arg);
+    static int setAsynchronous(PyObject* object, PyObject* arg);
 }
 
 struct GAParallelizationObject {
@@ -1378,6 +1426,21 @@ PyGetSetDef GAParallelization_getset[] = {
     { (char *) "thredNum", (getter)getThreadNum, (setter)setThreadNum,
       (char *) "the number of threads which are used by enabled "
                "parallelization", NULL },
+    { (char *) "islands", (getter)getIslands, (setter)setIslands,
+      (char *) "the number of islands (sub-populations of *popSize* "
+               "individuals each) of the island model; 1 disables it", NULL },
+    { (char *) "migrationInterval", (getter)getMigrationInterval,
+      (setter)setMigrationInterval,
+      (char *) "the number of generations between two migrations of the "
+               "island model", NULL },
+    { (char *) "migrationSize", (getter)getMigrationSize,
+      (setter)setMigrationSize,
+      (char *) "the number of best individuals which migrate from each "
+               "island to the next one", NULL },
+    { (char *) "asynchronous", (getter)getAsynchronous, (setter)setAsynchronous,
+      (char *) "flag which enables the asynchronous steady-state mode, where "
+               "each new individual replaces the worst one as soon as its "
+               "fitness is known (if it is better)", NULL },
     { NULL }
 };
 
@@ -1491,6 +1554,147 @@ static int setThreadNum(PyObject* object, PyObject* arg) {
     return 0;
 }
 
+static PyObject* getIslands(PyObject* object) {
+    GAParallelizationObject *self = (GAParallelizationObject*) object;
+
+    try {
+        return Py_BuildValue(CHAR_PTR_CAST "I", self->parallel->getIslands());
+    } catch (std::exception &e) {
+        PyErr_SetString(PyExc_RuntimeError, e.what());
+        Py_RETURN_NONE;
+    }
+}
+
+static PyObject* getMigrationInterval(PyObject* object) {
+    GAParallelizationObject *self = (GAParallelizationObject*) object;
+
+    try {
+        return Py_BuildValue(CHAR_PTR_CAST "I", self->parallel->getMigrationInterval());
+    } catch (std::exception &e) {
+        PyErr_SetString(PyExc_RuntimeError, e.what());
+        Py_RETURN_NONE;
+    }
+}
+
+static PyObject* getMigrationSize(PyObject* object) {
+    GAParallelizationObject *self = (GAParallelizationObject*) object;
+
+    try {
+        return Py_BuildValue(CHAR_PTR_CAST "I", self->parallel->getMigrationSize());
+    } catch (std::exception &e) {
+        PyErr_SetString(PyExc_RuntimeError, e.what());
+        Py_RETURN_NONE;
+    }
+}
+
+static PyObject* getAsynchronous(PyObject* object) {
+    GAParallelizationObject *self = (GAParallelizationObject*) object;
+    bool asynchronous;
+
+    try {
+        asynchronous = self->parallel->isAsynchronous();
+    } catch (std::exception &e) {
+        PyErr_SetString(PyExc_RuntimeError, e.what());
+        Py_RETURN_NONE;
+    }
+
+    if ( asynchronous ) {
+        Py_RETURN_TRUE;
+    } else {
+        Py_RETURN_FALSE;
+    }
+}
+
+static int setIslands(PyObject* object, PyObject* arg) {
+    GAParallelizationObject *self = (GAParallelizationObject*) object;
+
+    if(!PyInt_Check(arg)) {
+        PyErr_SetString(PyExc_TypeError, "GAParallelization.setIslands: islands have to be an int");
+        return -1;
+    }
+
+    long value = PyInt_AsLong(arg);
+    if (value < 0) {
+        PyErr_SetString(PyExc_ValueError, "GAParallelization.setIslands: islands must not be negative");
+        return -1;
+    }
+
+    try {
+        self->parallel->setIslands((unsigned int) value);
+    } catch (std::exception &e) {
+        PyErr_SetString(PyExc_RuntimeError, e.what());
+        return -1;
+    }
+
+    return 0;
+}
+
+static int setMigrationInterval(PyObject* object, PyObject* arg) {
+    GAParallelizationObject *self = (GAParallelizationObject*) object;
+
+    if(!PyInt_Check(arg)) {
+        PyErr_SetString(PyExc_TypeError, "GAParallelization.setMigrationInterval: migrationInterval have to be an int");
+        return -1;
+    }
+
+    long value = PyInt_AsLong(arg);
+    if (value < 0) {
+        PyErr_SetString(PyExc_ValueError, "GAParallelization.setMigrationInterval: migrationInterval must not be negative");
+        return -1;
+    }
+
+    try {
+        self->parallel->setMigrationInterval((unsigned int) value);
+    } catch (std::exception &e) {
+        PyErr_SetString(PyExc_RuntimeError, e.what());
+        return -1;
+    }
+
+    return 0;
+}
+
+static int setMigrationSize(PyObject* object, PyObject* arg) {
+    GAParallelizationObject *self = (GAParallelizationObject*) object;
+
+    if(!PyInt_Check(arg)) {
+        PyErr_SetString(PyExc_TypeError, "GAParallelization.setMigrationSize: migrationSize have to be an int");
+        return -1;
+    }
+
+    long value = PyInt_AsLong(arg);
+    if (value < 0) {
+        PyErr_SetString(PyExc_ValueError, "GAParallelization.setMigrationSize: migrationSize must not be negative");
+        return -1;
+    }
+
+    try {
+        self->parallel->setMigrationSize((unsigned int) value);
+    } catch (std::exception &e) {
+        PyErr_SetString(PyExc_RuntimeError, e.what());
+        return -1;
+    }
+
+    return 0;
+}
+
+static int setAsynchronous(PyObject* object, PyObject* arg) {
+    GAParallelizationObject *self = (GAParallelizationObject*) object;
+
+    if(!PyBool_Check(arg)) {
+        PyErr_SetString(PyExc_TypeError, "GAParallelization.setAsynchronous: asynchronous have to be a bool");
+        return -1;
+    }
+
+    try {
+        self->parallel->setAsynchronous(PyObject_IsTrue(arg));
+    } catch (std::exception &e) {
+        PyErr_SetString(PyExc_RuntimeError, e.what());
+        return -1;
+    }
+
+    return 0;
+}
+
 void init_GAParallelizationType(PyObject *d) {
     GAParallelizationType.ob_type = &PyType_Type;
     GAParallelizationType.tp_name = CHAR_PTR_CAST "gamera.knnga.GAParallelization";
@@ -1511,7 +1715,10 @@ void init_GAParallelizationType(PyObject *d) {
         "   enable (``True``) or disable (``Flase``) the parallelization of "
         "individual fitness calculations\n"
         "*threads* (optional)\n"
-        "   the number of threads which are used for parallelization";
+        "   the number of threads which are used for parallelization. Each "
+        "thread evaluates whole individuals; when a generation has fewer new "
+        "individuals than threads, the threads share the leave-one-out "
+        "classification of one individual instead.";
 
     PyType_Ready(&GAParallelizationType);
     PyDict_SetItemString(d, "GAParallelization", (PyObject*)&GAParallelizationType);
@@ -1758,6 +1965,17 @@ static void GAOptimization_dealloc(PyObject *object) {
 static PyObject* startCalculation(PyObject* object, PyObject* args) {
     GAOptimizationObject *self = (GAOptimizationObject*) object;
 
+    // the fitness is computed on the feature vectors of the classifier,
+    // whose normalization may be outdated after adding or removing
+    // prototypes; it is updated here, while the GIL is held
+    KnnObject *knn = NULL;
+    if (self->selection != NULL)
+        knn = self->selection->getKnnObject();
+    else if (self->weighting != NULL)
+        knn = self->weighting->getKnnObject();
+    if (knn != NULL && knn->feature_vectors != NULL)
+        get_compact_features(knn);
+
     Py_BEGIN_ALLOW_THREADS
 
     try {
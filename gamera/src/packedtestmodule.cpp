@@ -0,0 +1,212 @@
+/*
+ *
+ * Copyright (C) 2026 Gamera developers
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+  gamera._packedtest runs the word-wise overloads for the bit-packed
+  storage format (see packed_data.hpp) on packed copies of Python images
+  and returns the results in dense form. The packed format is C++ only,
+  so this module exists for tests/test_packed.py and is not a plugin:
+  nothing here is added to the Image methods.
+*/
+
+#include <Python.h>
+#include "gameramodule.hpp"
+#include "plugins/image_conversion.hpp"
+#include "plugins/logical.hpp"
+#include "plugins/projections.hpp"
+#include "plugins/threshold.hpp"
+
+using namespace Gamera;
+
+//======================================================================
+// packed copies
+//======================================================================
+
+static void delete_packed(OneBitPackedImageView* view) {
+  if (view != NULL) {
+    delete view->data();
+    delete view;
+  }
+}
+
+/*
+  A dense view is packed together with the rest of its data, so that
+  the packed view starts at the same bit of a word as the dense view
+  starts in its data.
+*/
+static OneBitPackedImageView* to_packed_view(PyObject* image) {
+  Image* cpp = (Image*)((RectObject*)image)->m_x;
+  switch (get_image_combination(image)) {
+  case ONEBITIMAGEVIEW: {
+    OneBitImageView* view = (OneBitImageView*)cpp;
+    OneBitImageView whole(*view->data());
+    OneBitPackedImageView* packed = to_packed(whole);
+    OneBitPackedImageView* result =
+      new OneBitPackedImageView(*packed->data(), view->origin(), view->dim());
+    delete packed;
+    return result;
+  }
+  case ONEBITRLEIMAGEVIEW:
+    return to_packed(*((OneBitRleImageView*)cpp));
+  default:
+    PyErr_Format(PyExc_TypeError, "Images of pixel type '%s' can not be packed.",
+                 get_pixel_type_name(image));
+    return NULL;
+  }
+}
+
+//======================================================================
+// module functions
+//======================================================================
+
+extern "C" {
+  DL_EXPORT(void) init_packedtest(void);
+  static PyObject* packedtest_logical(PyObject* self, PyObject* args);
+  static PyObject* packedtest_projection_rows(PyObject* self, PyObject* args);
+  static PyObject* packedtest_projection_cols(PyObject* self, PyObject* args);
+  static PyObject* packedtest_threshold(PyObject* self, PyObject* args);
+}
+
+static PyObject* packedtest_logical(PyObject* self, PyObject* args) {
+  PyObject *a, *b;
+  int operation, in_place;
+  if (PyArg_ParseTuple(args, CHAR_PTR_CAST "OOii:logical", &a, &b,
+                       &operation, &in_place) <= 0)
+    return 0;
+  if (!is_ImageObject(a) || !is_ImageObject(b)) {
+    PyErr_SetString(PyExc_TypeError, "logical: arguments must be images");
+    return 0;
+  }
+  OneBitPackedImageView* pa = to_packed_view(a);
+  if (pa == NULL)
+    return 0;
+  OneBitPackedImageView* pb = to_packed_view(b);
+  if (pb == NULL) {
+    delete_packed(pa);
+    return 0;
+  }
+
+  OneBitPackedImageView* result = NULL;
+  OneBitImageView* dense = NULL;
+  try {
+    if (operation == 0)
+      result = and_image(*pa, *pb, in_place != 0);
+    else if (operation == 1)
+      result = or_image(*pa, *pb, in_place != 0);
+    else
+      result = xor_image(*pa, *pb, in_place != 0);
+    dense = packed_to_dense(result == NULL ? *pa : *result);
+  } catch (std::exception& e) {
+    delete_packed(pa);
+    delete_packed(pb);
+    PyErr_SetString(PyExc_RuntimeError, e.what());
+    return 0;
+  }
+  delete_packed(result);
+  delete_packed(pa);
+  delete_packed(pb);
+  return create_ImageObject(dense);
+}
+
+static PyObject* packedtest_projection(PyObject* args, bool rows) {
+  PyObject* image;
+  if (PyArg_ParseTuple(args, CHAR_PTR_CAST "O:projection", &image) <= 0)
+    return 0;
+  if (!is_ImageObject(image)) {
+    PyErr_SetString(PyExc_TypeError, "projection: argument must be an image");
+    return 0;
+  }
+  OneBitPackedImageView* packed = to_packed_view(image);
+  if (packed == NULL)
+    return 0;
+  IntVector* proj = rows ? projection_rows(*packed) : projection_cols(*packed);
+  delete_packed(packed);
+  PyObject* result = IntVector_to_python(proj);
+  delete proj;
+  return result;
+}
+
+static PyObject* packedtest_projection_rows(PyObject* self, PyObject* args) {
+  return packedtest_projection(args, true);
+}
+
+static PyObject* packedtest_projection_cols(PyObject* self, PyObject* args) {
+  return packedtest_projection(args, false);
+}
+
+/*
+  The packed output view starts inside the first word of its data, so
+  that threshold_fill stores unaligned words.
+*/
+template<class T>
+OneBitImageView* threshold_packed(const T& in, typename T::value_type threshold) {
+  const size_t shift = 13;
+  OneBitPackedImageData data(Dim(in.ncols() + shift, in.nrows()), in.origin());
+  OneBitPackedImageView out(data, Point(in.ul_x() + shift, in.ul_y()), in.dim());
+  threshold_fill(in, out, threshold);
+  return packed_to_dense(out);
+}
+
+static PyObject* packedtest_threshold(PyObject* self, PyObject* args) {
+  PyObject* image;
+  double threshold;
+  if (PyArg_ParseTuple(args, CHAR_PTR_CAST "Od:threshold", &image,
+                       &threshold) <= 0)
+    return 0;
+  if (!is_ImageObject(image)) {
+    PyErr_SetString(PyExc_TypeError, "threshold: argument must be an image");
+    return 0;
+  }
+  Image* cpp = (Image*)((RectObject*)image)->m_x;
+  OneBitImageView* result;
+  switch (get_image_combination(image)) {
+  case GREYSCALEIMAGEVIEW:
+    result = threshold_packed(*((GreyScaleImageView*)cpp),
+                              (GreyScalePixel)threshold);
+    break;
+  case GREY16IMAGEVIEW:
+    result = threshold_packed(*((Grey16ImageView*)cpp),
+                              (Grey16Pixel)threshold);
+    break;
+  case FLOATIMAGEVIEW:
+    result = threshold_packed(*((FloatImageView*)cpp), (FloatPixel)threshold);
+    break;
+  default:
+    PyErr_Format(PyExc_TypeError, "threshold: pixel type '%s' is not supported.",
+                 get_pixel_type_name(image));
+    return 0;
+  }
+  return create_ImageObject(result);
+}
+
+static PyMethodDef packedtest_module_methods[] = {
+  { CHAR_PTR_CAST "logical", packedtest_logical, METH_VARARGS,
+    CHAR_PTR_CAST "**logical** (*a*, *b*, int *operation*, bool *in_place*)\n\nCombines packed copies of two OneBit images with AND (0), OR (1) or XOR (2) and returns the result as a dense image." },
+  { CHAR_PTR_CAST "projection_rows", packedtest_projection_rows, METH_VARARGS,
+    CHAR_PTR_CAST "**projection_rows** (*image*)\n\nprojection_rows of a packed copy of a OneBit image." },
+  { CHAR_PTR_CAST "projection_cols", packedtest_projection_cols, METH_VARARGS,
+    CHAR_PTR_CAST "**projection_cols** (*image*)\n\nprojection_cols of a packed copy of a OneBit image." },
+  { CHAR_PTR_CAST "threshold", packedtest_threshold, METH_VARARGS,
+    CHAR_PTR_CAST "**threshold** (*image*, *threshold*)\n\nthreshold_fill of a GreyScale, Grey16 or Float image into a packed image, returned as a dense image." },
+  { NULL }
+};
+
+DL_EXPORT(void) init_packedtest(void) {
+  Py_InitModule(CHAR_PTR_CAST "gamera._packedtest", packedtest_module_methods);
+}
@@ -0,0 +1,182 @@
+from gamera.core import *
+init_gamera()
+
+def _make_image():
+   img = Image((0,0), (40,30), GREYSCALE)
+   for y in range(img.nrows):
+      for x in range(img.ncols):
+         img.set((x,y), (x * 37 + y * 11 + x * y) % 256)
+   return img
+
+def _region_mean(img, x, y, region_size):
+   half = region_size / 2
+   values = [img.get((i,j))
+             for j in range(max(0, y - half), min(y + half, img.nrows - 1) + 1)
+             for i in range(max(0, x - half), min(x + half, img.ncols - 1) + 1)]
+   return float(sum(values)) / len(values)
+
+def test_mean_filter():
+   img = _make_image()
+   means = img.mean_filter(7)
+   for y in range(img.nrows):
+      for x in range(img.ncols):
+         assert abs(means.get((x,y)) - _region_mean(img, x, y, 7)) < 1e-9
+
+def _region_statistics(img, x, y, region_size):
+   # same operations as regional_threshold, so the results are identical
+   half = region_size / 2
+   values = [img.get((i,j))
+             for j in range(max(0, y - half), min(y + half, img.nrows - 1) + 1)
+             for i in range(max(0, x - half), min(x + half, img.ncols - 1) + 1)]
+   area = float(len(values))
+   mean = sum(values) / area
+   return mean, (sum([v*v for v in values]) / area - mean * mean) ** 0.5
+
+def test_regional_threshold():
+   # 1..9: the region of the center is the whole image, with mean 5 and
+   # variance 20/3; the region of a corner is a 2x2 block
+   img = Image((0,0), (2,2), GREYSCALE)
+   for i in range(9):
+      img.set((i % 3, i / 3), i + 1)
+   mean, deviation = _region_statistics(img, 1, 1, 3)
+   assert mean == 5.0 and abs(deviation ** 2 - 20 / 3.0) < 1e-9
+   mean, deviation = _region_statistics(img, 0, 0, 3)
+   assert mean == 3.0 and abs(deviation ** 2 - 2.5) < 1e-9
+   # with sensitivity 0, pixels above the regional mean are white
+   assert img.niblack_threshold(3, 0.0, 0, 255).to_nested_list() == \
+          [[1, 1, 1], [1, 1, 0], [0, 0, 0]]
+
+   img = _make_image()
+   for region_size in (1, 3, 8):
+      for sensitivity in (-0.2, 0.0, 0.5):
+         result = img.niblack_threshold(region_size, sensitivity, 20, 230)
+         for y in range(img.nrows):
+            for x in range(img.ncols):
+               value = img.get((x,y))
+               mean, deviation = _region_statistics(img, x, y, region_size)
+               white = value >= 230 or (value >= 20 and
+                                        value > mean + sensitivity * deviation)
+               assert result.get((x,y)) == (not white)
+      result = img.sauvola_threshold(region_size, 0.5, 128, 20, 230)
+      for y in range(img.nrows):
+         for x in range(img.ncols):
+            value = img.get((x,y))
+            mean, deviation = _region_statistics(img, x, y, region_size)
+            threshold = mean + (1.0 - 0.5 * (1.0 - deviation / 128))
+            white = value >= 230 or (value >= 20 and value > threshold)
+            assert result.get((x,y)) == (not white)
+
+def test_regional_statistics_subimage():
+   img = _make_image()
+   sub = img.subimage((5,4), (34,25))
+   copy = sub.image_copy()
+   assert sub.mean_filter(9).to_nested_list() == copy.mean_filter(9).to_nested_list()
+   means = copy.mean_filter(9)
+   assert sub.variance_filter(means, 9).to_nested_list() == \
+          copy.variance_filter(means, 9).to_nested_list()
+   assert sub.niblack_threshold(9).to_nested_list() == \
+          copy.niblack_threshold(9).to_nested_list()
+   assert sub.sauvola_threshold(9).to_nested_list() == \
+          copy.sauvola_threshold(9).to_nested_list()
+
+def test_histogram():
+   img = _make_image()
+   # odd width, so that the rows do not split into groups of four
+   sub = img.subimage((3,2), (33,20))
+   counts = [0] * 256
+   for y in range(sub.nrows):
+      for x in range(sub.ncols):
+         counts[sub.get((x,y))] += 1
+   size = float(sub.nrows * sub.ncols)
+   assert list(sub.histogram()) == [c / size for c in counts]
+   assert sub.otsu_find_threshold() == sub.image_copy().otsu_find_threshold()
+
+def test_histogram_large():
+   # large enough for the rows to be split among threads
+   img = Image((0,0), (1200,1000), GREYSCALE)
+   img.fill(17)
+   for i in range(40):
+      img.draw_filled_rect((i * 29, i * 23), (i * 29 + 50, i * 23 + 70),
+                           (i * 53) % 256)
+   sub = img.subimage((1,1), (1199,999))
+   assert sub.nrows * sub.ncols >= 1 << 20
+   counts = [0] * 256
+   for row in sub.to_nested_list():
+      for value in row:
+         counts[value] += 1
+   size = float(sub.nrows * sub.ncols)
+   assert list(sub.histogram()) == [c / size for c in counts]
+
+def test_histogram_grey16():
+   # counted with the full 16 bit range, also split among threads
+   img = Image((0,0), (1200,1000), GREY16)
+   img.fill(300)
+   for i in range(40):
+      img.draw_filled_rect((i * 29, i * 23), (i * 29 + 50, i * 23 + 70),
+                           (i * 1693) % 65536)
+   img.set((5,5), 65535)
+   for sub in (img.subimage((1,1), (1199,999)), img.subimage((3,2), (33,20))):
+      counts = [0] * 65536
+      for row in sub.to_nested_list():
+         for value in row:
+            counts[value] += 1
+      size = float(sub.nrows * sub.ncols)
+      assert list(sub.histogram()) == [c / size for c in counts]
+
+def _gatos_background(src, binarization, region_size):
+   # the average of the background pixels in the region, computed pixel
+   # by pixel like the previous implementation of gatos_background
+   half = region_size / 2
+   values = src.to_nested_list()
+   black = binarization.to_nested_list()
+   result = []
+   for y in range(src.nrows):
+      row = []
+      for x in range(src.ncols):
+         if not black[y][x]:
+            row.append(values[y][x])
+            continue
+         count = total = 0
+         for j in range(max(0, y - half), min(y + half, src.nrows - 1) + 1):
+            for i in range(max(0, x - half), min(x + half, src.ncols - 1) + 1):
+               if not black[j][i]:
+                  count += 1
+                  total += values[j][i]
+         if count > 0:
+            row.append(int(total / float(count)))
+         else:
+            row.append(255)
+      result.append(row)
+   return result
+
+def test_gatos_binarization():
+   # testline has enough rows for several bands of region size 5; the
+   # noise variance is given, because the estimate is 0 for a OneBit image
+   img = load_image("data/testline.png").to_greyscale()
+   filtered = img.wiener_filter(3, 2000.0)
+   binarization = filtered.sauvola_threshold(5)
+   background = _gatos_background(filtered, binarization, 5)
+   assert filtered.gatos_background(binarization, 5).to_nested_list() == \
+          background
+   background = nested_list_to_image(background, GREYSCALE)
+   expected = filtered.gatos_threshold(background, binarization).to_nested_list()
+   for num_threads in (0, 1, 2, 3):
+      result = img.gatos_binarization(3, 2000.0, 5, num_threads=num_threads)
+      assert result.to_nested_list() == expected
+
+def test_gatos_binarization_subimage():
+   img = Image((0,0), (60,50), GREYSCALE)
+   for y in range(img.nrows):
+      for x in range(img.ncols):
+         value = 200 - y + (x * 7 + y * 13) % 23
+         if (x / 4 + y / 5) % 4 == 0:
+            value -= 130
+         img.set((x,y), value)
+   sub = img.subimage((2,3), (57,48))
+   filtered = sub.wiener_filter(3)
+   binarization = filtered.sauvola_threshold(9)
+   background = filtered.gatos_background(binarization, 9)
+   expected = filtered.gatos_threshold(background, binarization).to_nested_list()
+   for num_threads in (0, 1, 3):
+      result = sub.gatos_binarization(3, region_size=9, num_threads=num_threads)
+      assert result.to_nested_list() == expected
@@ -1,4 +1,7 @@
+import py.test
+
 from gamera.core import *
+import array
 from gamera import knn, classify, gamera_xml
 init_gamera()
 
@@ -127,3 +130,356 @@ def test_noninteractive_classifier():
    assert len(classifier.get_glyphs()) == 0
    classifier.unserialize("tmp/serialized.knn")
 
+
+def test_noninteractive_selections_and_weights():
+   # classify works on feature vectors compacted for the current
+   # selections and weights; classify_with_images uses the full vectors
+   image = load_image("data/testline.png")
+   ccs = image.cc_analysis()
+   database = gamera_xml.glyphs_from_xml("data/testline.xml")
+   classifier = knn.kNNNonInteractive(database,features=featureset,normalize=False)
+   num_features = classifier.num_features
+   selections = array.array('i', [i % 3 != 1 for i in range(num_features)])
+   weights = array.array('d', [(i % 5) / 4.0 for i in range(num_features)])
+   classifier.set_selections(selections)
+   classifier.set_weights(weights)
+   for distance_type in (0, 1, 2):
+      classifier.distance_type = distance_type
+      for glyph in ccs[:20]:
+         classifier.generate_features(glyph)
+         compact = classifier.classify(glyph)[0]
+         full = classifier.classify_with_images(classifier.database, glyph)[0]
+         assert [id for c, id in compact] == [id for c, id in full]
+         for (c1, id1), (c2, id2) in zip(compact, full):
+            assert abs(c1 - c2) < 1e-9
+
+def test_noninteractive_index():
+   # databases of a few hundred glyphs are searched with an index;
+   # classify_with_images always compares all glyphs
+   import random
+   random.seed(42)
+   database = []
+   for i in range(400):
+      glyph = Image((0,0), (random.randint(4,15),random.randint(4,15)), ONEBIT)
+      for j in range(random.randint(1,40)):
+         glyph.set((random.randint(0,glyph.ncols-1),
+                    random.randint(0,glyph.nrows-1)), 1)
+      glyph.classify_manual("class%d" % (i % 7))
+      database.append(glyph)
+   unknowns = database[:60]
+   database = database[60:]
+   features = ['aspect_ratio', 'volume', 'compactness']
+   classifier = knn.kNNNonInteractive(database, features=features,
+                                      normalize=False)
+   classifier.confidence_types = [CONFIDENCE_DEFAULT, CONFIDENCE_NUN,
+                                  CONFIDENCE_AVGDISTANCE]
+   for distance_type in (0, 1, 2):
+      classifier.distance_type = distance_type
+      for num_k in (1, 5):
+         classifier.num_k = num_k
+         for glyph in unknowns:
+            classifier.generate_features(glyph)
+            indexed = classifier.classify(glyph)
+            full = classifier.classify_with_images(classifier.database, glyph)
+            assert [id for c, id in indexed[0]] == [id for c, id in full[0]]
+            for (c1, id1), (c2, id2) in zip(indexed[0], full[0]):
+               assert abs(c1 - c2) < 1e-9
+            for key in indexed[1]:
+               assert abs(indexed[1][key] - full[1][key]) < 1e-9
+         single = [classifier.classify(glyph) for glyph in unknowns]
+         assert classifier.classify_batch(unknowns, 2) == single
+
+def test_noninteractive_classify_batch():
+   image = load_image("data/testline.png")
+   ccs = image.cc_analysis()
+   database = gamera_xml.glyphs_from_xml("data/testline.xml")
+   classifier = knn.kNNNonInteractive(database,features=featureset,normalize=True)
+   classifier.num_k = 3
+   classifier.confidence_types = [CONFIDENCE_DEFAULT, CONFIDENCE_KNNFRACTION]
+   single = []
+   for glyph in ccs:
+      classifier.generate_features(glyph)
+      single.append(classifier.classify(glyph))
+   for num_threads in (0, 1, 3):
+      assert classifier.classify_batch(ccs, num_threads) == single
+      features = [glyph.features for glyph in ccs]
+      assert classifier.classify_features_batch(features, num_threads) == single
+   assert classifier.classify_batch([]) == []
+   py.test.raises(ValueError, classifier.classify_features_batch,
+                  [array.array('d', [1.0, 2.0])])
+
+def test_noninteractive_feature_precision():
+   from gamera import knncore
+   image = load_image("data/testline.png")
+   ccs = image.cc_analysis()
+   database = gamera_xml.glyphs_from_xml("data/testline.xml")
+   classifier = knn.kNNNonInteractive(database,features=featureset,normalize=True)
+   classifier.confidence_types = [CONFIDENCE_DEFAULT, CONFIDENCE_NUN,
+                                  CONFIDENCE_AVGDISTANCE]
+   for glyph in ccs:
+      classifier.generate_features(glyph)
+   assert classifier.feature_precision == knncore.DOUBLE_FEATURES
+   for distance_type in (0, 1, 2):
+      classifier.distance_type = distance_type
+      for num_k in (1, 4):
+         classifier.num_k = num_k
+         classifier.feature_precision = knncore.DOUBLE_FEATURES
+         exact = [classifier.classify(glyph) for glyph in ccs]
+         for precision in (knncore.FLOAT_FEATURES, knncore.INT16_FEATURES,
+                           knncore.INT8_FEATURES):
+            classifier.feature_precision = precision
+            assert [classifier.classify(glyph) for glyph in ccs] == exact
+            assert classifier.classify_batch(ccs, 2) == exact
+   def set_precision(precision):
+      classifier.feature_precision = precision
+   py.test.raises(ValueError, set_precision, 4)
+
+def test_noninteractive_serialize():
+   import os, tempfile
+   image = load_image("data/testline.png")
+   ccs = image.cc_analysis()
+   database = gamera_xml.glyphs_from_xml("data/testline.xml")
+   classifier = knn.kNNNonInteractive(database,features=featureset,normalize=False)
+   classifier.num_k = 3
+   fd, filename = tempfile.mkstemp()
+   os.close(fd)
+   try:
+      classifier.serialize(filename)
+      loaded = knn.kNNNonInteractive(filename)
+   finally:
+      os.remove(filename)
+   assert loaded.num_k == 3
+   assert loaded.leave_one_out() == classifier.leave_one_out()
+   for glyph in ccs:
+      classifier.generate_features(glyph)
+      assert loaded.classify(glyph) == classifier.classify(glyph)
+
+def test_noninteractive_serialize_formats():
+   import os, struct, tempfile
+   image = load_image("data/testline.png")
+   ccs = image.cc_analysis()
+   database = gamera_xml.glyphs_from_xml("data/testline.xml")
+   classifier = knn.kNNNonInteractive(database,features=featureset,normalize=True)
+   selections = classifier.get_selections()
+   selections[1] = 0
+   classifier.set_selections(selections)
+   fd, filename = tempfile.mkstemp()
+   os.close(fd)
+   try:
+      classifier.serialize(filename)
+      loaded = knn.kNNNonInteractive(filename)
+      # overwriting a file which is in use
+      loaded.serialize(filename)
+      reloaded = knn.kNNNonInteractive(filename)
+      assert not os.path.exists(filename + ".tmp")
+      assert list(reloaded.get_selections()) == list(selections)
+      for glyph in ccs:
+         classifier.generate_features(glyph)
+         assert loaded.classify(glyph) == classifier.classify(glyph)
+         assert reloaded.classify(glyph) == classifier.classify(glyph)
+      # truncated files are rejected
+      data = open(filename, "rb").read()
+      open(filename, "wb").write(data[:-8])
+      py.test.raises(IOError, knn.kNNNonInteractive, filename)
+      # files of the previous version of the format can still be read
+      f = open(filename, "wb")
+      f.write(struct.pack("LLLLL", 2, 1, 2, 3, 2))
+      for name in ("aspect_ratio", "volume"):
+         f.write(struct.pack("L", len(name) + 1) + name + "\0")
+      for name in ("a", "b", "a"):
+         f.write(struct.pack("L", len(name) + 1) + name + "\0")
+      f.write(struct.pack("?", True) + struct.pack("dddd", 1.0, 1.0, 2.0, 2.0))
+      f.write(struct.pack("ii", 1, 1) + struct.pack("dd", 1.0, 1.0))
+      f.write(struct.pack("dddddd", 0.0, 0.0, 10.0, 10.0, 0.0, 1.0))
+      f.close()
+      old = knn.kNNNonInteractive(filename)
+   finally:
+      os.remove(filename)
+   results = old.classify_features_batch([array.array('d', [19.0, 19.0]),
+                                          array.array('d', [1.0, 1.0])])
+   assert [r[0][0][1] for r in results] == ['b', 'a']
+
+def test_noninteractive_add_remove():
+   import os, tempfile
+   image = load_image("data/testline.png")
+   ccs = image.cc_analysis()
+   glyphs = list(gamera_xml.glyphs_from_xml("data/testline.xml"))
+   def classifications(classifier):
+      result = []
+      for glyph in ccs:
+         classifier.generate_features(glyph)
+         result.append(classifier.classify(glyph))
+      return result
+   def assert_same(a, b):
+      for (ids_a, confidences_a), (ids_b, confidences_b) in zip(a, b):
+         assert [id for c, id in ids_a] == [id for c, id in ids_b]
+         for key in confidences_a:
+            assert abs(confidences_a[key] - confidences_b[key]) < 1e-6
+   for normalize in (False, True):
+      classifier = knn.kNNNonInteractive(glyphs[:20], features=featureset,
+                                         normalize=normalize)
+      classifier.num_k = 3
+      classifier.add_to_database(glyphs[20:40] + glyphs[10:30])
+      manual = [glyph for glyph in glyphs[20:40]
+                if glyph.classification_state == MANUAL]
+      assert list(classifier.database) == glyphs[:20] + manual
+      classifier.remove_from_database(manual)
+      # an unclassified glyph is rejected without touching the database
+      py.test.raises(ValueError, classifier.merge_glyphs, [ccs[0]])
+      assert list(classifier.database) == glyphs[:20]
+      classifier.merge_glyphs(glyphs[20:])
+      assert classifier.num_feature_vectors == len(glyphs)
+      assert list(classifier.database) == glyphs
+      full = knn.kNNNonInteractive(glyphs, features=featureset,
+                                   normalize=normalize)
+      full.num_k = 3
+      assert_same(classifications(classifier), classifications(full))
+      assert classifier.leave_one_out() == full.leave_one_out()
+      removed = glyphs[5:15] + glyphs[-3:]
+      classifier.remove_from_database(removed)
+      kept = [glyph for glyph in glyphs if glyph not in removed]
+      assert list(classifier.database) == kept
+      reduced = knn.kNNNonInteractive(kept, features=featureset,
+                                      normalize=normalize)
+      reduced.num_k = 3
+      assert_same(classifications(classifier), classifications(reduced))
+   # an unserialized classifier has feature vectors but no glyphs
+   fd, filename = tempfile.mkstemp()
+   os.close(fd)
+   try:
+      knn.kNNNonInteractive(glyphs[:40], features=featureset,
+                            normalize=True).serialize(filename)
+      loaded = knn.kNNNonInteractive(filename)
+   finally:
+      os.remove(filename)
+   loaded.merge_glyphs(glyphs[40:])
+   assert loaded.num_feature_vectors == len(glyphs)
+   full = knn.kNNNonInteractive(glyphs, features=featureset, normalize=True)
+   assert_same(classifications(loaded), classifications(full))
+   loaded.remove_from_database(glyphs[40:])
+   assert loaded.num_feature_vectors == 40
+   py.test.raises(ValueError, classifier._remove_images,
+                  range(classifier.num_feature_vectors))
+
+def test_noninteractive_leave_one_out_after_merge():
+   # leave_one_out right after changing the database uses the updated
+   # normalization, like a classifier built from the new database
+   glyphs = list(gamera_xml.glyphs_from_xml("data/testline.xml"))
+   classifier = knn.kNNNonInteractive(glyphs[:20], features=featureset,
+                                      normalize=True)
+   classifier.num_k = 3
+   classifier.merge_glyphs(glyphs[20:])
+   full = knn.kNNNonInteractive(glyphs, features=featureset, normalize=True)
+   full.num_k = 3
+   assert classifier.leave_one_out() == full.leave_one_out()
+   assert classifier.leave_one_out([0, 2, 5]) == full.leave_one_out([0, 2, 5])
+   classifier.remove_from_database(glyphs[:10])
+   kept = knn.kNNNonInteractive(glyphs[10:], features=featureset,
+                                normalize=True)
+   kept.num_k = 3
+   assert classifier.leave_one_out() == kept.leave_one_out()
+
+def test_noninteractive_leave_one_out():
+   database = gamera_xml.glyphs_from_xml("data/testline.xml")
+   classifier = knn.kNNNonInteractive(database,features=featureset,normalize=False)
+   classifier.num_k = 3
+   correct, total = classifier.leave_one_out()
+   assert 0 < correct < total
+   indexes = range(classifier.num_features)
+   assert classifier.leave_one_out(indexes) == (correct, total)
+   for stop_threshold in (0, 2):
+      c, t = classifier.leave_one_out(indexes, stop_threshold)
+      assert t - c == stop_threshold + 1 and t <= total
+      assert classifier.leave_one_out(indexes, stop_threshold) == (c, t)
+
+def test_knndistance_statistics():
+   database = gamera_xml.glyphs_from_xml("data/testline.xml")
+   classifier = knn.kNNNonInteractive(database,features=featureset,normalize=False)
+   glyphs = list(classifier.database)
+   stats = classifier.knndistance_statistics(2)
+   assert len(stats) == len(glyphs)
+   for glyph, (average, id_name) in zip(glyphs, stats):
+      assert id_name == glyph.get_main_id()
+      distances = [classifier.distance_between_images(glyph, other)
+                   for other in glyphs if other is not glyph]
+      distances.sort()
+      assert abs(average - (distances[0] + distances[1]) / 2.0) < 1e-6 * max(1.0, average)
+
+def test_pairwise_distances():
+   database = gamera_xml.glyphs_from_xml("data/testline.xml")
+   classifier = knn.kNNNonInteractive(database,features=featureset,normalize=False)
+   glyphs = list(classifier.database)[:40]
+   n = len(glyphs)
+   matrix = classifier.distance_matrix(glyphs, normalize=False)
+   packed = classifier.unique_distances(glyphs, normalize=False)
+   single = classifier.unique_distances(glyphs, normalize=False,
+                                        single_precision=True)
+   assert (matrix.nrows, matrix.ncols) == (n, n)
+   assert (packed.nrows, packed.ncols) == (1, n * (n - 1) / 2)
+   assert len(single) == n * (n - 1) / 2
+   for i in range(n):
+      assert matrix.get((i, i)) == 0.0
+      for j in range(i + 1, n):
+         d = classifier.distance_between_images(glyphs[i], glyphs[j])
+         k = i * (2 * n - i - 1) / 2 + j - i - 1
+         assert abs(matrix.get((j, i)) - d) <= 1e-9 * max(1.0, d)
+         assert matrix.get((i, j)) == matrix.get((j, i))
+         assert packed.get((k, 0)) == matrix.get((j, i))
+         assert abs(single[k] - d) <= 1e-6 * max(1.0, d)
+   normalized = classifier.distance_matrix(glyphs)
+   assert normalized.get((1, 0)) != matrix.get((1, 0))
+
+def test_editing():
+   from gamera import knn_editing
+   glyphs = list(gamera_xml.glyphs_from_xml("data/testline.xml"))
+   classifier = knn.kNNInteractive(glyphs, featureset, False, 3)
+   glyphs = list(classifier.get_glyphs())
+   def main_id(glyph, database, cross_validation_mode=False):
+      return classifier.classify_with_images(database, glyph,
+                                             cross_validation_mode)[0][0][1]
+
+   # Wilson's editing removes the glyphs misclassified by all others
+   bad = [g for g in glyphs if g.get_main_id() != main_id(g, glyphs, True)]
+   assert 0 < len(bad) < len(glyphs)
+   edited = knn_editing.edit_mnn(classifier, 0, False)
+   assert edited.num_k == 3
+   assert sorted(map(id, edited.get_glyphs())) == \
+          sorted([id(g) for g in glyphs if g not in bad])
+
+   # Hart's condensing, in the order of the glyphs
+   store = [glyphs[0]]
+   changed = True
+   while changed:
+      changed = False
+      for g in glyphs[1:]:
+         if g not in store and g.get_main_id() != main_id(g, store):
+            store.append(g)
+            changed = True
+   assert 1 < len(store) < len(glyphs)
+   condensed = knn_editing.edit_cnn(classifier, 0, False)
+   assert condensed.num_k == 1
+   assert sorted(map(id, condensed.get_glyphs())) == sorted(map(id, store))
+   condensed = knn_editing.edit_mnn_cnn(classifier, 0, False, 3, True)
+   assert 0 < len(condensed.get_glyphs()) < len(edited.get_glyphs())
+
+def test_editing_ties():
+   from gamera import knn_editing
+   # the neighbors of the last glyph are a 'b' and an 'a' at the same
+   # distance, and the tie is resolved in alphabetical order of the classes
+   glyphs = []
+   for name, ncols in (('b', 2), ('a', 4), ('b', 3)):
+      glyph = Image((0,0), (ncols - 1, 4), ONEBIT)
+      glyph.fill(1)
+      glyph.classify_manual(name)
+      glyphs.append(glyph)
+   classifier = knn.kNNInteractive(glyphs, ['black_area'], False, 2)
+   glyphs = list(classifier.get_glyphs())
+   kept = []
+   for glyph in glyphs:
+      others = knn.kNNInteractive([g for g in glyphs if g is not glyph],
+                                  ['black_area'], False, 2)
+      if others.guess_glyph_automatic(glyph)[0][0][1] == glyph.get_main_id():
+         kept.append(glyph)
+   assert kept == glyphs[:1]
+   edited = knn_editing.edit_mnn(classifier, 0, False)
+   assert sorted(map(id, edited.get_glyphs())) == sorted(map(id, kept))
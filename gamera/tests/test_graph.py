@@ -1,5 +1,6 @@
 #!/usr/bin/env python
 import sys, gc, os
+import py.test
 from gamera.core import *
 init_gamera()
 import gamera.graph
@@ -554,6 +555,38 @@ def _test_minimum_spanning_tree(flag = gamera.graph.FREE):
 
 
 
+# ------------------------------------------------------------------------------
+def _test_minimum_spanning_tree_prim(flag = gamera.graph.FREE):
+   import random
+   rng = random.Random(flag)
+   g = gamera.graph.Graph(flag)
+   for i in range(60):
+      g.add_node(i)
+   # two subgraphs with random weights
+   for i in range(150):
+      a = rng.randint(0, 39)
+      b = rng.randint(0, 39)
+      if a != b:
+         g.add_edge(a, b, rng.randint(1, 20))
+   for i in range(40, 59):
+      g.add_edge(i, i+1, rng.randint(1, 20))
+
+   if g.is_directed():
+      py.test.raises(TypeError, g.create_minimum_spanning_tree_prim)
+      py.test.raises(TypeError, g.create_minimum_spanning_tree_kruskal)
+      return
+   kruskal = g.create_minimum_spanning_tree_kruskal()
+   prim = g.create_minimum_spanning_tree_prim()
+   for t in (kruskal, prim):
+      assert t.nnodes == 60
+      assert t.nsubgraphs == g.nsubgraphs
+      assert t.nedges == 60 - g.nsubgraphs
+   assert sum([e.cost for e in kruskal.get_edges()]) == \
+          sum([e.cost for e in prim.get_edges()])
+   del g
+
+
+
 # ------------------------------------------------------------------------------
 def _test_spanning_tree(flag = gamera.graph.FREE):
    g = gamera.graph.Graph(flag)
@@ -930,6 +963,128 @@ def _test_large_graph(flag = gamera.graph.FREE, count = 20000):
 
 
 
+# ------------------------------------------------------------------------------
+def _test_nsubgraphs(flag = gamera.graph.FREE, count = 5000):
+   # chains of seven nodes with some random shortcuts inside each chain
+   import random
+   rng = random.Random(count)
+   g = gamera.graph.Graph(flag)
+   for i in range(0, count):
+      g.add_node(i)
+   for i in range(0, count):
+      if (i+1) % 7 != 0 and i+1 < count:
+         g.add_edge(i, i+1)
+      j = i - i % 7 + rng.randint(0, 6)
+      if j < count:
+         g.add_edge(j, i)
+   nroots = len(list(g.get_subgraph_roots()))
+   assert g.nsubgraphs == nroots
+   if not g.is_directed():
+      assert nroots == (count + 6) / 7
+   del g
+
+
+
+# ------------------------------------------------------------------------------
+def _random_graph(flag, count, seed):
+   # random edges with power of two costs, so that all paths have different
+   # lengths and the shortest paths are unique
+   import random
+   rng = random.Random(seed)
+   g = gamera.graph.Graph(flag)
+   for i in range(0, count):
+      g.add_node(i)
+   for i in range(0, 2 * count):
+      g.add_edge(rng.randint(0, count - 1), rng.randint(0, count - 1),
+                 float(2 ** rng.randint(0, 40)))
+   return g
+
+
+
+def _reference_search(g, start, depth_first):
+   # the search of BfsIterator and DfsIterator on the node and edge objects
+   visited = set([start])
+   todo = [start]
+   order = []
+   while todo:
+      if depth_first:
+         v = todo.pop()
+      else:
+         v = todo.pop(0)
+      order.append(v)
+      n = g.get_node(v)
+      for e in n.edges:
+         m = e.traverse(n)
+         if m is not None and m() not in visited:
+            visited.add(m())
+            todo.append(m())
+   return order
+
+
+
+def _reference_dijkstra(g, source):
+   # the result of ShortestPath::dijkstra_shortest_path
+   inf = float("inf")
+   dist = dict([(n(), inf) for n in g.get_nodes()])
+   pred = {}
+   dist[source] = 0.0
+   done = set()
+   while True:
+      todo = [v for v in dist if v not in done and dist[v] < inf]
+      if not todo:
+         break
+      u = min(todo, key=lambda v: dist[v])
+      done.add(u)
+      for e in g.get_node(u).edges:
+         m = e.traverse(g.get_node(u))
+         if m is not None and dist[u] + e.cost < dist[m()]:
+            dist[m()] = dist[u] + e.cost
+            pred[m()] = u
+   paths = {}
+   for v in dist:
+      if dist[v] == inf:
+         paths[v] = (0.0, [v])
+      else:
+         path = [v]
+         while path[-1] in pred:
+            path.append(pred[path[-1]])
+         paths[v] = (dist[v], path)
+   return paths
+
+
+
+# ------------------------------------------------------------------------------
+def _test_csr_traversals(flag = gamera.graph.FREE, count = 5000):
+   g = _random_graph(flag, count, count)
+   for start in range(0, count, max(1, count / 16)):
+      bfs = [n() for n in g.BFS(start)]
+      dfs = [n() for n in g.DFS(g.get_node(start))]
+      assert bfs == _reference_search(g, start, False)
+      assert dfs == _reference_search(g, start, True)
+      assert g.size_of_subgraph(start) == len(dfs)
+   # is_fully_connected still counts the nodes with DfsIterator
+   assert g.is_fully_connected() == (g.size_of_subgraph(0) == count)
+   py.test.raises(KeyError, g.BFS, count)
+   py.test.raises(KeyError, g.DFS, count)
+   del g
+
+
+
+# ------------------------------------------------------------------------------
+def _test_csr_dijkstra(flag = gamera.graph.FREE, count = 5000):
+   count = min(count, 64)
+   g = _random_graph(flag, count, count + 1)
+   all_pairs = g.dijkstra_all_pairs_shortest_path()
+   assert sorted(all_pairs.keys()) == range(0, count)
+   for source in range(0, count):
+      reference = _reference_dijkstra(g, source)
+      assert g.shortest_path(source) == reference
+      assert all_pairs[source] == reference
+   py.test.raises(KeyError, g.dijkstra_shortest_path, count)
+   del g
+
+
+
 # ------------------------------------------------------------------------------
 def memory_usage():
       cmd = "ps u -p %i | awk '{sum=sum+$6}; END {print sum}'" % os.getpid()
@@ -1004,6 +1159,7 @@ tests_small = [
    _test_make_tree,
    _test_check_insert_restrictions,
    _test_minimum_spanning_tree,
+   _test_minimum_spanning_tree_prim,
    _test_spanning_tree,
    _test_colorize
 ]
@@ -1019,7 +1175,10 @@ tests_large = [
    _test_has_edge,
    _test_remove_edge,
    _test_userdefined_class,
-   _test_large_graph
+   _test_large_graph,
+   _test_nsubgraphs,
+   _test_csr_traversals,
+   _test_csr_dijkstra
 ]
 
 #   _test_memory
@@ -1138,3 +1297,155 @@ def test_textline_reading_order():
       del img
 
 
+
+# ------------------------------------------------------------------------------
+def test_minimum_spanning_tree_distance_matrix():
+   from gamera import cluster, knn
+   glyphs = load_image("data/testline.png").cc_analysis()[:40]
+   k = knn.kNNInteractive()
+   dists = k.distance_matrix(glyphs, 0)
+   n = len(glyphs)
+   # reference Prim on the matrix
+   inf = float("inf")
+   key = [inf] * n
+   key[0] = 0.0
+   done = [False] * n
+   total = 0.0
+   for step in range(n):
+      u = min([v for v in range(n) if not done[v]], key=lambda v: key[v])
+      done[u] = True
+      total += key[u]
+      for v in range(n):
+         if not done[v] and dists.get((v,u)) < key[v]:
+            key[v] = dists.get((v,u))
+
+   trees = [cluster.make_spanning_tree(glyphs, k)]
+   for method in ("create_minimum_spanning_tree_kruskal",
+                  "create_minimum_spanning_tree_prim"):
+      g = gamera.graph.Undirected()
+      getattr(g, method)(glyphs, dists)
+      trees.append(g)
+   for g in trees:
+      assert g.nnodes == n
+      assert g.nedges == n - 1
+      assert g.nsubgraphs == 1
+      assert abs(sum([e.cost for e in g.get_edges()]) - total) < 1e-6
+
+   g = gamera.graph.Undirected()
+   py.test.raises(ValueError, g.create_minimum_spanning_tree, glyphs[:-1], dists)
+
+
+
+# ------------------------------------------------------------------------------
+def test_from_label_pairs():
+   from gamera.plugins.geometry import labeled_region_neighbors
+   img = load_image("data/testline.png")
+   ccs = img.cc_analysis()
+   labelpairs = img.voronoi_from_labeled_image().labeled_region_neighbors()
+   assert len(labelpairs) > 0
+   weights = [float(2 ** (i % 40)) for i in range(len(labelpairs))]
+
+   for flag in (gamera.graph.UNDIRECTED, gamera.graph.DIRECTED):
+      g = gamera.graph.from_label_pairs(labelpairs, weights, flag)
+      h = gamera.graph.Graph(flag)
+      for label in sorted(set([a for a, b in labelpairs] + [b for a, b in labelpairs])):
+         h.add_node(label)
+      for (a, b), w in zip(labelpairs, weights):
+         h.add_edge(a, b, w)
+      assert [n() for n in g.get_nodes()] == [n() for n in h.get_nodes()]
+      assert [(e.from_node(), e.to_node(), e.cost) for e in g.get_edges()] == \
+             [(e.from_node(), e.to_node(), e.cost) for e in h.get_edges()]
+      assert g.nsubgraphs == h.nsubgraphs
+      start = labelpairs[0][0]
+      assert [n() for n in g.BFS(start)] == _reference_search(h, start, False)
+      assert g.shortest_path(start) == _reference_dijkstra(h, start)
+
+   g = gamera.graph.from_label_pairs([(1, 2), [2, 3]])
+   assert g.nnodes == 3 and g.nedges == 2
+   assert g.get_edges().next().cost == 1.0
+   py.test.raises(ValueError, gamera.graph.from_label_pairs, [(1, 2)], [1.0, 2.0])
+   py.test.raises(TypeError, gamera.graph.from_label_pairs, [(1, 2, 3)])
+
+
+
+# ------------------------------------------------------------------------------
+def test_minimum_spanning_tree_old_edge_set():
+   # the total weight and the edges (without their direction) of the trees
+   # must be those of the old Kruskal implementation
+   import random
+   def edge_set(t):
+      return set([frozenset((e.from_node(), e.to_node())) for e in t.get_edges()])
+   def total(t):
+      return sum([e.cost for e in t.get_edges()])
+   def reference_kruskal(nnodes, edges):
+      parent = range(nnodes)
+      def find(i):
+         while parent[i] != i:
+            i = parent[i]
+         return i
+      tree = set()
+      for w, a, b in sorted(edges):
+         if find(a) != find(b):
+            parent[find(a)] = find(b)
+            tree.add(frozenset((a, b)))
+      return tree
+
+   # the graph of _test_minimum_spanning_tree has equal weights
+   g = gamera.graph.Graph(gamera.graph.UNDIRECTED)
+   g.add_edges([
+      (9,10,4), (9,16,8), (10,16,11), (10,11,8),
+      (11,17,2), (11,14,4), (11,12,7), (12,13,9),
+      (12,14,14), (13,14,10), (14,15,2), (15,17,6),
+      (15,16,1), (16,17,7)])
+   old = set([frozenset(p) for p in [(15,16), (11,17), (14,15), (11,14),
+                                     (9,10), (11,12), (9,16), (12,13)]])
+   kruskal = g.create_minimum_spanning_tree()
+   assert edge_set(kruskal) == old
+   assert total(kruskal) == 37.0
+   assert total(g.create_minimum_spanning_tree_prim()) == 37.0
+
+   # unique weights, so that the minimum spanning tree is unique
+   rng = random.Random(25)
+   n = 40
+   weights = rng.sample(range(1, 1000), 3 * n)
+   edges = []
+   g = gamera.graph.Graph(gamera.graph.UNDIRECTED)
+   for i in range(n):
+      g.add_node(i)
+   for w in weights:
+      a, b = rng.sample(range(n), 2)
+      if not g.has_edge(a, b) and not g.has_edge(b, a):
+         g.add_edge(a, b, w)
+         edges.append((w, a, b))
+   reference = reference_kruskal(n, edges)
+   for t in (g.create_minimum_spanning_tree(),
+             g.create_minimum_spanning_tree_kruskal(),
+             g.create_minimum_spanning_tree_prim()):
+      assert edge_set(t) == reference
+      assert total(t) == sum([w for w, a, b in edges
+                              if frozenset((a, b)) in reference])
+
+   # the distance matrix of cluster.make_spanning_tree, with unique distances
+   images = range(n)
+   dists = Image((0, 0), (n - 1, n - 1), FLOAT)
+   distances = rng.sample(range(1, 10000), n * (n - 1) / 2)
+   edges = []
+   for a in range(n):
+      for b in range(a + 1, n):
+         d = float(distances.pop())
+         dists.set((a, b), d)
+         dists.set((b, a), d)
+         edges.append((d, a, b))
+   reference = reference_kruskal(n, edges)
+   for method in ("create_minimum_spanning_tree",
+                  "create_minimum_spanning_tree_kruskal",
+                  "create_minimum_spanning_tree_prim"):
+      t = gamera.graph.Undirected()
+      getattr(t, method)(images, dists)
+      assert edge_set(t) == reference
+      assert total(t) == sum([d for d, a, b in edges
+                              if frozenset((a, b)) in reference])
+   # only the Kruskal form keeps the old edge direction
+   t = gamera.graph.Undirected()
+   t.create_minimum_spanning_tree_kruskal(images, dists)
+   assert [e.from_node() < e.to_node() for e in t.get_edges()] == [True] * (n - 1)
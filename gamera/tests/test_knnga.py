@@ -0,0 +1,147 @@
+import py.test
+
+from gamera.core import *
+init_gamera()
+from gamera import knn, knnga, gamera_xml
+import array
+
+featureset = ['area', 'aspect_ratio', 'black_area', 'moments', 'nholes_extended', 'skeleton_features', 'volume64regions']
+
+def _classifier(k):
+   database = gamera_xml.glyphs_from_xml("data/testline.xml")
+   classifier = knn.kNNNonInteractive(database, features=featureset,
+                                      normalize=False)
+   classifier.num_k = k
+   return classifier
+
+def _optimization(classifier, mode, generations, threads=1, seed=0,
+                  islands=1, asynchronous=False):
+   base = knnga.GABaseSetting()
+   base.opMode = mode
+   base.popSize = 8
+   base.seed = seed
+   selection = knnga.GASelection()
+   selection.setTournamentSelection(3)
+   crossover = knnga.GACrossover()
+   mutation = knnga.GAMutation()
+   if mode == knnga.GA_SELECTION:
+      crossover.setUniformCrossover(0.5)
+      mutation.setBinaryMutation(0.05, False)
+   else:
+      crossover.setSBXcrossover(classifier.num_features, 0.0, 1.0)
+      mutation.setGaussMutation(classifier.num_features, 0.0, 1.0, 0.1, 0.05)
+   replacement = knnga.GAReplacement()
+   replacement.setSSGAdetTournament(3)
+   stop = knnga.GAStopCriteria()
+   stop.setMaxGenerations(generations)
+   parallel = knnga.GAParallelization()
+   parallel.mode = threads > 1
+   parallel.thredNum = threads
+   parallel.islands = islands
+   parallel.migrationInterval = 2
+   parallel.migrationSize = 2
+   parallel.asynchronous = asynchronous
+   return knnga.GAOptimization(classifier, base, selection, crossover,
+                               mutation, replacement, stop, parallel)
+
+def _set_genes(classifier, mode, genes):
+   if mode == knnga.GA_SELECTION:
+      classifier.set_selections(array.array('i', [int(g) for g in genes]))
+   else:
+      classifier.set_weights(array.array('d', [float(g) for g in genes]))
+
+def _best_per_generation(ga):
+   # the best fitness and individual after each generation
+   fitnesses = [float(line.split('\t')[2])
+                for line in ga.monitorString.splitlines()[1:]]
+   individuals = [[gene for gene in line.strip('[]\t ').split(',') if gene.strip()]
+                  for line in ga.bestIndiString.splitlines()[1:]]
+   assert len(fitnesses) == len(individuals) > 0
+   return zip(fitnesses, individuals)
+
+def test_fitness_equals_leave_one_out():
+   # the fitness of the cached and incrementally evaluated individuals is
+   # the same as that of a fresh leave-one-out; an overestimated fitness
+   # would show up as the best of a generation
+   for mode in (knnga.GA_SELECTION, knnga.GA_WEIGHTING):
+      for k, distance_type in ((1, 0), (3, 1), (3, 2)):
+         classifier = _classifier(k)
+         classifier.distance_type = distance_type
+         ga = _optimization(classifier, mode, 20)
+         ga.startCalculation()
+         checker = _classifier(k)
+         checker.distance_type = distance_type
+         for fitness, genes in _best_per_generation(ga):
+            _set_genes(checker, mode, genes)
+            correct, total = checker.leave_one_out()
+            assert abs(fitness - correct / float(total)) < 1e-6
+         correct, total = classifier.leave_one_out()
+         assert ga.bestFitness == correct / float(total)
+
+def test_fitness_after_merge():
+   # the GA runs on the normalization of the merged database, not on the
+   # one the classifier was created with
+   database = list(gamera_xml.glyphs_from_xml("data/testline.xml"))
+   for mode in (knnga.GA_SELECTION, knnga.GA_WEIGHTING):
+      classifier = knn.kNNNonInteractive(database[:20], features=featureset,
+                                         normalize=True)
+      classifier.num_k = 3
+      classifier.merge_glyphs(database[20:])
+      ga = _optimization(classifier, mode, 5)
+      ga.startCalculation()
+      checker = knn.kNNNonInteractive(database, features=featureset,
+                                      normalize=True)
+      checker.num_k = 3
+      for fitness, genes in _best_per_generation(ga):
+         _set_genes(checker, mode, genes)
+         correct, total = checker.leave_one_out()
+         assert abs(fitness - correct / float(total)) < 1e-6
+
+def test_parallel_evaluation():
+   # with the same seed, evaluating the offspring on several threads gives
+   # the same populations as evaluating them one after another
+   for mode in (knnga.GA_SELECTION, knnga.GA_WEIGHTING):
+      results = []
+      for threads in (1, 4):
+         classifier = _classifier(3)
+         ga = _optimization(classifier, mode, 10, threads, seed=7)
+         ga.startCalculation()
+         results.append((ga.monitorString, ga.bestIndiString, ga.bestFitness))
+      assert results[0] == results[1]
+
+def _check_written_back(classifier, ga, mode):
+   # the classifier holds the first individual that reached the best fitness
+   correct, total = classifier.leave_one_out()
+   assert 0.0 < ga.bestFitness <= 1.0
+   assert ga.bestFitness == correct / float(total)
+   for fitness, genes in _best_per_generation(ga):
+      if abs(fitness - ga.bestFitness) < 1e-6:
+         break
+   if mode == knnga.GA_SELECTION:
+      assert list(classifier.get_selections()) == [int(g) for g in genes]
+   else:
+      assert list(classifier.get_weights()) == [float(g) for g in genes]
+
+def test_islands():
+   for mode in (knnga.GA_SELECTION, knnga.GA_WEIGHTING):
+      classifier = _classifier(3)
+      ga = _optimization(classifier, mode, 6, threads=2, islands=3)
+      ga.startCalculation()
+      assert ga.generation == 6
+      _check_written_back(classifier, ga, mode)
+
+def test_asynchronous():
+   for mode in (knnga.GA_SELECTION, knnga.GA_WEIGHTING):
+      classifier = _classifier(3)
+      ga = _optimization(classifier, mode, 6, threads=2, asynchronous=True)
+      ga.startCalculation()
+      assert ga.generation == 6
+      _check_written_back(classifier, ga, mode)
+
+def test_parallelization_settings():
+   parallel = knnga.GAParallelization()
+   for name in ("islands", "migrationInterval", "migrationSize"):
+      py.test.raises(ValueError, setattr, parallel, name, -1)
+   py.test.raises(RuntimeError, setattr, parallel, "islands", 0)
+   parallel.migrationSize = 0
+   assert parallel.migrationSize == 0
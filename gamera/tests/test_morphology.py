@@ -0,0 +1,38 @@
+from gamera.core import *
+init_gamera()
+
+def _make_image():
+   img = Image((0,0), (69,24), ONEBIT)
+   img.draw_filled_rect((3,3), (20,15), 1)
+   img.draw_line((0,23), (69,0), 1)
+   img.draw_filled_rect((60,5), (69,20), 1)
+   for x in range(25, 55, 3):
+      img.set((x,10), 1)
+   return img
+
+def _structure(times, geo):
+   size = 2 * times + 1
+   se = Image((0,0), (size - 1, size - 1), ONEBIT)
+   n_corner = (1 + times) / 2
+   n = size - 1
+   for y in range(size):
+      for x in range(size):
+         if not geo or not (x+y < n_corner or n-x+y < n_corner or
+                            x+n-y < n_corner or n-x+n-y < n_corner):
+            se.set((x,y), 1)
+   return se
+
+def test_erode_dilate_onebit():
+   img = _make_image()
+   sub = img.subimage((1,1), (68,22))
+   for image in (img, sub):
+      for times in (1, 2, 3):
+         for geo in (0, 1):
+            se = _structure(times, geo)
+            origin = Point(times, times)
+            assert image.erode_dilate(times, 0, geo).to_nested_list() == \
+                   image.dilate_with_structure(se, origin).to_nested_list()
+            assert image.erode_dilate(times, 1, geo).to_nested_list() == \
+                   image.erode_with_structure(se, origin).to_nested_list()
+   assert img.dilate().to_nested_list() == \
+          img.erode_dilate(1, 0, 0).to_nested_list()
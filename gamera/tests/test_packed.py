@@ -0,0 +1,49 @@
+from gamera.core import *
+from gamera import _packedtest
+init_gamera()
+
+# The bit-packed storage is C++ only; the functions of the private
+# _packedtest module run the packed overloads on packed copies and
+# return the results.
+
+def _images():
+   a = load_image("data/testline.png")
+   b = Image(a.ul, a.lr, ONEBIT)
+   b.draw_filled_rect((100,5), (400,30), 1)
+   b.draw_line((0,0), (906,43), 1)
+   images = [(a, b)]
+   # views starting and ending inside a word of the packed data
+   for ul, lr in (((3,2), (150,40)), ((64,0), (127,43)), ((70,7), (900,20))):
+      images.append((a.subimage(ul, lr), b.subimage(ul, lr)))
+   return images
+
+def test_logical_packed():
+   for a, b in _images():
+      for operation, dense in ((0, a.and_image), (1, a.or_image),
+                               (2, a.xor_image)):
+         expected = dense(b, False).to_nested_list()
+         assert _packedtest.logical(a, b, operation, False).to_nested_list() == expected
+         assert _packedtest.logical(a, b, operation, True).to_nested_list() == expected
+   a = load_image("data/testline.png")
+   try:
+      _packedtest.logical(a, a.subimage((0,0), (10,10)), 0, False)
+   except RuntimeError:
+      pass
+   else:
+      assert False
+
+def test_projections_packed():
+   for a, b in _images():
+      rle = Image(a, ONEBIT, RLE)
+      rle.or_image(a, True)
+      for image in (a, b, rle):
+         assert _packedtest.projection_rows(image) == image.projection_rows()
+         assert _packedtest.projection_cols(image) == image.projection_cols()
+
+def test_threshold_packed():
+   grey = load_image("data/GreyScale_generic.tiff")
+   for image in (grey, grey.subimage((5,3), (90,60)),
+                 grey.to_float(), grey.to_grey16()):
+      for t in (0, 100, 200):
+         assert _packedtest.threshold(image, t).to_nested_list() == \
+                image.threshold(t).to_nested_list()
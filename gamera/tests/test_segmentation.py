@@ -0,0 +1,143 @@
+import py.test
+
+from gamera.core import *
+init_gamera()
+
+def test_cc_analysis_shapes():
+   img = Image((0,0), (20,10), ONEBIT)
+   # U shape: both arms are separate until the bottom row joins them
+   img.draw_line((1,1), (1,8), 1)
+   img.draw_line((6,1), (6,8), 1)
+   img.draw_line((1,8), (6,8), 1)
+   # diagonal neighbours are 8-connected
+   img.set((10,1), 1)
+   img.set((11,2), 1)
+   img.set((10,3), 1)
+   # isolated pixel
+   img.set((15,5), 1)
+   ccs = img.cc_analysis()
+   assert len(ccs) == 3
+   rects = [(cc.ul_x, cc.ul_y, cc.ncols, cc.nrows) for cc in ccs]
+   assert rects == [(1,1,6,8), (10,1,2,3), (15,5,1,1)]
+   assert [cc.label for cc in ccs] == [2, 3, 4]
+   assert [cc.black_area()[0] for cc in ccs] == [20, 3, 1]
+
+def test_cc_analysis_relabel():
+   img = Image((0,0), (10,10), ONEBIT)
+   img.draw_filled_rect((1,1), (3,3), 1)
+   img.draw_filled_rect((6,6), (8,8), 1)
+   first = [(cc.label, cc.ul_x, cc.ul_y) for cc in img.cc_analysis()]
+   second = [(cc.label, cc.ul_x, cc.ul_y) for cc in img.cc_analysis()]
+   assert first == second
+
+def test_cc_analysis_many_provisional_labels():
+   # every dot in the first row of a block starts a new provisional
+   # label, which are only joined by the line below; this needs more
+   # provisional labels than fit into a OneBitPixel
+   ncols, nblocks = 700, 233
+   img = Image((0,0), (ncols,3*nblocks), ONEBIT)
+   for b in range(nblocks):
+      y = 3*b
+      for x in range(0, ncols, 2):
+         img.set((x,y), 1)
+      img.draw_line((0,y+1), (ncols-1,y+1), 1)
+   ccs = img.cc_analysis()
+   assert len(ccs) == nblocks
+   for b, cc in enumerate(ccs):
+      assert (cc.ul_y, cc.nrows, cc.ncols) == (3*b, 2, ncols)
+
+def test_cc_analysis_rle():
+   dense = Image((0,0), (40,30), ONEBIT)
+   dense.draw_filled_rect((2,2), (10,5), 1)
+   dense.draw_line((20,0), (39,29), 1)
+   dense.draw_line((39,0), (20,29), 1)
+   dense.set((5,20), 1)
+   rle = Image(dense, ONEBIT, RLE)
+   rle.or_image(dense, True)
+   a = [(cc.ul_x, cc.ul_y, cc.ncols, cc.nrows) for cc in dense.cc_analysis()]
+   b = [(cc.ul_x, cc.ul_y, cc.ncols, cc.nrows) for cc in rle.cc_analysis()]
+   assert a == b
+   assert len(a) == 3
+   assert rle.to_nested_list() == dense.to_nested_list()
+   # relabeling a sub image
+   sub_dense = dense.subimage((15,1), (39,28))
+   sub_rle = rle.subimage((15,1), (39,28))
+   a = [(cc.ul_x, cc.ul_y, cc.ncols, cc.nrows) for cc in sub_dense.cc_analysis()]
+   b = [(cc.ul_x, cc.ul_y, cc.ncols, cc.nrows) for cc in sub_rle.cc_analysis()]
+   assert a == b
+   assert rle.to_nested_list() == dense.to_nested_list()
+
+def test_cc_analysis_parallel():
+   def make_image():
+      img = Image((0,0), (150,400), ONEBIT)
+      # components crossing the strip seams in all directions
+      img.draw_line((0,0), (149,399), 1)
+      img.draw_line((149,0), (0,399), 1)
+      img.draw_filled_rect((10,50), (30,350), 1)
+      for y in range(0, 400, 5):
+         img.draw_line((60,y), (100,y+4), 1)
+      for x in range(110, 150, 3):
+         img.set((x,200), 1)
+      return img
+   a = make_image()
+   serial = [(cc.label, cc.ul_x, cc.ul_y, cc.ncols, cc.nrows)
+             for cc in a.cc_analysis()]
+   for num_threads in (0, 1, 3, 8):
+      b = make_image()
+      parallel = [(cc.label, cc.ul_x, cc.ul_y, cc.ncols, cc.nrows)
+                  for cc in b.cc_analysis_parallel(num_threads)]
+      assert parallel == serial
+      assert b.to_nested_list() == a.to_nested_list()
+
+def _make_statistics_image():
+   img = Image((0,0), (150,400), ONEBIT)
+   img.draw_line((0,0), (149,399), 1)
+   img.draw_filled_rect((10,50), (30,350), 1)
+   for y in range(0, 400, 5):
+      img.draw_line((60,y), (100,y+4), 1)
+   for x in range(110, 150, 3):
+      img.set((x,200), 1)
+   return img.subimage((3,2), (149,399))
+
+def _statistics(cc):
+   n = sx = sy = sxx = sxy = syy = 0.0
+   for y in range(cc.nrows):
+      for x in range(cc.ncols):
+         if cc.get((x,y)):
+            px, py = cc.ul_x + x, cc.ul_y + y
+            n += 1; sx += px; sy += py
+            sxx += px*px; sxy += px*py; syy += py*py
+   cx, cy = sx/n, sy/n
+   return (n, cx, cy, sxx/n - cx*cx, sxy/n - cx*cy, syy/n - cy*cy)
+
+def test_cc_analysis_statistics():
+   reference = None
+   for num_threads in (1, 0, 3):
+      dense = _make_statistics_image()
+      rle = Image(dense, ONEBIT, RLE)
+      rle.or_image(dense, True)
+      for img in (dense, rle):
+         ccs, statistics = img.cc_analysis_statistics(num_threads)
+         assert len(ccs) == len(statistics)
+         rects = [(cc.ul_x, cc.ul_y, cc.ncols, cc.nrows) for cc in ccs]
+         if reference is None:
+            reference = (rects, [_statistics(cc) for cc in ccs])
+         assert rects == reference[0]
+         for s, expected in zip(statistics, reference[1]):
+            assert s[0] == expected[0]
+            for a, b in zip(s[1:], expected[1:]):
+               assert abs(a - b) < 1e-6
+
+def test_cc_analysis_filter_black_area():
+   from gamera.plugins.segmentation import \
+        filter_black_area_small, filter_black_area_large
+   for min_area, max_area in ((0, 1000000), (2, 1000000), (5, 300), (30, 40)):
+      for num_threads in (1, 0):
+         a = _make_statistics_image()
+         expected = filter_black_area_large(
+            filter_black_area_small(a.cc_analysis(), min_area), max_area)
+         b = _make_statistics_image()
+         ccs = b.cc_analysis_filter_black_area(min_area, max_area, num_threads)
+         assert [(cc.label, cc.ul_x, cc.ul_y, cc.ncols, cc.nrows) for cc in ccs] == \
+                [(cc.label, cc.ul_x, cc.ul_y, cc.ncols, cc.nrows) for cc in expected]
+         assert b.to_nested_list() == a.to_nested_list()